@@ -76,6 +76,9 @@ cols = {
     "mm%":        [3, 100, "Metadata miss percentage"],
     "arcsz":      [5, 1024, "ARC Size"],
     "c":          [4, 1024, "ARC Target Size"],
+    "csize":      [5, 1024, "Compressed size of compressed ARC blocks"],
+    "usize":      [5, 1024, "Logical size of compressed ARC blocks"],
+    "chit":       [4, 1000, "Hits on compressed-only blocks per second"],
     "mfu":        [4, 1000, "MFU List hits per second"],
     "mru":        [4, 1000, "MRU List hits per second"],
     "mfug":       [4, 1000, "MFU Ghost List hits per second"],
@@ -393,6 +396,9 @@ def calculate():
 
     v["arcsz"] = cur["size"]
     v["c"] = cur["c"]
+    v["csize"] = cur.get("compressed_size", 0)
+    v["usize"] = cur.get("uncompressed_size", 0)
+    v["chit"] = d.get("compressed_hits", 0) / sint
     v["mfu"] = d["mfu_hits"] / sint
     v["mru"] = d["mru_hits"] / sint
     v["mrug"] = d["mru_ghost_hits"] / sint
@@ -0,0 +1,327 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * raidz_test checks and times the RAID-Z parity generation and
+ * reconstruction code outside of a pool.
+ *
+ * In the default verify mode every implementation supported by this CPU
+ * rebuilds every combination of up to nparity lost columns, for each
+ * parity level and a range of column counts, and the result is compared
+ * with the original data.  With -B the parity generation and the
+ * reconstruction of 1 to nparity missing data columns are timed instead,
+ * so degraded throughput can be compared with healthy throughput.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/zfs_context.h>
+#include <sys/spa.h>
+#include <sys/vdev_raidz.h>
+
+extern int vdev_raidz_default_to_general;
+
+static const char *raidz_impl_names[] = { "scalar", "sse2", "ssse3", "avx2" };
+#define	RAIDZ_TEST_IMPLS	\
+	(sizeof (raidz_impl_names) / sizeof (raidz_impl_names[0]))
+
+static const uint64_t raidz_bench_ndata[] = { 2, 4, 8, 16 };
+#define	RAIDZ_BENCH_CONFIGS	\
+	(sizeof (raidz_bench_ndata) / sizeof (raidz_bench_ndata[0]))
+
+static uint64_t opt_sectors = SPA_OLD_MAXBLOCKSIZE >> SPA_MINBLOCKSHIFT;
+static uint64_t opt_maxdata = 16;
+static hrtime_t opt_time = NANOSEC / 4;
+static boolean_t opt_bench = B_FALSE;
+static int opt_verbose = 0;
+
+static void
+usage(boolean_t requested)
+{
+	FILE *fp = requested ? stdout : stderr;
+
+	(void) fprintf(fp, "Usage: raidz_test\n"
+	    "\t[-B] benchmark instead of verify\n"
+	    "\t[-s sectors (default: %llu)] block size in 512 byte sectors\n"
+	    "\t[-d max_data_columns (default: %llu)] verify mode only\n"
+	    "\t[-t msec (default: %llu)] time per benchmark measurement\n"
+	    "\t[-v] verbose\n"
+	    "\t[-h] (print help)\n",
+	    (u_longlong_t)opt_sectors, (u_longlong_t)opt_maxdata,
+	    (u_longlong_t)(opt_time / (NANOSEC / MILLISEC)));
+	exit(requested ? 0 : 1);
+}
+
+static void
+process_options(int argc, char **argv)
+{
+	int opt;
+
+	while ((opt = getopt(argc, argv, "Bs:d:t:vh")) != EOF) {
+		switch (opt) {
+		case 'B':
+			opt_bench = B_TRUE;
+			break;
+		case 's':
+			opt_sectors = strtoull(optarg, NULL, 0);
+			break;
+		case 'd':
+			opt_maxdata = strtoull(optarg, NULL, 0);
+			break;
+		case 't':
+			opt_time = strtoull(optarg, NULL, 0) *
+			    (NANOSEC / MILLISEC);
+			break;
+		case 'v':
+			opt_verbose++;
+			break;
+		case 'h':
+			usage(B_TRUE);
+			break;
+		case '?':
+		default:
+			usage(B_FALSE);
+			break;
+		}
+	}
+
+	if (opt_sectors == 0 ||
+	    opt_sectors > (SPA_MAXBLOCKSIZE >> SPA_MINBLOCKSHIFT) ||
+	    opt_maxdata == 0 || opt_time == 0)
+		usage(B_FALSE);
+}
+
+static void **
+raidz_test_save(raidz_map_t *rm)
+{
+	void **copy;
+	int c;
+
+	copy = kmem_alloc(rm->rm_cols * sizeof (void *), KM_SLEEP);
+	for (c = 0; c < rm->rm_cols; c++) {
+		copy[c] = kmem_alloc(rm->rm_col[c].rc_size, KM_SLEEP);
+		bcopy(rm->rm_col[c].rc_data, copy[c], rm->rm_col[c].rc_size);
+	}
+	return (copy);
+}
+
+static void
+raidz_test_save_free(raidz_map_t *rm, void **copy)
+{
+	int c;
+
+	for (c = 0; c < rm->rm_cols; c++)
+		kmem_free(copy[c], rm->rm_col[c].rc_size);
+	kmem_free(copy, rm->rm_cols * sizeof (void *));
+}
+
+/*
+ * Trash the target columns, reconstruct them and check the data columns
+ * against the saved copy.  Lost parity columns are trashed as well so
+ * that any use of them shows up as a miscompare.
+ */
+static int
+raidz_test_one(raidz_map_t *rm, void **orig, int *tgts, int ntgts)
+{
+	int c, i, err = 0;
+
+	for (i = 0; i < ntgts; i++)
+		(void) memset(rm->rm_col[tgts[i]].rc_data, 0xa5,
+		    rm->rm_col[tgts[i]].rc_size);
+
+	if (tgts[ntgts - 1] >= rm->rm_firstdatacol)
+		(void) vdev_raidz_reconstruct(rm, tgts, ntgts);
+
+	for (c = rm->rm_firstdatacol; c < rm->rm_cols; c++) {
+		if (bcmp(rm->rm_col[c].rc_data, orig[c],
+		    rm->rm_col[c].rc_size) != 0)
+			err = 1;
+	}
+
+	for (c = 0; c < rm->rm_cols; c++)
+		bcopy(orig[c], rm->rm_col[c].rc_data, rm->rm_col[c].rc_size);
+
+	return (err);
+}
+
+/*
+ * Walk all sorted target sets of size ntgts over the columns of the map.
+ */
+static int
+raidz_test_map(raidz_map_t *rm, void **orig, int *tgts, int n, int ntgts)
+{
+	int first = (n == 0 ? 0 : tgts[n - 1] + 1);
+	int err = 0;
+
+	if (n == ntgts)
+		return (raidz_test_one(rm, orig, tgts, ntgts));
+
+	for (tgts[n] = first; tgts[n] < rm->rm_cols; tgts[n]++)
+		err += raidz_test_map(rm, orig, tgts, n + 1, ntgts);
+
+	return (err);
+}
+
+static int
+raidz_verify(void)
+{
+	int tgts[VDEV_RAIDZ_MAXPARITY];
+	uint64_t seed = 1;
+	uint64_t nparity, ndata;
+	raidz_map_t *rm;
+	void **orig;
+	int i, general, ntgts, err, errors = 0;
+
+	for (i = 0; i < RAIDZ_TEST_IMPLS; i++) {
+		if (vdev_raidz_impl_set(raidz_impl_names[i]) != 0)
+			continue;
+
+		for (nparity = 1; nparity <= VDEV_RAIDZ_MAXPARITY; nparity++) {
+			for (ndata = 1; ndata <= opt_maxdata; ndata++) {
+				rm = vdev_raidz_math_map_alloc(nparity + ndata,
+				    nparity, opt_sectors, &seed);
+				vdev_raidz_math_generate(rm, nparity);
+				orig = raidz_test_save(rm);
+
+				err = 0;
+				for (general = 0; general <= 1; general++) {
+					vdev_raidz_default_to_general = general;
+					for (ntgts = 1; ntgts <= nparity; ntgts++)
+						err += raidz_test_map(rm, orig,
+						    tgts, 0, ntgts);
+				}
+				vdev_raidz_default_to_general = 0;
+
+				if (err != 0 || opt_verbose) {
+					(void) printf("%-8s raidz%llu %2llu "
+					    "data columns: %s\n",
+					    raidz_impl_names[i],
+					    (u_longlong_t)nparity,
+					    (u_longlong_t)ndata,
+					    err ? "FAILED" : "ok");
+				}
+				errors += err;
+
+				raidz_test_save_free(rm, orig);
+				vdev_raidz_math_map_free(rm);
+			}
+		}
+	}
+
+	(void) printf("raidz_test: verify %s\n", errors ? "FAILED" : "passed");
+	return (errors ? 1 : 0);
+}
+
+/*
+ * Throughput in MB/s of logical data, repeating op until opt_time passes.
+ */
+static uint64_t
+raidz_bench_run(raidz_map_t *rm, int nparity, int *tgts, int ntgts)
+{
+	uint64_t iters = 0, bytes = 0;
+	hrtime_t start, elapsed;
+	int c;
+
+	for (c = rm->rm_firstdatacol; c < rm->rm_cols; c++)
+		bytes += rm->rm_col[c].rc_size;
+
+	start = gethrtime();
+	do {
+		if (ntgts == 0)
+			vdev_raidz_math_generate(rm, nparity);
+		else
+			(void) vdev_raidz_reconstruct(rm, tgts, ntgts);
+		iters++;
+	} while ((elapsed = gethrtime() - start) < opt_time);
+
+	return (bytes * iters * (NANOSEC / MICROSEC) / elapsed);
+}
+
+static int
+raidz_bench(void)
+{
+	int tgts[VDEV_RAIDZ_MAXPARITY];
+	uint64_t seed = 1;
+	uint64_t nparity, ndata;
+	raidz_map_t *rm;
+	int i, j, ntgts;
+
+	(void) printf("%llu byte blocks, MB/s of data\n",
+	    (u_longlong_t)(opt_sectors << SPA_MINBLOCKSHIFT));
+	(void) printf("%-8s %-6s %5s %8s %8s %8s %8s\n", "impl", "parity",
+	    "data", "gen", "rec1", "rec2", "rec3");
+
+	for (i = 0; i < RAIDZ_TEST_IMPLS; i++) {
+		if (vdev_raidz_impl_set(raidz_impl_names[i]) != 0)
+			continue;
+
+		for (nparity = 1; nparity <= VDEV_RAIDZ_MAXPARITY; nparity++) {
+			for (j = 0; j < RAIDZ_BENCH_CONFIGS; j++) {
+				ndata = raidz_bench_ndata[j];
+				rm = vdev_raidz_math_map_alloc(nparity + ndata,
+				    nparity, opt_sectors, &seed);
+				vdev_raidz_math_generate(rm, nparity);
+
+				(void) printf("%-8s raidz%llu %5llu %8llu",
+				    raidz_impl_names[i], (u_longlong_t)nparity,
+				    (u_longlong_t)ndata, (u_longlong_t)
+				    raidz_bench_run(rm, nparity, NULL, 0));
+
+				/* lose the leading data columns */
+				for (ntgts = 1; ntgts <= nparity; ntgts++) {
+					tgts[ntgts - 1] = nparity + ntgts - 1;
+					if (tgts[ntgts - 1] >= rm->rm_cols)
+						break;
+					(void) printf(" %8llu", (u_longlong_t)
+					    raidz_bench_run(rm, nparity, tgts,
+					    ntgts));
+				}
+				(void) printf("\n");
+
+				vdev_raidz_math_map_free(rm);
+			}
+		}
+	}
+
+	return (0);
+}
+
+int
+main(int argc, char **argv)
+{
+	int err;
+
+	(void) setvbuf(stdout, NULL, _IOLBF, 0);
+
+	process_options(argc, argv);
+
+	kernel_init(FREAD);
+
+	if (opt_bench)
+		err = raidz_bench();
+	else
+		err = raidz_verify();
+
+	kernel_fini();
+
+	return (err);
+}
@@ -0,0 +1,779 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * zbench measures the raw speed of the data path algorithms in libzpool
+ * on this machine, one implementation at a time, so that algorithms can
+ * be chosen per dataset and regressions caught.
+ *
+ * checksum	Every function in zio_checksum_table, once per implementation
+ *		for those which have several (fletcher-4, SHA-256).  SHA-256
+ *		is also timed in batches of SHA256_MB_LANES buffers, as the
+ *		write issue threads hash them, when the implementation has a
+ *		multi-buffer routine.
+ * compress	Every algorithm and level in zio_compress_table, compressing
+ *		and decompressing, with the ratio achieved.  gzip is also
+ *		timed per block with and without the per-CPU zlib workspaces
+ *		(zfs_gzip_workspace).
+ * raidz	Generation of P, PQ and PQR parity, and reconstruction of
+ *		missing data columns from every combination of surviving
+ *		parity columns, per implementation.
+ *
+ * Every measurement runs over each block size and corpus asked for and
+ * reports MB/s and CPU cycles per byte.  Cycles are counted with the time
+ * stamp counter where there is one, or derived from -m otherwise.
+ * Implementations which failed their self-test at startup or which this
+ * CPU lacks are reported as unsupported.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/zfs_context.h>
+#include <sys/spa.h>
+#include <sys/zio_checksum.h>
+#include <sys/zio_compress.h>
+#include <sys/sha256.h>
+#include <sys/vdev_raidz.h>
+#include <zfs_fletcher.h>
+
+extern int zfs_gzip_workspace;
+
+#define	ZBENCH_CHECKSUM		0x1
+#define	ZBENCH_COMPRESS		0x2
+#define	ZBENCH_RAIDZ		0x4
+#define	ZBENCH_ALL	(ZBENCH_CHECKSUM | ZBENCH_COMPRESS | ZBENCH_RAIDZ)
+
+#define	ZBENCH_MAX_BLKSZ	8
+#define	ZBENCH_MAX_CORPORA	8
+#define	ZBENCH_RAIDZ_DCOLS	8
+
+static const uint64_t zbench_default_blksz[] = { 4096, 16384, 131072 };
+#define	ZBENCH_DEFAULT_BLKSZ	\
+	(sizeof (zbench_default_blksz) / sizeof (zbench_default_blksz[0]))
+
+static const char *zbench_default_corpora[] = { "random", "text" };
+#define	ZBENCH_DEFAULT_CORPORA	\
+	(sizeof (zbench_default_corpora) / sizeof (zbench_default_corpora[0]))
+
+static const char *fletcher_4_impl_names[] =
+	{ "scalar", "sse2", "ssse3", "avx2" };
+static const char *sha256_impl_names[] = { "scalar", "shani", "avx2" };
+static const char *raidz_impl_names[] = { "scalar", "sse2", "ssse3", "avx2" };
+
+#define	ZBENCH_NAMES(a)	(sizeof (a) / sizeof (a[0]))
+
+/*
+ * Checksums with more than one implementation.
+ */
+typedef struct zbench_impls {
+	zio_checksum_t	*zi_func;
+	const char	**zi_names;
+	int		zi_count;
+	int		(*zi_set)(const char *);
+	const char	*(*zi_get)(void);
+} zbench_impls_t;
+
+static const zbench_impls_t zbench_impls[] = {
+	{ fletcher_4_native, fletcher_4_impl_names,
+	    ZBENCH_NAMES(fletcher_4_impl_names),
+	    fletcher_4_impl_set, fletcher_4_impl_get },
+	{ zio_checksum_SHA256, sha256_impl_names,
+	    ZBENCH_NAMES(sha256_impl_names),
+	    sha256_impl_set, sha256_impl_get },
+};
+
+static uint64_t opt_blksz[ZBENCH_MAX_BLKSZ];
+static int opt_nblksz = 0;
+static const char *opt_corpora[ZBENCH_MAX_CORPORA];
+static int opt_ncorpora = 0;
+static int opt_tests = 0;
+static uint64_t opt_mhz = 0;
+static hrtime_t opt_time = NANOSEC / 4;
+
+/* CPU cycles per nanosecond, or 0 if unknown */
+static double zbench_ghz = 0;
+
+typedef void zbench_func_t(void *arg, uint64_t blksz);
+
+typedef struct zbench_buf {
+	void			*zb_data[SHA256_MB_LANES];
+	uint64_t		zb_size[SHA256_MB_LANES];
+	zio_cksum_t		zb_cksum[SHA256_MB_LANES];
+	zio_cksum_salt_t	zb_salt;
+	zio_checksum_info_t	*zb_ci;
+	zio_compress_info_t	*zb_cpi;
+	void			*zb_cdata;	/* zb_data[0], compressed */
+	void			*zb_out;
+	size_t			zb_clen;
+	int			zb_level;
+	raidz_map_t		*zb_rm;
+	int			zb_tgts[VDEV_RAIDZ_MAXPARITY];
+	int			zb_ntgts;
+} zbench_buf_t;
+
+static void
+usage(boolean_t requested)
+{
+	FILE *fp = requested ? stdout : stderr;
+
+	(void) fprintf(fp, "Usage: zbench\n"
+	    "\t[-T checksum|compress|raidz] ... (default: all)\n"
+	    "\t[-b blocksize] ... (default: 4K, 16K and 128K)\n"
+	    "\t[-c random|text|zero|file] ... corpus (default: random, "
+	    "text)\n"
+	    "\t[-m MHz] CPU clock, if there is no time stamp counter\n"
+	    "\t[-t msec (default: %llu)] time per measurement\n"
+	    "\t[-h] (print help)\n",
+	    (u_longlong_t)(opt_time / (NANOSEC / MILLISEC)));
+	exit(requested ? 0 : 1);
+}
+
+static void
+process_options(int argc, char **argv)
+{
+	uint64_t blksz;
+	int opt, i;
+
+	while ((opt = getopt(argc, argv, "T:b:c:m:t:h")) != EOF) {
+		switch (opt) {
+		case 'T':
+			if (strcmp(optarg, "checksum") == 0)
+				opt_tests |= ZBENCH_CHECKSUM;
+			else if (strcmp(optarg, "compress") == 0)
+				opt_tests |= ZBENCH_COMPRESS;
+			else if (strcmp(optarg, "raidz") == 0)
+				opt_tests |= ZBENCH_RAIDZ;
+			else
+				usage(B_FALSE);
+			break;
+		case 'b':
+			blksz = strtoull(optarg, NULL, 0);
+			if (opt_nblksz == ZBENCH_MAX_BLKSZ || blksz == 0 ||
+			    blksz > SPA_MAXBLOCKSIZE ||
+			    !IS_P2ALIGNED(blksz, SPA_MINBLOCKSIZE))
+				usage(B_FALSE);
+			opt_blksz[opt_nblksz++] = blksz;
+			break;
+		case 'c':
+			if (opt_ncorpora == ZBENCH_MAX_CORPORA)
+				usage(B_FALSE);
+			opt_corpora[opt_ncorpora++] = optarg;
+			break;
+		case 'm':
+			opt_mhz = strtoull(optarg, NULL, 0);
+			break;
+		case 't':
+			opt_time = strtoull(optarg, NULL, 0) *
+			    (NANOSEC / MILLISEC);
+			break;
+		case 'h':
+			usage(B_TRUE);
+			break;
+		case '?':
+		default:
+			usage(B_FALSE);
+			break;
+		}
+	}
+
+	if (opt_time == 0)
+		usage(B_FALSE);
+
+	if (opt_tests == 0)
+		opt_tests = ZBENCH_ALL;
+
+	for (i = 0; opt_nblksz == 0 && i < ZBENCH_DEFAULT_BLKSZ; i++)
+		opt_blksz[i] = zbench_default_blksz[i];
+	if (opt_nblksz == 0)
+		opt_nblksz = ZBENCH_DEFAULT_BLKSZ;
+
+	for (i = 0; opt_ncorpora == 0 && i < ZBENCH_DEFAULT_CORPORA; i++)
+		opt_corpora[i] = zbench_default_corpora[i];
+	if (opt_ncorpora == 0)
+		opt_ncorpora = ZBENCH_DEFAULT_CORPORA;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+static uint64_t
+zbench_tsc(void)
+{
+	uint32_t lo, hi;
+
+	__asm__ __volatile__("rdtsc" : "=a" (lo), "=d" (hi));
+	return ((uint64_t)hi << 32 | lo);
+}
+#endif
+
+/*
+ * Find the number of CPU cycles per nanosecond: from -m if given,
+ * otherwise by timing the time stamp counter against gethrtime().
+ */
+static void
+zbench_clock_init(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	hrtime_t start, elapsed;
+	uint64_t tsc;
+#endif
+
+	if (opt_mhz != 0) {
+		zbench_ghz = (double)opt_mhz / 1000;
+		return;
+	}
+
+#if defined(__x86_64__) || defined(__i386__)
+	start = gethrtime();
+	tsc = zbench_tsc();
+	while ((elapsed = gethrtime() - start) < NANOSEC / 10)
+		;
+	zbench_ghz = (double)(zbench_tsc() - tsc) / elapsed;
+#endif
+}
+
+/*
+ * Call func until opt_time has passed and return the time taken per byte
+ * in nanoseconds, where each call processes bytes bytes.
+ */
+static double
+zbench_run(zbench_func_t *func, void *arg, uint64_t blksz, uint64_t bytes)
+{
+	uint64_t iters = 0;
+	hrtime_t start, elapsed;
+
+	start = gethrtime();
+	do {
+		func(arg, blksz);
+		iters++;
+	} while ((elapsed = gethrtime() - start) < opt_time);
+
+	return ((double)elapsed / (bytes * iters));
+}
+
+/*
+ * Print a time per byte as MB/s and cycles per byte.
+ */
+static void
+zbench_print_rate(double nspb)
+{
+	(void) printf(" %8.0f", 1000 / nspb);
+	if (zbench_ghz != 0)
+		(void) printf(" %7.2f", nspb * zbench_ghz);
+	else
+		(void) printf(" %7s", "-");
+}
+
+static void
+zbench_print_header(const char *what, const char *impl, const char *extra)
+{
+	(void) printf("\n%-12s %-8s %-8s %7s %s\n", what, impl, "corpus",
+	    "blksz", extra);
+}
+
+static void
+zbench_print_row(const char *name, const char *impl, const char *corpus,
+    uint64_t blksz)
+{
+	(void) printf("%-12s %-8s %-8.8s %7llu", name, impl, corpus,
+	    (u_longlong_t)blksz);
+}
+
+static void
+zbench_print_unsupported(const char *name, const char *impl, int err)
+{
+	(void) printf("%-12s %-8s %s\n", name, impl, err == ENOTSUP ?
+	    "unsupported or failed self-test" : "not built");
+}
+
+static void
+zbench_fill_random(void *buf, uint64_t size)
+{
+	uint64_t *p = buf;
+	uint64_t x = 0x5a5a5a5a5a5a5a5aULL;
+	uint64_t i;
+
+	for (i = 0; i < size / sizeof (uint64_t); i++) {
+		x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+		p[i] = x;
+	}
+}
+
+/*
+ * Fill buf with lines of words drawn from a small vocabulary, which
+ * compresses about as well as source code or logs.
+ */
+static void
+zbench_fill_text(void *buf, uint64_t size)
+{
+	static const char *words[] = { "the", "block", "pointer", "of",
+	    "zio", "to", "and", "checksum", "is", "a", "dnode", "in",
+	    "txg", "for", "spa", "vdev", "with", "data", "=", "{", "}",
+	    "if", "return", "(", ")", ";", "\n", "\t" };
+	char *p = buf;
+	uint64_t x = 0x5a5a5a5a5a5a5a5aULL;
+	uint64_t i = 0;
+	const char *w;
+
+	while (i < size) {
+		x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+		w = words[(x >> 33) % (sizeof (words) / sizeof (words[0]))];
+		while (*w != '\0' && i < size)
+			p[i++] = *w++;
+		if (i < size)
+			p[i++] = ' ';
+	}
+}
+
+/*
+ * Fill buf from the start of a file, repeating it if it is short.
+ */
+static int
+zbench_fill_file(void *buf, uint64_t size, const char *path)
+{
+	char *p = buf;
+	uint64_t off = 0, len;
+	ssize_t n;
+	int fd;
+
+	if ((fd = open(path, O_RDONLY)) < 0) {
+		(void) fprintf(stderr, "zbench: cannot open %s: %s\n", path,
+		    strerror(errno));
+		return (-1);
+	}
+
+	while (off < size) {
+		n = pread(fd, p + off, size - off, off);
+		if (n <= 0)
+			break;
+		off += n;
+	}
+	(void) close(fd);
+
+	if (off == 0) {
+		(void) fprintf(stderr, "zbench: %s is empty\n", path);
+		return (-1);
+	}
+
+	for (len = off; off < size; off++)
+		p[off] = p[off - len];
+
+	return (0);
+}
+
+/*
+ * Load a corpus into every lane of zb.
+ */
+static int
+zbench_load(zbench_buf_t *zb, const char *corpus)
+{
+	int i;
+
+	if (strcmp(corpus, "random") == 0)
+		zbench_fill_random(zb->zb_data[0], SPA_MAXBLOCKSIZE);
+	else if (strcmp(corpus, "text") == 0)
+		zbench_fill_text(zb->zb_data[0], SPA_MAXBLOCKSIZE);
+	else if (strcmp(corpus, "zero") == 0)
+		bzero(zb->zb_data[0], SPA_MAXBLOCKSIZE);
+	else if (zbench_fill_file(zb->zb_data[0], SPA_MAXBLOCKSIZE,
+	    corpus) != 0)
+		return (-1);
+
+	for (i = 1; i < SHA256_MB_LANES; i++)
+		bcopy(zb->zb_data[0], zb->zb_data[i], SPA_MAXBLOCKSIZE);
+
+	return (0);
+}
+
+static void
+zbench_checksum_single(void *arg, uint64_t blksz)
+{
+	zbench_buf_t *zb = arg;
+
+	if (zb->zb_ci->ci_func[0] != NULL)
+		zb->zb_ci->ci_func[0](zb->zb_data[0], blksz, &zb->zb_cksum[0]);
+	else
+		zb->zb_ci->ci_salted_func[0](zb->zb_data[0], blksz,
+		    &zb->zb_salt, &zb->zb_cksum[0]);
+}
+
+static void
+zbench_sha256_multi(void *arg, uint64_t blksz)
+{
+	zbench_buf_t *zb = arg;
+	int i;
+
+	for (i = 0; i < SHA256_MB_LANES; i++)
+		zb->zb_size[i] = blksz;
+
+	zio_checksum_SHA256_multi((const void **)zb->zb_data, zb->zb_size,
+	    zb->zb_cksum, SHA256_MB_LANES);
+}
+
+static void
+zbench_checksum_one(zbench_buf_t *zb, const char *impl, const char *corpus)
+{
+	int j;
+
+	for (j = 0; j < opt_nblksz; j++) {
+		zbench_print_row(zb->zb_ci->ci_name, impl, corpus,
+		    opt_blksz[j]);
+		zbench_print_rate(zbench_run(zbench_checksum_single, zb,
+		    opt_blksz[j], opt_blksz[j]));
+		(void) printf("\n");
+	}
+
+	if (zb->zb_ci->ci_func[0] != zio_checksum_SHA256 ||
+	    !sha256_impl_multi())
+		return;
+
+	for (j = 0; j < opt_nblksz; j++) {
+		zbench_print_row("sha256-mb", impl, corpus, opt_blksz[j]);
+		zbench_print_rate(zbench_run(zbench_sha256_multi, zb,
+		    opt_blksz[j], opt_blksz[j] * SHA256_MB_LANES));
+		(void) printf("\n");
+	}
+}
+
+/*
+ * Time every checksum function.  The embedded checksums (label, zilog,
+ * ...) are skipped, as they reuse the functions of the others.
+ */
+static void
+zbench_checksum(zbench_buf_t *zb, const char *corpus)
+{
+	zio_checksum_info_t *ci;
+	const zbench_impls_t *zi;
+	const char *impl;
+	int c, i, err;
+
+	zbench_print_header("checksum", "impl", "    MB/s     c/B");
+
+	for (c = 0; c < ZIO_CHECKSUM_FUNCTIONS; c++) {
+		ci = &zio_checksum_table[c];
+		if (ci->ci_func[0] == NULL && ci->ci_salted_func[0] == NULL)
+			continue;
+		if (ci->ci_eck || ci->ci_func[0] ==
+		    zio_checksum_table[ZIO_CHECKSUM_OFF].ci_func[0])
+			continue;
+
+		zb->zb_ci = ci;
+
+		for (zi = zbench_impls; zi < zbench_impls +
+		    ZBENCH_NAMES(zbench_impls); zi++) {
+			if (zi->zi_func == ci->ci_func[0])
+				break;
+		}
+		if (zi == zbench_impls + ZBENCH_NAMES(zbench_impls)) {
+			zbench_checksum_one(zb, "-", corpus);
+			continue;
+		}
+
+		impl = zi->zi_get();
+		for (i = 0; i < zi->zi_count; i++) {
+			err = zi->zi_set(zi->zi_names[i]);
+			if (err != 0) {
+				zbench_print_unsupported(ci->ci_name,
+				    zi->zi_names[i], err);
+				continue;
+			}
+			zbench_checksum_one(zb, zi->zi_names[i], corpus);
+		}
+		VERIFY0(zi->zi_set(impl));
+	}
+}
+
+static void
+zbench_compress_one(void *arg, uint64_t blksz)
+{
+	zbench_buf_t *zb = arg;
+
+	zb->zb_clen = zb->zb_cpi->ci_compress(zb->zb_data[0], zb->zb_cdata,
+	    blksz, blksz, zb->zb_cpi->ci_level);
+}
+
+static void
+zbench_decompress_one(void *arg, uint64_t blksz)
+{
+	zbench_buf_t *zb = arg;
+
+	VERIFY0(zb->zb_cpi->ci_decompress(zb->zb_cdata, zb->zb_out,
+	    zb->zb_clen, blksz, zb->zb_cpi->ci_level));
+}
+
+/*
+ * Microseconds per block of func, which processes blksz bytes per call.
+ */
+static double
+zbench_usec(zbench_func_t *func, void *arg, uint64_t blksz)
+{
+	return (zbench_run(func, arg, blksz, blksz) * blksz / 1000);
+}
+
+/*
+ * Time every compression algorithm and level.  Data which an algorithm
+ * cannot shrink is only timed compressing, as the pool would store it
+ * uncompressed.
+ */
+static void
+zbench_compress(zbench_buf_t *zb, const char *corpus)
+{
+	zio_compress_info_t *cpi;
+	double nspb;
+	int c, j;
+
+	zbench_print_header("compress", "", "    MB/s     c/B  decomp MB/s"
+	    "     c/B   ratio");
+
+	for (c = 0; c < ZIO_COMPRESS_FUNCTIONS; c++) {
+		cpi = &zio_compress_table[c];
+		if (cpi->ci_compress == NULL)
+			continue;
+		zb->zb_cpi = cpi;
+
+		for (j = 0; j < opt_nblksz; j++) {
+			zbench_print_row(cpi->ci_name, "", corpus,
+			    opt_blksz[j]);
+			zbench_print_rate(zbench_run(zbench_compress_one, zb,
+			    opt_blksz[j], opt_blksz[j]));
+
+			if (zb->zb_clen >= opt_blksz[j]) {
+				(void) printf(" %20s %7s\n", "incompressible",
+				    "1.00");
+				continue;
+			}
+
+			nspb = zbench_run(zbench_decompress_one, zb,
+			    opt_blksz[j], opt_blksz[j]);
+			VERIFY0(bcmp(zb->zb_data[0], zb->zb_out,
+			    opt_blksz[j]));
+			(void) printf("    ");
+			zbench_print_rate(nspb);
+			(void) printf(" %7.2f\n",
+			    (double)opt_blksz[j] / zb->zb_clen);
+		}
+	}
+}
+
+/*
+ * Time gzip per block with zlib allocating its state for every block, as
+ * compress2() does, and with the per-CPU zlib workspaces.
+ */
+static void
+zbench_gzip_workspace(zbench_buf_t *zb, const char *corpus)
+{
+	int workspace = zfs_gzip_workspace;
+	double usec[2][2];
+	int c, j, ws;
+
+	zbench_print_header("gzip usec", "", "  comp alloc   comp ws "
+	    "decomp alloc decomp ws");
+
+	for (c = ZIO_COMPRESS_GZIP_1; c <= ZIO_COMPRESS_GZIP_9; c += 4) {
+		zb->zb_cpi = &zio_compress_table[c];
+
+		for (j = 0; j < opt_nblksz; j++) {
+			zbench_print_row(zb->zb_cpi->ci_name, "", corpus,
+			    opt_blksz[j]);
+
+			for (ws = 0; ws <= 1; ws++) {
+				zfs_gzip_workspace = ws;
+				usec[0][ws] = zbench_usec(zbench_compress_one,
+				    zb, opt_blksz[j]);
+				if (zb->zb_clen >= opt_blksz[j])
+					break;
+				usec[1][ws] = zbench_usec(
+				    zbench_decompress_one, zb, opt_blksz[j]);
+			}
+
+			if (ws <= 1) {
+				(void) printf(" %s\n", "incompressible");
+				continue;
+			}
+
+			(void) printf(" %11.1f %9.1f %12.1f %9.1f\n",
+			    usec[0][0], usec[0][1], usec[1][0], usec[1][1]);
+		}
+	}
+
+	zfs_gzip_workspace = workspace;
+}
+
+/*ARGSUSED*/
+static void
+zbench_raidz_gen(void *arg, uint64_t blksz)
+{
+	zbench_buf_t *zb = arg;
+
+	vdev_raidz_math_generate(zb->zb_rm, zb->zb_rm->rm_firstdatacol);
+}
+
+/*ARGSUSED*/
+static void
+zbench_raidz_rec(void *arg, uint64_t blksz)
+{
+	zbench_buf_t *zb = arg;
+
+	(void) vdev_raidz_reconstruct(zb->zb_rm, zb->zb_tgts, zb->zb_ntgts);
+}
+
+/*
+ * For each non-empty set of surviving parity columns, lose as many
+ * leading data columns, plus the other parity columns, and time their
+ * reconstruction from the survivors.  Throughput is in logical data.
+ */
+static void
+zbench_raidz_map(zbench_buf_t *zb, const char *impl, uint64_t nparity,
+    uint64_t blksz)
+{
+	raidz_map_t *rm = zb->zb_rm;
+	char path[8];
+	int set, c, n, ndata;
+
+	zbench_print_row("gen", impl, "random", blksz);
+	(void) printf(" %-6.*s", (int)nparity, "PQR");
+	zbench_print_rate(zbench_run(zbench_raidz_gen, zb, blksz, blksz));
+	(void) printf("\n");
+
+	for (set = 1; set < (1 << nparity); set++) {
+		n = 0;
+		ndata = 0;
+		for (c = 0; c < nparity; c++) {
+			if (set & (1 << c)) {
+				path[ndata++] = "PQR"[c];
+			} else {
+				zb->zb_tgts[n++] = c;
+			}
+		}
+		path[ndata] = '\0';
+
+		if (nparity + ndata > rm->rm_cols)
+			continue;
+		for (c = 0; c < ndata; c++)
+			zb->zb_tgts[n++] = nparity + c;
+		zb->zb_ntgts = n;
+
+		zbench_print_row("rec", impl, "random", blksz);
+		(void) printf(" %-6s", path);
+		zbench_print_rate(zbench_run(zbench_raidz_rec, zb, blksz,
+		    blksz));
+		(void) printf("\n");
+	}
+}
+
+static void
+zbench_raidz(zbench_buf_t *zb)
+{
+	const char *impl = vdev_raidz_impl_get();
+	uint64_t seed = 1;
+	uint64_t nparity;
+	int i, j, err;
+
+	(void) printf("\n%-12s %-8s %-8s %7s %-6s %8s %7s\n",
+	    "raidz", "impl", "corpus", "blksz", "parity", "MB/s", "c/B");
+
+	for (i = 0; i < ZBENCH_NAMES(raidz_impl_names); i++) {
+		err = vdev_raidz_impl_set(raidz_impl_names[i]);
+		if (err != 0) {
+			zbench_print_unsupported("", raidz_impl_names[i], err);
+			continue;
+		}
+
+		for (nparity = 1; nparity <= VDEV_RAIDZ_MAXPARITY; nparity++) {
+			for (j = 0; j < opt_nblksz; j++) {
+				zb->zb_rm = vdev_raidz_math_map_alloc(
+				    nparity + ZBENCH_RAIDZ_DCOLS, nparity,
+				    opt_blksz[j] >> SPA_MINBLOCKSHIFT, &seed);
+				vdev_raidz_math_generate(zb->zb_rm, nparity);
+
+				zbench_raidz_map(zb, raidz_impl_names[i],
+				    nparity, opt_blksz[j]);
+
+				vdev_raidz_math_map_free(zb->zb_rm);
+			}
+		}
+	}
+
+	VERIFY0(vdev_raidz_impl_set(impl));
+}
+
+int
+main(int argc, char **argv)
+{
+	zbench_buf_t zb;
+	const char *corpus;
+	int i, err = 0;
+
+	(void) setvbuf(stdout, NULL, _IOLBF, 0);
+
+	process_options(argc, argv);
+
+	kernel_init(FREAD);
+	zbench_clock_init();
+
+	bzero(&zb, sizeof (zb));
+	for (i = 0; i < SHA256_MB_LANES; i++)
+		zb.zb_data[i] = umem_alloc(SPA_MAXBLOCKSIZE, UMEM_NOFAIL);
+	zb.zb_cdata = umem_alloc(SPA_MAXBLOCKSIZE, UMEM_NOFAIL);
+	zb.zb_out = umem_alloc(SPA_MAXBLOCKSIZE, UMEM_NOFAIL);
+	zbench_fill_random(&zb.zb_salt, sizeof (zb.zb_salt));
+
+	(void) printf("%llu msec per measurement", (u_longlong_t)
+	    (opt_time / (NANOSEC / MILLISEC)));
+	if (zbench_ghz != 0)
+		(void) printf(", %.0f MHz clock", zbench_ghz * 1000);
+	(void) printf("\n");
+
+	for (i = 0; i < opt_ncorpora; i++) {
+		if (!(opt_tests & (ZBENCH_CHECKSUM | ZBENCH_COMPRESS)))
+			break;
+
+		if (zbench_load(&zb, opt_corpora[i]) != 0) {
+			err = 1;
+			continue;
+		}
+
+		/* files are labelled by their last path component */
+		if ((corpus = strrchr(opt_corpora[i], '/')) != NULL)
+			corpus++;
+		else
+			corpus = opt_corpora[i];
+
+		if (opt_tests & ZBENCH_CHECKSUM)
+			zbench_checksum(&zb, corpus);
+		if (opt_tests & ZBENCH_COMPRESS) {
+			zbench_compress(&zb, corpus);
+			zbench_gzip_workspace(&zb, corpus);
+		}
+	}
+
+	if (opt_tests & ZBENCH_RAIDZ)
+		zbench_raidz(&zb);
+
+	for (i = 0; i < SHA256_MB_LANES; i++)
+		umem_free(zb.zb_data[i], SPA_MAXBLOCKSIZE);
+	umem_free(zb.zb_cdata, SPA_MAXBLOCKSIZE);
+	umem_free(zb.zb_out, SPA_MAXBLOCKSIZE);
+
+	kernel_fini();
+
+	return (err);
+}
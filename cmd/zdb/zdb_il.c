@@ -120,7 +120,8 @@ zil_prt_rec_write(zilog_t *zilog, int txtype, lr_write_t *lr)
 	char *data, *dlimit;
 	blkptr_t *bp = &lr->lr_blkptr;
 	zbookmark_t zb;
-	char buf[SPA_MAXBLOCKSIZE];
+	char *buf = NULL;
+	uint64_t lsize = 0;
 	int verbose = MAX(dump_opt['d'], dump_opt['i']);
 	int error;
 
@@ -142,7 +143,6 @@ zil_prt_rec_write(zilog_t *zilog, int txtype, lr_write_t *lr)
 			    (u_longlong_t)BP_GET_LSIZE(bp));
 		}
 		if (bp->blk_birth == 0) {
-			bzero(buf, sizeof (buf));
 			(void) printf("%s<hole>\n", prefix);
 			return;
 		}
@@ -155,11 +155,16 @@ zil_prt_rec_write(zilog_t *zilog, int txtype, lr_write_t *lr)
 		    lr->lr_foid, ZB_ZIL_LEVEL,
 		    lr->lr_offset / BP_GET_LSIZE(bp));
 
+		/* The block may be as large as the dataset's recordsize */
+		lsize = BP_GET_LSIZE(bp);
+		buf = umem_alloc(lsize, UMEM_NOFAIL);
 		error = zio_wait(zio_read(NULL, zilog->zl_spa,
-		    bp, buf, BP_GET_LSIZE(bp), NULL, NULL,
+		    bp, buf, lsize, NULL, NULL,
 		    ZIO_PRIORITY_SYNC_READ, ZIO_FLAG_CANFAIL, &zb));
-		if (error)
+		if (error) {
+			umem_free(buf, lsize);
 			return;
+		}
 		data = buf;
 	} else {
 		data = (char *)(lr + 1);
@@ -177,6 +182,9 @@ zil_prt_rec_write(zilog_t *zilog, int txtype, lr_write_t *lr)
 		data++;
 	}
 	(void) printf("\n");
+
+	if (buf != NULL)
+		umem_free(buf, lsize);
 }
 
 /* ARGSUSED */
@@ -304,6 +304,7 @@ zhack_do_feature_enable(int argc, char **argv)
 	feature.fi_uname = "zhack";
 	feature.fi_mos = B_FALSE;
 	feature.fi_can_readonly = B_FALSE;
+	feature.fi_activate_on_enable = B_FALSE;
 	feature.fi_depends = nodeps;
 
 	optind = 1;
@@ -395,6 +396,7 @@ zhack_do_feature_ref(int argc, char **argv)
 	 */
 	feature.fi_uname = "zhack";
 	feature.fi_mos = B_FALSE;
+	feature.fi_activate_on_enable = B_FALSE;
 	feature.fi_desc = NULL;
 	feature.fi_depends = nodeps;
 
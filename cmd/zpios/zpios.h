@@ -93,6 +93,7 @@ typedef struct cmd_args {
 	uint64_t regionnoise;		/* Region noise */
 	uint64_t chunknoise;		/* Chunk noise */
 	uint64_t thread_delay;		/* Thread delay */
+	uint64_t queue_depth;		/* Reads in flight per thread */
 
 	char pre[ZPIOS_PATH_SIZE];	/* Pre-exec hook */
 	char post[ZPIOS_PATH_SIZE];	/* Post-exec hook */
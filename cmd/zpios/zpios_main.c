@@ -44,7 +44,7 @@
 
 static const char short_opt[] =
 	"t:l:h:e:n:i:j:k:o:m:q:r:c:a:b:g:s:A:B:C:"
-	"L:p:M:xP:R:G:I:N:T:VzOfHv?";
+	"L:p:M:xP:R:G:I:N:T:Q:VzOfHv?";
 static const struct option long_opt[] = {
 	{"threadcount",		required_argument,	0,	't' },
 	{"threadcount_low",	required_argument,	0,	'l' },
@@ -76,6 +76,7 @@ static const struct option long_opt[] = {
 	{"regionnoise",		required_argument,	0,	'I' },
 	{"chunknoise",		required_argument,	0,	'N' },
 	{"threaddelay",		required_argument,	0,	'T' },
+	{"queuedepth",		required_argument,	0,	'Q' },
 	{"verify",		no_argument,		0,	'V' },
 	{"zerocopy",		no_argument,		0,	'z' },
 	{"nowait",		no_argument,		0,	'O' },
@@ -126,6 +127,7 @@ usage(void)
 		"	--regionnoise       -I    =shift\n"
 		"	--chunknoise        -N    =bytes\n"
 		"	--threaddelay       -T    =jiffies\n"
+		"	--queuedepth        -Q    =reads\n"
 		"	--verify            -V\n"
 		"	--zerocopy          -z\n"
 		"	--nowait            -O\n"
@@ -282,6 +284,10 @@ args_init(int argc, char **argv)
 			rc = set_noise(&args->thread_delay, optarg,
 			    "threaddelay");
 			break;
+		case 'Q': /* --queuedepth */
+			rc = set_noise(&args->queue_depth, optarg,
+			    "queuedepth");
+			break;
 		case 'V': /* --verify */
 			args->flags |= DMU_VERIFY;
 			break;
@@ -509,6 +515,7 @@ run_one(cmd_args_t *args, uint32_t id, uint32_t T, uint32_t N,
 	cmd->cmd_region_noise = args->regionnoise;
 	cmd->cmd_chunk_noise = args->chunknoise;
 	cmd->cmd_thread_delay = args->thread_delay;
+	cmd->cmd_queue_depth = args->queue_depth;
 	cmd->cmd_flags = args->flags;
 	cmd->cmd_data_size = (T + N + 1) * sizeof (zpios_stats_t);
 
@@ -0,0 +1,1003 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * zpoolbench measures the speed of whole pool operations in libzpool,
+ * against a pool it creates on a file in the directory given by -f, so
+ * that changes to the DMU and DSL can be compared on the same machine.
+ * The pool is created afresh for each measurement.
+ *
+ * sync		Dirty -o objects in each of -d datasets, with a -b sized
+ *		write to each, and time txg_wait_synced() for -n txgs.
+ *		This is repeated for each -p value of
+ *		zfs_sync_taskq_batch_pct, which sizes the taskqs that sync
+ *		the datasets, and the dnodes of each dataset, in parallel.
+ * create	Create -c objects from each of -j threads, all in the same
+ *		dataset, one object per tx as file creation does, and time
+ *		it.  This is repeated for each -j value.
+ * recordsize	Write -w megabytes sequentially to a single object whose
+ *		block size is set to each -r value in turn, and time the
+ *		writes through the final txg sync.  The pool has the
+ *		large_blocks feature enabled so that sizes above 128k can
+ *		be compared.
+ * prefetch	Write -w megabytes to a single object of 128k blocks, then
+ *		read it back as each -S number of concurrent sequential
+ *		streams, each reading its own part of the object in -l sized
+ *		reads from its own thread.  Each is timed with prefetch
+ *		disabled and enabled, and the pool is exported and imported
+ *		before each so that the reads start with nothing cached.
+ * fsync	From each of -j threads, write -b bytes to an object of the
+ *		thread's own, log the write to the intent log with its data
+ *		as a small file write does, and zil_commit() it, -i times.
+ *		This is repeated for each -j value.  Records are capped at
+ *		the largest size that still carries its data.
+ *
+ * sync reports the mean time to sync a txg and the rate at which data was
+ * written out, create the rate at which objects were created, recordsize
+ * the rate at which data was written along with the number of data blocks
+ * and indirect blocks it took to describe it, prefetch the rate at which
+ * data was read, and fsync the rate of commits across all threads along
+ * with the median and 99th percentile time a zil_commit() took.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/zfs_context.h>
+#include <sys/spa.h>
+#include <sys/spa_impl.h>
+#include <sys/dmu.h>
+#include <sys/dmu_objset.h>
+#include <sys/dsl_pool.h>
+#include <sys/txg.h>
+#include <sys/zil.h>
+#include <sys/zil_impl.h>
+#include <sys/fs/zfs.h>
+#include <sys/zfeature.h>
+
+#define	ZPOOLBENCH_SYNC		0x1
+#define	ZPOOLBENCH_CREATE	0x2
+#define	ZPOOLBENCH_RECORDSIZE	0x4
+#define	ZPOOLBENCH_PREFETCH	0x8
+#define	ZPOOLBENCH_FSYNC	0x10
+#define	ZPOOLBENCH_ALL		(ZPOOLBENCH_SYNC | ZPOOLBENCH_CREATE | \
+	ZPOOLBENCH_RECORDSIZE | ZPOOLBENCH_PREFETCH | ZPOOLBENCH_FSYNC)
+
+#define	ZPOOLBENCH_POOL		"zpoolbench"
+#define	ZPOOLBENCH_MAX_PCT	8
+#define	ZPOOLBENCH_MAX_THREADS	8
+#define	ZPOOLBENCH_MAX_RECSIZES	8
+#define	ZPOOLBENCH_MAX_STREAMS	8
+
+static const int zpoolbench_default_pct[] = { 1, 25, 75, 100 };
+#define	ZPOOLBENCH_DEFAULT_PCT	\
+	(sizeof (zpoolbench_default_pct) / sizeof (zpoolbench_default_pct[0]))
+
+static const int zpoolbench_default_threads[] = { 1, 4, 16 };
+#define	ZPOOLBENCH_DEFAULT_THREADS	(sizeof (zpoolbench_default_threads) / \
+	sizeof (zpoolbench_default_threads[0]))
+
+static const uint64_t zpoolbench_default_recsizes[] = { 1 << 17, 1 << 20 };
+#define	ZPOOLBENCH_DEFAULT_RECSIZES	\
+	(sizeof (zpoolbench_default_recsizes) / \
+	sizeof (zpoolbench_default_recsizes[0]))
+
+static const int zpoolbench_default_streams[] = { 1, 4, 16 };
+#define	ZPOOLBENCH_DEFAULT_STREAMS	(sizeof (zpoolbench_default_streams) / \
+	sizeof (zpoolbench_default_streams[0]))
+
+extern int dmu_object_alloc_chunk_shift;
+
+static int opt_tests = 0;
+static const char *opt_dir = "/tmp";
+static uint64_t opt_size = 1ULL << 30;
+static int opt_datasets = 16;
+static int opt_objects = 64;
+static uint64_t opt_blksz = 16384;
+static int opt_txgs = 10;
+static int opt_pct[ZPOOLBENCH_MAX_PCT];
+static int opt_npct = 0;
+static int opt_creates = 10000;
+static int opt_threads[ZPOOLBENCH_MAX_THREADS];
+static int opt_nthreads = 0;
+static uint64_t opt_recsizes[ZPOOLBENCH_MAX_RECSIZES];
+static int opt_nrecsizes = 0;
+static uint64_t opt_write = 256ULL << 20;
+static int opt_streams[ZPOOLBENCH_MAX_STREAMS];
+static int opt_nstreams = 0;
+static uint64_t opt_readsz = 131072;
+static int opt_fsyncs = 1000;
+
+static char zpoolbench_vdev[MAXPATHLEN];
+
+/*
+ * A dataset of the pool under test, with the objects written to it.
+ */
+typedef struct zpoolbench_ds {
+	objset_t	*zd_os;
+	uint64_t	*zd_objs;
+} zpoolbench_ds_t;
+
+/*
+ * One of the concurrent streams of the prefetch test, reading zr_length
+ * bytes of the object from zr_offset.
+ */
+typedef struct zpoolbench_reader {
+	objset_t	*zr_os;
+	uint64_t	zr_object;
+	uint64_t	zr_offset;
+	uint64_t	zr_length;
+} zpoolbench_reader_t;
+
+/*
+ * One of the threads of the fsync test, writing to and committing its own
+ * object, with the time each of its zil_commit()s took in zf_lat.
+ */
+typedef struct zpoolbench_fsyncer {
+	objset_t	*zf_os;
+	zilog_t		*zf_zilog;
+	uint64_t	zf_object;
+	hrtime_t	*zf_lat;
+} zpoolbench_fsyncer_t;
+
+static void
+usage(boolean_t requested)
+{
+	FILE *fp = requested ? stdout : stderr;
+
+	(void) fprintf(fp, "Usage: zpoolbench\n"
+	    "\t[-T sync|create|recordsize|prefetch|fsync] ... "
+	    "(default: all)\n"
+	    "\t[-f dir (default: %s)] directory of the pool's file vdev\n"
+	    "\t[-s size (default: %lluM)] size of the file vdev\n"
+	    "\t[-d datasets (default: %d)]\n"
+	    "\t[-o objects (default: %d)] objects dirtied per dataset\n"
+	    "\t[-b blocksize (default: %llu)] bytes written per object, "
+	    "or per fsync\n"
+	    "\t[-n txgs (default: %d)] txgs synced per measurement\n"
+	    "\t[-p pct] ... zfs_sync_taskq_batch_pct (default: 1, 25, 75, "
+	    "100)\n"
+	    "\t[-c creates (default: %d)] objects created per thread\n"
+	    "\t[-j threads] ... creating or fsyncing threads "
+	    "(default: 1, 4, 16)\n"
+	    "\t[-r recordsize] ... object block size (default: 131072, "
+	    "1048576)\n"
+	    "\t[-w size (default: %lluM)] data written per recordsize, "
+	    "and read by prefetch\n"
+	    "\t[-S streams] ... concurrent readers (default: 1, 4, 16)\n"
+	    "\t[-l readsize (default: %llu)] bytes per read\n"
+	    "\t[-i fsyncs (default: %d)] fsyncs per thread\n"
+	    "\t[-h] (print help)\n",
+	    opt_dir, (u_longlong_t)(opt_size >> 20), opt_datasets,
+	    opt_objects, (u_longlong_t)opt_blksz, opt_txgs, opt_creates,
+	    (u_longlong_t)(opt_write >> 20), (u_longlong_t)opt_readsz,
+	    opt_fsyncs);
+	exit(requested ? 0 : 1);
+}
+
+static void
+process_options(int argc, char **argv)
+{
+	int opt, i;
+
+	while ((opt = getopt(argc, argv, "T:f:s:d:o:b:n:p:c:j:r:w:S:l:i:h"))
+	    != EOF) {
+		switch (opt) {
+		case 'T':
+			if (strcmp(optarg, "sync") == 0)
+				opt_tests |= ZPOOLBENCH_SYNC;
+			else if (strcmp(optarg, "create") == 0)
+				opt_tests |= ZPOOLBENCH_CREATE;
+			else if (strcmp(optarg, "recordsize") == 0)
+				opt_tests |= ZPOOLBENCH_RECORDSIZE;
+			else if (strcmp(optarg, "prefetch") == 0)
+				opt_tests |= ZPOOLBENCH_PREFETCH;
+			else if (strcmp(optarg, "fsync") == 0)
+				opt_tests |= ZPOOLBENCH_FSYNC;
+			else
+				usage(B_FALSE);
+			break;
+		case 'f':
+			opt_dir = optarg;
+			break;
+		case 's':
+			opt_size = strtoull(optarg, NULL, 0) << 20;
+			break;
+		case 'd':
+			opt_datasets = atoi(optarg);
+			break;
+		case 'o':
+			opt_objects = atoi(optarg);
+			break;
+		case 'b':
+			opt_blksz = strtoull(optarg, NULL, 0);
+			if (opt_blksz == 0 || opt_blksz > SPA_MAXBLOCKSIZE ||
+			    !IS_P2ALIGNED(opt_blksz, SPA_MINBLOCKSIZE))
+				usage(B_FALSE);
+			break;
+		case 'n':
+			opt_txgs = atoi(optarg);
+			break;
+		case 'p':
+			if (opt_npct == ZPOOLBENCH_MAX_PCT)
+				usage(B_FALSE);
+			opt_pct[opt_npct] = atoi(optarg);
+			if (opt_pct[opt_npct] <= 0 || opt_pct[opt_npct] > 100)
+				usage(B_FALSE);
+			opt_npct++;
+			break;
+		case 'c':
+			opt_creates = atoi(optarg);
+			break;
+		case 'j':
+			if (opt_nthreads == ZPOOLBENCH_MAX_THREADS)
+				usage(B_FALSE);
+			opt_threads[opt_nthreads] = atoi(optarg);
+			if (opt_threads[opt_nthreads] <= 0)
+				usage(B_FALSE);
+			opt_nthreads++;
+			break;
+		case 'r':
+			if (opt_nrecsizes == ZPOOLBENCH_MAX_RECSIZES)
+				usage(B_FALSE);
+			opt_recsizes[opt_nrecsizes] = strtoull(optarg, NULL, 0);
+			if (opt_recsizes[opt_nrecsizes] < SPA_MINBLOCKSIZE ||
+			    opt_recsizes[opt_nrecsizes] > SPA_MAXBLOCKSIZE ||
+			    !ISP2(opt_recsizes[opt_nrecsizes]))
+				usage(B_FALSE);
+			opt_nrecsizes++;
+			break;
+		case 'w':
+			opt_write = strtoull(optarg, NULL, 0) << 20;
+			break;
+		case 'S':
+			if (opt_nstreams == ZPOOLBENCH_MAX_STREAMS)
+				usage(B_FALSE);
+			opt_streams[opt_nstreams] = atoi(optarg);
+			if (opt_streams[opt_nstreams] <= 0)
+				usage(B_FALSE);
+			opt_nstreams++;
+			break;
+		case 'l':
+			opt_readsz = strtoull(optarg, NULL, 0);
+			if (opt_readsz == 0 || opt_readsz > SPA_MAXBLOCKSIZE)
+				usage(B_FALSE);
+			break;
+		case 'i':
+			opt_fsyncs = atoi(optarg);
+			break;
+		case 'h':
+			usage(B_TRUE);
+			break;
+		case '?':
+		default:
+			usage(B_FALSE);
+			break;
+		}
+	}
+
+	if (opt_size < SPA_MINDEVSIZE || opt_datasets <= 0 ||
+	    opt_objects <= 0 || opt_txgs <= 0 || opt_creates <= 0 ||
+	    opt_write == 0 || opt_fsyncs <= 0)
+		usage(B_FALSE);
+
+	if (opt_tests == 0)
+		opt_tests = ZPOOLBENCH_ALL;
+
+	for (i = 0; opt_npct == 0 && i < ZPOOLBENCH_DEFAULT_PCT; i++)
+		opt_pct[i] = zpoolbench_default_pct[i];
+	if (opt_npct == 0)
+		opt_npct = ZPOOLBENCH_DEFAULT_PCT;
+
+	for (i = 0; opt_nthreads == 0 && i < ZPOOLBENCH_DEFAULT_THREADS; i++)
+		opt_threads[i] = zpoolbench_default_threads[i];
+	if (opt_nthreads == 0)
+		opt_nthreads = ZPOOLBENCH_DEFAULT_THREADS;
+
+	for (i = 0; opt_nrecsizes == 0 && i < ZPOOLBENCH_DEFAULT_RECSIZES; i++)
+		opt_recsizes[i] = zpoolbench_default_recsizes[i];
+	if (opt_nrecsizes == 0)
+		opt_nrecsizes = ZPOOLBENCH_DEFAULT_RECSIZES;
+
+	for (i = 0; opt_nstreams == 0 && i < ZPOOLBENCH_DEFAULT_STREAMS; i++)
+		opt_streams[i] = zpoolbench_default_streams[i];
+	if (opt_nstreams == 0)
+		opt_nstreams = ZPOOLBENCH_DEFAULT_STREAMS;
+}
+
+/*
+ * Create the pool on a single file vdev of opt_size bytes, with every
+ * feature enabled as zpool create would, and return it held.
+ */
+static spa_t *
+zpoolbench_pool_create(void)
+{
+	nvlist_t *file, *root, *props;
+	spa_t *spa;
+	char *name;
+	int fd, i;
+
+	fd = open(zpoolbench_vdev, O_RDWR | O_CREAT | O_TRUNC, 0666);
+	if (fd == -1) {
+		(void) fprintf(stderr, "can't open %s: %s\n",
+		    zpoolbench_vdev, strerror(errno));
+		exit(1);
+	}
+	VERIFY0(ftruncate(fd, opt_size));
+	(void) close(fd);
+
+	VERIFY0(nvlist_alloc(&file, NV_UNIQUE_NAME, 0));
+	VERIFY0(nvlist_add_string(file, ZPOOL_CONFIG_TYPE, VDEV_TYPE_FILE));
+	VERIFY0(nvlist_add_string(file, ZPOOL_CONFIG_PATH, zpoolbench_vdev));
+	VERIFY0(nvlist_add_uint64(file, ZPOOL_CONFIG_ASHIFT,
+	    SPA_MINBLOCKSHIFT));
+
+	VERIFY0(nvlist_alloc(&root, NV_UNIQUE_NAME, 0));
+	VERIFY0(nvlist_add_string(root, ZPOOL_CONFIG_TYPE, VDEV_TYPE_ROOT));
+	VERIFY0(nvlist_add_nvlist_array(root, ZPOOL_CONFIG_CHILDREN,
+	    &file, 1));
+
+	VERIFY0(nvlist_alloc(&props, NV_UNIQUE_NAME, 0));
+	for (i = 0; i < SPA_FEATURES; i++) {
+		VERIFY(asprintf(&name, "feature@%s",
+		    spa_feature_table[i].fi_uname) != -1);
+		VERIFY0(nvlist_add_uint64(props, name, 0));
+		free(name);
+	}
+
+	(void) spa_destroy(ZPOOLBENCH_POOL);
+	VERIFY0(spa_create(ZPOOLBENCH_POOL, root, props, NULL));
+	nvlist_free(props);
+	nvlist_free(root);
+	nvlist_free(file);
+
+	VERIFY0(spa_open(ZPOOLBENCH_POOL, &spa, FTAG));
+	return (spa);
+}
+
+static void
+zpoolbench_pool_destroy(spa_t *spa)
+{
+	spa_close(spa, FTAG);
+	VERIFY0(spa_destroy(ZPOOLBENCH_POOL));
+	(void) unlink(zpoolbench_vdev);
+}
+
+/*
+ * Export and import the held pool, so that none of its blocks are left
+ * in the ARC, and return it held again.
+ */
+static spa_t *
+zpoolbench_pool_reimport(spa_t *spa)
+{
+	nvlist_t *config;
+
+	spa_close(spa, FTAG);
+	VERIFY0(spa_export(ZPOOLBENCH_POOL, &config, B_FALSE, B_FALSE));
+	VERIFY0(spa_import(ZPOOLBENCH_POOL, config, NULL, 0));
+	nvlist_free(config);
+
+	VERIFY0(spa_open(ZPOOLBENCH_POOL, &spa, FTAG));
+	return (spa);
+}
+
+/*
+ * Create and own opt_datasets datasets, each with opt_objects objects.
+ */
+static zpoolbench_ds_t *
+zpoolbench_ds_create(void)
+{
+	zpoolbench_ds_t *zds;
+	char name[MAXNAMELEN];
+	dmu_tx_t *tx;
+	int d, i;
+
+	zds = umem_zalloc(opt_datasets * sizeof (zpoolbench_ds_t),
+	    UMEM_NOFAIL);
+
+	for (d = 0; d < opt_datasets; d++) {
+		zpoolbench_ds_t *zd = &zds[d];
+
+		(void) snprintf(name, sizeof (name), "%s/ds%d",
+		    ZPOOLBENCH_POOL, d);
+		VERIFY0(dmu_objset_create(name, DMU_OST_OTHER, 0,
+		    NULL, NULL));
+		VERIFY0(dmu_objset_own(name, DMU_OST_OTHER, B_FALSE, zds,
+		    &zd->zd_os));
+
+		zd->zd_objs = umem_alloc(opt_objects * sizeof (uint64_t),
+		    UMEM_NOFAIL);
+		tx = dmu_tx_create(zd->zd_os);
+		for (i = 0; i < opt_objects; i++)
+			dmu_tx_hold_bonus(tx, DMU_NEW_OBJECT);
+		VERIFY0(dmu_tx_assign(tx, TXG_WAIT));
+		for (i = 0; i < opt_objects; i++) {
+			zd->zd_objs[i] = dmu_object_alloc(zd->zd_os,
+			    DMU_OT_UINT64_OTHER, opt_blksz, DMU_OT_NONE, 0,
+			    tx);
+		}
+		dmu_tx_commit(tx);
+	}
+
+	return (zds);
+}
+
+static void
+zpoolbench_ds_destroy(zpoolbench_ds_t *zds)
+{
+	int d;
+
+	for (d = 0; d < opt_datasets; d++) {
+		dmu_objset_disown(zds[d].zd_os, zds);
+		umem_free(zds[d].zd_objs, opt_objects * sizeof (uint64_t));
+	}
+	umem_free(zds, opt_datasets * sizeof (zpoolbench_ds_t));
+}
+
+/*
+ * Write a block to every object of every dataset, within a single txg.
+ */
+static void
+zpoolbench_dirty(zpoolbench_ds_t *zds, void *buf, uint64_t round)
+{
+	dmu_tx_t *tx;
+	int d, i;
+
+	for (d = 0; d < opt_datasets; d++) {
+		zpoolbench_ds_t *zd = &zds[d];
+
+		tx = dmu_tx_create(zd->zd_os);
+		for (i = 0; i < opt_objects; i++) {
+			dmu_tx_hold_write(tx, zd->zd_objs[i],
+			    round * opt_blksz, opt_blksz);
+		}
+		VERIFY0(dmu_tx_assign(tx, TXG_WAIT));
+		for (i = 0; i < opt_objects; i++) {
+			dmu_write(zd->zd_os, zd->zd_objs[i],
+			    round * opt_blksz, opt_blksz, buf, tx);
+		}
+		dmu_tx_commit(tx);
+	}
+}
+
+static void
+zpoolbench_sync(void *buf)
+{
+	spa_t *spa;
+	zpoolbench_ds_t *zds;
+	hrtime_t start, elapsed;
+	uint64_t bytes;
+	int p, n;
+
+	(void) printf("\n%-8s %8s %8s %8s %7s %10s %8s\n",
+	    "sync", "datasets", "objects", "blksz", "pct", "msec/txg",
+	    "MB/s");
+
+	bytes = (uint64_t)opt_datasets * opt_objects * opt_blksz;
+
+	for (p = 0; p < opt_npct; p++) {
+		zfs_sync_taskq_batch_pct = opt_pct[p];
+		spa = zpoolbench_pool_create();
+		zds = zpoolbench_ds_create();
+		txg_wait_synced(spa_get_dsl(spa), 0);
+
+		elapsed = 0;
+		for (n = 0; n < opt_txgs; n++) {
+			zpoolbench_dirty(zds, buf, n);
+			start = gethrtime();
+			txg_wait_synced(spa_get_dsl(spa), 0);
+			elapsed += gethrtime() - start;
+		}
+
+		(void) printf("%-8s %8d %8d %8llu %7d %10.2f %8.1f\n", "",
+		    opt_datasets, opt_objects, (u_longlong_t)opt_blksz,
+		    opt_pct[p], (double)elapsed / opt_txgs / MICROSEC,
+		    (double)bytes * opt_txgs / (1 << 20) /
+		    ((double)elapsed / NANOSEC));
+
+		zpoolbench_ds_destroy(zds);
+		zpoolbench_pool_destroy(spa);
+	}
+}
+
+/*
+ * Create opt_creates objects in os, each in a tx of its own.
+ */
+static void *
+zpoolbench_create_thread(void *arg)
+{
+	objset_t *os = arg;
+	dmu_tx_t *tx;
+	int i;
+
+	for (i = 0; i < opt_creates; i++) {
+		tx = dmu_tx_create(os);
+		dmu_tx_hold_bonus(tx, DMU_NEW_OBJECT);
+		VERIFY0(dmu_tx_assign(tx, TXG_WAIT));
+		(void) dmu_object_alloc(os, DMU_OT_UINT64_OTHER, 0,
+		    DMU_OT_NONE, 0, tx);
+		dmu_tx_commit(tx);
+	}
+
+	thread_exit();
+
+	return (NULL);
+}
+
+static void
+zpoolbench_create(void)
+{
+	spa_t *spa;
+	objset_t *os;
+	kt_did_t *tid;
+	kthread_t *thread;
+	char name[MAXNAMELEN];
+	hrtime_t start, elapsed;
+	int j, t;
+
+	(void) printf("\n%-8s %8s %8s %8s %10s\n",
+	    "create", "threads", "creates", "shift", "creates/s");
+
+	(void) snprintf(name, sizeof (name), "%s/create", ZPOOLBENCH_POOL);
+
+	for (j = 0; j < opt_nthreads; j++) {
+		spa = zpoolbench_pool_create();
+		VERIFY0(dmu_objset_create(name, DMU_OST_OTHER, 0, NULL, NULL));
+		VERIFY0(dmu_objset_own(name, DMU_OST_OTHER, B_FALSE, FTAG,
+		    &os));
+		tid = umem_zalloc(opt_threads[j] * sizeof (kt_did_t),
+		    UMEM_NOFAIL);
+
+		start = gethrtime();
+		for (t = 0; t < opt_threads[j]; t++) {
+			VERIFY3P(thread = zk_thread_create(NULL, 0,
+			    (thread_func_t)zpoolbench_create_thread, os,
+			    TS_RUN, NULL, 0, 0, PTHREAD_CREATE_JOINABLE),
+			    !=, NULL);
+			tid[t] = thread->t_tid;
+		}
+		for (t = 0; t < opt_threads[j]; t++)
+			thread_join(tid[t]);
+		elapsed = gethrtime() - start;
+
+		(void) printf("%-8s %8d %8d %8d %10.0f\n", "",
+		    opt_threads[j], opt_creates, dmu_object_alloc_chunk_shift,
+		    (double)opt_creates * opt_threads[j] /
+		    ((double)elapsed / NANOSEC));
+
+		umem_free(tid, opt_threads[j] * sizeof (kt_did_t));
+		dmu_objset_disown(os, FTAG);
+		zpoolbench_pool_destroy(spa);
+	}
+}
+
+/*
+ * Number of indirect blocks above nblocks contiguous data blocks, for an
+ * object described by doi.
+ */
+static uint64_t
+zpoolbench_indirect_blocks(dmu_object_info_t *doi, uint64_t nblocks)
+{
+	uint64_t epb = doi->doi_metadata_block_size >> SPA_BLKPTRSHIFT;
+	uint64_t count = 0;
+	int level;
+
+	for (level = 1; level < doi->doi_indirection; level++) {
+		nblocks = howmany(nblocks, epb);
+		count += nblocks;
+	}
+
+	return (count);
+}
+
+static void
+zpoolbench_recordsize(void)
+{
+	spa_t *spa;
+	objset_t *os;
+	dmu_object_info_t doi;
+	dmu_tx_t *tx;
+	char name[MAXNAMELEN];
+	hrtime_t start, elapsed;
+	uint64_t object, recsize, off, i;
+	void *buf;
+	int r;
+
+	(void) printf("\n%-10s %8s %8s %8s %8s %8s\n",
+	    "recordsize", "blksz", "MB", "MB/s", "blocks", "indirect");
+
+	(void) snprintf(name, sizeof (name), "%s/recordsize", ZPOOLBENCH_POOL);
+
+	for (r = 0; r < opt_nrecsizes; r++) {
+		recsize = opt_recsizes[r];
+		buf = umem_alloc(recsize, UMEM_NOFAIL);
+		for (i = 0; i < recsize / sizeof (uint64_t); i++)
+			((uint64_t *)buf)[i] = i;
+
+		spa = zpoolbench_pool_create();
+		VERIFY0(dmu_objset_create(name, DMU_OST_OTHER, 0, NULL, NULL));
+		VERIFY0(dmu_objset_own(name, DMU_OST_OTHER, B_FALSE, FTAG,
+		    &os));
+
+		tx = dmu_tx_create(os);
+		dmu_tx_hold_bonus(tx, DMU_NEW_OBJECT);
+		VERIFY0(dmu_tx_assign(tx, TXG_WAIT));
+		object = dmu_object_alloc(os, DMU_OT_UINT64_OTHER, 0,
+		    DMU_OT_NONE, 0, tx);
+		VERIFY0(dmu_object_set_blocksize(os, object, recsize, 0, tx));
+		dmu_tx_commit(tx);
+		txg_wait_synced(spa_get_dsl(spa), 0);
+
+		start = gethrtime();
+		for (off = 0; off < opt_write; off += recsize) {
+			tx = dmu_tx_create(os);
+			dmu_tx_hold_write(tx, object, off, recsize);
+			VERIFY0(dmu_tx_assign(tx, TXG_WAIT));
+			dmu_write(os, object, off, recsize, buf, tx);
+			dmu_tx_commit(tx);
+		}
+		txg_wait_synced(spa_get_dsl(spa), 0);
+		elapsed = gethrtime() - start;
+
+		VERIFY0(dmu_object_info(os, object, &doi));
+		(void) printf("%-10s %8llu %8llu %8.1f %8llu %8llu\n", "",
+		    (u_longlong_t)doi.doi_data_block_size,
+		    (u_longlong_t)(off >> 20),
+		    (double)off / (1 << 20) / ((double)elapsed / NANOSEC),
+		    (u_longlong_t)doi.doi_fill_count,
+		    (u_longlong_t)zpoolbench_indirect_blocks(&doi,
+		    doi.doi_fill_count));
+
+		dmu_objset_disown(os, FTAG);
+		zpoolbench_pool_destroy(spa);
+		umem_free(buf, recsize);
+	}
+}
+
+/*
+ * Read the reader's part of the object sequentially, opt_readsz at a time.
+ */
+static void *
+zpoolbench_read_thread(void *arg)
+{
+	zpoolbench_reader_t *zr = arg;
+	uint64_t off;
+	void *buf;
+
+	buf = umem_alloc(opt_readsz, UMEM_NOFAIL);
+	for (off = 0; off < zr->zr_length; off += opt_readsz) {
+		VERIFY0(dmu_read(zr->zr_os, zr->zr_object,
+		    zr->zr_offset + off, MIN(opt_readsz, zr->zr_length - off),
+		    buf, DMU_READ_PREFETCH));
+	}
+	umem_free(buf, opt_readsz);
+
+	thread_exit();
+
+	return (NULL);
+}
+
+static void
+zpoolbench_prefetch(void)
+{
+	spa_t *spa;
+	objset_t *os;
+	zpoolbench_reader_t *zr;
+	kt_did_t *tid;
+	kthread_t *thread;
+	dmu_tx_t *tx;
+	char name[MAXNAMELEN];
+	hrtime_t start, elapsed;
+	uint64_t object, off, len, i;
+	void *buf;
+	int disable = zfs_prefetch_disable;
+	int s, t, pf;
+
+	(void) printf("\n%-8s %8s %8s %8s %8s\n",
+	    "prefetch", "streams", "readsz", "prefetch", "MB/s");
+
+	(void) snprintf(name, sizeof (name), "%s/prefetch", ZPOOLBENCH_POOL);
+
+	buf = umem_alloc(SPA_OLD_MAXBLOCKSIZE, UMEM_NOFAIL);
+	for (i = 0; i < SPA_OLD_MAXBLOCKSIZE / sizeof (uint64_t); i++)
+		((uint64_t *)buf)[i] = i;
+
+	spa = zpoolbench_pool_create();
+	VERIFY0(dmu_objset_create(name, DMU_OST_OTHER, 0, NULL, NULL));
+	VERIFY0(dmu_objset_own(name, DMU_OST_OTHER, B_FALSE, FTAG, &os));
+
+	tx = dmu_tx_create(os);
+	dmu_tx_hold_bonus(tx, DMU_NEW_OBJECT);
+	VERIFY0(dmu_tx_assign(tx, TXG_WAIT));
+	object = dmu_object_alloc(os, DMU_OT_UINT64_OTHER,
+	    SPA_OLD_MAXBLOCKSIZE, DMU_OT_NONE, 0, tx);
+	dmu_tx_commit(tx);
+
+	for (off = 0; off < opt_write; off += SPA_OLD_MAXBLOCKSIZE) {
+		tx = dmu_tx_create(os);
+		dmu_tx_hold_write(tx, object, off, SPA_OLD_MAXBLOCKSIZE);
+		VERIFY0(dmu_tx_assign(tx, TXG_WAIT));
+		dmu_write(os, object, off, SPA_OLD_MAXBLOCKSIZE, buf, tx);
+		dmu_tx_commit(tx);
+	}
+	txg_wait_synced(spa_get_dsl(spa), 0);
+	dmu_objset_disown(os, FTAG);
+	umem_free(buf, SPA_OLD_MAXBLOCKSIZE);
+
+	for (s = 0; s < opt_nstreams; s++) {
+		zr = umem_zalloc(opt_streams[s] * sizeof (zpoolbench_reader_t),
+		    UMEM_NOFAIL);
+		tid = umem_zalloc(opt_streams[s] * sizeof (kt_did_t),
+		    UMEM_NOFAIL);
+
+		/* each stream reads a whole number of blocks */
+		len = P2ROUNDUP(howmany(off, opt_streams[s]),
+		    SPA_OLD_MAXBLOCKSIZE);
+
+		for (pf = 0; pf <= 1; pf++) {
+			zfs_prefetch_disable = !pf;
+			spa = zpoolbench_pool_reimport(spa);
+			VERIFY0(dmu_objset_own(name, DMU_OST_OTHER, B_FALSE,
+			    FTAG, &os));
+
+			start = gethrtime();
+			for (t = 0; t < opt_streams[s]; t++) {
+				zr[t].zr_os = os;
+				zr[t].zr_object = object;
+				zr[t].zr_offset = MIN(t * len, off);
+				zr[t].zr_length = MIN(len,
+				    off - zr[t].zr_offset);
+				VERIFY3P(thread = zk_thread_create(NULL, 0,
+				    (thread_func_t)zpoolbench_read_thread,
+				    &zr[t], TS_RUN, NULL, 0, 0,
+				    PTHREAD_CREATE_JOINABLE), !=, NULL);
+				tid[t] = thread->t_tid;
+			}
+			for (t = 0; t < opt_streams[s]; t++)
+				thread_join(tid[t]);
+			elapsed = gethrtime() - start;
+
+			(void) printf("%-8s %8d %8llu %8s %8.1f\n", "",
+			    opt_streams[s], (u_longlong_t)opt_readsz,
+			    pf ? "on" : "off",
+			    (double)off / (1 << 20) /
+			    ((double)elapsed / NANOSEC));
+
+			dmu_objset_disown(os, FTAG);
+		}
+
+		umem_free(tid, opt_streams[s] * sizeof (kt_did_t));
+		umem_free(zr, opt_streams[s] * sizeof (zpoolbench_reader_t));
+	}
+
+	zfs_prefetch_disable = disable;
+	zpoolbench_pool_destroy(spa);
+}
+
+/*
+ * All the records the fsync test logs carry their data, so the intent log
+ * never has to ask for it.
+ */
+/* ARGSUSED */
+static int
+zpoolbench_get_data(void *arg, lr_write_t *lr, char *buf, struct lwb *lwb,
+    zio_t *zio)
+{
+	return (SET_ERROR(ENOENT));
+}
+
+/*
+ * Log a TX_WRITE of len bytes of buf at off in object, with the data
+ * copied into the record.
+ */
+static void
+zpoolbench_log_write(zilog_t *zilog, dmu_tx_t *tx, uint64_t object,
+    uint64_t off, uint64_t len, void *buf)
+{
+	itx_t *itx;
+	lr_write_t *lr;
+
+	itx = zil_itx_create(TX_WRITE, sizeof (*lr) + len);
+	lr = (lr_write_t *)&itx->itx_lr;
+	lr->lr_foid = object;
+	lr->lr_offset = off;
+	lr->lr_length = len;
+	lr->lr_blkoff = 0;
+	BP_ZERO(&lr->lr_blkptr);
+	bcopy(buf, lr + 1, len);
+
+	itx->itx_private = NULL;
+	itx->itx_wr_state = WR_COPIED;
+	itx->itx_sync = B_TRUE;
+	zil_itx_assign(zilog, itx, tx);
+}
+
+/*
+ * Write, log and commit opt_fsyncs times, timing each zil_commit().
+ */
+static void *
+zpoolbench_fsync_thread(void *arg)
+{
+	zpoolbench_fsyncer_t *zf = arg;
+	uint64_t len = MIN(opt_blksz, ZIL_MAX_LOG_DATA);
+	uint64_t off;
+	hrtime_t start;
+	dmu_tx_t *tx;
+	void *buf;
+	int i;
+
+	buf = umem_zalloc(len, UMEM_NOFAIL);
+	for (i = 0; i < opt_fsyncs; i++) {
+		off = i * len;
+		tx = dmu_tx_create(zf->zf_os);
+		dmu_tx_hold_write(tx, zf->zf_object, off, len);
+		VERIFY0(dmu_tx_assign(tx, TXG_WAIT));
+		dmu_write(zf->zf_os, zf->zf_object, off, len, buf, tx);
+		zpoolbench_log_write(zf->zf_zilog, tx, zf->zf_object, off,
+		    len, buf);
+		dmu_tx_commit(tx);
+
+		start = gethrtime();
+		zil_commit(zf->zf_zilog, zf->zf_object);
+		zf->zf_lat[i] = gethrtime() - start;
+	}
+	umem_free(buf, len);
+
+	thread_exit();
+
+	return (NULL);
+}
+
+static int
+zpoolbench_hrtime_compare(const void *x1, const void *x2)
+{
+	hrtime_t t1 = *(const hrtime_t *)x1;
+	hrtime_t t2 = *(const hrtime_t *)x2;
+
+	if (t1 < t2)
+		return (-1);
+	if (t1 > t2)
+		return (1);
+
+	return (0);
+}
+
+static void
+zpoolbench_fsync(void)
+{
+	spa_t *spa;
+	objset_t *os;
+	zilog_t *zilog;
+	zpoolbench_fsyncer_t *zf;
+	kt_did_t *tid;
+	kthread_t *thread;
+	dmu_tx_t *tx;
+	char name[MAXNAMELEN];
+	hrtime_t start, elapsed, *lat;
+	uint64_t n;
+	int j, t;
+
+	(void) printf("\n%-8s %8s %8s %10s %10s %10s\n",
+	    "fsync", "threads", "bytes", "fsyncs/s", "p50 usec", "p99 usec");
+
+	(void) snprintf(name, sizeof (name), "%s/fsync", ZPOOLBENCH_POOL);
+
+	for (j = 0; j < opt_nthreads; j++) {
+		n = (uint64_t)opt_threads[j] * opt_fsyncs;
+
+		spa = zpoolbench_pool_create();
+		VERIFY0(dmu_objset_create(name, DMU_OST_OTHER, 0, NULL, NULL));
+		VERIFY0(dmu_objset_own(name, DMU_OST_OTHER, B_FALSE, FTAG,
+		    &os));
+		zilog = zil_open(os, zpoolbench_get_data);
+
+		zf = umem_zalloc(opt_threads[j] * sizeof (zpoolbench_fsyncer_t),
+		    UMEM_NOFAIL);
+		tid = umem_zalloc(opt_threads[j] * sizeof (kt_did_t),
+		    UMEM_NOFAIL);
+		lat = umem_zalloc(n * sizeof (hrtime_t), UMEM_NOFAIL);
+
+		tx = dmu_tx_create(os);
+		for (t = 0; t < opt_threads[j]; t++)
+			dmu_tx_hold_bonus(tx, DMU_NEW_OBJECT);
+		VERIFY0(dmu_tx_assign(tx, TXG_WAIT));
+		for (t = 0; t < opt_threads[j]; t++) {
+			zf[t].zf_os = os;
+			zf[t].zf_zilog = zilog;
+			zf[t].zf_object = dmu_object_alloc(os,
+			    DMU_OT_UINT64_OTHER, 0, DMU_OT_NONE, 0, tx);
+			zf[t].zf_lat = &lat[t * opt_fsyncs];
+		}
+		dmu_tx_commit(tx);
+		txg_wait_synced(spa_get_dsl(spa), 0);
+
+		start = gethrtime();
+		for (t = 0; t < opt_threads[j]; t++) {
+			VERIFY3P(thread = zk_thread_create(NULL, 0,
+			    (thread_func_t)zpoolbench_fsync_thread, &zf[t],
+			    TS_RUN, NULL, 0, 0, PTHREAD_CREATE_JOINABLE),
+			    !=, NULL);
+			tid[t] = thread->t_tid;
+		}
+		for (t = 0; t < opt_threads[j]; t++)
+			thread_join(tid[t]);
+		elapsed = gethrtime() - start;
+
+		qsort(lat, n, sizeof (hrtime_t), zpoolbench_hrtime_compare);
+
+		(void) printf("%-8s %8d %8llu %10.0f %10.1f %10.1f\n", "",
+		    opt_threads[j],
+		    (u_longlong_t)MIN(opt_blksz, ZIL_MAX_LOG_DATA),
+		    (double)n / ((double)elapsed / NANOSEC),
+		    (double)lat[n / 2] / (NANOSEC / MICROSEC),
+		    (double)lat[MIN(n * 99 / 100, n - 1)] /
+		    (NANOSEC / MICROSEC));
+
+		umem_free(lat, n * sizeof (hrtime_t));
+		umem_free(tid, opt_threads[j] * sizeof (kt_did_t));
+		umem_free(zf, opt_threads[j] * sizeof (zpoolbench_fsyncer_t));
+		zil_close(zilog);
+		dmu_objset_disown(os, FTAG);
+		zpoolbench_pool_destroy(spa);
+	}
+}
+
+int
+main(int argc, char **argv)
+{
+	void *buf;
+	int i;
+
+	(void) setvbuf(stdout, NULL, _IOLBF, 0);
+
+	process_options(argc, argv);
+
+	(void) snprintf(zpoolbench_vdev, sizeof (zpoolbench_vdev),
+	    "%s/%s.vdev", opt_dir, ZPOOLBENCH_POOL);
+	VERIFY(asprintf(&spa_config_path, "%s/%s.cache", opt_dir,
+	    ZPOOLBENCH_POOL) != -1);
+
+	kernel_init(FREAD | FWRITE);
+
+	buf = umem_alloc(opt_blksz, UMEM_NOFAIL);
+	for (i = 0; i < opt_blksz / sizeof (uint64_t); i++)
+		((uint64_t *)buf)[i] = i;
+
+	if (opt_tests & ZPOOLBENCH_SYNC)
+		zpoolbench_sync(buf);
+	if (opt_tests & ZPOOLBENCH_CREATE)
+		zpoolbench_create();
+	if (opt_tests & ZPOOLBENCH_RECORDSIZE)
+		zpoolbench_recordsize();
+	if (opt_tests & ZPOOLBENCH_PREFETCH)
+		zpoolbench_prefetch();
+	if (opt_tests & ZPOOLBENCH_FSYNC)
+		zpoolbench_fsync();
+
+	umem_free(buf, opt_blksz);
+
+	kernel_fini();
+
+	free(spa_config_path);
+
+	return (0);
+}
@@ -34,6 +34,7 @@
 
 #include <sys/dmu.h>
 #include <sys/zfs_ioctl.h>
+#include <sys/zio_checksum.h>
 #include <zfs_fletcher.h>
 
 uint64_t drr_record_count[DRR_NUMTYPES];
@@ -44,6 +45,18 @@ boolean_t do_byteswap = B_FALSE;
 boolean_t do_cksum = B_TRUE;
 #define	INITIAL_BUFLEN (1<<20)
 
+/*
+ * The dedup key of a WRITE record is only meaningful to a receiver which
+ * knows its checksum, so name it.
+ */
+static const char *
+checksum_name(uint8_t checksum)
+{
+	if (checksum >= ZIO_CHECKSUM_FUNCTIONS)
+		return ("unknown");
+	return (zio_checksum_table[checksum].ci_name);
+}
+
 static void
 usage(void)
 {
@@ -320,12 +333,13 @@ main(int argc, char *argv[])
 			}
 			if (verbose) {
 				(void) printf("WRITE object = %llu type = %u "
-				    "checksum type = %u\n"
+				    "checksum type = %u (%s)\n"
 				    "offset = %llu length = %llu "
 				    "props = %llx\n",
 				    (u_longlong_t)drrw->drr_object,
 				    drrw->drr_type,
 				    drrw->drr_checksumtype,
+				    checksum_name(drrw->drr_checksumtype),
 				    (u_longlong_t)drrw->drr_offset,
 				    (u_longlong_t)drrw->drr_length,
 				    (u_longlong_t)drrw->drr_key.ddk_prop);
@@ -355,12 +369,13 @@ main(int argc, char *argv[])
 			}
 			if (verbose) {
 				(void) printf("WRITE_BYREF object = %llu "
-				    "checksum type = %u props = %llx\n"
+				    "checksum type = %u (%s) props = %llx\n"
 				    "offset = %llu length = %llu\n"
 				    "toguid = %llx refguid = %llx\n"
 				    "refobject = %llu refoffset = %llu\n",
 				    (u_longlong_t)drrwbr->drr_object,
 				    drrwbr->drr_checksumtype,
+				    checksum_name(drrwbr->drr_checksumtype),
 				    (u_longlong_t)drrwbr->drr_key.ddk_prop,
 				    (u_longlong_t)drrwbr->drr_offset,
 				    (u_longlong_t)drrwbr->drr_length,
@@ -50,7 +50,12 @@ int lzc_hold(nvlist_t *holds, int cleanup_fd, nvlist_t **errlist);
 int lzc_release(nvlist_t *holds, nvlist_t **errlist);
 int lzc_get_holds(const char *snapname, nvlist_t **holdsp);
 
-int lzc_send(const char *snapname, const char *fromsnap, int fd);
+enum lzc_send_flags {
+	LZC_SEND_FLAG_LARGE_BLOCK = 1 << 0
+};
+
+int lzc_send(const char *snapname, const char *fromsnap, int fd,
+    enum lzc_send_flags flags);
 int lzc_receive(const char *snapname, nvlist_t *props, const char *origin,
     boolean_t force, int fd);
 int lzc_send_space(const char *snapname, const char *fromsnap,
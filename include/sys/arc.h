@@ -124,6 +124,26 @@ typedef struct arc_buf_info {
 	enum zio_compress	abi_l2arc_compress;
 } arc_buf_info_t;
 
+/*
+ * ARC residency and hit/miss counters kept for each objset and each
+ * object type of a pool, see arc_pool_stats().
+ */
+typedef enum arc_pool_stat_type {
+	ARC_PSTAT_SIZE,
+	ARC_PSTAT_DEMAND_DATA_HITS,
+	ARC_PSTAT_DEMAND_DATA_MISSES,
+	ARC_PSTAT_DEMAND_METADATA_HITS,
+	ARC_PSTAT_DEMAND_METADATA_MISSES,
+	ARC_PSTAT_PREFETCH_HITS,
+	ARC_PSTAT_PREFETCH_MISSES,
+	ARC_PSTAT_NUMTYPES
+} arc_pool_stat_type_t;
+
+typedef struct arc_pool_stat {
+	uint64_t		aps_id;		/* objset id or object type */
+	uint64_t		aps_value[ARC_PSTAT_NUMTYPES];
+} arc_pool_stat_t;
+
 void arc_space_consume(uint64_t space, arc_space_type_t type);
 void arc_space_return(uint64_t space, arc_space_type_t type);
 arc_buf_t *arc_buf_alloc(spa_t *spa, int size, void *tag,
@@ -134,6 +154,9 @@ void arc_loan_inuse_buf(arc_buf_t *buf, void *tag);
 void arc_buf_add_ref(arc_buf_t *buf, void *tag);
 boolean_t arc_buf_remove_ref(arc_buf_t *buf, void *tag);
 void arc_buf_info(arc_buf_t *buf, arc_buf_info_t *abi, int state_index);
+void arc_pool_stats(uint64_t spa, boolean_t types, arc_pool_stat_t **apsp,
+    uint64_t *np);
+void arc_pool_stats_purge(uint64_t spa);
 int arc_buf_size(arc_buf_t *buf);
 void arc_release(arc_buf_t *buf, void *tag);
 int arc_released(arc_buf_t *buf);
@@ -168,6 +191,7 @@ void arc_set_callback(arc_buf_t *buf, arc_evict_func_t *func, void *_private);
 int arc_buf_evict(arc_buf_t *buf);
 
 void arc_flush(spa_t *spa);
+uint64_t arc_max_bytes(void);
 void arc_tempreserve_clear(uint64_t reserve);
 int arc_tempreserve_space(uint64_t reserve, uint64_t txg);
 
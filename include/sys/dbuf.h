@@ -35,6 +35,7 @@
 #include <sys/zfs_context.h>
 #include <sys/refcount.h>
 #include <sys/zrlock.h>
+#include <sys/multilist.h>
 
 #ifdef	__cplusplus
 extern "C" {
@@ -76,6 +77,16 @@ typedef enum dbuf_states {
 	DB_EVICTING
 } dbuf_states_t;
 
+/*
+ * Which of the caches of unreferenced dbufs, if any, a dbuf is on.
+ */
+typedef enum dbuf_cached_state {
+	DB_NO_CACHE = 0,
+	DB_DBUF_CACHE,
+	DB_DBUF_METADATA_CACHE,
+	DB_CACHE_MAX
+} dbuf_cached_state_t;
+
 struct dnode;
 struct dmu_tx;
 
@@ -219,6 +230,13 @@ typedef struct dmu_buf_impl {
 	 */
 	list_node_t db_link;
 
+	/*
+	 * Our link on the dbuf cache while we have no holds, and which
+	 * cache that is.  Protected by db_mtx and the sublist lock.
+	 */
+	multilist_node_t db_cache_link;
+	dbuf_cached_state_t db_caching_status;
+
 	/* Data which is unique to data (leaf) blocks: */
 
 	/* stuff we store for the user (see dmu_buf_set_user) */
@@ -232,13 +250,51 @@ typedef struct dmu_buf_impl {
 	uint8_t db_dirtycnt;
 } dmu_buf_impl_t;
 
-/* Note: the dbuf hash table is exposed only for the mdb module */
-#define	DBUF_MUTEXES 256
-#define	DBUF_HASH_MUTEX(h, idx) (&(h)->hash_mutexes[(idx) & (DBUF_MUTEXES-1)])
+/*
+ * Note: the dbuf hash table is exposed only for the mdb module and for
+ * dbuf_stats.c.
+ *
+ * Every dbuf_hold() takes a hash mutex, picked by the low bits of the
+ * hash, to look up or insert its dbuf, so dbuf_init() sets up
+ * DBUF_MUTEXES_PER_CPU of them per CPU, each on a cache line of its own.
+ * Along with the mutex, that line holds what it protects: the bucket
+ * array the stripe's buckets are in at the moment (hl_buckets), and the
+ * number of dbufs hashed to the stripe (hl_count), kept here rather than
+ * in a global counter bumped on every insert and removal.  The array
+ * never has fewer buckets than there are mutexes, so doubling it with
+ * dbuf_hash_grow() never moves a dbuf to another mutex.
+ */
+typedef struct dbuf_hash_buckets {
+	uint64_t hb_mask;
+	dmu_buf_impl_t **hb_table;
+} dbuf_hash_buckets_t;
+
+#define	DBUF_HASH_LOCK_ALIGN	64
+#define	DBUF_HASH_LOCK_PAD	(P2NPHASE(sizeof (kmutex_t) + \
+	sizeof (void *) + sizeof (uint64_t), DBUF_HASH_LOCK_ALIGN))
+
+typedef struct dbuf_hash_lock {
+	kmutex_t		hl_lock;
+	dbuf_hash_buckets_t	*hl_buckets;
+	uint64_t		hl_count;
+#ifdef _KERNEL
+	unsigned char		hl_pad[DBUF_HASH_LOCK_PAD];
+#endif
+} dbuf_hash_lock_t;
+
+#define	DBUF_MUTEXES		256
+#define	DBUF_MUTEXES_PER_CPU	32
+#define	DBUF_HASH_LOCK(h, idx)	\
+	(&(h)->hash_mutexes[(idx) & (h)->hash_mutex_mask])
+#define	DBUF_HASH_MUTEX(h, idx)	(&DBUF_HASH_LOCK(h, idx)->hl_lock)
+
 typedef struct dbuf_hash_table {
 	uint64_t hash_table_mask;
-	dmu_buf_impl_t **hash_table;
-	kmutex_t hash_mutexes[DBUF_MUTEXES];
+	dbuf_hash_buckets_t *hash_buckets;
+	uint64_t hash_mutex_mask;
+	dbuf_hash_lock_t *hash_mutexes;
+	uint64_t hash_lock_contended;
+	uint64_t hash_resizes;
 } dbuf_hash_table_t;
 
 
@@ -255,7 +311,8 @@ dmu_buf_impl_t *dbuf_hold_level(struct dnode *dn, int level, uint64_t blkid,
 int dbuf_hold_impl(struct dnode *dn, uint8_t level, uint64_t blkid, int create,
     void *tag, dmu_buf_impl_t **dbp);
 
-void dbuf_prefetch(struct dnode *dn, uint64_t blkid, zio_priority_t prio);
+void dbuf_prefetch(struct dnode *dn, int level, uint64_t blkid,
+    zio_priority_t prio);
 
 void dbuf_add_ref(dmu_buf_impl_t *db, void *tag);
 uint64_t dbuf_refcount(dmu_buf_impl_t *db);
@@ -119,6 +119,13 @@ typedef enum dmu_object_byteswap {
 	((ot) & DMU_OT_METADATA) : \
 	dmu_ot[(int)(ot)].ot_metadata)
 
+/*
+ * These object types use blk_fill != 1 for their L0 bp's, so their data
+ * can't be embedded in the bp: blk_fill holds payload in an embedded bp.
+ */
+#define	DMU_OT_HAS_FILL(ot) \
+	((ot) == DMU_OT_DNODE || (ot) == DMU_OT_OBJSET)
+
 #define	DMU_OT_BYTESWAP(ot) (((ot) & DMU_OT_NEWTYPE) ? \
 	((ot) & DMU_OT_BYTESWAP_MASK) : \
 	dmu_ot[(int)(ot)].ot_byteswap)
@@ -249,9 +256,10 @@ void zfs_znode_byteswap(void *buf, size_t size);
 
 /*
  * The maximum number of bytes that can be accessed as part of one
- * operation, including metadata.
+ * operation, including metadata.  This has to leave room for several
+ * SPA_MAXBLOCKSIZE blocks.
  */
-#define	DMU_MAX_ACCESS (10<<20) /* 10MB */
+#define	DMU_MAX_ACCESS (64<<20) /* 64MB */
 #define	DMU_MAX_DELETEBLKCNT (20480) /* ~5MB of indirect blocks */
 
 #define	DMU_USERUSED_OBJECT	(-1ULL)
@@ -328,6 +336,7 @@ typedef void dmu_buf_evict_func_t(struct dmu_buf *db, void *user_ptr);
 #define	DMU_POOL_FREE_BPOBJ		"free_bpobj"
 #define	DMU_POOL_BPTREE_OBJ		"bptree_obj"
 #define	DMU_POOL_EMPTY_BPOBJ		"empty_bpobj"
+#define	DMU_POOL_CHECKSUM_SALT		"com.delphix:checksum_salt"
 
 /*
  * Allocate an object from this objset.  The range of object numbers
@@ -613,6 +622,26 @@ int dmu_free_long_object(objset_t *os, uint64_t object);
 #define	DMU_READ_NO_PREFETCH	1 /* don't prefetch */
 int dmu_read(objset_t *os, uint64_t object, uint64_t offset, uint64_t size,
 	void *buf, uint32_t flags);
+
+/*
+ * Asynchronous, vectored reads.  dmu_read_async() issues the reads of all
+ * of the ranges and returns without waiting for them.  Once every range
+ * has been copied into its buffer, done is called from a taskq thread with
+ * 0 or the first error encountered.  It is called exactly once, even if
+ * the reads could not be issued.  The ranges and their buffers must not be
+ * touched, and the objset must stay held, until then.
+ */
+typedef struct dmu_read_range {
+	uint64_t	dmr_object;
+	uint64_t	dmr_offset;
+	uint64_t	dmr_size;
+	void		*dmr_buf;
+} dmu_read_range_t;
+
+typedef void dmu_read_done_func_t(void *arg, int error);
+
+void dmu_read_async(objset_t *os, dmu_read_range_t *ranges, int nranges,
+	uint32_t flags, dmu_read_done_func_t *done, void *arg);
 void dmu_write(objset_t *os, uint64_t object, uint64_t offset, uint64_t size,
 	const void *buf, dmu_tx_t *tx);
 void dmu_prealloc(objset_t *os, uint64_t object, uint64_t offset, uint64_t size,
@@ -813,7 +842,7 @@ uint64_t dmu_tx_get_txg(dmu_tx_t *tx);
  * {zfs,zvol,ztest}_get_done() args
  */
 typedef struct zgd {
-	struct zilog	*zgd_zilog;
+	struct lwb	*zgd_lwb;
 	struct blkptr	*zgd_bp;
 	dmu_buf_t	*zgd_db;
 	struct rl	*zgd_rl;
@@ -842,7 +871,7 @@ void dmu_traverse_objset(objset_t *os, uint64_t txg_start,
     dmu_traverse_cb_t cb, void *arg);
 
 int
-dmu_send(const char *tosnap, const char *fromsnap,
+dmu_send(const char *tosnap, const char *fromsnap, boolean_t large_block_ok,
          int outfd, struct vnode *fd, offset_t *off);
 
 
@@ -855,6 +884,7 @@ int dmu_diff(const char *tosnap_name, const char *fromsnap_name,
 extern uint64_t *zfs_crc64_table;
 
 extern int zfs_mdcomp_disable;
+extern int zfs_max_recordsize;
 
 #ifdef	__cplusplus
 }
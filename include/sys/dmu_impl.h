@@ -48,7 +48,7 @@ extern "C" {
  * bplist is self-contained
  * refcount is self-contained
  * txg is self-contained (hopefully!)
- * zst_lock
+ * zs_lock
  * zf_rwlock
  *
  * XXX try to improve evicting path?
@@ -70,9 +70,10 @@ extern "C" {
  * os_obj_lock
  *   must be held before:
  *   	everything except dp_config_rwlock
- *   protects os_obj_next
+ *   protects os_obj_next_chunk
  *   held from:
  *   	dmu_object_alloc: dn_dbufs_mtx, db_mtx, hash_mutexes, dn_struct_rwlock
+ *   	(only to claim a new chunk of object numbers for a CPU)
  *
  * dn_struct_rwlock
  *   must be held before:
@@ -87,8 +88,9 @@ extern "C" {
  *   	callers of dbuf_read_impl, dbuf_hold[_impl], dbuf_prefetch
  *   	dmu_object_info_from_dnode: dn_dirty_mtx (dn_datablksz)
  *   	dmu_tx_count_free:
- *   	dbuf_read_impl: db_mtx, dmu_zfetch()
- *   	dmu_zfetch: zf_rwlock/r, zst_lock, dbuf_prefetch()
+ *   	dbuf_read_impl: db_mtx
+ *   	dmu_buf_hold_array_by_dnode: dmu_zfetch()
+ *   	dmu_zfetch: zf_rwlock/r, zs_lock, dbuf_prefetch()
  *   	dbuf_new_size: db_mtx
  *   	dbuf_dirty: db_mtx
  *	dbuf_findbp: (callers, phys? - the real need)
@@ -212,6 +214,16 @@ extern "C" {
  *   	dnode_destroy: none (os_dnodes)
  *   	dnode_setdirty: none (dn_dirtyblksz, os_*_dnodes)
  *   	dnode_free: none (dn_dirtyblksz, os_*_dnodes)
+ *   	dmu_objset_sync_dnodes_task: none (os_synced_dnodes)
+ *
+ * os_*_dnodes sublist locks (leaf)
+ *   protects:
+ *   	os_dirty_dnodes and os_free_dnodes of the syncing txg
+ *   	dn_dirty_link
+ *   held from:
+ *   	dnode_setdirty: os_lock
+ *   	dnode_free: os_lock
+ *   	dmu_objset_sync_dnodes_task: none, while running dnode_sync()
  *
  * ds_lock
  *    protects:
@@ -270,6 +282,7 @@ typedef struct dmu_sendarg {
 	objset_t *dsa_os;
 	zio_cksum_t dsa_zc;
 	uint64_t dsa_toguid;
+	uint64_t dsa_featureflags;
 	int dsa_err;
 	dmu_pendop_t dsa_pending_op;
 	boolean_t dsa_incremental;
@@ -94,22 +94,34 @@ struct objset {
 	uint8_t os_primary_cache;
 	uint8_t os_secondary_cache;
 	uint8_t os_sync;
+	uint64_t os_recordsize;
 
 	/* no lock needed: */
 	struct dmu_tx *os_synctx; /* XXX sketchy */
 	blkptr_t *os_rootbp;
 	zil_header_t os_zil_header;
-	list_t os_synced_dnodes;
+	list_t os_synced_dnodes;	/* appended to under os_lock */
 	uint64_t os_flags;
 
 	/* Protected by os_obj_lock */
 	kmutex_t os_obj_lock;
-	uint64_t os_obj_next;
+	uint64_t os_obj_next_chunk;
 
-	/* Protected by os_lock */
+	/*
+	 * Next object number to allocate from the chunk claimed by each
+	 * CPU; updated atomically, and refilled under os_obj_lock.
+	 */
+	uint64_t *os_obj_next_percpu;
+	int os_obj_next_percpu_len;
+
+	/*
+	 * Protected by os_lock.  The dirty and free dnode lists are also
+	 * split into sublists with locks of their own, so that the
+	 * dnodes of the syncing txg can be synced in parallel.
+	 */
 	kmutex_t os_lock;
-	list_t os_dirty_dnodes[TXG_SIZE];
-	list_t os_free_dnodes[TXG_SIZE];
+	multilist_t os_dirty_dnodes[TXG_SIZE];
+	multilist_t os_free_dnodes[TXG_SIZE];
 	list_t os_dnodes;
 	list_t os_downgraded_dbufs;
 
@@ -34,6 +34,7 @@
 #include <sys/refcount.h>
 #include <sys/dmu_zfetch.h>
 #include <sys/zrlock.h>
+#include <sys/multilist.h>
 
 #ifdef	__cplusplus
 extern "C" {
@@ -191,8 +192,8 @@ typedef struct dnode {
 	/* There are no level-0 blocks of this blkid or higher in dn_dbufs */
 	uint64_t dn_unlisted_l0_blkid;
 
-	/* protected by os_lock: */
-	list_node_t dn_dirty_link[TXG_SIZE];	/* next on dataset's dirty */
+	/* protected by os_lock and the sublist lock: */
+	multilist_node_t dn_dirty_link[TXG_SIZE]; /* next on dataset's dirty */
 
 	/* protected by dn_mtx: */
 	kmutex_t dn_mtx;
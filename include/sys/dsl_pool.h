@@ -57,6 +57,8 @@ extern unsigned long zfs_dirty_data_sync;
 extern int zfs_dirty_data_max_percent;
 extern int zfs_dirty_data_max_max_percent;
 extern int zfs_delay_min_dirty_percent;
+extern int zfs_sync_taskq_batch_pct;
+extern int zfs_read_taskq_batch_pct;
 extern unsigned long zfs_delay_scale;
 
 /* These macros are for indexing into the zfs_all_blkstats_t. */
@@ -90,13 +92,18 @@ typedef struct dsl_pool {
 	struct dsl_dataset *dp_origin_snap;
 	uint64_t dp_root_dir_obj;
 	struct taskq *dp_iput_taskq;
+	struct taskq *dp_sync_taskq;
+	struct taskq *dp_sync_ds_taskq;
+	struct taskq *dp_read_taskq;
 
 	/* No lock needed - sync context only */
 	blkptr_t dp_meta_rootbp;
+	uint64_t dp_sync_times[TXG_SYNC_PHASES]; /* nsecs, of syncing txg */
 	uint64_t dp_tmp_userrefs_obj;
 	bpobj_t dp_free_bpobj;
 	uint64_t dp_bptree_obj;
 	uint64_t dp_empty_bpobj;
+	kmutex_t dp_empty_bpobj_lock;	/* replacing it in parallel syncs */
 
 	struct dsl_scan *dp_scan;
 
@@ -108,6 +115,8 @@ typedef struct dsl_pool {
 	uint64_t dp_mos_used_delta;
 	uint64_t dp_mos_compressed_delta;
 	uint64_t dp_mos_uncompressed_delta;
+	uint64_t dp_sync_dnodes_active;
+	hrtime_t dp_sync_dnodes_start;
 
 	/*
 	 * Time of most recently scheduled (furthest in the future)
@@ -140,6 +149,8 @@ void dsl_pool_close(dsl_pool_t *dp);
 dsl_pool_t *dsl_pool_create(spa_t *spa, nvlist_t *zplprops, uint64_t txg);
 void dsl_pool_sync(dsl_pool_t *dp, uint64_t txg);
 void dsl_pool_sync_done(dsl_pool_t *dp, uint64_t txg);
+void dsl_pool_sync_dnodes_enter(dsl_pool_t *dp);
+void dsl_pool_sync_dnodes_exit(dsl_pool_t *dp);
 int dsl_pool_sync_context(dsl_pool_t *dp);
 uint64_t dsl_pool_adjustedsize(dsl_pool_t *dp, boolean_t netfree);
 uint64_t dsl_pool_adjustedfree(dsl_pool_t *dp, boolean_t netfree);
@@ -0,0 +1,98 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+#ifndef	_SYS_MULTILIST_H
+#define	_SYS_MULTILIST_H
+
+#include <sys/zfs_context.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/*
+ * A multilist is a list split into a fixed number of sublists, each
+ * with its own lock.  An object always lives on the sublist picked for
+ * it by the index function given at creation time, so inserts and
+ * removes of unrelated objects take different locks.  There is no
+ * ordering between sublists; consumers that care about order walk the
+ * sublists one at a time.
+ */
+
+typedef list_node_t multilist_node_t;
+typedef struct multilist multilist_t;
+typedef unsigned int multilist_sublist_index_func_t(multilist_t *, void *);
+
+/*
+ * Keep the locks of neighbouring sublists on different cache lines.
+ */
+#define	MULTILIST_SUBLIST_PAD	64
+
+typedef struct multilist_sublist {
+	kmutex_t	mls_lock;
+	list_t		mls_list;
+	uint8_t		mls_pad[MULTILIST_SUBLIST_PAD];
+} multilist_sublist_t;
+
+struct multilist {
+	size_t				ml_offset;
+	unsigned int			ml_num_sublists;
+	multilist_sublist_t		*ml_sublists;
+	multilist_sublist_index_func_t	*ml_index_func;
+};
+
+extern void multilist_create(multilist_t *ml, size_t size, size_t offset,
+    unsigned int num, multilist_sublist_index_func_t *index_func);
+extern void multilist_destroy(multilist_t *ml);
+
+extern void multilist_insert(multilist_t *ml, void *obj);
+extern void multilist_remove(multilist_t *ml, void *obj);
+extern int multilist_is_empty(multilist_t *ml);
+
+extern unsigned int multilist_get_num_sublists(multilist_t *ml);
+extern unsigned int multilist_get_random_index(multilist_t *ml);
+extern unsigned int multilist_get_sublist_index(multilist_t *ml, void *obj);
+
+extern multilist_sublist_t *multilist_sublist_lock(multilist_t *ml,
+    unsigned int idx);
+extern void multilist_sublist_unlock(multilist_sublist_t *mls);
+
+extern void multilist_sublist_insert_head(multilist_sublist_t *mls,
+    void *obj);
+extern void multilist_sublist_insert_tail(multilist_sublist_t *mls,
+    void *obj);
+extern void multilist_sublist_insert_after(multilist_sublist_t *mls,
+    void *obj, void *nobj);
+extern void multilist_sublist_remove(multilist_sublist_t *mls, void *obj);
+
+extern void *multilist_sublist_head(multilist_sublist_t *mls);
+extern void *multilist_sublist_tail(multilist_sublist_t *mls);
+extern void *multilist_sublist_next(multilist_sublist_t *mls, void *obj);
+extern void *multilist_sublist_prev(multilist_sublist_t *mls, void *obj);
+
+extern void multilist_link_init(multilist_node_t *link);
+extern int multilist_link_active(multilist_node_t *link);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _SYS_MULTILIST_H */
@@ -0,0 +1,75 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+#ifndef _SYS_SHA256_H
+#define	_SYS_SHA256_H
+
+#include <sys/types.h>
+#include <sys/simd.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#define	SHA256_BLOCK_SIZE	64
+#define	SHA256_MB_LANES		8
+
+/*
+ * SHA-256 compression function implementations.
+ *
+ * so_block runs the compression function over nblks consecutive 64 byte
+ * blocks of a single buffer.  so_multi, when provided, does the same for
+ * up to SHA256_MB_LANES independent buffers at once, buffer i having
+ * nblks[i] blocks; it is what makes hashing several blocks per call pay
+ * off.  Padding and the final block are always handled by the caller.
+ */
+typedef void sha256_block_func_t(uint32_t *H, const uint8_t *data,
+    uint64_t nblks);
+typedef void sha256_multi_func_t(uint32_t (*H)[8], const uint8_t **data,
+    const uint64_t *nblks, int n);
+
+typedef struct sha256_ops {
+	sha256_block_func_t	*so_block;
+	sha256_multi_func_t	*so_multi;
+	boolean_t		(*so_valid)(void);
+	const char		*so_name;
+} sha256_ops_t;
+
+extern const sha256_ops_t sha256_scalar_ops;
+#if defined(HAVE_SIMD_X86)
+extern const sha256_ops_t sha256_shani_ops;
+extern const sha256_ops_t sha256_avx2_ops;
+#endif
+
+extern sha256_block_func_t sha256_scalar_block;
+extern const uint32_t SHA256_K[64];
+
+extern void sha256_init(void);
+extern void sha256_fini(void);
+extern int sha256_impl_set(const char *name);
+extern const char *sha256_impl_get(void);
+extern boolean_t sha256_impl_multi(void);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _SYS_SHA256_H */
@@ -0,0 +1,282 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+#ifndef _SYS_SIMD_H
+#define	_SYS_SIMD_H
+
+#include <sys/types.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/*
+ * Runtime detection of x86 vector extensions and the save/restore
+ * bracket that must surround any code using them.
+ *
+ * The vectorized routines are written with the compiler's generic
+ * vector extensions and per-function target attributes, so no special
+ * compiler flags are needed for the files containing them.  Callers are
+ * expected to check the zfs_*_available() predicate before calling a
+ * routine built for that extension, and to wrap the call in
+ * kfpu_begin()/kfpu_end().
+ */
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define	HAVE_SIMD_X86	1
+#endif
+
+#ifdef HAVE_SIMD_X86
+
+/* CPUID.1:ECX */
+#define	CPUID1_ECX_SSSE3	(1U << 9)
+#define	CPUID1_ECX_SSE41	(1U << 19)
+#define	CPUID1_ECX_PCLMUL	(1U << 1)
+#define	CPUID1_ECX_OSXSAVE	(1U << 27)
+#define	CPUID1_ECX_AVX		(1U << 28)
+/* CPUID.1:EDX */
+#define	CPUID1_EDX_SSE2		(1U << 26)
+/* CPUID.(EAX=7,ECX=0):EBX */
+#define	CPUID7_EBX_AVX2		(1U << 5)
+#define	CPUID7_EBX_SHA		(1U << 29)
+/* XCR0 bits that must be enabled by the OS for AVX state */
+#define	XCR0_SSE_AVX		((1ULL << 1) | (1ULL << 2))
+/* XCR0 bits of the AVX-512 opmask and zmm state */
+#define	XCR0_AVX512		((1ULL << 5) | (1ULL << 6) | (1ULL << 7))
+
+static inline void
+zfs_cpuid(uint32_t leaf, uint32_t subleaf, uint32_t *eax, uint32_t *ebx,
+    uint32_t *ecx, uint32_t *edx)
+{
+	__asm__ __volatile__("cpuid"
+	    : "=a" (*eax), "=b" (*ebx), "=c" (*ecx), "=d" (*edx)
+	    : "a" (leaf), "c" (subleaf));
+}
+
+static inline uint64_t
+zfs_xgetbv(uint32_t index)
+{
+	uint32_t eax, edx;
+
+	__asm__ __volatile__(".byte 0x0f, 0x01, 0xd0"	/* xgetbv */
+	    : "=a" (eax), "=d" (edx) : "c" (index));
+	return ((uint64_t)edx << 32 | eax);
+}
+
+static inline boolean_t
+zfs_sse2_available(void)
+{
+	uint32_t a, b, c, d;
+
+	zfs_cpuid(1, 0, &a, &b, &c, &d);
+	return ((d & CPUID1_EDX_SSE2) != 0);
+}
+
+static inline boolean_t
+zfs_ssse3_available(void)
+{
+	uint32_t a, b, c, d;
+
+	zfs_cpuid(1, 0, &a, &b, &c, &d);
+	return ((d & CPUID1_EDX_SSE2) != 0 && (c & CPUID1_ECX_SSSE3) != 0);
+}
+
+static inline boolean_t
+zfs_sse4_1_available(void)
+{
+	uint32_t a, b, c, d;
+
+	zfs_cpuid(1, 0, &a, &b, &c, &d);
+	return ((c & CPUID1_ECX_SSSE3) != 0 && (c & CPUID1_ECX_SSE41) != 0);
+}
+
+/*
+ * AVX state is only usable when the OS has enabled it in XCR0, which
+ * is advertised through OSXSAVE.
+ */
+static inline boolean_t
+zfs_avx_available(void)
+{
+	uint32_t a, b, c, d;
+
+	zfs_cpuid(1, 0, &a, &b, &c, &d);
+	if ((c & (CPUID1_ECX_OSXSAVE | CPUID1_ECX_AVX)) !=
+	    (CPUID1_ECX_OSXSAVE | CPUID1_ECX_AVX))
+		return (B_FALSE);
+	return ((zfs_xgetbv(0) & XCR0_SSE_AVX) == XCR0_SSE_AVX);
+}
+
+static inline boolean_t
+zfs_avx2_available(void)
+{
+	uint32_t a, b, c, d;
+
+	if (!zfs_avx_available())
+		return (B_FALSE);
+	zfs_cpuid(0, 0, &a, &b, &c, &d);
+	if (a < 7)
+		return (B_FALSE);
+	zfs_cpuid(7, 0, &a, &b, &c, &d);
+	return ((b & CPUID7_EBX_AVX2) != 0);
+}
+
+static inline boolean_t
+zfs_shani_available(void)
+{
+	uint32_t a, b, c, d;
+
+	if (!zfs_sse4_1_available())
+		return (B_FALSE);
+	zfs_cpuid(0, 0, &a, &b, &c, &d);
+	if (a < 7)
+		return (B_FALSE);
+	zfs_cpuid(7, 0, &a, &b, &c, &d);
+	return ((b & CPUID7_EBX_SHA) != 0);
+}
+
+#if defined(_KERNEL)
+
+/*
+ * The kernel is built soft-float and does not preserve vector state
+ * across its own use of it.  Interrupts are disabled for the duration
+ * of the vector code so we cannot be preempted, and the vector
+ * registers of the interrupted thread are saved on the stack and put
+ * back when done.  Callers must keep each section short, at most about
+ * one 128K block worth of work, splitting larger buffers into several
+ * sections.
+ *
+ * Only registers 0-15 are saved, which is all the SSE and AVX2 code can
+ * touch.  The VEX-encoded AVX2 code clears the upper bits of zmm0-15
+ * though, so on AVX-512 capable CPUs those are saved whole.  What is
+ * saved is decided once by kfpu_init(), at module load, rather than by
+ * running CPUID in every section.
+ */
+extern boolean_t ml_set_interrupts_enabled(boolean_t);
+
+typedef enum kfpu_mode {
+	KFPU_XMM,
+	KFPU_YMM,
+	KFPU_ZMM
+} kfpu_mode_t;
+
+extern kfpu_mode_t kfpu_mode;
+extern void kfpu_init(void);
+
+typedef struct kfpu_state {
+	uint8_t		kfpu_regs[16 * 64] __attribute__((aligned(64)));
+	boolean_t	kfpu_intr;
+	kfpu_mode_t	kfpu_mode;
+} kfpu_state_t;
+
+#define	KFPU_XMM_SAVE(i, p)						\
+	__asm__ __volatile__("movdqu %%xmm" #i ", %0" : "=m" (*(p)))
+#define	KFPU_XMM_RESTORE(i, p)						\
+	__asm__ __volatile__("movdqu %0, %%xmm" #i :: "m" (*(p)))
+#define	KFPU_YMM_SAVE(i, p)						\
+	__asm__ __volatile__("vmovdqu %%ymm" #i ", %0" : "=m" (*(p)))
+#define	KFPU_YMM_RESTORE(i, p)						\
+	__asm__ __volatile__("vmovdqu %0, %%ymm" #i :: "m" (*(p)))
+#define	KFPU_ZMM_SAVE(i, p)						\
+	__asm__ __volatile__("vmovdqu64 %%zmm" #i ", %0" : "=m" (*(p)))
+#define	KFPU_ZMM_RESTORE(i, p)						\
+	__asm__ __volatile__("vmovdqu64 %0, %%zmm" #i :: "m" (*(p)))
+
+#define	KFPU_REGS(op, sz, s)						\
+	do {								\
+		uint8_t (*r)[sz] = (uint8_t (*)[sz])(s)->kfpu_regs;	\
+		op(0, r + 0);	op(1, r + 1);	op(2, r + 2);		\
+		op(3, r + 3);	op(4, r + 4);	op(5, r + 5);		\
+		op(6, r + 6);	op(7, r + 7);	op(8, r + 8);		\
+		op(9, r + 9);	op(10, r + 10);	op(11, r + 11);		\
+		op(12, r + 12);	op(13, r + 13);	op(14, r + 14);		\
+		op(15, r + 15);						\
+	} while (0)
+
+static inline void
+kfpu_begin(kfpu_state_t *s)
+{
+	s->kfpu_intr = ml_set_interrupts_enabled(B_FALSE);
+	s->kfpu_mode = kfpu_mode;
+	switch (s->kfpu_mode) {
+	case KFPU_ZMM:
+		KFPU_REGS(KFPU_ZMM_SAVE, 64, s);
+		break;
+	case KFPU_YMM:
+		KFPU_REGS(KFPU_YMM_SAVE, 32, s);
+		break;
+	default:
+		KFPU_REGS(KFPU_XMM_SAVE, 16, s);
+		break;
+	}
+}
+
+/*
+ * No vzeroupper after the restore: it would clear the upper halves of
+ * the ymm registers that were just put back.
+ */
+static inline void
+kfpu_end(kfpu_state_t *s)
+{
+	switch (s->kfpu_mode) {
+	case KFPU_ZMM:
+		KFPU_REGS(KFPU_ZMM_RESTORE, 64, s);
+		break;
+	case KFPU_YMM:
+		KFPU_REGS(KFPU_YMM_RESTORE, 32, s);
+		break;
+	default:
+		KFPU_REGS(KFPU_XMM_RESTORE, 16, s);
+		break;
+	}
+	(void) ml_set_interrupts_enabled(s->kfpu_intr);
+}
+
+#else	/* !_KERNEL */
+
+/*
+ * Userland threads own their vector state, nothing to do.
+ */
+typedef struct kfpu_state {
+	int		kfpu_unused;
+} kfpu_state_t;
+
+#define	kfpu_init()	((void)0)
+#define	kfpu_begin(s)	((void)(s))
+#define	kfpu_end(s)	((void)(s))
+
+#endif	/* _KERNEL */
+
+#else	/* !HAVE_SIMD_X86 */
+
+typedef struct kfpu_state {
+	int		kfpu_unused;
+} kfpu_state_t;
+
+#define	kfpu_init()	((void)0)
+#define	kfpu_begin(s)	((void)(s))
+#define	kfpu_end(s)	((void)(s))
+
+#endif	/* HAVE_SIMD_X86 */
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _SYS_SIMD_H */
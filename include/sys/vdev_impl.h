@@ -122,7 +122,7 @@ struct vdev_queue {
 };
 
 struct vdev_io {
-	char		vi_buffer[SPA_MAXBLOCKSIZE]; /* Must be first */
+	char		vi_buffer[SPA_OLD_MAXBLOCKSIZE]; /* Must be first */
 	list_node_t	vi_node;
 };
 
@@ -0,0 +1,123 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+/*
+ * Copyright (c) 2005, 2010, Oracle and/or its affiliates. All rights reserved.
+ * Copyright (c) 2013 by Delphix. All rights reserved.
+ */
+
+#ifndef _SYS_VDEV_RAIDZ_H
+#define	_SYS_VDEV_RAIDZ_H
+
+#include <sys/types.h>
+#include <sys/vdev_impl.h>
+#include <sys/simd.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+typedef struct raidz_col {
+	uint64_t rc_devidx;		/* child device index for I/O */
+	uint64_t rc_offset;		/* device offset */
+	uint64_t rc_size;		/* I/O size */
+	void *rc_data;			/* I/O data */
+	void *rc_gdata;			/* used to store the "good" version */
+	int rc_error;			/* I/O error for this device */
+	uint8_t rc_tried;		/* Did we attempt this I/O column? */
+	uint8_t rc_skipped;		/* Did we skip this I/O column? */
+} raidz_col_t;
+
+typedef struct raidz_map {
+	uint64_t rm_cols;		/* Regular column count */
+	uint64_t rm_scols;		/* Count including skipped columns */
+	uint64_t rm_bigcols;		/* Number of oversized columns */
+	uint64_t rm_asize;		/* Actual total I/O size */
+	uint64_t rm_missingdata;	/* Count of missing data devices */
+	uint64_t rm_missingparity;	/* Count of missing parity devices */
+	uint64_t rm_firstdatacol;	/* First data column/parity count */
+	uint64_t rm_nskip;		/* Skipped sectors for padding */
+	uint64_t rm_skipstart;		/* Column index of padding start */
+	void *rm_datacopy;		/* rm_asize-buffer of copied data */
+	uintptr_t rm_reports;		/* # of referencing checksum reports */
+	uint8_t	rm_freed;		/* map no longer has referencing ZIO */
+	uint8_t	rm_ecksuminjected;	/* checksum error was injected */
+	raidz_col_t rm_col[1];		/* Flexible array of I/O columns */
+} raidz_map_t;
+
+#define	VDEV_RAIDZ_P		0
+#define	VDEV_RAIDZ_Q		1
+#define	VDEV_RAIDZ_R		2
+
+/*
+ * RAID-Z math implementations.  rmo_gen[n - 1] computes the first n
+ * parity columns of a map from its data columns, treating short columns
+ * as zero padded; n may be less than rm_firstdatacol.
+ *
+ * rmo_mul_add multiplies size bytes of src by the field element c and
+ * stores the product in dst, or adds it to dst if add is set.  All of the
+ * reconstruction paths are expressed in terms of it.
+ *
+ * Vectorized implementations process whole vectors and rely on all
+ * column sizes being a multiple of the (512 byte) minimum sector size.
+ */
+typedef void raidz_gen_func_t(raidz_map_t *rm);
+typedef void raidz_mul_func_t(void *dst, const void *src, uint64_t size,
+    uint8_t c, boolean_t add);
+
+typedef struct raidz_math_ops {
+	raidz_gen_func_t	*rmo_gen[VDEV_RAIDZ_MAXPARITY];
+	raidz_mul_func_t	*rmo_mul_add;
+	boolean_t		(*rmo_valid)(void);
+	const char		*rmo_name;
+} raidz_math_ops_t;
+
+extern const raidz_math_ops_t vdev_raidz_scalar_ops;
+#if defined(HAVE_SIMD_X86)
+extern const raidz_math_ops_t vdev_raidz_sse2_ops;
+extern const raidz_math_ops_t vdev_raidz_ssse3_ops;
+extern const raidz_math_ops_t vdev_raidz_avx2_ops;
+#endif
+
+/* Scalar reference routines, vdev_raidz.c */
+extern raidz_gen_func_t vdev_raidz_generate_parity_p;
+extern raidz_gen_func_t vdev_raidz_generate_parity_pq;
+extern raidz_gen_func_t vdev_raidz_generate_parity_pqr;
+extern raidz_mul_func_t vdev_raidz_mul_add;
+extern uint8_t vdev_raidz_gf_mul(uint8_t a, uint8_t b);
+extern int vdev_raidz_reconstruct(raidz_map_t *rm, int *t, int nt);
+
+/* vdev_raidz_math.c */
+extern void vdev_raidz_math_init(void);
+extern void vdev_raidz_math_fini(void);
+extern void vdev_raidz_math_generate(raidz_map_t *rm, int nparity);
+extern void vdev_raidz_math_mul_add(void *dst, const void *src,
+    uint64_t size, uint8_t c, boolean_t add);
+extern raidz_map_t *vdev_raidz_math_map_alloc(uint64_t dcols,
+    uint64_t nparity, uint64_t sectors, uint64_t *seed);
+extern void vdev_raidz_math_map_free(raidz_map_t *rm);
+extern int vdev_raidz_impl_set(const char *name);
+extern const char *vdev_raidz_impl_get(void);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _SYS_VDEV_RAIDZ_H */
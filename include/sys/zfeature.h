@@ -40,6 +40,7 @@ struct objset;
 extern boolean_t feature_is_supported(struct objset *os, uint64_t obj,
     uint64_t desc_obj, nvlist_t *unsup_feat, nvlist_t *enabled_feat);
 
+extern int spa_feature_load_refcounts(struct spa *);
 extern void spa_feature_create_zap_objects(struct spa *, struct dmu_tx *);
 extern void spa_feature_enable(struct spa *, zfeature_info_t *,
     struct dmu_tx *);
@@ -99,6 +99,8 @@ typedef enum drr_headertype {
 
     /* Unsure what Oracle called this bit */
 #define	DMU_BACKUP_FEATURE_SPILLBLOCKS	(0x20)
+/* flags #6 through #18 are reserved for other implementations */
+#define	DMU_BACKUP_FEATURE_LARGE_BLOCKS	(1<<19)
     /*
 NOTE 3:  Fix to 7097870 (spill block can be dropped in some situations during
          incremental receive) introduces backward incompatibility with zfs
@@ -118,7 +120,8 @@ NOTE 3:  Fix to 7097870 (spill block can be dropped in some situations during
  * Mask of all supported backup features
  */
 #define	DMU_BACKUP_FEATURE_MASK	(DMU_BACKUP_FEATURE_DEDUP | \
-		DMU_BACKUP_FEATURE_DEDUPPROPS | DMU_BACKUP_FEATURE_SA_SPILL)
+		DMU_BACKUP_FEATURE_DEDUPPROPS | DMU_BACKUP_FEATURE_SA_SPILL | \
+		DMU_BACKUP_FEATURE_LARGE_BLOCKS)
 
 /* Are all features in the given flag word currently supported? */
 #define	DMU_STREAM_SUPPORTED(x)	(!((x) & ~DMU_BACKUP_FEATURE_MASK))
@@ -368,6 +371,7 @@ typedef struct zfs_cmd {
 	uint64_t	zc_sendobj;
 	uint64_t	zc_fromobj;
 	uint64_t	zc_createtxg;
+	uint64_t	zc_flags;
 	zfs_stat_t	zc_stat;
     int             zc_ioc_error; /* ioctl error value */
     uint64_t        zc_dev;      /* OSX doesn't have ddi_driver_major*/
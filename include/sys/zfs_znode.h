@@ -143,7 +143,7 @@ extern "C" {
 #define	ZFS_SHARES_DIR		"SHARES"
 #define	ZFS_SA_ATTRS		"SA_ATTRS"
 
-#define	ZFS_MAX_BLOCKSIZE	(SPA_MAXBLOCKSIZE)
+#define	ZFS_MAX_BLOCKSIZE	(SPA_OLD_MAXBLOCKSIZE)
 
 /*
  * Path component length
@@ -37,6 +37,8 @@
 extern "C" {
 #endif
 
+struct lwb;
+
 /*
  * Intent log format:
  *
@@ -90,7 +92,7 @@ typedef struct zil_chain {
 } zil_chain_t;
 
 #define	ZIL_MIN_BLKSZ	4096ULL
-#define	ZIL_MAX_BLKSZ	SPA_MAXBLOCKSIZE
+#define	ZIL_MAX_BLKSZ	SPA_OLD_MAXBLOCKSIZE
 
 /*
  * The words of a log block checksum.
@@ -387,8 +389,9 @@ typedef struct zil_stats {
 
 	/*
 	 * Number of times the ZIL has been flushed to stable storage.
-	 * This is less than zil_commit_count when commits are "merged"
-	 * (see the documentation above zil_commit()).
+	 * This is less than zil_commit_count when a commit finds its
+	 * records already issued by an earlier one, and only has to wait
+	 * for them (see the documentation above zil_commit()).
 	 */
 	kstat_named_t zil_commit_writer_count;
 
@@ -440,7 +443,8 @@ typedef int zil_parse_blk_func_t(zilog_t *zilog, blkptr_t *bp, void *arg,
 typedef int zil_parse_lr_func_t(zilog_t *zilog, lr_t *lr, void *arg,
     uint64_t txg);
 typedef int (*zil_replay_func_t)(void *, char *, boolean_t);
-typedef int zil_get_data_t(void *arg, lr_write_t *lr, char *dbuf, zio_t *zio);
+typedef int zil_get_data_t(void *arg, lr_write_t *lr, char *dbuf,
+    struct lwb *lwb, zio_t *zio);
 
 extern int zil_parse(zilog_t *zilog, zil_parse_blk_func_t *parse_blk_func,
     zil_parse_lr_func_t *parse_lr_func, void *arg, uint64_t txg);
@@ -476,7 +480,7 @@ extern void	zil_clean(zilog_t *zilog, uint64_t synced_txg);
 extern int	zil_suspend(const char *osname, void **cookiep);
 extern void	zil_resume(void *cookie);
 
-extern void	zil_add_block(zilog_t *zilog, const blkptr_t *bp);
+extern void	zil_lwb_add_block(struct lwb *lwb, const blkptr_t *bp);
 extern int	zil_bp_tree_add(zilog_t *zilog, const blkptr_t *bp);
 
 extern void	zil_set_sync(zilog_t *zilog, uint64_t syncval);
@@ -35,6 +35,20 @@
 extern "C" {
 #endif
 
+/*
+ * Log write buffer states.  An lwb is filled with log records while it is
+ * OPENED, its write is in flight once it is ISSUED, and it is DONE when
+ * the write and the flushes of the vdevs it touched have completed.
+ * Any number of lwbs may be ISSUED at once, but each lwb's root zio
+ * waits for that of the lwb issued before it, so they become DONE in
+ * the order they were issued.
+ */
+typedef enum {
+	LWB_STATE_OPENED,
+	LWB_STATE_ISSUED,
+	LWB_STATE_DONE
+} lwb_state_t;
+
 /*
  * Log write buffer.
  */
@@ -42,15 +56,33 @@ typedef struct lwb {
 	zilog_t		*lwb_zilog;	/* back pointer to log struct */
 	blkptr_t	lwb_blk;	/* on disk address of this log blk */
 	boolean_t	lwb_fastwrite;	/* is blk marked for fastwrite? */
+	lwb_state_t	lwb_state;	/* protected by zl_lock */
 	int		lwb_nused;	/* # used bytes in buffer */
 	int		lwb_sz;		/* size of block and buffer */
 	char		*lwb_buf;	/* log write buffer */
 	zio_t		*lwb_zio;	/* zio for this buffer */
+	zio_t		*lwb_root_zio;	/* parent of lwb_zio and its flushes */
 	dmu_tx_t	*lwb_tx;	/* tx for log block allocation */
 	uint64_t	lwb_max_txg;	/* highest txg in this lwb */
 	list_node_t	lwb_node;	/* zilog->zl_lwb_list linkage */
+	list_t		lwb_itxs;	/* itxs to free once DONE */
+	list_t		lwb_waiters;	/* zil_commit() callers to wake */
+	kmutex_t	lwb_vdev_lock;	/* protects lwb_vdev_tree */
+	avl_tree_t	lwb_vdev_tree;	/* vdevs to flush after lwb write */
 } lwb_t;
 
+/*
+ * A zil_commit() caller sleeps on one of these until the last lwb issued
+ * when its records had all been written out is DONE.
+ */
+typedef struct zil_commit_waiter {
+	kcondvar_t	zcw_cv;		/* signalled when zcw_done is set */
+	list_node_t	zcw_node;	/* lwb->lwb_waiters linkage */
+	boolean_t	zcw_done;	/* protected by zl_lock */
+	int		zcw_error;	/* error of the lwb waited for */
+	uint64_t	zcw_lr_seq;	/* highest lr seq waited for */
+} zil_commit_waiter_t;
+
 /*
  * Intent log transaction lists
  */
@@ -74,8 +106,9 @@ typedef struct itx_async_node {
 } itx_async_node_t;
 
 /*
- * Vdev flushing: during a zil_commit(), we build up an AVL tree of the vdevs
- * we've touched so we know which ones need a write cache flush at the end.
+ * Vdev flushing: each lwb builds up an AVL tree of the vdevs its block and
+ * any dmu_sync()ed data it points to were written to, so we know which
+ * ones need a write cache flush once the lwb has been written.
  */
 typedef struct zil_vdev_node {
 	uint64_t	zv_vdev;	/* vdev to be flushed */
@@ -94,20 +127,20 @@ struct zilog {
 	const zil_header_t *zl_header;	/* log header buffer */
 	objset_t	*zl_os;		/* object set we're logging */
 	zil_get_data_t	*zl_get_data;	/* callback to get object content */
-	zio_t		*zl_root_zio;	/* log writer root zio */
+	kmutex_t	zl_issuer_lock;	/* single lwb filler and issuer */
+	lwb_t		*zl_last_lwb_issued; /* most recently issued lwb */
+	uint64_t	zl_lwb_error_txg; /* alloc txg of last failed lwb */
 	uint64_t	zl_lr_seq;	/* on-disk log record sequence number */
 	uint64_t	zl_commit_lr_seq; /* last committed on-disk lr seq */
 	uint64_t	zl_destroy_txg;	/* txg of last zil_destroy() */
 	uint64_t	zl_replayed_seq[TXG_SIZE]; /* last replayed rec seq */
 	uint64_t	zl_replaying_seq; /* current replay seq number */
 	uint32_t	zl_suspend;	/* log suspend count */
-	kcondvar_t	zl_cv_writer;	/* log writer thread completion */
 	kcondvar_t	zl_cv_suspend;	/* log suspend completion */
 	uint8_t		zl_suspending;	/* log is currently suspending */
 	uint8_t		zl_keep_first;	/* keep first log block in destroy */
 	uint8_t		zl_replay;	/* replaying records while set */
 	uint8_t		zl_stop_sync;	/* for debugging */
-	uint8_t		zl_writer;	/* boolean: write setup in progress */
 	uint8_t		zl_logbias;	/* latency or throughput */
 	uint8_t		zl_sync;	/* synchronous or asynchronous */
 	int		zl_parse_error;	/* last zil_parse() error */
@@ -115,16 +148,11 @@ struct zilog {
 	uint64_t	zl_parse_lr_seq; /* highest lr seq on last parse */
 	uint64_t	zl_parse_blk_count; /* number of blocks parsed */
 	uint64_t	zl_parse_lr_count; /* number of log records parsed */
-	uint64_t	zl_next_batch;	/* next batch number */
-	uint64_t	zl_com_batch;	/* committed batch number */
-	kcondvar_t	zl_cv_batch[2];	/* batch condition variables */
 	itxg_t		zl_itxg[TXG_SIZE]; /* intent log txg chains */
 	list_t		zl_itx_commit_list; /* itx list to be committed */
 	uint64_t	zl_itx_list_sz;	/* total size of records on list */
 	uint64_t	zl_cur_used;	/* current commit log size used */
 	list_t		zl_lwb_list;	/* in-flight log write list */
-	kmutex_t	zl_vdev_lock;	/* protects zl_vdev_tree */
-	avl_tree_t	zl_vdev_tree;	/* vdevs to flush in zil_commit() */
 	taskq_t		*zl_clean_taskq; /* runs lwb and itx clean tasks */
 	avl_tree_t	zl_bp_tree;	/* track bps during log parse */
 	clock_t		zl_replay_time;	/* lbolt of when replay started */
@@ -140,7 +168,7 @@ typedef struct zil_bp_node {
 	avl_node_t	zn_node;
 } zil_bp_node_t;
 
-#define	ZIL_MAX_LOG_DATA (SPA_MAXBLOCKSIZE - sizeof (zil_chain_t) - \
+#define	ZIL_MAX_LOG_DATA (SPA_OLD_MAXBLOCKSIZE - sizeof (zil_chain_t) - \
                           sizeof (lr_write_t))
 
 #ifdef	__cplusplus
@@ -26,6 +26,7 @@
 #define	_SYS_ZIO_CHECKSUM_H
 
 #include <sys/zio.h>
+#include "zfeature_common.h"
 
 #ifdef	__cplusplus
 extern "C" {
@@ -35,6 +36,8 @@ extern "C" {
  * Signature for checksum functions.
  */
 typedef void zio_checksum_t(const void *data, uint64_t size, zio_cksum_t *zcp);
+typedef void zio_checksum_salted_t(const void *data, uint64_t size,
+    const zio_cksum_salt_t *salt, zio_cksum_t *zcp);
 
 /*
  * Information about each checksum function.
@@ -45,6 +48,7 @@ typedef const struct zio_checksum_info {
 	int		ci_eck;		/* uses zio embedded checksum? */
 	int		ci_dedup;	/* strong enough for dedup? */
 	char		*ci_name;	/* descriptive name */
+	zio_checksum_salted_t *ci_salted_func[2]; /* keyed with pool salt */
 } zio_checksum_info_t;
 
 typedef struct zio_bad_cksum {
@@ -62,11 +66,18 @@ extern zio_checksum_info_t zio_checksum_table[ZIO_CHECKSUM_FUNCTIONS];
  * Checksum routines.
  */
 extern zio_checksum_t zio_checksum_SHA256;
+extern void zio_checksum_SHA256_multi(const void **data, const uint64_t *size,
+    zio_cksum_t *zcp, int n);
+extern zio_checksum_t zio_checksum_SHA512_native;
+extern zio_checksum_t zio_checksum_SHA512_byteswap;
+extern zio_checksum_salted_t zio_checksum_skein_native;
+extern zio_checksum_salted_t zio_checksum_skein_byteswap;
 
 extern void zio_checksum_compute(zio_t *zio, enum zio_checksum checksum,
     void *data, uint64_t size);
 extern int zio_checksum_error(zio_t *zio, zio_bad_cksum_t *out);
 extern enum zio_checksum spa_dedup_checksum(spa_t *spa);
+extern spa_feature_t zio_checksum_to_feature(enum zio_checksum cksum);
 
 #ifdef	__cplusplus
 }
@@ -58,6 +58,12 @@ extern zio_compress_info_t zio_compress_table[ZIO_COMPRESS_FUNCTIONS];
 extern void lz4_init(void);
 extern void lz4_fini(void);
 
+/*
+ * gzip workspace init & free
+ */
+extern void gzip_init(void);
+extern void gzip_fini(void);
+
 /*
  * Compression routines.
  */
@@ -86,6 +92,12 @@ extern size_t zio_compress_data(enum zio_compress c, void *src, void *dst,
 extern int zio_decompress_data(enum zio_compress c, void *src, void *dst,
     size_t s_len, size_t d_len);
 
+/*
+ * Early abort statistics.
+ */
+extern void zio_compress_init(void);
+extern void zio_compress_fini(void);
+
 #ifdef	__cplusplus
 }
 #endif
@@ -43,6 +43,7 @@ typedef struct zfeature_info {
 	const char *fi_desc;	/* Feature description */
 	boolean_t fi_can_readonly; /* Can open pool readonly w/o support? */
 	boolean_t fi_mos;	/* Is the feature necessary to read the MOS? */
+	boolean_t fi_activate_on_enable; /* Active as soon as enabled? */
 	struct zfeature_info **fi_depends; /* array; null terminated */
 } zfeature_info_t;
 
@@ -51,9 +52,14 @@ typedef int (zfeature_func_t)(zfeature_info_t *fi, void *arg);
 #define	ZFS_FEATURE_DEBUG
 
 typedef enum spa_feature {
+	SPA_FEATURE_NONE = -1,
 	SPA_FEATURE_ASYNC_DESTROY,
 	SPA_FEATURE_EMPTY_BPOBJ,
 	SPA_FEATURE_LZ4_COMPRESS,
+	SPA_FEATURE_SHA512,
+	SPA_FEATURE_SKEIN,
+	SPA_FEATURE_LARGE_BLOCKS,
+	SPA_FEATURE_EMBEDDED_DATA,
 	SPA_FEATURES
 } spa_feature_t;
 
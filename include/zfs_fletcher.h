@@ -28,6 +28,7 @@
 
 #include <sys/types.h>
 #include <sys/spa.h>
+#include <sys/simd.h>
 
 #ifdef	__cplusplus
 extern "C" {
@@ -45,6 +46,45 @@ void fletcher_4_incremental_native(const void *, uint64_t,
     zio_cksum_t *);
 void fletcher_4_incremental_byteswap(const void *, uint64_t,
     zio_cksum_t *);
+void fletcher_4_init(void);
+void fletcher_4_fini(void);
+int fletcher_4_impl_set(const char *);
+const char *fletcher_4_impl_get(void);
+
+/*
+ * fletcher-4 implementations
+ *
+ * Every implementation computes the checksum of a buffer starting from a
+ * zero state.  fo_blksz is the granularity the implementation works in;
+ * callers only hand it whole multiples of it and finish any remainder
+ * with the scalar code.  Vectorized implementations interleave the input
+ * over several independent lanes and fold the lanes back together with
+ * fletcher_4_fold_lanes().
+ */
+typedef struct fletcher_4_ops {
+	void		(*fo_native)(const void *, uint64_t, zio_cksum_t *);
+	void		(*fo_byteswap)(const void *, uint64_t, zio_cksum_t *);
+	boolean_t	(*fo_valid)(void);
+	uint64_t	fo_blksz;
+	const char	*fo_name;
+} fletcher_4_ops_t;
+
+/*
+ * Largest piece of the input a vectorized implementation checksums in one
+ * kfpu section.  Bigger buffers are done a piece at a time, with the lane
+ * accumulators carried from one piece to the next.
+ */
+#define	FLETCHER_4_KFPU_SIZE	SPA_OLD_MAXBLOCKSIZE
+
+extern const fletcher_4_ops_t fletcher_4_scalar_ops;
+#if defined(HAVE_SIMD_X86)
+extern const fletcher_4_ops_t fletcher_4_sse2_ops;
+extern const fletcher_4_ops_t fletcher_4_ssse3_ops;
+extern const fletcher_4_ops_t fletcher_4_avx2_ops;
+#endif
+
+void fletcher_4_fold_lanes(int, const uint64_t *, const uint64_t *,
+    const uint64_t *, const uint64_t *, zio_cksum_t *);
 
 #ifdef	__cplusplus
 }
@@ -117,6 +117,7 @@ typedef struct zpios_cmd {
 	uint32_t cmd_region_noise;	/* Region noise */
 	uint32_t cmd_chunk_noise;	/* Chunk noise */
 	uint32_t cmd_thread_delay;	/* Thread delay */
+	uint32_t cmd_queue_depth;	/* Reads in flight per thread */
 	uint32_t cmd_flags;		/* Test flags */
 	char cmd_pre[ZPIOS_PATH_SIZE];	/* Pre-exec hook */
 	char cmd_post[ZPIOS_PATH_SIZE];	/* Post-exec hook */
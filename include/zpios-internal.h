@@ -52,6 +52,8 @@ typedef struct thread_data {
 	int rc;
 	zpios_stats_t stats;
 	kmutex_t lock;
+	kcondvar_t rd_cv;
+	int rd_inflight;
 } thread_data_t;
 
 /* region for IO data */
@@ -78,6 +80,7 @@ typedef struct run_args {
 	__u32 region_noise;
 	__u32 chunk_noise;
 	__u32 thread_delay;
+	__u32 queue_depth;
 	__u32 flags;
 	char pre[ZPIOS_PATH_SIZE];
 	char post[ZPIOS_PATH_SIZE];
@@ -452,9 +452,15 @@ lzc_get_holds(const char *snapname, nvlist_t **holdsp)
 
 /*
  * If fromsnap is NULL, a full (non-incremental) stream will be sent.
+ *
+ * If LZC_SEND_FLAG_LARGE_BLOCK is set, the stream is permitted to contain
+ * DRR_WRITE records with drr_length > SPA_OLD_MAXBLOCKSIZE, and DRR_OBJECT
+ * records with drr_blksz > SPA_OLD_MAXBLOCKSIZE.  The receiving system must
+ * have the large_blocks feature enabled.
  */
 int
-lzc_send(const char *snapname, const char *fromsnap, int fd)
+lzc_send(const char *snapname, const char *fromsnap, int fd,
+    enum lzc_send_flags flags)
 {
 	nvlist_t *args;
 	int err;
@@ -463,6 +469,8 @@ lzc_send(const char *snapname, const char *fromsnap, int fd)
 	fnvlist_add_int32(args, "fd", fd);
 	if (fromsnap != NULL)
 		fnvlist_add_string(args, "fromsnap", fromsnap);
+	if (flags & LZC_SEND_FLAG_LARGE_BLOCK)
+		fnvlist_add_boolean(args, "largeblockok");
 	err = lzc_ioctl(ZFS_IOC_SEND_NEW, snapname, args, NULL);
 	nvlist_free(args);
 	return (err);
@@ -130,6 +130,28 @@
 #include <sys/byteorder.h>
 #include <sys/zio.h>
 #include <sys/spa.h>
+#include <sys/simd.h>
+#include <zfs_fletcher.h>
+
+#if defined(HAVE_SIMD_X86) && defined(_KERNEL)
+/*
+ * The vector state kfpu_begin() saves.  fletcher-4 is the lowest level
+ * user of the vector code, so it lives here; kfpu_init() must run before
+ * any implementation other than the scalar one is selected.
+ */
+kfpu_mode_t kfpu_mode = KFPU_XMM;
+
+void
+kfpu_init(void)
+{
+	if (!zfs_avx_available())
+		kfpu_mode = KFPU_XMM;
+	else if ((zfs_xgetbv(0) & XCR0_AVX512) == XCR0_AVX512)
+		kfpu_mode = KFPU_ZMM;
+	else
+		kfpu_mode = KFPU_YMM;
+}
+#endif
 
 void
 fletcher_2_native(const void *buf, uint64_t size, zio_cksum_t *zcp)
@@ -165,8 +187,8 @@ fletcher_2_byteswap(const void *buf, uint64_t size, zio_cksum_t *zcp)
 	ZIO_SET_CHECKSUM(zcp, a0, a1, b0, b1);
 }
 
-void
-fletcher_4_native(const void *buf, uint64_t size, zio_cksum_t *zcp)
+static void
+fletcher_4_scalar_native(const void *buf, uint64_t size, zio_cksum_t *zcp)
 {
 	const uint32_t *ip = buf;
 	const uint32_t *ipend = ip + (size / sizeof (uint32_t));
@@ -182,8 +204,8 @@ fletcher_4_native(const void *buf, uint64_t size, zio_cksum_t *zcp)
 	ZIO_SET_CHECKSUM(zcp, a, b, c, d);
 }
 
-void
-fletcher_4_byteswap(const void *buf, uint64_t size, zio_cksum_t *zcp)
+static void
+fletcher_4_scalar_byteswap(const void *buf, uint64_t size, zio_cksum_t *zcp)
 {
 	const uint32_t *ip = buf;
 	const uint32_t *ipend = ip + (size / sizeof (uint32_t));
@@ -199,8 +221,8 @@ fletcher_4_byteswap(const void *buf, uint64_t size, zio_cksum_t *zcp)
 	ZIO_SET_CHECKSUM(zcp, a, b, c, d);
 }
 
-void
-fletcher_4_incremental_native(const void *buf, uint64_t size,
+static void
+fletcher_4_scalar_incremental_native(const void *buf, uint64_t size,
     zio_cksum_t *zcp)
 {
 	const uint32_t *ip = buf;
@@ -222,8 +244,8 @@ fletcher_4_incremental_native(const void *buf, uint64_t size,
 	ZIO_SET_CHECKSUM(zcp, a, b, c, d);
 }
 
-void
-fletcher_4_incremental_byteswap(const void *buf, uint64_t size,
+static void
+fletcher_4_scalar_incremental_byteswap(const void *buf, uint64_t size,
     zio_cksum_t *zcp)
 {
 	const uint32_t *ip = buf;
@@ -245,6 +267,316 @@ fletcher_4_incremental_byteswap(const void *buf, uint64_t size,
 	ZIO_SET_CHECKSUM(zcp, a, b, c, d);
 }
 
+static boolean_t
+fletcher_4_scalar_valid(void)
+{
+	return (B_TRUE);
+}
+
+const fletcher_4_ops_t fletcher_4_scalar_ops = {
+	.fo_native = fletcher_4_scalar_native,
+	.fo_byteswap = fletcher_4_scalar_byteswap,
+	.fo_valid = fletcher_4_scalar_valid,
+	.fo_blksz = sizeof (uint32_t),
+	.fo_name = "scalar"
+};
+
+/*
+ * Implementations in order of preference.  fletcher_4_init() picks the
+ * first one that is supported by the CPU and passes the self-test.
+ */
+static const fletcher_4_ops_t *fletcher_4_impls[] = {
+#if defined(HAVE_SIMD_X86)
+	&fletcher_4_avx2_ops,
+	&fletcher_4_ssse3_ops,
+	&fletcher_4_sse2_ops,
+#endif
+	&fletcher_4_scalar_ops,
+};
+
+#define	FLETCHER_4_IMPLS \
+	(sizeof (fletcher_4_impls) / sizeof (fletcher_4_impls[0]))
+
+/*
+ * Until fletcher_4_init() has run (and in consumers such as libzfs which
+ * never call it) everything goes through the scalar code.
+ */
+static const fletcher_4_ops_t *fletcher_4_impl = &fletcher_4_scalar_ops;
+static boolean_t fletcher_4_impl_ok[FLETCHER_4_IMPLS];
+
+/*
+ * Below this size the setup cost of the vector code and the combine step
+ * of the incremental variants outweigh the gain.
+ */
+#define	FLETCHER_4_INCREMENTAL_MIN	256
+
+/*
+ * Fold the per-lane accumulators of a k-way interleaved computation into
+ * the fletcher-4 checksum of the whole buffer.  Lane j sums the words at
+ * positions j, j + k, j + 2k, ...  Writing the distance of a word from
+ * the end of the buffer as k * t - j, where t is its distance from the
+ * end within its lane, the weight of each word in b, c and d is a
+ * polynomial in t that can be expanded over the lane's own weights
+ * (1, t, t(t+1)/2, t(t+1)(t+2)/6), giving integer coefficients:
+ *
+ *	A = sum(a_j)
+ *	B = sum(k b_j - j a_j)
+ *	C = sum(k^2 c_j - k(k+2j-1)/2 b_j + j(j-1)/2 a_j)
+ *	D = sum(k^3 d_j - k^2(k+j-1) c_j +
+ *	    k(3j^2 + 3(k-2)j + (k-1)(k-2))/6 b_j - j(j-1)(j-2)/6 a_j)
+ *
+ * All arithmetic is mod 2^64, same as the scalar recurrence.
+ */
+void
+fletcher_4_fold_lanes(int lanes, const uint64_t *a, const uint64_t *b,
+    const uint64_t *c, const uint64_t *d, zio_cksum_t *zcp)
+{
+	uint64_t k = lanes;
+	uint64_t k2 = k * k;
+	uint64_t k3 = k2 * k;
+	uint64_t A = 0, B = 0, C = 0, D = 0;
+	uint64_t j;
+
+	ASSERT3U(k, >=, 2);
+
+	for (j = 0; j < k; j++) {
+		A += a[j];
+		B += k * b[j] - j * a[j];
+		C += k2 * c[j] - (k * (k + 2 * j - 1) / 2) * b[j] +
+		    (j * (j - 1) / 2) * a[j];
+		D += k3 * d[j] - k2 * (k + j - 1) * c[j] +
+		    (k * (3 * j * j + 3 * (k - 2) * j + (k - 1) * (k - 2)) / 6) *
+		    b[j] - (j * (j - 1) * (j - 2) / 6) * a[j];
+	}
+
+	ZIO_SET_CHECKSUM(zcp, A, B, C, D);
+}
+
+/*
+ * Append the checksum nzc of a size byte buffer, computed from a zero
+ * state, to the running checksum zcp.  Over n words the initial state
+ * (A, B, C, D) contributes:
+ *
+ *	a: A
+ *	b: B + n A
+ *	c: C + n B + n(n+1)/2 A
+ *	d: D + n C + n(n+1)/2 B + n(n+1)(n+2)/6 A
+ */
+static void
+fletcher_4_combine(zio_cksum_t *zcp, const zio_cksum_t *nzc, uint64_t size)
+{
+	uint64_t n = size / sizeof (uint32_t);
+	uint64_t f[3] = { n, n + 1, n + 2 };
+	uint64_t n2, n3;
+	uint64_t a, b, c, d;
+	int i;
+
+	/*
+	 * Compute the binomials exactly mod 2^64 by dividing one of the
+	 * factors rather than the (possibly overflowed) product.
+	 */
+	n2 = (n % 2 == 0) ? (n / 2) * (n + 1) : n * ((n + 1) / 2);
+	for (i = 0; i < 3; i++) {
+		if (f[i] % 3 == 0) {
+			f[i] /= 3;
+			break;
+		}
+	}
+	for (i = 0; i < 3; i++) {
+		if (f[i] % 2 == 0) {
+			f[i] /= 2;
+			break;
+		}
+	}
+	n3 = f[0] * f[1] * f[2];
+
+	a = zcp->zc_word[0];
+	b = zcp->zc_word[1];
+	c = zcp->zc_word[2];
+	d = zcp->zc_word[3];
+
+	ZIO_SET_CHECKSUM(zcp,
+	    a + nzc->zc_word[0],
+	    b + n * a + nzc->zc_word[1],
+	    c + n * b + n2 * a + nzc->zc_word[2],
+	    d + n * c + n2 * b + n3 * a + nzc->zc_word[3]);
+}
+
+static inline void
+fletcher_4_compute(const fletcher_4_ops_t *ops, boolean_t byteswap,
+    const void *buf, uint64_t size, zio_cksum_t *zcp)
+{
+	uint64_t bulk = P2ALIGN(size, ops->fo_blksz);
+
+	if (byteswap) {
+		ops->fo_byteswap(buf, bulk, zcp);
+		if (bulk < size)
+			fletcher_4_scalar_incremental_byteswap(
+			    (const char *)buf + bulk, size - bulk, zcp);
+	} else {
+		ops->fo_native(buf, bulk, zcp);
+		if (bulk < size)
+			fletcher_4_scalar_incremental_native(
+			    (const char *)buf + bulk, size - bulk, zcp);
+	}
+}
+
+static void
+fletcher_4_incremental(const fletcher_4_ops_t *ops, boolean_t byteswap,
+    const void *buf, uint64_t size, zio_cksum_t *zcp)
+{
+	zio_cksum_t nzc;
+
+	if (ops == &fletcher_4_scalar_ops ||
+	    size < FLETCHER_4_INCREMENTAL_MIN) {
+		if (byteswap)
+			fletcher_4_scalar_incremental_byteswap(buf, size, zcp);
+		else
+			fletcher_4_scalar_incremental_native(buf, size, zcp);
+		return;
+	}
+
+	fletcher_4_compute(ops, byteswap, buf, size, &nzc);
+	fletcher_4_combine(zcp, &nzc, size);
+}
+
+void
+fletcher_4_native(const void *buf, uint64_t size, zio_cksum_t *zcp)
+{
+	fletcher_4_compute(fletcher_4_impl, B_FALSE, buf, size, zcp);
+}
+
+void
+fletcher_4_byteswap(const void *buf, uint64_t size, zio_cksum_t *zcp)
+{
+	fletcher_4_compute(fletcher_4_impl, B_TRUE, buf, size, zcp);
+}
+
+void
+fletcher_4_incremental_native(const void *buf, uint64_t size,
+    zio_cksum_t *zcp)
+{
+	fletcher_4_incremental(fletcher_4_impl, B_FALSE, buf, size, zcp);
+}
+
+void
+fletcher_4_incremental_byteswap(const void *buf, uint64_t size,
+    zio_cksum_t *zcp)
+{
+	fletcher_4_incremental(fletcher_4_impl, B_TRUE, buf, size, zcp);
+}
+
+/*
+ * Self-test of an implementation against the scalar reference.  Every
+ * word size from 0 to 1K is covered so that all combinations of bulk and
+ * remainder are exercised, followed by large sizes up to a full block.
+ * The test data includes runs of all-ones words so that the accumulators
+ * wrap as they would on real data.
+ */
+#define	FLETCHER_4_TEST_SIZE	SPA_OLD_MAXBLOCKSIZE
+
+static boolean_t
+fletcher_4_selftest(const fletcher_4_ops_t *ops, const void *buf)
+{
+	zio_cksum_t ref, zc;
+	uint64_t size, split;
+	int bswap;
+
+	for (size = 0; size <= FLETCHER_4_TEST_SIZE;
+	    size += (size < 1024) ? 4 : 4096 - 12) {
+		for (bswap = 0; bswap <= 1; bswap++) {
+			fletcher_4_compute(&fletcher_4_scalar_ops, bswap,
+			    buf, size, &ref);
+			fletcher_4_compute(ops, bswap, buf, size, &zc);
+			if (!ZIO_CHECKSUM_EQUAL(ref, zc))
+				return (B_FALSE);
+
+			split = P2ALIGN(size / 3, sizeof (uint32_t));
+			ZIO_SET_CHECKSUM(&ref, 1, 2, 3, 4);
+			ZIO_SET_CHECKSUM(&zc, 1, 2, 3, 4);
+			fletcher_4_incremental(&fletcher_4_scalar_ops, bswap,
+			    buf, split, &ref);
+			fletcher_4_incremental(&fletcher_4_scalar_ops, bswap,
+			    (const char *)buf + split, size - split, &ref);
+			fletcher_4_incremental(ops, bswap, buf, split, &zc);
+			fletcher_4_incremental(ops, bswap,
+			    (const char *)buf + split, size - split, &zc);
+			if (!ZIO_CHECKSUM_EQUAL(ref, zc))
+				return (B_FALSE);
+		}
+	}
+
+	return (B_TRUE);
+}
+
+void
+fletcher_4_init(void)
+{
+	uint32_t *buf;
+	uint64_t x = 0x5a5a5a5a5a5a5a5aULL;
+	int i;
+
+	buf = kmem_alloc(FLETCHER_4_TEST_SIZE, KM_SLEEP);
+	for (i = 0; i < FLETCHER_4_TEST_SIZE / sizeof (uint32_t); i++) {
+		x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+		buf[i] = (i % 64 < 8) ? 0xffffffff : (uint32_t)(x >> 32);
+	}
+
+	fletcher_4_impl = &fletcher_4_scalar_ops;
+	for (i = 0; i < FLETCHER_4_IMPLS; i++) {
+		const fletcher_4_ops_t *ops = fletcher_4_impls[i];
+
+		fletcher_4_impl_ok[i] = B_FALSE;
+		if (!ops->fo_valid())
+			continue;
+		if (ops != &fletcher_4_scalar_ops &&
+		    !fletcher_4_selftest(ops, buf)) {
+			cmn_err(CE_WARN, "fletcher_4: %s implementation "
+			    "failed self-test, disabled", ops->fo_name);
+			continue;
+		}
+		fletcher_4_impl_ok[i] = B_TRUE;
+		if (fletcher_4_impl == &fletcher_4_scalar_ops)
+			fletcher_4_impl = ops;
+	}
+
+	kmem_free(buf, FLETCHER_4_TEST_SIZE);
+}
+
+void
+fletcher_4_fini(void)
+{
+	fletcher_4_impl = &fletcher_4_scalar_ops;
+}
+
+/*
+ * Select an implementation by name.  Only implementations which passed
+ * the self-test in fletcher_4_init() can be selected.
+ */
+int
+fletcher_4_impl_set(const char *name)
+{
+	int i;
+
+	for (i = 0; i < FLETCHER_4_IMPLS; i++) {
+		if (strcmp(fletcher_4_impls[i]->fo_name, name) != 0)
+			continue;
+		if (!fletcher_4_impl_ok[i] &&
+		    fletcher_4_impls[i] != &fletcher_4_scalar_ops)
+			return (ENOTSUP);
+		fletcher_4_impl = fletcher_4_impls[i];
+		return (0);
+	}
+
+	return (EINVAL);
+}
+
+const char *
+fletcher_4_impl_get(void)
+{
+	return (fletcher_4_impl->fo_name);
+}
+
 #if defined(_KERNEL) && defined(HAVE_SPL)
 EXPORT_SYMBOL(fletcher_2_native);
 EXPORT_SYMBOL(fletcher_2_byteswap);
@@ -252,4 +584,8 @@ EXPORT_SYMBOL(fletcher_4_native);
 EXPORT_SYMBOL(fletcher_4_byteswap);
 EXPORT_SYMBOL(fletcher_4_incremental_native);
 EXPORT_SYMBOL(fletcher_4_incremental_byteswap);
+EXPORT_SYMBOL(fletcher_4_init);
+EXPORT_SYMBOL(fletcher_4_fini);
+EXPORT_SYMBOL(fletcher_4_impl_set);
+EXPORT_SYMBOL(fletcher_4_impl_get);
 #endif
@@ -0,0 +1,174 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * AVX2 fletcher-4.
+ *
+ * Same scheme as the SSE code in zfs_fletcher_sse.c, with four 64-bit
+ * lanes per register: each 32 byte load is split into its even and odd
+ * words, giving eight independent streams that are folded back together
+ * by fletcher_4_fold_lanes().  All sixteen accumulators and temporaries
+ * fit in the ymm register file.
+ */
+
+#include <sys/types.h>
+#include <sys/zio.h>
+#include <sys/spa.h>
+#include <sys/simd.h>
+#include <zfs_fletcher.h>
+
+#if defined(HAVE_SIMD_X86)
+
+typedef uint64_t v4du_t __attribute__((vector_size(32)));
+typedef uint64_t v4du_u_t __attribute__((vector_size(32), aligned(1),
+    may_alias));
+typedef char v32qi_t __attribute__((vector_size(32)));
+
+#define	FLETCHER_4_AVX2_LANES	8
+
+#define	FLETCHER_4_AVX2_LOOP(buf, size, a, b, c, d, LOAD)		\
+do {									\
+	const v4du_u_t *ip = (buf);					\
+	const v4du_u_t *ipend = ip + ((size) / sizeof (v4du_t));	\
+	const v4du_t lomask = { 0xffffffffULL, 0xffffffffULL,		\
+	    0xffffffffULL, 0xffffffffULL };				\
+	v4du_t alo, blo, clo, dlo, ahi, bhi, chi, dhi;			\
+	v4du_t x, lo, hi;						\
+	int i;								\
+									\
+	for (i = 0; i < 4; i++) {					\
+		alo[i] = a[2 * i];					\
+		ahi[i] = a[2 * i + 1];					\
+		blo[i] = b[2 * i];					\
+		bhi[i] = b[2 * i + 1];					\
+		clo[i] = c[2 * i];					\
+		chi[i] = c[2 * i + 1];					\
+		dlo[i] = d[2 * i];					\
+		dhi[i] = d[2 * i + 1];					\
+	}								\
+									\
+	for (; ip < ipend; ip++) {					\
+		x = *ip;						\
+		x = LOAD(x);						\
+		lo = x & lomask;					\
+		hi = x >> 32;						\
+									\
+		alo += lo;						\
+		blo += alo;						\
+		clo += blo;						\
+		dlo += clo;						\
+									\
+		ahi += hi;						\
+		bhi += ahi;						\
+		chi += bhi;						\
+		dhi += chi;						\
+	}								\
+									\
+	/* stream 2i is lane i of the even words, 2i + 1 of the odd */	\
+	for (i = 0; i < 4; i++) {					\
+		a[2 * i] = alo[i];					\
+		a[2 * i + 1] = ahi[i];					\
+		b[2 * i] = blo[i];					\
+		b[2 * i + 1] = bhi[i];					\
+		c[2 * i] = clo[i];					\
+		c[2 * i + 1] = chi[i];					\
+		d[2 * i] = dlo[i];					\
+		d[2 * i + 1] = dhi[i];					\
+	}								\
+} while (0)
+
+#define	FLETCHER_4_AVX2_NATIVE(x)	(x)
+
+#define	FLETCHER_4_AVX2_BSWAP(x)					\
+	((v4du_t)__builtin_ia32_pshufb256((v32qi_t)(x), shuf))
+
+static __attribute__((noinline, target("avx2"))) void
+fletcher_4_avx2_native_impl(const void *buf, uint64_t size, uint64_t *a,
+    uint64_t *b, uint64_t *c, uint64_t *d)
+{
+	FLETCHER_4_AVX2_LOOP(buf, size, a, b, c, d, FLETCHER_4_AVX2_NATIVE);
+}
+
+static __attribute__((noinline, target("avx2"))) void
+fletcher_4_avx2_byteswap_impl(const void *buf, uint64_t size, uint64_t *a,
+    uint64_t *b, uint64_t *c, uint64_t *d)
+{
+	/* pshufb shuffles within each 128-bit half */
+	const v32qi_t shuf = { 3, 2, 1, 0, 7, 6, 5, 4,
+	    11, 10, 9, 8, 15, 14, 13, 12,
+	    3, 2, 1, 0, 7, 6, 5, 4,
+	    11, 10, 9, 8, 15, 14, 13, 12 };
+
+	FLETCHER_4_AVX2_LOOP(buf, size, a, b, c, d, FLETCHER_4_AVX2_BSWAP);
+}
+
+typedef void fletcher_4_avx2_impl_t(const void *, uint64_t, uint64_t *,
+    uint64_t *, uint64_t *, uint64_t *);
+
+static inline void
+fletcher_4_avx2_compute(fletcher_4_avx2_impl_t *impl, const void *buf,
+    uint64_t size, zio_cksum_t *zcp)
+{
+	uint64_t a[FLETCHER_4_AVX2_LANES] = { 0 };
+	uint64_t b[FLETCHER_4_AVX2_LANES] = { 0 };
+	uint64_t c[FLETCHER_4_AVX2_LANES] = { 0 };
+	uint64_t d[FLETCHER_4_AVX2_LANES] = { 0 };
+	const char *p = buf;
+	uint64_t n;
+	kfpu_state_t kfpu;
+
+	for (; size > 0; p += n, size -= n) {
+		n = MIN(size, FLETCHER_4_KFPU_SIZE);
+		kfpu_begin(&kfpu);
+		impl(p, n, a, b, c, d);
+		kfpu_end(&kfpu);
+	}
+
+	fletcher_4_fold_lanes(FLETCHER_4_AVX2_LANES, a, b, c, d, zcp);
+}
+
+static void
+fletcher_4_avx2_native(const void *buf, uint64_t size, zio_cksum_t *zcp)
+{
+	fletcher_4_avx2_compute(fletcher_4_avx2_native_impl, buf, size, zcp);
+}
+
+static void
+fletcher_4_avx2_byteswap(const void *buf, uint64_t size, zio_cksum_t *zcp)
+{
+	fletcher_4_avx2_compute(fletcher_4_avx2_byteswap_impl, buf, size, zcp);
+}
+
+static boolean_t
+fletcher_4_avx2_valid(void)
+{
+	return (zfs_avx2_available());
+}
+
+const fletcher_4_ops_t fletcher_4_avx2_ops = {
+	.fo_native = fletcher_4_avx2_native,
+	.fo_byteswap = fletcher_4_avx2_byteswap,
+	.fo_valid = fletcher_4_avx2_valid,
+	.fo_blksz = sizeof (v4du_t),
+	.fo_name = "avx2"
+};
+
+#endif /* HAVE_SIMD_X86 */
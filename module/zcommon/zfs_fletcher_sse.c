@@ -0,0 +1,202 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * SSE2 and SSSE3 fletcher-4.
+ *
+ * Each 16 byte load holds four 32-bit words.  They are split into the
+ * even words (low halves of the two 64-bit lanes) and the odd words (high
+ * halves), and each group is run through the fletcher-4 recurrence with
+ * its own set of 64-bit accumulators.  This gives four independent
+ * streams where stream j sums words j, j + 4, j + 8, ... which are folded
+ * back together by fletcher_4_fold_lanes().
+ *
+ * The two variants differ only in how the byteswapped input is produced:
+ * SSE2 has to shift and mask, SSSE3 uses a single pshufb.
+ */
+
+#include <sys/types.h>
+#include <sys/zio.h>
+#include <sys/spa.h>
+#include <sys/simd.h>
+#include <zfs_fletcher.h>
+
+#if defined(HAVE_SIMD_X86)
+
+typedef uint64_t v2du_t __attribute__((vector_size(16)));
+typedef uint64_t v2du_u_t __attribute__((vector_size(16), aligned(1),
+    may_alias));
+typedef char v16qi_t __attribute__((vector_size(16)));
+
+#define	FLETCHER_4_SSE_LANES	4
+
+/*
+ * Body shared by all variants; LOAD(x) turns the raw 16 bytes into
+ * native-order words.  The accumulators are picked up from and left in
+ * a..d, so a buffer can be done in several calls.  It is a macro rather
+ * than an inline function because each instance has to be compiled for
+ * its own target.
+ */
+#define	FLETCHER_4_SSE_LOOP(buf, size, a, b, c, d, LOAD)		\
+do {									\
+	const v2du_u_t *ip = (buf);					\
+	const v2du_u_t *ipend = ip + ((size) / sizeof (v2du_t));	\
+	const v2du_t lomask = { 0xffffffffULL, 0xffffffffULL };		\
+	v2du_t alo = { a[0], a[2] }, blo = { b[0], b[2] };		\
+	v2du_t clo = { c[0], c[2] }, dlo = { d[0], d[2] };		\
+	v2du_t ahi = { a[1], a[3] }, bhi = { b[1], b[3] };		\
+	v2du_t chi = { c[1], c[3] }, dhi = { d[1], d[3] };		\
+	v2du_t x, lo, hi;						\
+									\
+	for (; ip < ipend; ip++) {					\
+		x = *ip;						\
+		x = LOAD(x);						\
+		lo = x & lomask;					\
+		hi = x >> 32;						\
+									\
+		alo += lo;						\
+		blo += alo;						\
+		clo += blo;						\
+		dlo += clo;						\
+									\
+		ahi += hi;						\
+		bhi += ahi;						\
+		chi += bhi;						\
+		dhi += chi;						\
+	}								\
+									\
+	/* stream 2i is lane i of the even words, 2i + 1 of the odd */	\
+	a[0] = alo[0]; a[1] = ahi[0]; a[2] = alo[1]; a[3] = ahi[1];	\
+	b[0] = blo[0]; b[1] = bhi[0]; b[2] = blo[1]; b[3] = bhi[1];	\
+	c[0] = clo[0]; c[1] = chi[0]; c[2] = clo[1]; c[3] = chi[1];	\
+	d[0] = dlo[0]; d[1] = dhi[0]; d[2] = dlo[1]; d[3] = dhi[1];	\
+} while (0)
+
+#define	FLETCHER_4_SSE_NATIVE(x)	(x)
+
+#define	FLETCHER_4_SSE_BSWAP_SHIFT(x)					\
+	((((x) & m0) << 24) | (((x) & m1) << 8) |			\
+	(((x) >> 8) & m1) | (((x) >> 24) & m0))
+
+#define	FLETCHER_4_SSE_BSWAP_SHUFFLE(x)					\
+	((v2du_t)__builtin_ia32_pshufb128((v16qi_t)(x), shuf))
+
+static __attribute__((noinline, target("sse2"))) void
+fletcher_4_sse2_native_impl(const void *buf, uint64_t size, uint64_t *a,
+    uint64_t *b, uint64_t *c, uint64_t *d)
+{
+	FLETCHER_4_SSE_LOOP(buf, size, a, b, c, d, FLETCHER_4_SSE_NATIVE);
+}
+
+static __attribute__((noinline, target("sse2"))) void
+fletcher_4_sse2_byteswap_impl(const void *buf, uint64_t size, uint64_t *a,
+    uint64_t *b, uint64_t *c, uint64_t *d)
+{
+	const v2du_t m0 = { 0x000000ff000000ffULL, 0x000000ff000000ffULL };
+	const v2du_t m1 = { 0x0000ff000000ff00ULL, 0x0000ff000000ff00ULL };
+
+	FLETCHER_4_SSE_LOOP(buf, size, a, b, c, d, FLETCHER_4_SSE_BSWAP_SHIFT);
+}
+
+static __attribute__((noinline, target("ssse3"))) void
+fletcher_4_ssse3_byteswap_impl(const void *buf, uint64_t size, uint64_t *a,
+    uint64_t *b, uint64_t *c, uint64_t *d)
+{
+	const v16qi_t shuf = { 3, 2, 1, 0, 7, 6, 5, 4,
+	    11, 10, 9, 8, 15, 14, 13, 12 };
+
+	FLETCHER_4_SSE_LOOP(buf, size, a, b, c, d,
+	    FLETCHER_4_SSE_BSWAP_SHUFFLE);
+}
+
+typedef void fletcher_4_sse_impl_t(const void *, uint64_t, uint64_t *,
+    uint64_t *, uint64_t *, uint64_t *);
+
+static inline void
+fletcher_4_sse_compute(fletcher_4_sse_impl_t *impl, const void *buf,
+    uint64_t size, zio_cksum_t *zcp)
+{
+	uint64_t a[FLETCHER_4_SSE_LANES] = { 0 };
+	uint64_t b[FLETCHER_4_SSE_LANES] = { 0 };
+	uint64_t c[FLETCHER_4_SSE_LANES] = { 0 };
+	uint64_t d[FLETCHER_4_SSE_LANES] = { 0 };
+	const char *p = buf;
+	uint64_t n;
+	kfpu_state_t kfpu;
+
+	for (; size > 0; p += n, size -= n) {
+		n = MIN(size, FLETCHER_4_KFPU_SIZE);
+		kfpu_begin(&kfpu);
+		impl(p, n, a, b, c, d);
+		kfpu_end(&kfpu);
+	}
+
+	fletcher_4_fold_lanes(FLETCHER_4_SSE_LANES, a, b, c, d, zcp);
+}
+
+static void
+fletcher_4_sse2_native(const void *buf, uint64_t size, zio_cksum_t *zcp)
+{
+	fletcher_4_sse_compute(fletcher_4_sse2_native_impl, buf, size, zcp);
+}
+
+static void
+fletcher_4_sse2_byteswap(const void *buf, uint64_t size, zio_cksum_t *zcp)
+{
+	fletcher_4_sse_compute(fletcher_4_sse2_byteswap_impl, buf, size, zcp);
+}
+
+static void
+fletcher_4_ssse3_byteswap(const void *buf, uint64_t size, zio_cksum_t *zcp)
+{
+	fletcher_4_sse_compute(fletcher_4_ssse3_byteswap_impl, buf, size, zcp);
+}
+
+static boolean_t
+fletcher_4_sse2_valid(void)
+{
+	return (zfs_sse2_available());
+}
+
+static boolean_t
+fletcher_4_ssse3_valid(void)
+{
+	return (zfs_ssse3_available());
+}
+
+const fletcher_4_ops_t fletcher_4_sse2_ops = {
+	.fo_native = fletcher_4_sse2_native,
+	.fo_byteswap = fletcher_4_sse2_byteswap,
+	.fo_valid = fletcher_4_sse2_valid,
+	.fo_blksz = sizeof (v2du_t),
+	.fo_name = "sse2"
+};
+
+/* The native loop needs nothing beyond SSE2. */
+const fletcher_4_ops_t fletcher_4_ssse3_ops = {
+	.fo_native = fletcher_4_sse2_native,
+	.fo_byteswap = fletcher_4_ssse3_byteswap,
+	.fo_valid = fletcher_4_ssse3_valid,
+	.fo_blksz = sizeof (v2du_t),
+	.fo_name = "ssse3"
+};
+
+#endif /* HAVE_SIMD_X86 */
@@ -92,11 +92,12 @@
  * buf_hash_remove() expects the appropriate hash mutex to be
  * already held before it is invoked.
  *
- * Each arc state also has a mutex which is used to protect the
- * buffer list associated with the state.  When attempting to
- * obtain a hash table lock while holding an arc list lock you
- * must use: mutex_tryenter() to avoid deadlock.  Also note that
- * the active state mutex must be held before the ghost state mutex.
+ * The buffer lists associated with each arc state are multilists,
+ * and each of their sublists has a mutex protecting it.  When
+ * attempting to obtain a hash table lock while holding an arc list
+ * lock you must use: mutex_tryenter() to avoid deadlock.  Also note
+ * that the active state sublist lock must be held before the ghost
+ * state sublist lock, and that one before the l2c_only one.
  *
  * Arc buffers may have an associated eviction callback function.
  * This function will be invoked prior to removing the buffer (e.g.
@@ -133,6 +134,7 @@
 #include <sys/zio_compress.h>
 #include <sys/zfs_context.h>
 #include <sys/arc.h>
+#include <sys/multilist.h>
 #include <sys/vdev.h>
 #include <sys/vdev_impl.h>
 #include <sys/dsl_pool.h>
@@ -157,6 +159,15 @@ static kmutex_t		arc_reclaim_thr_lock;
 static kcondvar_t	arc_reclaim_thr_cv;	/* used to signal reclaim thr */
 static uint8_t		arc_thread_exit;
 
+static kmutex_t		arc_evict_lock;
+static kcondvar_t	arc_evict_cv;		/* used to signal evict thr */
+static kcondvar_t	arc_evict_waiters_cv;	/* evict thr made a pass */
+static boolean_t	arc_evict_running;
+static uint8_t		arc_evict_thread_exit;
+
+static taskq_t		*arc_hash_taskq;	/* grows the hash table */
+static boolean_t	arc_hash_growing;	/* under arc_evict_lock */
+
 #if defined (__OPPLE__) && defined(_KERNEL)
 static kmutex_t		arc_vmpressure_thr_lock;
 static kcondvar_t	arc_vmpressure_thr_cv;	/* used to signal reclaim thr */
@@ -177,6 +188,24 @@ typedef enum arc_reclaim_strategy {
  */
 int arc_evict_iterations = 100;
 
+/*
+ * Number of sublists each state list is split into; 0 means one per
+ * CPU.  Only read in arc_init().
+ */
+int zfs_arc_num_sublists_per_state = 0;
+
+/*
+ * Average number of hdrs per buffer hash bucket above which the hash
+ * table is doubled in size.
+ */
+int zfs_arc_hash_max_load = 2;
+
+/*
+ * Keep a copy of compressed blocks in their on-disk form, and only hold
+ * the decompressed data while a consumer references it.
+ */
+int zfs_compressed_arc_enabled = 1;
+
 /* number of seconds before growing cache again */
 int zfs_arc_grow_retry = 5;
 
@@ -189,6 +218,14 @@ int zfs_arc_p_dampener_disable = 1;
 /* log2(fraction of arc to reclaim) */
 int zfs_arc_shrink_shift = 5;
 
+/*
+ * Free headroom below arc_c kept by arc_evict_thread(), as log2 of the
+ * fraction of arc_c.  The thread is woken once the headroom drops below
+ * the low watermark and evicts until it is back at the high one.
+ */
+int zfs_arc_evict_lowat_shift = 7;
+int zfs_arc_evict_hiwat_shift = 6;
+
 /*
  * minimum lifespan of a prefetch block in clock ticks
  * (initialized in arc_init())
@@ -304,13 +341,27 @@ SYSCTL_INT(_zfs, OID_AUTO, vfs_suspend_fs_end_delay,
  * places.  The reason for the ARC_l2c_only state is to keep the
  * buffer header in the hash table, so that reads that hit the
  * second level ARC benefit from these fast lookups.
+ *
+ * Headers in the ARC_l2c_only state have no data and sit on no state
+ * list, so they are cut down to the fields needed to find and read
+ * back the block (see HDR_L2ONLY_SIZE) and come from their own kmem
+ * cache.  With a large cache device these headers can outnumber all
+ * others.  arc_hdr_realloc() swaps a header for the other kind as it
+ * enters ARC_l2c_only, and again when a read hits it.
  */
 
+/*
+ * The evictable buffers of a state are kept on multilists, so that
+ * buffers going on and off them from different CPUs mostly take
+ * different locks.  A header's sublist is picked by hashing its
+ * identity; see arc_state_multilist_index_func().
+ */
 typedef struct arc_state {
-	list_t	arcs_list[ARC_BUFC_NUMTYPES];	/* list of evictable buffers */
+	/* list of evictable buffers */
+	multilist_t arcs_list[ARC_BUFC_NUMTYPES];
 	uint64_t arcs_lsize[ARC_BUFC_NUMTYPES];	/* amount of evictable data */
 	uint64_t arcs_size;	/* total amount of data in this state */
-	kmutex_t arcs_mtx;
+	uint64_t arcs_hdr_size;	/* memory used by the headers in this state */
 	arc_state_type_t arcs_state;
 } arc_state_t;
 
@@ -339,6 +390,11 @@ typedef struct arc_stats {
 	kstat_named_t arcstat_mfu_ghost_hits;
 	kstat_named_t arcstat_deleted;
 	kstat_named_t arcstat_recycle_miss;
+	/*
+	 * Number of allocations that found the ARC over its target and
+	 * had to wait for a pass of the eviction thread.
+	 */
+	kstat_named_t arcstat_evict_waits;
 	/*
 	 * Number of buffers that could not be evicted because the hash lock
 	 * was held by another thread.  The lock may not necessarily be held
@@ -360,6 +416,10 @@ typedef struct arc_stats {
 	kstat_named_t arcstat_hash_collisions;
 	kstat_named_t arcstat_hash_chains;
 	kstat_named_t arcstat_hash_chain_max;
+	kstat_named_t arcstat_hash_buckets;
+	kstat_named_t arcstat_hash_locks;
+	kstat_named_t arcstat_hash_lock_contended;
+	kstat_named_t arcstat_hash_resizes;
 	kstat_named_t arcstat_p;
 	kstat_named_t arcstat_c;
 	kstat_named_t arcstat_c_min;
@@ -369,6 +429,9 @@ typedef struct arc_stats {
 	kstat_named_t arcstat_data_size;
 	kstat_named_t arcstat_meta_size;
 	kstat_named_t arcstat_other_size;
+	kstat_named_t arcstat_compressed_size;
+	kstat_named_t arcstat_uncompressed_size;
+	kstat_named_t arcstat_compressed_hits;
 	kstat_named_t arcstat_anon_size;
 	kstat_named_t arcstat_anon_evict_data;
 	kstat_named_t arcstat_anon_evict_metadata;
@@ -384,6 +447,11 @@ typedef struct arc_stats {
 	kstat_named_t arcstat_mfu_ghost_size;
 	kstat_named_t arcstat_mfu_ghost_evict_data;
 	kstat_named_t arcstat_mfu_ghost_evict_metadata;
+	kstat_named_t arcstat_mru_hdr_size;
+	kstat_named_t arcstat_mru_ghost_hdr_size;
+	kstat_named_t arcstat_mfu_hdr_size;
+	kstat_named_t arcstat_mfu_ghost_hdr_size;
+	kstat_named_t arcstat_l2c_only_hdr_size;
 	kstat_named_t arcstat_l2_hits;
 	kstat_named_t arcstat_l2_misses;
 	kstat_named_t arcstat_l2_feeds;
@@ -406,6 +474,17 @@ typedef struct arc_stats {
 	kstat_named_t arcstat_l2_compress_successes;
 	kstat_named_t arcstat_l2_compress_zeros;
 	kstat_named_t arcstat_l2_compress_failures;
+	kstat_named_t arcstat_l2_log_blk_writes;
+	kstat_named_t arcstat_l2_dev_hdr_write_errors;
+	kstat_named_t arcstat_l2_rebuild_success;
+	kstat_named_t arcstat_l2_rebuild_unsupported;
+	kstat_named_t arcstat_l2_rebuild_io_errors;
+	kstat_named_t arcstat_l2_rebuild_cksum_lb_errors;
+	kstat_named_t arcstat_l2_rebuild_abort_lowmem;
+	kstat_named_t arcstat_l2_rebuild_log_blks;
+	kstat_named_t arcstat_l2_rebuild_bufs;
+	kstat_named_t arcstat_l2_rebuild_bufs_precached;
+	kstat_named_t arcstat_l2_rebuild_size;
 	kstat_named_t arcstat_memory_throttle_count;
 	kstat_named_t arcstat_duplicate_buffers;
 	kstat_named_t arcstat_duplicate_buffers_size;
@@ -438,6 +517,7 @@ static arc_stats_t arc_stats = {
 	{ "mfu_ghost_hits",		KSTAT_DATA_UINT64 },
 	{ "deleted",			KSTAT_DATA_UINT64 },
 	{ "recycle_miss",		KSTAT_DATA_UINT64 },
+	{ "evict_waits",		KSTAT_DATA_UINT64 },
 	{ "mutex_miss",			KSTAT_DATA_UINT64 },
 	{ "evict_skip",			KSTAT_DATA_UINT64 },
 	{ "evict_l2_cached",		KSTAT_DATA_UINT64 },
@@ -448,6 +528,10 @@ static arc_stats_t arc_stats = {
 	{ "hash_collisions",		KSTAT_DATA_UINT64 },
 	{ "hash_chains",		KSTAT_DATA_UINT64 },
 	{ "hash_chain_max",		KSTAT_DATA_UINT64 },
+	{ "hash_buckets",		KSTAT_DATA_UINT64 },
+	{ "hash_locks",			KSTAT_DATA_UINT64 },
+	{ "hash_lock_contended",	KSTAT_DATA_UINT64 },
+	{ "hash_resizes",		KSTAT_DATA_UINT64 },
 	{ "p",				KSTAT_DATA_UINT64 },
 	{ "c",				KSTAT_DATA_UINT64 },
 	{ "c_min",			KSTAT_DATA_UINT64 },
@@ -457,6 +541,9 @@ static arc_stats_t arc_stats = {
 	{ "data_size",			KSTAT_DATA_UINT64 },
 	{ "meta_size",			KSTAT_DATA_UINT64 },
 	{ "other_size",			KSTAT_DATA_UINT64 },
+	{ "compressed_size",		KSTAT_DATA_UINT64 },
+	{ "uncompressed_size",		KSTAT_DATA_UINT64 },
+	{ "compressed_hits",		KSTAT_DATA_UINT64 },
 	{ "anon_size",			KSTAT_DATA_UINT64 },
 	{ "anon_evict_data",		KSTAT_DATA_UINT64 },
 	{ "anon_evict_metadata",	KSTAT_DATA_UINT64 },
@@ -472,6 +559,11 @@ static arc_stats_t arc_stats = {
 	{ "mfu_ghost_size",		KSTAT_DATA_UINT64 },
 	{ "mfu_ghost_evict_data",	KSTAT_DATA_UINT64 },
 	{ "mfu_ghost_evict_metadata",	KSTAT_DATA_UINT64 },
+	{ "mru_hdr_size",		KSTAT_DATA_UINT64 },
+	{ "mru_ghost_hdr_size",		KSTAT_DATA_UINT64 },
+	{ "mfu_hdr_size",		KSTAT_DATA_UINT64 },
+	{ "mfu_ghost_hdr_size",		KSTAT_DATA_UINT64 },
+	{ "l2c_only_hdr_size",		KSTAT_DATA_UINT64 },
 	{ "l2_hits",			KSTAT_DATA_UINT64 },
 	{ "l2_misses",			KSTAT_DATA_UINT64 },
 	{ "l2_feeds",			KSTAT_DATA_UINT64 },
@@ -494,6 +586,17 @@ static arc_stats_t arc_stats = {
 	{ "l2_compress_successes",	KSTAT_DATA_UINT64 },
 	{ "l2_compress_zeros",		KSTAT_DATA_UINT64 },
 	{ "l2_compress_failures",	KSTAT_DATA_UINT64 },
+	{ "l2_log_blk_writes",		KSTAT_DATA_UINT64 },
+	{ "l2_dev_hdr_write_errors",	KSTAT_DATA_UINT64 },
+	{ "l2_rebuild_success",		KSTAT_DATA_UINT64 },
+	{ "l2_rebuild_unsupported",	KSTAT_DATA_UINT64 },
+	{ "l2_rebuild_io_errors",	KSTAT_DATA_UINT64 },
+	{ "l2_rebuild_cksum_lb_errors",	KSTAT_DATA_UINT64 },
+	{ "l2_rebuild_abort_lowmem",	KSTAT_DATA_UINT64 },
+	{ "l2_rebuild_log_blks",	KSTAT_DATA_UINT64 },
+	{ "l2_rebuild_bufs",		KSTAT_DATA_UINT64 },
+	{ "l2_rebuild_bufs_precached",	KSTAT_DATA_UINT64 },
+	{ "l2_rebuild_size",		KSTAT_DATA_UINT64 },
 	{ "memory_throttle_count",	KSTAT_DATA_UINT64 },
 	{ "duplicate_buffers",		KSTAT_DATA_UINT64 },
 	{ "duplicate_buffers_size",	KSTAT_DATA_UINT64 },
@@ -609,31 +712,78 @@ struct arc_write_callback {
 	arc_buf_t	*awcb_buf;
 };
 
+/*
+ * Per-pool accounting of ARC residency and hits/misses.  Every objset
+ * and every object type a pool has had blocks of in the ARC gets an
+ * arc_pstats_t, whose counters are split per CPU so that arc_read()
+ * does not bounce a shared cache line around.  arc_pool_stats() folds
+ * them when the pool's kstats are read.
+ */
+#define	ARC_PSTATS_HASH_SIZE	1024
+#define	ARC_PSTATS_LOCKS	64
+#define	ARC_PSTATS_PAD		64
+
+typedef struct arc_pstats_cpu {
+	uint64_t		apc_stat[ARC_PSTAT_NUMTYPES];
+	uint8_t			apc_pad[ARC_PSTATS_PAD];
+} arc_pstats_cpu_t;
+
+typedef struct arc_pstats {
+	struct arc_pstats	*aps_next;
+	uint64_t		aps_spa;
+	uint64_t		aps_id;
+	boolean_t		aps_is_type;
+	boolean_t		aps_purged;	/* its pool is gone */
+	uint64_t		aps_refcnt;	/* hdrs charged to it */
+	arc_pstats_cpu_t	*aps_cpu;
+} arc_pstats_t;
+
 struct arc_buf_hdr {
 	/* protected by hash lock */
 	dva_t			b_dva;
 	uint64_t		b_birth;
 	uint64_t		b_cksum0;
 
-	kmutex_t		b_freeze_lock;
-	zio_cksum_t		*b_freeze_cksum;
-
 	arc_buf_hdr_t		*b_hash_next;
-	arc_buf_t		*b_buf;
 	uint32_t		b_flags;
-	uint32_t		b_datacnt;
 
-	arc_callback_t		*b_acb;
-	kcondvar_t		b_cv;
+	/* protected by b_freeze_lock, or the hash lock if ARC_L2_ONLY */
+	zio_cksum_t		*b_freeze_cksum;
 
 	/* immutable */
 	arc_buf_contents_t	b_type;
 	uint64_t		b_size;
 	uint64_t		b_spa;
 
-	/* protected by arc state mutex */
+	/* protected by the lock of the state sublist holding the hdr */
 	arc_state_t		*b_state;
-	list_node_t		b_arc_node;
+
+	l2arc_buf_hdr_t		*b_l2hdr;
+	list_node_t		b_l2node;
+
+	/*
+	 * ARC_L2_ONLY headers end here.  The fields below are only
+	 * needed while the block may have data in the ARC.
+	 */
+	kmutex_t		b_freeze_lock;
+
+	arc_buf_t		*b_buf;
+	uint32_t		b_datacnt;
+
+	arc_callback_t		*b_acb;
+	kcondvar_t		b_cv;
+
+	/* compressed copy of the block, protected by hash lock */
+	void			*b_cdata;
+	uint64_t		b_csize;
+	enum zio_compress	b_ccompress;
+
+	/* what the hdr's data is charged to, protected by hash lock */
+	arc_pstats_t		*b_objset_pstats;
+	arc_pstats_t		*b_type_pstats;
+
+	/* protected by the lock of the state sublist holding the hdr */
+	multilist_node_t	b_arc_node;
 
 	/* updated atomically */
 	clock_t			b_arc_access;
@@ -645,9 +795,6 @@ struct arc_buf_hdr {
 
 	/* self protecting */
 	refcount_t		b_refcnt;
-
-	l2arc_buf_hdr_t		*b_l2hdr;
-	list_node_t		b_l2node;
 };
 
 static list_t arc_prune_list;
@@ -686,6 +833,7 @@ static boolean_t l2arc_write_eligible(uint64_t spa_guid, arc_buf_hdr_t *ab);
 #define	ARC_L2_WRITING		(1 << 16)	/* L2ARC write in progress */
 #define	ARC_L2_EVICTED		(1 << 17)	/* evicted during I/O */
 #define	ARC_L2_WRITE_HEAD	(1 << 18)	/* head of write list */
+#define	ARC_L2_ONLY		(1 << 19)	/* slim L2ARC-only hdr */
 
 #define	HDR_IN_HASH_TABLE(hdr)	((hdr)->b_flags & ARC_IN_HASH_TABLE)
 #define	HDR_IO_IN_PROGRESS(hdr)	((hdr)->b_flags & ARC_IO_IN_PROGRESS)
@@ -700,44 +848,58 @@ static boolean_t l2arc_write_eligible(uint64_t spa_guid, arc_buf_hdr_t *ab);
 #define	HDR_L2_WRITING(hdr)	((hdr)->b_flags & ARC_L2_WRITING)
 #define	HDR_L2_EVICTED(hdr)	((hdr)->b_flags & ARC_L2_EVICTED)
 #define	HDR_L2_WRITE_HEAD(hdr)	((hdr)->b_flags & ARC_L2_WRITE_HEAD)
+#define	HDR_L2_ONLY(hdr)	((hdr)->b_flags & ARC_L2_ONLY)
 
 /*
  * Other sizes
  */
 
 #define	HDR_SIZE ((int64_t)sizeof (arc_buf_hdr_t))
+#define	HDR_L2ONLY_SIZE ((int64_t)offsetof(arc_buf_hdr_t, b_freeze_lock))
 #define	L2HDR_SIZE ((int64_t)sizeof (l2arc_buf_hdr_t))
 
+#define	ARC_HDR_SIZE(hdr)	(HDR_L2_ONLY(hdr) ? HDR_L2ONLY_SIZE : HDR_SIZE)
+
 /*
  * Hash table routines
  */
 
+/*
+ * The hash locks are striped by the low bits of the hash, and their
+ * number is fixed when the ARC is initialized.  The table always has at
+ * least as many buckets as there are locks, so all hdrs of a bucket are
+ * covered by the same lock and a hdr's lock does not change when the
+ * table grows.  The table is grown by buf_hash_grow() one lock stripe at
+ * a time; each stripe records the table its buckets currently live in,
+ * which can only be looked at with the stripe's lock held.  The grow
+ * runs from arc_hash_taskq, see arc_evict_thread().
+ */
+typedef struct buf_hash_table {
+	uint64_t ht_mask;
+	arc_buf_hdr_t **ht_table;
+} buf_hash_table_t;
+
 #define	HT_LOCK_ALIGN	64
-#define	HT_LOCK_PAD	(P2NPHASE(sizeof (kmutex_t), (HT_LOCK_ALIGN)))
+#define	HT_LOCK_PAD	\
+	(P2NPHASE(sizeof (kmutex_t) + sizeof (void *), (HT_LOCK_ALIGN)))
 
 struct ht_lock {
-	kmutex_t	ht_lock;
+	kmutex_t		ht_lock;
+	buf_hash_table_t	*ht_cur;
 #ifdef _KERNEL
-	unsigned char	pad[HT_LOCK_PAD];
+	unsigned char		pad[HT_LOCK_PAD];
 #endif
 };
 
-#ifdef __LP64__
-#define	BUF_LOCKS 256
-#else
-#define	BUF_LOCKS 256
-#endif
-typedef struct buf_hash_table {
-	uint64_t ht_mask;
-	arc_buf_hdr_t **ht_table;
-	struct ht_lock ht_locks[BUF_LOCKS];
-} buf_hash_table_t;
+#define	BUF_LOCKS		256
+#define	BUF_LOCKS_PER_CPU	32
 
 static buf_hash_table_t *buf_hash_table = NULL;
+static struct ht_lock *buf_hash_locks = NULL;
+static uint64_t buf_hash_lock_mask;
 
-#define	BUF_HASH_INDEX(spa, dva, birth) \
-	(buf_hash(spa, dva, birth) & buf_hash_table->ht_mask)
-#define	BUF_HASH_LOCK_NTRY(idx) (buf_hash_table->ht_locks[(uint64_t)idx & (BUF_LOCKS-1ULL)])
+#define	BUF_HASH_INDEX(spa, dva, birth)	buf_hash(spa, dva, birth)
+#define	BUF_HASH_LOCK_NTRY(idx)	(buf_hash_locks[(idx) & buf_hash_lock_mask])
 #define	BUF_HASH_LOCK(idx)	(&(BUF_HASH_LOCK_NTRY(idx).ht_lock))
 #define	HDR_LOCK(hdr) \
 	(BUF_HASH_LOCK(BUF_HASH_INDEX(hdr->b_spa, &hdr->b_dva, hdr->b_birth)))
@@ -773,6 +935,7 @@ int l2arc_noprefetch = B_TRUE;			/* don't cache prefetch bufs */
 int l2arc_nocompress = B_FALSE;			/* don't compress bufs */
 int l2arc_feed_again = B_TRUE;			/* turbo warmup */
 int l2arc_norw = B_FALSE;			/* no reads during writes */
+int l2arc_rebuild_enabled = B_TRUE;		/* rebuild devices on import */
 
 #ifdef _KERNEL
 SYSCTL_QUAD(_zfs, OID_AUTO, l2arc_write_max, CTLFLAG_RW,
@@ -792,6 +955,8 @@ SYSCTL_INT(_zfs, OID_AUTO, l2arc_feed_again, CTLFLAG_RW,
     &l2arc_feed_again, 0, "turbo warmup");
 SYSCTL_INT(_zfs, OID_AUTO, l2arc_norw, CTLFLAG_RW,
     &l2arc_norw, 0, "no reads during writes");
+SYSCTL_INT(_zfs, OID_AUTO, l2arc_rebuild_enabled, CTLFLAG_RW,
+    &l2arc_rebuild_enabled, 0, "rebuild l2arc devices on import");
 
 SYSCTL_QUAD(_zfs, OID_AUTO, anon_size, CTLFLAG_RD,
     &ARC_anon.arcs_size, "size of anonymous state");
@@ -851,6 +1016,14 @@ typedef struct l2arc_dev {
 	boolean_t		l2ad_writing;	/* currently writing */
 	list_t			*l2ad_buflist;	/* buffer list */
 	list_node_t		l2ad_node;	/* device list node */
+	/* persistent L2ARC, only touched by the feed or rebuild thread */
+	struct l2arc_dev_hdr_phys *l2ad_dev_hdr; /* device header */
+	uint64_t		l2ad_dev_hdr_asize;
+	struct l2arc_log_blk_phys *l2ad_log_blk; /* log block being filled */
+	uint64_t		l2ad_log_ent_idx; /* next entry in log block */
+	uint64_t		l2ad_log_payload_start;
+	boolean_t		l2ad_rebuild;	/* rebuild pending or running */
+	boolean_t		l2ad_rebuild_cancel;
 } l2arc_dev_t;
 
 static list_t L2ARC_dev_list;			/* device list */
@@ -898,19 +1071,112 @@ typedef struct l2arc_data_free {
 	list_node_t	l2df_list_node;
 } l2arc_data_free_t;
 
+/*
+ * Persistent L2ARC on-disk structures; see "Persistent L2ARC" below.
+ * Everything is stored in native byte order and a device written by a
+ * host of the other endianness is simply not rebuilt.
+ */
+#define	L2ARC_DEV_HDR_MAGIC	0x5a46534c32415243ULL	/* "ZFSL2ARC" */
+#define	L2ARC_LOG_BLK_MAGIC	0x4c4f47424c4b4844ULL	/* "LOGBLKHD" */
+#define	L2ARC_PERSIST_VERSION	1
+
+/* dh_flags */
+#define	L2ARC_DEV_HDR_EVICT_FIRST	(1ULL << 0)	/* l2ad_first */
+
+/*
+ * Log entry le_prop layout: logical and allocated size in sectors,
+ * the compression l2arc_compress_buf() applied, and the buffer type.
+ */
+#define	L2BLK_GET_LSIZE(field)	\
+	BF64_GET_SB((field), 0, 16, SPA_MINBLOCKSHIFT, 1)
+#define	L2BLK_SET_LSIZE(field, x)	\
+	BF64_SET_SB((field), 0, 16, SPA_MINBLOCKSHIFT, 1, x)
+#define	L2BLK_GET_ASIZE(field)	\
+	BF64_GET_SB((field), 16, 16, SPA_MINBLOCKSHIFT, 0)
+#define	L2BLK_SET_ASIZE(field, x)	\
+	BF64_SET_SB((field), 16, 16, SPA_MINBLOCKSHIFT, 0, x)
+#define	L2BLK_GET_COMPRESS(field)	BF64_GET((field), 32, 8)
+#define	L2BLK_SET_COMPRESS(field, x)	BF64_SET((field), 32, 8, x)
+#define	L2BLK_GET_TYPE(field)		BF64_GET((field), 40, 8)
+#define	L2BLK_SET_TYPE(field, x)	BF64_SET((field), 40, 8, x)
+
+typedef struct l2arc_log_ent_phys {
+	dva_t			le_dva;		/* block identity */
+	uint64_t		le_birth;
+	uint64_t		le_cksum0;
+	zio_cksum_t		le_freeze_cksum; /* of the logical data */
+	uint64_t		le_prop;	/* see L2BLK_* */
+	uint64_t		le_daddr;	/* device address of buffer */
+} l2arc_log_ent_phys_t;
+
+/*
+ * Points at a log block.  Besides the block itself, its payload (the
+ * buffers it describes, written before it) starts at lbp_payload_start.
+ */
+typedef struct l2arc_log_blkptr {
+	uint64_t		lbp_daddr;
+	uint64_t		lbp_payload_start;
+	zio_cksum_t		lbp_cksum;	/* fletcher4 of the log block */
+} l2arc_log_blkptr_t;
+
+#define	L2ARC_LOG_BLK_SIZE	(128 * 1024)
+#define	L2ARC_LOG_BLK_HEADER_LEN				\
+	(2 * sizeof (uint64_t) + sizeof (l2arc_log_blkptr_t))
+#define	L2ARC_LOG_BLK_ENTRIES					\
+	((L2ARC_LOG_BLK_SIZE - L2ARC_LOG_BLK_HEADER_LEN) /	\
+	sizeof (l2arc_log_ent_phys_t))
+
+typedef struct l2arc_log_blk_phys {
+	uint64_t		lb_magic;
+	uint64_t		lb_nents;	/* entries in use */
+	l2arc_log_blkptr_t	lb_prev_lbp;	/* next older log block */
+	l2arc_log_ent_phys_t	lb_entries[L2ARC_LOG_BLK_ENTRIES];
+	uint8_t			lb_pad[L2ARC_LOG_BLK_SIZE -
+	    L2ARC_LOG_BLK_HEADER_LEN -
+	    L2ARC_LOG_BLK_ENTRIES * sizeof (l2arc_log_ent_phys_t)];
+} l2arc_log_blk_phys_t;
+
+/*
+ * The device header lives right after the front vdev labels and
+ * points at the newest log block.
+ */
+typedef struct l2arc_dev_hdr_phys {
+	uint64_t		dh_magic;
+	uint64_t		dh_version;
+	uint64_t		dh_spa_guid;
+	uint64_t		dh_vdev_guid;
+	uint64_t		dh_flags;	/* L2ARC_DEV_HDR_* */
+	uint64_t		dh_start;	/* l2ad_start */
+	uint64_t		dh_end;		/* l2ad_end */
+	uint64_t		dh_hand;	/* l2ad_hand */
+	uint64_t		dh_evict;	/* l2ad_evict */
+	l2arc_log_blkptr_t	dh_start_lbp;	/* newest log block */
+	zio_cksum_t		dh_self_cksum;	/* fletcher4 of the above */
+} l2arc_dev_hdr_phys_t;
+
 static kmutex_t l2arc_feed_thr_lock;
 static kcondvar_t l2arc_feed_thr_cv;
 static uint8_t l2arc_thread_exit;
 
+static kmutex_t l2arc_rebuild_thr_lock;
+static kcondvar_t l2arc_rebuild_thr_cv;
+
 static void l2arc_read_done(zio_t *zio);
-static void l2arc_hdr_stat_add(void);
-static void l2arc_hdr_stat_remove(void);
+static void l2arc_hdr_stat_add(arc_buf_hdr_t *hdr);
+static void l2arc_hdr_stat_remove(arc_buf_hdr_t *hdr);
 
 static boolean_t l2arc_compress_buf(l2arc_buf_hdr_t *l2hdr);
 static void l2arc_decompress_zio(zio_t *zio, arc_buf_hdr_t *hdr,
     enum zio_compress c);
 static void l2arc_release_cdata_buf(arc_buf_hdr_t *ab);
 
+static boolean_t l2arc_dev_hdr_read(l2arc_dev_t *dev);
+static void l2arc_dev_hdr_update(l2arc_dev_t *dev);
+static void l2arc_dev_rebuild_thread(l2arc_dev_t *dev);
+static uint64_t l2arc_log_blk_overhead(uint64_t write_sz);
+static boolean_t l2arc_log_blk_insert(l2arc_dev_t *dev, arc_buf_hdr_t *ab);
+static uint64_t l2arc_log_blk_commit(l2arc_dev_t *dev, zio_t *pio);
+
 static uint64_t
 buf_hash(uint64_t spa, const dva_t *dva, uint64_t birth)
 {
@@ -947,6 +1213,28 @@ buf_discard_identity(arc_buf_hdr_t *hdr)
 	hdr->b_cksum0 = 0;
 }
 
+/*
+ * Return the bucket of the given hash, in whichever table its lock
+ * stripe currently lives in.  The stripe's lock must be held.
+ */
+static inline arc_buf_hdr_t **
+buf_hash_bucket(uint64_t idx)
+{
+	buf_hash_table_t *ht = BUF_HASH_LOCK_NTRY(idx).ht_cur;
+
+	ASSERT(MUTEX_HELD(BUF_HASH_LOCK(idx)));
+	return (&ht->ht_table[idx & ht->ht_mask]);
+}
+
+static inline void
+buf_hash_lock_enter(kmutex_t *hash_lock)
+{
+	if (!mutex_tryenter(hash_lock)) {
+		ARCSTAT_BUMP(arcstat_hash_lock_contended);
+		mutex_enter(hash_lock);
+	}
+}
+
 static arc_buf_hdr_t *
 buf_hash_find(uint64_t spa, const dva_t *dva, uint64_t birth, kmutex_t **lockp)
 {
@@ -954,8 +1242,8 @@ buf_hash_find(uint64_t spa, const dva_t *dva, uint64_t birth, kmutex_t **lockp)
 	kmutex_t *hash_lock = BUF_HASH_LOCK(idx);
 	arc_buf_hdr_t *buf;
 
-	mutex_enter(hash_lock);
-	for (buf = buf_hash_table->ht_table[idx]; buf != NULL;
+	buf_hash_lock_enter(hash_lock);
+	for (buf = *buf_hash_bucket(idx); buf != NULL;
 	    buf = buf->b_hash_next) {
 		if (BUF_EQUAL(spa, dva, birth, buf)) {
 			*lockp = hash_lock;
@@ -978,20 +1266,21 @@ buf_hash_insert(arc_buf_hdr_t *buf, kmutex_t **lockp)
 {
 	uint64_t idx = BUF_HASH_INDEX(buf->b_spa, &buf->b_dva, buf->b_birth);
 	kmutex_t *hash_lock = BUF_HASH_LOCK(idx);
-	arc_buf_hdr_t *fbuf;
+	arc_buf_hdr_t *fbuf, **bucket;
 	uint32_t i;
 
 	ASSERT(!HDR_IN_HASH_TABLE(buf));
 	*lockp = hash_lock;
-	mutex_enter(hash_lock);
-	for (fbuf = buf_hash_table->ht_table[idx], i = 0; fbuf != NULL;
+	buf_hash_lock_enter(hash_lock);
+	bucket = buf_hash_bucket(idx);
+	for (fbuf = *bucket, i = 0; fbuf != NULL;
 	    fbuf = fbuf->b_hash_next, i++) {
 		if (BUF_EQUAL(buf->b_spa, &buf->b_dva, buf->b_birth, fbuf))
 			return (fbuf);
 	}
 
-	buf->b_hash_next = buf_hash_table->ht_table[idx];
-	buf_hash_table->ht_table[idx] = buf;
+	buf->b_hash_next = *bucket;
+	*bucket = buf;
 	buf->b_flags |= ARC_IN_HASH_TABLE;
 
 	/* collect some hash table performance data */
@@ -1012,13 +1301,13 @@ buf_hash_insert(arc_buf_hdr_t *buf, kmutex_t **lockp)
 static void
 buf_hash_remove(arc_buf_hdr_t *buf)
 {
-	arc_buf_hdr_t *fbuf, **bufp;
+	arc_buf_hdr_t *fbuf, **bufp, **bucket;
 	uint64_t idx = BUF_HASH_INDEX(buf->b_spa, &buf->b_dva, buf->b_birth);
 
 	ASSERT(MUTEX_HELD(BUF_HASH_LOCK(idx)));
 	ASSERT(HDR_IN_HASH_TABLE(buf));
 
-	bufp = &buf_hash_table->ht_table[idx];
+	bufp = bucket = buf_hash_bucket(idx);
 	while ((fbuf = *bufp) != buf) {
 		ASSERT(fbuf != NULL);
 		bufp = &fbuf->b_hash_next;
@@ -1030,38 +1319,150 @@ buf_hash_remove(arc_buf_hdr_t *buf)
 	/* collect some hash table performance data */
 	ARCSTAT_BUMPDOWN(arcstat_hash_elements);
 
-	if (buf_hash_table->ht_table[idx] &&
-	    buf_hash_table->ht_table[idx]->b_hash_next == NULL)
+	if (*bucket != NULL && (*bucket)->b_hash_next == NULL)
 		ARCSTAT_BUMPDOWN(arcstat_hash_chains);
 }
 
+static buf_hash_table_t *
+buf_hash_table_alloc(uint64_t hsize, int kmflag)
+{
+	buf_hash_table_t *ht;
+
+	ht = kmem_alloc(sizeof (buf_hash_table_t), KM_SLEEP);
+	ht->ht_mask = hsize - 1ULL;
+#if defined(_KERNEL) && defined(HAVE_SPL)
+	/*
+	 * Large allocations which do not require contiguous pages
+	 * should be using vmem_alloc() in the linux kernel
+	 */
+	ht->ht_table = vmem_zalloc(hsize * sizeof (void*), kmflag);
+#else
+	ht->ht_table = kmem_zalloc(hsize * sizeof (void*), kmflag);
+#endif
+	if (ht->ht_table == NULL) {
+		kmem_free(ht, sizeof (buf_hash_table_t));
+		return (NULL);
+	}
+
+	return (ht);
+}
+
+static void
+buf_hash_table_free(buf_hash_table_t *ht)
+{
+#if defined(_KERNEL) && defined(HAVE_SPL)
+	/* Large allocations which do not require contiguous pages
+	 * should be using vmem_free() in the linux kernel */
+	vmem_free(ht->ht_table, (ht->ht_mask + 1) * sizeof (void *));
+#else
+	kmem_free(ht->ht_table, (ht->ht_mask + 1) * sizeof (void *));
+#endif
+	kmem_free(ht, sizeof (buf_hash_table_t));
+}
+
+/*
+ * The table is grown once the average chain holds more than
+ * zfs_arc_hash_max_load hdrs, up to a bucket per page of memory.
+ */
+static boolean_t
+buf_hash_grow_needed(void)
+{
+	uint64_t nbuckets = buf_hash_table->ht_mask + 1;
+
+	return (ARCSTAT(arcstat_hash_elements) >
+	    nbuckets * MAX(zfs_arc_hash_max_load, 1) &&
+	    nbuckets * 2 <= physmem);
+}
+
+/*
+ * Double the size of the hash table.  The hdrs are moved over one lock
+ * stripe at a time with only that stripe's lock held, so lookups of
+ * other stripes go on meanwhile, and a lookup always walks the table its
+ * stripe has been moved to.  Once every stripe has been moved, nothing
+ * can be looking at the old table any more and it is freed.
+ */
+static boolean_t
+buf_hash_grow(void)
+{
+	buf_hash_table_t *oht = buf_hash_table;
+	buf_hash_table_t *nht;
+	uint64_t s, i;
+
+	nht = buf_hash_table_alloc((oht->ht_mask + 1) << 1, KM_NOSLEEP);
+	if (nht == NULL)
+		return (B_FALSE);
+
+	for (s = 0; s <= buf_hash_lock_mask; s++) {
+		struct ht_lock *htl = &buf_hash_locks[s];
+
+		mutex_enter(&htl->ht_lock);
+		ASSERT3P(htl->ht_cur, ==, oht);
+		for (i = s; i <= oht->ht_mask; i += buf_hash_lock_mask + 1) {
+			arc_buf_hdr_t *hdr, **bucket;
+
+			hdr = oht->ht_table[i];
+			if (hdr != NULL && hdr->b_hash_next != NULL)
+				ARCSTAT_BUMPDOWN(arcstat_hash_chains);
+
+			while ((hdr = oht->ht_table[i]) != NULL) {
+				oht->ht_table[i] = hdr->b_hash_next;
+				bucket = &nht->ht_table[BUF_HASH_INDEX(
+				    hdr->b_spa, &hdr->b_dva, hdr->b_birth) &
+				    nht->ht_mask];
+				if (*bucket != NULL &&
+				    (*bucket)->b_hash_next == NULL)
+					ARCSTAT_BUMP(arcstat_hash_chains);
+				hdr->b_hash_next = *bucket;
+				*bucket = hdr;
+			}
+		}
+		htl->ht_cur = nht;
+		mutex_exit(&htl->ht_lock);
+	}
+
+	buf_hash_table = nht;
+	buf_hash_table_free(oht);
+
+	ARCSTAT(arcstat_hash_buckets) = nht->ht_mask + 1;
+	ARCSTAT(arcstat_hash_chain_max) = 0;
+	ARCSTAT_BUMP(arcstat_hash_resizes);
+
+	return (B_TRUE);
+}
+
+/* ARGSUSED */
+static void
+buf_hash_grow_task(void *arg)
+{
+	(void) buf_hash_grow();
+
+	mutex_enter(&arc_evict_lock);
+	arc_hash_growing = B_FALSE;
+	mutex_exit(&arc_evict_lock);
+}
+
 /*
  * Global data structures and functions for the buf kmem cache.
  */
 static kmem_cache_t *hdr_cache;
+static kmem_cache_t *hdr_l2only_cache;
 static kmem_cache_t *buf_cache;
 static kmem_cache_t *l2arc_hdr_cache;
 
 static void
 buf_fini(void)
 {
-	int i;
+	uint64_t i;
 
-#if defined(_KERNEL) && defined(HAVE_SPL)
-	/* Large allocations which do not require contiguous pages
-	 * should be using vmem_free() in the linux kernel */
-	vmem_free(buf_hash_table->ht_table,
-	    (buf_hash_table->ht_mask + 1) * sizeof (void *));
-#else
-	kmem_free(buf_hash_table->ht_table,
-	    (buf_hash_table->ht_mask + 1) * sizeof (void *));
-#endif
-	for (i = 0; i < BUF_LOCKS; i++)
-		mutex_destroy(&buf_hash_table->ht_locks[i].ht_lock);
+	buf_hash_table_free(buf_hash_table);
+	for (i = 0; i <= buf_hash_lock_mask; i++)
+		mutex_destroy(&buf_hash_locks[i].ht_lock);
+	kmem_free(buf_hash_locks,
+	    (buf_hash_lock_mask + 1) * sizeof (struct ht_lock));
 	kmem_cache_destroy(hdr_cache);
+	kmem_cache_destroy(hdr_l2only_cache);
 	kmem_cache_destroy(buf_cache);
 	kmem_free(zfs_crc64_table, sizeof(uint64_t) * 256);
-	kmem_free(buf_hash_table, sizeof(buf_hash_table_t));
 	kmem_cache_destroy(l2arc_hdr_cache);
 }
 
@@ -1079,13 +1480,26 @@ hdr_cons(void *vbuf, void *unused, int kmflag)
 	refcount_create(&buf->b_refcnt);
 	cv_init(&buf->b_cv, NULL, CV_DEFAULT, NULL);
 	mutex_init(&buf->b_freeze_lock, NULL, MUTEX_DEFAULT, NULL);
-	list_link_init(&buf->b_arc_node);
+	multilist_link_init(&buf->b_arc_node);
 	list_link_init(&buf->b_l2node);
 	arc_space_consume(sizeof (arc_buf_hdr_t), ARC_SPACE_HDRS);
 
 	return (0);
 }
 
+/* ARGSUSED */
+static int
+hdr_l2only_cons(void *vbuf, void *unused, int kmflag)
+{
+	arc_buf_hdr_t *buf = vbuf;
+
+	bzero(buf, HDR_L2ONLY_SIZE);
+	list_link_init(&buf->b_l2node);
+	arc_space_consume(HDR_L2ONLY_SIZE, ARC_SPACE_HDRS);
+
+	return (0);
+}
+
 /* ARGSUSED */
 static int
 buf_cons(void *vbuf, void *unused, int kmflag)
@@ -1117,6 +1531,16 @@ hdr_dest(void *vbuf, void *unused)
 	arc_space_return(sizeof (arc_buf_hdr_t), ARC_SPACE_HDRS);
 }
 
+/* ARGSUSED */
+static void
+hdr_l2only_dest(void *vbuf, void *unused)
+{
+	arc_buf_hdr_t *buf = vbuf;
+
+	ASSERT(BUF_EMPTY(buf));
+	arc_space_return(HDR_L2ONLY_SIZE, ARC_SPACE_HDRS);
+}
+
 /* ARGSUSED */
 static void
 buf_dest(void *vbuf, void *unused)
@@ -1133,39 +1557,38 @@ buf_init(void)
 {
 	uint64_t *ct;
 	uint64_t hsize = 1ULL << 12;
+	uint64_t nlocks = BUF_LOCKS;
 	int i, j;
 
-	buf_hash_table = kmem_zalloc(sizeof(buf_hash_table_t), KM_SLEEP);
-
 	/*
-	 * The hash table is big enough to fill all of physical memory
-	 * with an average 64K block size.  The table will take up
-	 * totalmem*sizeof(void*)/64K (eg. 128KB/GB with 8-byte pointers).
+	 * The hash table starts out big enough to fill all of physical
+	 * memory with an average 64K block size.  The table will take up
+	 * totalmem*sizeof(void*)/64K (eg. 128KB/GB with 8-byte pointers),
+	 * and is grown by buf_hash_grow() when blocks are smaller.
 	 */
 	while (hsize * 65536 < physmem * PAGESIZE)
 		hsize <<= 1;
-retry:
-	buf_hash_table->ht_mask = hsize - 1ULL;
-
-#if defined(_KERNEL) && defined(HAVE_SPL)
-	/*
-	 * Large allocations which do not require contiguous pages
-	 * should be using vmem_alloc() in the linux kernel
-	 */
-	buf_hash_table->ht_table =
-	    vmem_zalloc(hsize * sizeof (void*), KM_SLEEP);
-#else
-	buf_hash_table->ht_table =
-	    kmem_zalloc(hsize * sizeof (void*), KM_NOSLEEP);
-#endif
-	if (buf_hash_table->ht_table == NULL) {
+	while ((buf_hash_table = buf_hash_table_alloc(hsize,
+	    KM_NOSLEEP)) == NULL) {
 		ASSERT(hsize > (1ULL << 8));
 		hsize >>= 1;
-		goto retry;
 	}
 
+	while (nlocks < max_ncpus * BUF_LOCKS_PER_CPU && nlocks < hsize)
+		nlocks <<= 1;
+	nlocks = MIN(nlocks, hsize);
+	buf_hash_lock_mask = nlocks - 1;
+	buf_hash_locks = kmem_zalloc(nlocks * sizeof (struct ht_lock),
+	    KM_SLEEP);
+
+	ARCSTAT(arcstat_hash_buckets) = hsize;
+	ARCSTAT(arcstat_hash_locks) = nlocks;
+
 	hdr_cache = kmem_cache_create("arc_buf_hdr_t", sizeof (arc_buf_hdr_t),
 	    0, hdr_cons, hdr_dest, NULL, NULL, NULL, 0);
+	hdr_l2only_cache = kmem_cache_create("arc_buf_hdr_t_l2only",
+	    HDR_L2ONLY_SIZE, 0, hdr_l2only_cons, hdr_l2only_dest, NULL,
+	    NULL, NULL, 0);
 	buf_cache = kmem_cache_create("arc_buf_t", sizeof (arc_buf_t),
 	    0, buf_cons, buf_dest, NULL, NULL, NULL, 0);
 	l2arc_hdr_cache = kmem_cache_create("l2arc_buf_hdr_t", L2HDR_SIZE,
@@ -1177,9 +1600,10 @@ retry:
 		for (ct = zfs_crc64_table + i, *ct = i, j = 8; j > 0; j--)
 			*ct = ((*ct) >> 1) ^ (-((*ct) & 1) & ZFS_CRC64_POLY);
 
-	for (i = 0; i < BUF_LOCKS; i++) {
-		mutex_init(&buf_hash_table->ht_locks[i].ht_lock,
+	for (i = 0; i < nlocks; i++) {
+		mutex_init(&buf_hash_locks[i].ht_lock,
 		    NULL, MUTEX_DEFAULT, NULL);
+		buf_hash_locks[i].ht_cur = buf_hash_table;
 	}
 }
 
@@ -1315,14 +1739,10 @@ add_reference(arc_buf_hdr_t *ab, kmutex_t *hash_lock, void *tag)
 
 	if ((refcount_add(&ab->b_refcnt, tag) == 1) &&
 	    (ab->b_state != arc_anon)) {
-		uint64_t delta = ab->b_size * ab->b_datacnt;
-		list_t *list = &ab->b_state->arcs_list[ab->b_type];
+		uint64_t delta = ab->b_size * ab->b_datacnt + ab->b_csize;
 		uint64_t *size = &ab->b_state->arcs_lsize[ab->b_type];
 
-		ASSERT(!MUTEX_HELD(&ab->b_state->arcs_mtx));
-		mutex_enter(&ab->b_state->arcs_mtx);
-		ASSERT(list_link_active(&ab->b_arc_node));
-		list_remove(list, ab);
+		multilist_remove(&ab->b_state->arcs_list[ab->b_type], ab);
 		if (GHOST_STATE(ab->b_state)) {
 			ASSERT3U(ab->b_datacnt, ==, 0);
 			ASSERT3P(ab->b_buf, ==, NULL);
@@ -1331,7 +1751,6 @@ add_reference(arc_buf_hdr_t *ab, kmutex_t *hash_lock, void *tag)
 		ASSERT(delta > 0);
 		ASSERT3U(*size, >=, delta);
 		atomic_add_64(size, -delta);
-		mutex_exit(&ab->b_state->arcs_mtx);
 		/* remove the prefetch flag if we get a reference */
 		if (ab->b_flags & ARC_PREFETCH)
 			ab->b_flags &= ~ARC_PREFETCH;
@@ -1351,13 +1770,9 @@ remove_reference(arc_buf_hdr_t *ab, kmutex_t *hash_lock, void *tag)
 	    (state != arc_anon)) {
 		uint64_t *size = &state->arcs_lsize[ab->b_type];
 
-		ASSERT(!MUTEX_HELD(&state->arcs_mtx));
-		mutex_enter(&state->arcs_mtx);
-		ASSERT(!list_link_active(&ab->b_arc_node));
-		list_insert_head(&state->arcs_list[ab->b_type], ab);
-		ASSERT(ab->b_datacnt > 0);
-		atomic_add_64(size, ab->b_size * ab->b_datacnt);
-		mutex_exit(&state->arcs_mtx);
+		multilist_insert(&state->arcs_list[ab->b_type], ab);
+		ASSERT(ab->b_datacnt > 0 || ab->b_cdata != NULL);
+		atomic_add_64(size, ab->b_size * ab->b_datacnt + ab->b_csize);
 	}
 	return (cnt);
 }
@@ -1365,9 +1780,9 @@ remove_reference(arc_buf_hdr_t *ab, kmutex_t *hash_lock, void *tag)
 /*
  * Returns detailed information about a specific arc buffer.  When the
  * state_index argument is set the function will calculate the arc header
- * list position for its arc state.  Since this requires a linear traversal
- * callers are strongly encourage not to do this.  However, it can be helpful
- * for targeted analysis so the functionality is provided.
+ * position within its arc state sublist.  Since this requires a linear
+ * traversal callers are strongly encourage not to do this.  However, it can
+ * be helpful for targeted analysis so the functionality is provided.
  */
 void
 arc_buf_info(arc_buf_t *ab, arc_buf_info_t *abi, int state_index)
@@ -1396,18 +1811,312 @@ arc_buf_info(arc_buf_t *ab, arc_buf_info_t *abi, int state_index)
 		abi->abi_l2arc_hits = hdr->b_l2hdr->b_hits;
 	}
 
-	if (state && state_index && list_link_active(&hdr->b_arc_node)) {
-		list_t *list = &state->arcs_list[hdr->b_type];
+	if (state && state_index && multilist_link_active(&hdr->b_arc_node)) {
+		multilist_t *ml = &state->arcs_list[hdr->b_type];
+		multilist_sublist_t *mls;
 		arc_buf_hdr_t *h;
 
-		mutex_enter(&state->arcs_mtx);
-		for (h = list_head(list); h != NULL; h = list_next(list, h)) {
+		mls = multilist_sublist_lock(ml,
+		    multilist_get_sublist_index(ml, hdr));
+		for (h = multilist_sublist_head(mls); h != NULL;
+		    h = multilist_sublist_next(mls, h)) {
 			abi->abi_state_index++;
 			if (h == hdr)
 				break;
 		}
-		mutex_exit(&state->arcs_mtx);
+		multilist_sublist_unlock(mls);
+	}
+}
+
+/*
+ * An arc_pstats_t is held by every hdr charged to it, but stays in the
+ * table when the last of them lets go, so that the counters of an objset
+ * or type only ever grow while its pool is imported.  When the pool is
+ * exported, arc_pool_stats_purge() frees its entries, since the load
+ * guid they are keyed by changes on every import; an entry still held
+ * by a hdr then is unlinked and freed on its last release.  The hash
+ * chains, and the reference counts of the entries on them, are
+ * protected by the ARC_PSTATS_LOCKS stripe locks.
+ */
+static arc_pstats_t *arc_pstats_table[ARC_PSTATS_HASH_SIZE];
+static kmutex_t arc_pstats_locks[ARC_PSTATS_LOCKS];
+
+#define	ARC_PSTATS_HASH(spa, id, is_type)	\
+	(((spa) ^ ((id) << 1 | (is_type))) & (ARC_PSTATS_HASH_SIZE - 1))
+#define	ARC_PSTATS_LOCK(idx)	\
+	(&arc_pstats_locks[(idx) & (ARC_PSTATS_LOCKS - 1)])
+
+static arc_pstats_t *
+arc_pstats_find(uint64_t idx, uint64_t spa, uint64_t id, boolean_t is_type)
+{
+	arc_pstats_t *aps;
+
+	for (aps = arc_pstats_table[idx]; aps != NULL; aps = aps->aps_next) {
+		if (aps->aps_spa == spa && aps->aps_id == id &&
+		    aps->aps_is_type == is_type)
+			break;
+	}
+
+	return (aps);
+}
+
+static arc_pstats_t *
+arc_pstats_hold(uint64_t spa, uint64_t id, boolean_t is_type)
+{
+	uint64_t idx = ARC_PSTATS_HASH(spa, id, is_type);
+	kmutex_t *lock = ARC_PSTATS_LOCK(idx);
+	arc_pstats_t *aps;
+
+	mutex_enter(lock);
+	if ((aps = arc_pstats_find(idx, spa, id, is_type)) == NULL) {
+		aps = kmem_alloc(sizeof (arc_pstats_t), KM_PUSHPAGE);
+		aps->aps_spa = spa;
+		aps->aps_id = id;
+		aps->aps_is_type = is_type;
+		aps->aps_purged = B_FALSE;
+		aps->aps_refcnt = 0;
+		aps->aps_cpu = kmem_zalloc(max_ncpus *
+		    sizeof (arc_pstats_cpu_t), KM_PUSHPAGE);
+		aps->aps_next = arc_pstats_table[idx];
+		arc_pstats_table[idx] = aps;
+	}
+	aps->aps_refcnt++;
+	mutex_exit(lock);
+
+	return (aps);
+}
+
+/*
+ * Take another hold on an entry the caller already holds.
+ */
+static void
+arc_pstats_add_ref(arc_pstats_t *aps)
+{
+	kmutex_t *lock;
+
+	if (aps == NULL)
+		return;
+
+	lock = ARC_PSTATS_LOCK(ARC_PSTATS_HASH(aps->aps_spa, aps->aps_id,
+	    aps->aps_is_type));
+	mutex_enter(lock);
+	ASSERT3U(aps->aps_refcnt, >, 0);
+	aps->aps_refcnt++;
+	mutex_exit(lock);
+}
+
+static void
+arc_pstats_free(arc_pstats_t *aps)
+{
+	kmem_free(aps->aps_cpu, max_ncpus * sizeof (arc_pstats_cpu_t));
+	kmem_free(aps, sizeof (arc_pstats_t));
+}
+
+static void
+arc_pstats_rele(arc_pstats_t *aps)
+{
+	kmutex_t *lock;
+	boolean_t last;
+
+	if (aps == NULL)
+		return;
+
+	lock = ARC_PSTATS_LOCK(ARC_PSTATS_HASH(aps->aps_spa, aps->aps_id,
+	    aps->aps_is_type));
+	mutex_enter(lock);
+	ASSERT3U(aps->aps_refcnt, >, 0);
+	last = (--aps->aps_refcnt == 0 && aps->aps_purged);
+	mutex_exit(lock);
+
+	if (last)
+		arc_pstats_free(aps);
+}
+
+/*
+ * Free the entries of the pool with the given load guid, once it has
+ * been exported.  Those still held are unlinked here and freed by
+ * arc_pstats_rele().
+ */
+void
+arc_pool_stats_purge(uint64_t spa)
+{
+	arc_pstats_t **apsp, *aps, *tofree;
+	int i;
+
+	for (i = 0; i < ARC_PSTATS_HASH_SIZE; i++) {
+		tofree = NULL;
+		mutex_enter(ARC_PSTATS_LOCK(i));
+		apsp = &arc_pstats_table[i];
+		while ((aps = *apsp) != NULL) {
+			if (aps->aps_spa != spa) {
+				apsp = &aps->aps_next;
+				continue;
+			}
+			*apsp = aps->aps_next;
+			aps->aps_purged = B_TRUE;
+			if (aps->aps_refcnt == 0) {
+				aps->aps_next = tofree;
+				tofree = aps;
+			}
+		}
+		mutex_exit(ARC_PSTATS_LOCK(i));
+
+		while ((aps = tofree) != NULL) {
+			tofree = aps->aps_next;
+			arc_pstats_free(aps);
+		}
+	}
+}
+
+static inline void
+arc_pstats_incr(arc_pstats_t *aps, arc_pool_stat_type_t stat, int64_t delta)
+{
+	if (aps != NULL)
+		atomic_add_64(&aps->aps_cpu[CPU_SEQID].apc_stat[stat], delta);
+}
+
+static void
+arc_pstats_space(arc_buf_hdr_t *hdr, int64_t space)
+{
+	arc_pstats_incr(hdr->b_objset_pstats, ARC_PSTAT_SIZE, space);
+	arc_pstats_incr(hdr->b_type_pstats, ARC_PSTAT_SIZE, space);
+}
+
+static void
+arc_pstats_access(arc_buf_hdr_t *hdr, boolean_t hit)
+{
+	arc_pool_stat_type_t stat;
+
+	if (hdr->b_flags & ARC_PREFETCH)
+		stat = hit ? ARC_PSTAT_PREFETCH_HITS :
+		    ARC_PSTAT_PREFETCH_MISSES;
+	else if (hdr->b_type == ARC_BUFC_METADATA)
+		stat = hit ? ARC_PSTAT_DEMAND_METADATA_HITS :
+		    ARC_PSTAT_DEMAND_METADATA_MISSES;
+	else
+		stat = hit ? ARC_PSTAT_DEMAND_DATA_HITS :
+		    ARC_PSTAT_DEMAND_DATA_MISSES;
+
+	arc_pstats_incr(hdr->b_objset_pstats, stat, 1);
+	arc_pstats_incr(hdr->b_type_pstats, stat, 1);
+}
+
+/*
+ * Charge the hdr, along with the data it currently holds, to the given
+ * objset and object type of its pool.  The hash lock must be held
+ * unless the hdr is anonymous.
+ */
+static void
+arc_hdr_set_pstats(arc_buf_hdr_t *hdr, uint64_t objset,
+    dmu_object_type_t type)
+{
+	int64_t space = hdr->b_datacnt * hdr->b_size + hdr->b_csize;
+	arc_pstats_t *objset_pstats = hdr->b_objset_pstats;
+	arc_pstats_t *type_pstats = hdr->b_type_pstats;
+
+	arc_pstats_space(hdr, -space);
+	hdr->b_objset_pstats = arc_pstats_hold(hdr->b_spa, objset, B_FALSE);
+	hdr->b_type_pstats = arc_pstats_hold(hdr->b_spa, type, B_TRUE);
+	arc_pstats_space(hdr, space);
+
+	arc_pstats_rele(objset_pstats);
+	arc_pstats_rele(type_pstats);
+}
+
+/*
+ * Drop what the hdr is charged to, once it no longer holds any data.
+ */
+static void
+arc_hdr_clear_pstats(arc_buf_hdr_t *hdr)
+{
+	ASSERT0(hdr->b_datacnt);
+	ASSERT0(hdr->b_csize);
+
+	arc_pstats_rele(hdr->b_objset_pstats);
+	arc_pstats_rele(hdr->b_type_pstats);
+	hdr->b_objset_pstats = NULL;
+	hdr->b_type_pstats = NULL;
+}
+
+/*
+ * Fold the counters of the objsets, or the object types, of the pool
+ * with the given load guid into an array of *np entries.  The array is
+ * allocated here and freed by the caller.
+ */
+void
+arc_pool_stats(uint64_t spa, boolean_t types, arc_pool_stat_t **apsp,
+    uint64_t *np)
+{
+	arc_pool_stat_t *stats;
+	arc_pstats_t *aps;
+	uint64_t i, n = 0;
+	int c, s;
+
+	for (i = 0; i < ARC_PSTATS_HASH_SIZE; i++) {
+		mutex_enter(ARC_PSTATS_LOCK(i));
+		for (aps = arc_pstats_table[i]; aps; aps = aps->aps_next)
+			if (aps->aps_spa == spa && aps->aps_is_type == types)
+				n++;
+		mutex_exit(ARC_PSTATS_LOCK(i));
+	}
+
+	*apsp = NULL;
+	*np = 0;
+	if (n == 0)
+		return;
+
+	/* entries added after the count was taken are left out */
+	stats = kmem_zalloc(n * sizeof (arc_pool_stat_t), KM_SLEEP);
+
+	for (i = 0; i < ARC_PSTATS_HASH_SIZE && *np < n; i++) {
+		mutex_enter(ARC_PSTATS_LOCK(i));
+		for (aps = arc_pstats_table[i]; aps && *np < n;
+		    aps = aps->aps_next) {
+			arc_pool_stat_t *st = &stats[*np];
+
+			if (aps->aps_spa != spa || aps->aps_is_type != types)
+				continue;
+
+			st->aps_id = aps->aps_id;
+			for (c = 0; c < max_ncpus; c++) {
+				for (s = 0; s < ARC_PSTAT_NUMTYPES; s++)
+					st->aps_value[s] +=
+					    aps->aps_cpu[c].apc_stat[s];
+			}
+			/* a racing update may be folded in half-way */
+			if ((int64_t)st->aps_value[ARC_PSTAT_SIZE] < 0)
+				st->aps_value[ARC_PSTAT_SIZE] = 0;
+			(*np)++;
+		}
+		mutex_exit(ARC_PSTATS_LOCK(i));
 	}
+
+	*apsp = stats;
+}
+
+static void
+arc_pstats_init(void)
+{
+	int i;
+
+	for (i = 0; i < ARC_PSTATS_LOCKS; i++)
+		mutex_init(&arc_pstats_locks[i], NULL, MUTEX_DEFAULT, NULL);
+}
+
+static void
+arc_pstats_fini(void)
+{
+	arc_pstats_t *aps;
+	int i;
+
+	for (i = 0; i < ARC_PSTATS_HASH_SIZE; i++) {
+		while ((aps = arc_pstats_table[i]) != NULL) {
+			arc_pstats_table[i] = aps->aps_next;
+			arc_pstats_free(aps);
+		}
+	}
+	for (i = 0; i < ARC_PSTATS_LOCKS; i++)
+		mutex_destroy(&arc_pstats_locks[i]);
 }
 
 /*
@@ -1418,66 +2127,67 @@ static void
 arc_change_state(arc_state_t *new_state, arc_buf_hdr_t *ab, kmutex_t *hash_lock)
 {
 	arc_state_t *old_state = ab->b_state;
-	int64_t refcnt = refcount_count(&ab->b_refcnt);
+	int64_t refcnt = 0;
+	uint32_t datacnt = 0;
+	uint64_t csize = 0;
 	uint64_t from_delta, to_delta;
 
 	ASSERT(MUTEX_HELD(hash_lock));
 	ASSERT3P(new_state, !=, old_state);
-	ASSERT(refcnt == 0 || ab->b_datacnt > 0);
-	ASSERT(ab->b_datacnt == 0 || !GHOST_STATE(new_state));
-	ASSERT(ab->b_datacnt <= 1 || old_state != arc_anon);
+	if (HDR_L2_ONLY(ab)) {
+		ASSERT(new_state == arc_anon || new_state == arc_l2c_only);
+	} else {
+		refcnt = refcount_count(&ab->b_refcnt);
+		datacnt = ab->b_datacnt;
+		csize = ab->b_csize;
+		ASSERT(ab->b_cdata == NULL || !GHOST_STATE(new_state));
+	}
+	ASSERT(refcnt == 0 || datacnt > 0);
+	ASSERT(datacnt == 0 || !GHOST_STATE(new_state));
+	ASSERT(datacnt <= 1 || old_state != arc_anon);
 
-	from_delta = to_delta = ab->b_datacnt * ab->b_size;
+	from_delta = to_delta = datacnt * ab->b_size + csize;
 
 	/*
 	 * If this buffer is evictable, transfer it from the
-	 * old state list to the new state list.
+	 * old state list to the new state list.  ARC_l2c_only
+	 * headers are never evicted from their state, so that
+	 * state keeps no lists.
 	 */
 	if (refcnt == 0) {
 		if (old_state != arc_anon) {
-			int use_mutex = !MUTEX_HELD(&old_state->arcs_mtx);
 			uint64_t *size = &old_state->arcs_lsize[ab->b_type];
 
-			if (use_mutex)
-				mutex_enter(&old_state->arcs_mtx);
-
-			ASSERT(list_link_active(&ab->b_arc_node));
-			list_remove(&old_state->arcs_list[ab->b_type], ab);
-
 			/*
 			 * If prefetching out of the ghost cache,
 			 * we will have a non-zero datacnt.
 			 */
-			if (GHOST_STATE(old_state) && ab->b_datacnt == 0) {
+			if (GHOST_STATE(old_state) && datacnt == 0) {
 				/* ghost elements have a ghost size */
-				ASSERT(ab->b_buf == NULL);
+				ASSERT(HDR_L2_ONLY(ab) || ab->b_buf == NULL);
 				from_delta = ab->b_size;
 			}
-			ASSERT3U(*size, >=, from_delta);
-			atomic_add_64(size, -from_delta);
-
-			if (use_mutex)
-				mutex_exit(&old_state->arcs_mtx);
+			if (old_state != arc_l2c_only) {
+				multilist_remove(
+				    &old_state->arcs_list[ab->b_type], ab);
+				ASSERT3U(*size, >=, from_delta);
+				atomic_add_64(size, -from_delta);
+			}
 		}
 		if (new_state != arc_anon) {
-			int use_mutex = !MUTEX_HELD(&new_state->arcs_mtx);
 			uint64_t *size = &new_state->arcs_lsize[ab->b_type];
 
-			if (use_mutex)
-				mutex_enter(&new_state->arcs_mtx);
-
-			list_insert_head(&new_state->arcs_list[ab->b_type], ab);
-
 			/* ghost elements have a ghost size */
 			if (GHOST_STATE(new_state)) {
-				ASSERT(ab->b_datacnt == 0);
-				ASSERT(ab->b_buf == NULL);
+				ASSERT(datacnt == 0);
+				ASSERT(HDR_L2_ONLY(ab) || ab->b_buf == NULL);
 				to_delta = ab->b_size;
 			}
-			atomic_add_64(size, to_delta);
-
-			if (use_mutex)
-				mutex_exit(&new_state->arcs_mtx);
+			if (new_state != arc_l2c_only) {
+				multilist_insert(
+				    &new_state->arcs_list[ab->b_type], ab);
+				atomic_add_64(size, to_delta);
+			}
 		}
 	}
 
@@ -1494,11 +2204,106 @@ arc_change_state(arc_state_t *new_state, arc_buf_hdr_t *ab, kmutex_t *hash_lock)
 	}
 	ab->b_state = new_state;
 
+	/* adjust header sizes */
+	if (old_state != arc_anon)
+		atomic_add_64(&old_state->arcs_hdr_size, -ARC_HDR_SIZE(ab));
+	if (new_state != arc_anon)
+		atomic_add_64(&new_state->arcs_hdr_size, ARC_HDR_SIZE(ab));
+
 	/* adjust l2arc hdr stats */
 	if (new_state == arc_l2c_only)
-		l2arc_hdr_stat_add();
+		l2arc_hdr_stat_add(ab);
 	else if (old_state == arc_l2c_only)
-		l2arc_hdr_stat_remove();
+		l2arc_hdr_stat_remove(ab);
+}
+
+/*
+ * Replaces an ARC_l2c_only header with a copy of the other kind: a
+ * slim one when the header has just entered the state, or a full one
+ * when a read is about to bring the block back into the ARC.  The
+ * copy takes over the old header's place in the hash table and on
+ * the L2ARC buffer list, and the old header is freed.  The hash lock
+ * must be held.
+ */
+static arc_buf_hdr_t *
+arc_hdr_realloc(arc_buf_hdr_t *hdr, boolean_t l2only)
+{
+	arc_buf_hdr_t *nhdr, *fhdr, **hdrp;
+	list_t *buflist;
+	boolean_t buflist_held = MUTEX_HELD(&l2arc_buflist_mtx);
+	uint64_t idx = BUF_HASH_INDEX(hdr->b_spa, &hdr->b_dva, hdr->b_birth);
+
+	ASSERT(MUTEX_HELD(BUF_HASH_LOCK(idx)));
+	ASSERT(HDR_IN_HASH_TABLE(hdr));
+	ASSERT3P(hdr->b_state, ==, arc_l2c_only);
+	ASSERT3P(hdr->b_l2hdr, !=, NULL);
+
+	if (l2only) {
+		ASSERT(!HDR_L2_ONLY(hdr));
+		ASSERT(refcount_is_zero(&hdr->b_refcnt));
+		ASSERT3P(hdr->b_buf, ==, NULL);
+		ASSERT3P(hdr->b_cdata, ==, NULL);
+		ASSERT3P(hdr->b_acb, ==, NULL);
+		ASSERT(!multilist_link_active(&hdr->b_arc_node));
+
+		nhdr = kmem_cache_alloc(hdr_l2only_cache, KM_PUSHPAGE);
+		bcopy(hdr, nhdr, HDR_L2ONLY_SIZE);
+		nhdr->b_flags |= ARC_L2_ONLY;
+	} else {
+		ASSERT(HDR_L2_ONLY(hdr));
+
+		nhdr = kmem_cache_alloc(hdr_cache, KM_PUSHPAGE);
+		bcopy(hdr, nhdr, HDR_L2ONLY_SIZE);
+		nhdr->b_flags &= ~ARC_L2_ONLY;
+		nhdr->b_buf = NULL;
+		nhdr->b_datacnt = 0;
+		nhdr->b_acb = NULL;
+		nhdr->b_cdata = NULL;
+		nhdr->b_csize = 0;
+		nhdr->b_ccompress = ZIO_COMPRESS_OFF;
+		nhdr->b_objset_pstats = NULL;
+		nhdr->b_type_pstats = NULL;
+		nhdr->b_arc_access = 0;
+		nhdr->b_mru_hits = 0;
+		nhdr->b_mru_ghost_hits = 0;
+		nhdr->b_mfu_hits = 0;
+		nhdr->b_mfu_ghost_hits = 0;
+		nhdr->b_l2_hits = 0;
+	}
+	list_link_init(&nhdr->b_l2node);
+
+	hdrp = buf_hash_bucket(idx);
+	while ((fhdr = *hdrp) != hdr) {
+		ASSERT(fhdr != NULL);
+		hdrp = &fhdr->b_hash_next;
+	}
+	*hdrp = nhdr;
+
+	if (!buflist_held)
+		mutex_enter(&l2arc_buflist_mtx);
+	buflist = hdr->b_l2hdr->b_dev->l2ad_buflist;
+	list_insert_after(buflist, hdr, nhdr);
+	list_remove(buflist, hdr);
+	if (!buflist_held)
+		mutex_exit(&l2arc_buflist_mtx);
+
+	l2arc_hdr_stat_remove(hdr);
+	l2arc_hdr_stat_add(nhdr);
+	atomic_add_64(&arc_l2c_only->arcs_hdr_size,
+	    ARC_HDR_SIZE(nhdr) - ARC_HDR_SIZE(hdr));
+
+	buf_discard_identity(hdr);
+	hdr->b_hash_next = NULL;
+	hdr->b_freeze_cksum = NULL;
+	hdr->b_l2hdr = NULL;
+	if (l2only) {
+		/* slim hdrs are not charged to anything */
+		arc_hdr_clear_pstats(hdr);
+		kmem_cache_free(hdr_cache, hdr);
+	} else
+		kmem_cache_free(hdr_l2only_cache, hdr);
+
+	return (nhdr);
 }
 
 void
@@ -1581,6 +2386,8 @@ arc_buf_alloc(spa_t *spa, int size, void *tag, arc_buf_contents_t type)
 	hdr->b_type = type;
 	hdr->b_spa = spa_load_guid(spa);
 	hdr->b_state = arc_anon;
+	hdr->b_objset_pstats = NULL;
+	hdr->b_type_pstats = NULL;
 	hdr->b_arc_access = 0;
 	hdr->b_mru_hits = 0;
 	hdr->b_mru_ghost_hits = 0;
@@ -1717,6 +2524,7 @@ arc_buf_add_ref(arc_buf_t *buf, void* tag)
 	ARCSTAT_CONDSTAT(!(hdr->b_flags & ARC_PREFETCH),
 	    demand, prefetch, hdr->b_type != ARC_BUFC_METADATA,
 	    data, metadata, hits);
+	arc_pstats_access(hdr, B_TRUE);
 }
 
 /*
@@ -1744,7 +2552,7 @@ arc_buf_data_free(arc_buf_t *buf, void (*free_func)(void *, size_t))
 }
 
 static void
-arc_buf_destroy(arc_buf_t *buf, boolean_t recycle, boolean_t all)
+arc_buf_destroy(arc_buf_t *buf, boolean_t all)
 {
 	arc_buf_t **bufp;
 
@@ -1757,17 +2565,15 @@ arc_buf_destroy(arc_buf_t *buf, boolean_t recycle, boolean_t all)
 		arc_cksum_verify(buf);
 		arc_buf_unwatch(buf);
 
-		if (!recycle) {
-			if (type == ARC_BUFC_METADATA) {
-				arc_buf_data_free(buf, zio_buf_free);
-				arc_space_return(size, ARC_SPACE_META);
-			} else {
-				ASSERT(type == ARC_BUFC_DATA);
-				arc_buf_data_free(buf, zio_data_buf_free);
-				arc_space_return(size, ARC_SPACE_DATA);
-			}
+		if (type == ARC_BUFC_METADATA) {
+			arc_buf_data_free(buf, zio_buf_free);
+			arc_space_return(size, ARC_SPACE_META);
+		} else {
+			ASSERT(type == ARC_BUFC_DATA);
+			arc_buf_data_free(buf, zio_data_buf_free);
+			arc_space_return(size, ARC_SPACE_DATA);
 		}
-		if (list_link_active(&buf->b_hdr->b_arc_node)) {
+		if (multilist_link_active(&buf->b_hdr->b_arc_node)) {
 			uint64_t *cnt = &state->arcs_lsize[type];
 
 			ASSERT(refcount_is_zero(&buf->b_hdr->b_refcnt));
@@ -1778,6 +2584,7 @@ arc_buf_destroy(arc_buf_t *buf, boolean_t recycle, boolean_t all)
 		}
 		ASSERT3U(state->arcs_size, >=, size);
 		atomic_add_64(&state->arcs_size, -size);
+		arc_pstats_space(buf->b_hdr, -size);
 		buf->b_data = NULL;
 
 		/*
@@ -1793,21 +2600,125 @@ arc_buf_destroy(arc_buf_t *buf, boolean_t recycle, boolean_t all)
 		buf->b_hdr->b_datacnt -= 1;
 	}
 
-	/* only remove the buf if requested */
-	if (!all)
-		return;
+	/* only remove the buf if requested */
+	if (!all)
+		return;
+
+	/* remove the buf from the hdr list */
+	for (bufp = &buf->b_hdr->b_buf; *bufp != buf; bufp = &(*bufp)->b_next)
+		continue;
+	*bufp = buf->b_next;
+	buf->b_next = NULL;
+
+	ASSERT(buf->b_efunc == NULL);
+
+	/* clean up the buf */
+	buf->b_hdr = NULL;
+	kmem_cache_free(buf_cache, buf);
+}
+
+/*
+ * Attach a compressed copy of csize bytes to the hdr.  The copy is
+ * charged to the hdr's state like a buffer is, and is what remains
+ * cached of the block once its last buffer has been released.
+ */
+static void
+arc_cdata_alloc(arc_buf_hdr_t *hdr, enum zio_compress compress,
+    uint64_t csize)
+{
+	arc_state_t *state = hdr->b_state;
+
+	ASSERT3P(hdr->b_cdata, ==, NULL);
+	ASSERT3U(hdr->b_type, ==, ARC_BUFC_DATA);
+	ASSERT3U(csize, <, hdr->b_size);
+	ASSERT(!GHOST_STATE(state));
+
+	hdr->b_cdata = zio_data_buf_alloc(csize);
+	hdr->b_csize = csize;
+	hdr->b_ccompress = compress;
+	arc_space_consume(csize, ARC_SPACE_DATA);
+	arc_pstats_space(hdr, csize);
+
+	atomic_add_64(&state->arcs_size, csize);
+	if (multilist_link_active(&hdr->b_arc_node)) {
+		ASSERT(refcount_is_zero(&hdr->b_refcnt));
+		atomic_add_64(&state->arcs_lsize[hdr->b_type], csize);
+	}
+
+	ARCSTAT_INCR(arcstat_compressed_size, csize);
+	ARCSTAT_INCR(arcstat_uncompressed_size, hdr->b_size);
+}
+
+static void
+arc_cdata_free(arc_buf_hdr_t *hdr)
+{
+	arc_state_t *state = hdr->b_state;
+	uint64_t csize = hdr->b_csize;
+
+	ASSERT3P(hdr->b_cdata, !=, NULL);
+
+	if (multilist_link_active(&hdr->b_arc_node)) {
+		uint64_t *cnt = &state->arcs_lsize[hdr->b_type];
+
+		ASSERT(refcount_is_zero(&hdr->b_refcnt));
+		ASSERT3U(*cnt, >=, csize);
+		atomic_add_64(cnt, -csize);
+	}
+	ASSERT3U(state->arcs_size, >=, csize);
+	atomic_add_64(&state->arcs_size, -csize);
+
+	zio_data_buf_free(hdr->b_cdata, csize);
+	arc_space_return(csize, ARC_SPACE_DATA);
+	arc_pstats_space(hdr, -csize);
+	hdr->b_cdata = NULL;
+	hdr->b_csize = 0;
+	hdr->b_ccompress = ZIO_COMPRESS_OFF;
+
+	ARCSTAT_INCR(arcstat_compressed_size, -csize);
+	ARCSTAT_INCR(arcstat_uncompressed_size, -hdr->b_size);
+}
+
+/*
+ * A hdr with a compressed copy only keeps its logical buffer around
+ * while somebody references it.
+ */
+static boolean_t
+arc_buf_demote_needed(arc_buf_hdr_t *hdr)
+{
+	return (hdr->b_cdata != NULL && refcount_is_zero(&hdr->b_refcnt));
+}
 
-	/* remove the buf from the hdr list */
-	for (bufp = &buf->b_hdr->b_buf; *bufp != buf; bufp = &(*bufp)->b_next)
-		continue;
-	*bufp = buf->b_next;
+/*
+ * Hand out a new buffer for a hdr that only has its compressed copy
+ * cached.  The caller holds the hash lock and a reference on the hdr.
+ */
+static arc_buf_t *
+arc_buf_decompress(arc_buf_hdr_t *hdr)
+{
+	arc_buf_t *buf;
+
+	ASSERT3P(hdr->b_cdata, !=, NULL);
+	ASSERT3P(hdr->b_buf, ==, NULL);
+	ASSERT3U(hdr->b_datacnt, ==, 0);
+	ASSERT(!refcount_is_zero(&hdr->b_refcnt));
+
+	buf = kmem_cache_alloc(buf_cache, KM_PUSHPAGE);
+	buf->b_hdr = hdr;
+	buf->b_data = NULL;
+	buf->b_efunc = NULL;
+	buf->b_private = NULL;
 	buf->b_next = NULL;
+	hdr->b_buf = buf;
+	hdr->b_datacnt = 1;
+	arc_get_data_buf(buf);
 
-	ASSERT(buf->b_efunc == NULL);
+	VERIFY0(zio_decompress_data(hdr->b_ccompress, hdr->b_cdata,
+	    buf->b_data, hdr->b_csize, hdr->b_size));
+	arc_cksum_verify(buf);
+	arc_buf_watch(buf);
+	ARCSTAT_BUMP(arcstat_compressed_hits);
 
-	/* clean up the buf */
-	buf->b_hdr = NULL;
-	kmem_cache_free(buf_cache, buf);
+	return (buf);
 }
 
 static void
@@ -1815,7 +2726,7 @@ arc_hdr_destroy(arc_buf_hdr_t *hdr)
 {
 	l2arc_buf_hdr_t *l2hdr = hdr->b_l2hdr;
 
-	ASSERT(refcount_is_zero(&hdr->b_refcnt));
+	ASSERT(HDR_L2_ONLY(hdr) || refcount_is_zero(&hdr->b_refcnt));
 	ASSERT3P(hdr->b_state, ==, arc_anon);
 	ASSERT(!HDR_IO_IN_PROGRESS(hdr));
 
@@ -1843,7 +2754,7 @@ arc_hdr_destroy(arc_buf_hdr_t *hdr)
 			kmem_cache_free(l2arc_hdr_cache, l2hdr);
 			arc_space_return(L2HDR_SIZE, ARC_SPACE_L2HDRS);
 			if (hdr->b_state == arc_l2c_only)
-				l2arc_hdr_stat_remove();
+				l2arc_hdr_stat_remove(hdr);
 			hdr->b_l2hdr = NULL;
 		}
 
@@ -1855,6 +2766,15 @@ arc_hdr_destroy(arc_buf_hdr_t *hdr)
 		ASSERT(!HDR_IN_HASH_TABLE(hdr));
 		buf_discard_identity(hdr);
 	}
+	if (HDR_L2_ONLY(hdr)) {
+		if (hdr->b_freeze_cksum != NULL) {
+			kmem_free(hdr->b_freeze_cksum, sizeof (zio_cksum_t));
+			hdr->b_freeze_cksum = NULL;
+		}
+		ASSERT3P(hdr->b_hash_next, ==, NULL);
+		kmem_cache_free(hdr_l2only_cache, hdr);
+		return;
+	}
 	while (hdr->b_buf) {
 		arc_buf_t *buf = hdr->b_buf;
 
@@ -1862,7 +2782,7 @@ arc_hdr_destroy(arc_buf_hdr_t *hdr)
 			mutex_enter(&arc_eviction_mtx);
 			mutex_enter(&buf->b_evict_lock);
 			ASSERT(buf->b_hdr != NULL);
-			arc_buf_destroy(hdr->b_buf, FALSE, FALSE);
+			arc_buf_destroy(hdr->b_buf, FALSE);
 			hdr->b_buf = buf->b_next;
 			buf->b_hdr = &arc_eviction_hdr;
 			buf->b_next = arc_eviction_list;
@@ -1870,15 +2790,19 @@ arc_hdr_destroy(arc_buf_hdr_t *hdr)
 			mutex_exit(&buf->b_evict_lock);
 			mutex_exit(&arc_eviction_mtx);
 		} else {
-			arc_buf_destroy(hdr->b_buf, FALSE, TRUE);
+			arc_buf_destroy(hdr->b_buf, TRUE);
 		}
 	}
+	if (hdr->b_cdata != NULL)
+		arc_cdata_free(hdr);
 	if (hdr->b_freeze_cksum != NULL) {
 		kmem_free(hdr->b_freeze_cksum, sizeof (zio_cksum_t));
 		hdr->b_freeze_cksum = NULL;
 	}
 
-	ASSERT(!list_link_active(&hdr->b_arc_node));
+	arc_hdr_clear_pstats(hdr);
+
+	ASSERT(!multilist_link_active(&hdr->b_arc_node));
 	ASSERT3P(hdr->b_hash_next, ==, NULL);
 	ASSERT3P(hdr->b_acb, ==, NULL);
 	kmem_cache_free(hdr_cache, hdr);
@@ -1901,8 +2825,8 @@ arc_buf_free(arc_buf_t *buf, void *tag)
 		ASSERT3P(hash_lock, ==, HDR_LOCK(hdr));
 
 		(void) remove_reference(hdr, hash_lock, tag);
-		if (hdr->b_datacnt > 1) {
-			arc_buf_destroy(buf, FALSE, TRUE);
+		if (hdr->b_datacnt > 1 || arc_buf_demote_needed(hdr)) {
+			arc_buf_destroy(buf, TRUE);
 		} else {
 			ASSERT(buf == hdr->b_buf);
 			ASSERT(buf->b_efunc == NULL);
@@ -1925,7 +2849,7 @@ arc_buf_free(arc_buf_t *buf, void *tag)
 			arc_hdr_destroy(hdr);
 	} else {
 		if (remove_reference(hdr, NULL, tag) > 0)
-			arc_buf_destroy(buf, FALSE, TRUE);
+			arc_buf_destroy(buf, TRUE);
 		else
 			arc_hdr_destroy(hdr);
 	}
@@ -1953,11 +2877,14 @@ arc_buf_remove_ref(arc_buf_t *buf, void* tag)
 	(void) remove_reference(hdr, hash_lock, tag);
 	if (hdr->b_datacnt > 1) {
 		if (no_callback)
-			arc_buf_destroy(buf, FALSE, TRUE);
+			arc_buf_destroy(buf, TRUE);
 	} else if (no_callback) {
 		ASSERT(hdr->b_buf == buf && buf->b_next == NULL);
 		ASSERT(buf->b_efunc == NULL);
-		hdr->b_flags |= ARC_BUF_AVAILABLE;
+		if (arc_buf_demote_needed(hdr))
+			arc_buf_destroy(buf, TRUE);
+		else
+			hdr->b_flags |= ARC_BUF_AVAILABLE;
 	}
 	ASSERT(no_callback || hdr->b_datacnt > 1 ||
 	    refcount_is_zero(&hdr->b_refcnt));
@@ -1976,6 +2903,11 @@ arc_buf_size(arc_buf_t *buf)
  * evicted. In order to ensure proper locking, the eviction must be initiated
  * from the DMU. Return true if the buffer is associated with user data and
  * duplicate buffers still exist.
+ *
+ * A hdr keeping a compressed copy does not call for eviction: the dbuf
+ * cache then holds the decompressed buffer while the dbuf is cached, and
+ * it is only freed, leaving the compressed copy, once the dbuf cache lets
+ * go of it.
  */
 boolean_t
 arc_buf_eviction_needed(arc_buf_t *buf)
@@ -1983,9 +2915,6 @@ arc_buf_eviction_needed(arc_buf_t *buf)
 	arc_buf_hdr_t *hdr;
 	boolean_t evict_needed = B_FALSE;
 
-	if (zfs_disable_dup_eviction)
-		return (B_FALSE);
-
 	mutex_enter(&buf->b_evict_lock);
 	hdr = buf->b_hdr;
 	if (hdr == NULL) {
@@ -2006,7 +2935,8 @@ arc_buf_eviction_needed(arc_buf_t *buf)
 		return (B_TRUE);
 	}
 
-	if (hdr->b_datacnt > 1 && hdr->b_type == ARC_BUFC_DATA)
+	if (hdr->b_datacnt > 1 && hdr->b_type == ARC_BUFC_DATA &&
+	    !zfs_disable_dup_eviction)
 		evict_needed = B_TRUE;
 
 	mutex_exit(&buf->b_evict_lock);
@@ -2014,56 +2944,40 @@ arc_buf_eviction_needed(arc_buf_t *buf)
 }
 
 /*
- * Evict buffers from list until we've removed the specified number of
- * bytes.  Move the removed buffers to the appropriate evict state.
- * If the recycle flag is set, then attempt to "recycle" a buffer:
- * - look for a buffer to evict that is `bytes' long.
- * - return the data block from this buffer rather than freeing it.
- * This flag is used by callers that are trying to make space for a
- * new buffer in a full arc cache.
- *
- * This function makes a "best effort".  It skips over any buffers
- * it can't get a hash_lock on, and so may not catch all candidates.
- * It may also return without evicting as much space as requested.
+ * Evict buffers from sublist idx of a state list, walking it from the
+ * tail, until target bytes have been evicted (or the whole sublist, if
+ * target is negative).
  */
-static void *
-arc_evict(arc_state_t *state, uint64_t spa, int64_t bytes, boolean_t recycle,
-    arc_buf_contents_t type)
+static uint64_t
+arc_evict_sublist(arc_state_t *state, unsigned int idx, uint64_t spa,
+    int64_t target, arc_buf_contents_t type, uint64_t *skippedp,
+    uint64_t *missedp)
 {
 	arc_state_t *evicted_state;
-	uint64_t bytes_evicted = 0, skipped = 0, missed = 0;
+	multilist_t *ml = &state->arcs_list[type];
+	multilist_sublist_t *mls;
+	uint64_t bytes_evicted = 0;
 	arc_buf_hdr_t *ab, *ab_prev = NULL;
-	list_t *list = &state->arcs_list[type];
 	kmutex_t *hash_lock;
 	boolean_t have_lock;
-	void *stolen = NULL;
 	arc_buf_hdr_t marker = {{{ 0 }}};
 	int count = 0;
 
-	ASSERT(state == arc_mru || state == arc_mfu);
-
 	evicted_state = (state == arc_mru) ? arc_mru_ghost : arc_mfu_ghost;
 
-top:
-	mutex_enter(&state->arcs_mtx);
-	mutex_enter(&evicted_state->arcs_mtx);
+	mls = multilist_sublist_lock(ml, idx);
 
-	for (ab = list_tail(list); ab; ab = ab_prev) {
-		ab_prev = list_prev(list, ab);
+	for (ab = multilist_sublist_tail(mls); ab; ab = ab_prev) {
+		ab_prev = multilist_sublist_prev(mls, ab);
 		/* prefetch buffers have a minimum lifespan */
 		if (HDR_IO_IN_PROGRESS(ab) ||
 		    (spa && ab->b_spa != spa) ||
 		    (ab->b_flags & (ARC_PREFETCH|ARC_INDIRECT) &&
 		    ddi_get_lbolt() - ab->b_arc_access <
 		    zfs_arc_min_prefetch_lifespan)) {
-			skipped++;
+			(*skippedp)++;
 			continue;
 		}
-		/* "lookahead" for better eviction candidate */
-		if (recycle && ab->b_size != bytes &&
-		    ab_prev && ab_prev->b_size == bytes)
-			continue;
-
 		/* ignore markers */
 		if (ab->b_spa == 0)
 			continue;
@@ -2071,23 +2985,18 @@ top:
 		/*
 		 * It may take a long time to evict all the bufs requested.
 		 * To avoid blocking all arc activity, periodically drop
-		 * the arcs_mtx and give other threads a chance to run
+		 * the sublist lock and give other threads a chance to run
 		 * before reacquiring the lock.
-		 *
-		 * If we are looking for a buffer to recycle, we are in
-		 * the hot code path, so don't sleep.
 		 */
-		if (!recycle && count++ > arc_evict_iterations) {
-			list_insert_after(list, ab, &marker);
-			mutex_exit(&evicted_state->arcs_mtx);
-			mutex_exit(&state->arcs_mtx);
+		if (count++ > arc_evict_iterations) {
+			multilist_sublist_insert_after(mls, ab, &marker);
+			multilist_sublist_unlock(mls);
 #ifdef LINUX
 			kpreempt(KPREEMPT_SYNC);
 #endif
-			mutex_enter(&state->arcs_mtx);
-			mutex_enter(&evicted_state->arcs_mtx);
-			ab_prev = list_prev(list, &marker);
-			list_remove(list, &marker);
+			mls = multilist_sublist_lock(ml, idx);
+			ab_prev = multilist_sublist_prev(mls, &marker);
+			multilist_sublist_remove(mls, &marker);
 			count = 0;
 			continue;
 		}
@@ -2096,26 +3005,18 @@ top:
 		have_lock = MUTEX_HELD(hash_lock);
 		if (have_lock || mutex_tryenter(hash_lock)) {
 			ASSERT3U(refcount_count(&ab->b_refcnt), ==, 0);
-			ASSERT(ab->b_datacnt > 0);
+			ASSERT(ab->b_datacnt > 0 || ab->b_cdata != NULL);
 			while (ab->b_buf) {
 				arc_buf_t *buf = ab->b_buf;
 				if (!mutex_tryenter(&buf->b_evict_lock)) {
-					missed += 1;
+					(*missedp)++;
 					break;
 				}
-				if (buf->b_data) {
+				if (buf->b_data)
 					bytes_evicted += ab->b_size;
-					if (recycle && ab->b_type == type &&
-					    ab->b_size == bytes &&
-					    !HDR_L2_WRITING(ab)) {
-						stolen = buf->b_data;
-						recycle = FALSE;
-					}
-				}
 				if (buf->b_efunc) {
 					mutex_enter(&arc_eviction_mtx);
-					arc_buf_destroy(buf,
-					    buf->b_data == stolen, FALSE);
+					arc_buf_destroy(buf, FALSE);
 					ab->b_buf = buf->b_next;
 					buf->b_hdr = &arc_eviction_hdr;
 					buf->b_next = arc_eviction_list;
@@ -2124,8 +3025,7 @@ top:
 					mutex_exit(&buf->b_evict_lock);
 				} else {
 					mutex_exit(&buf->b_evict_lock);
-					arc_buf_destroy(buf,
-					    buf->b_data == stolen, TRUE);
+					arc_buf_destroy(buf, TRUE);
 				}
 			}
 
@@ -2143,6 +3043,15 @@ top:
 				}
 			}
 
+			/*
+			 * The header hashes to the same sublist index in
+			 * the ghost state, whose lock is taken inside
+			 * arc_change_state() while we still hold this one.
+			 */
+			if (ab->b_datacnt == 0 && ab->b_cdata != NULL) {
+				bytes_evicted += ab->b_csize;
+				arc_cdata_free(ab);
+			}
 			if (ab->b_datacnt == 0) {
 				arc_change_state(evicted_state, ab, hash_lock);
 				ASSERT(HDR_IN_HASH_TABLE(ab));
@@ -2152,22 +3061,71 @@ top:
 			}
 			if (!have_lock)
 				mutex_exit(hash_lock);
-			if (bytes >= 0 && bytes_evicted >= bytes)
+			if (target >= 0 && bytes_evicted >= target)
 				break;
 		} else {
-			missed += 1;
+			(*missedp)++;
 		}
 	}
 
-	mutex_exit(&evicted_state->arcs_mtx);
-	mutex_exit(&state->arcs_mtx);
+	multilist_sublist_unlock(mls);
+
+	return (bytes_evicted);
+}
+
+/*
+ * Evict buffers from list until we've removed the specified number of
+ * bytes.  Move the removed buffers to the appropriate evict state.
+ * Return the number of bytes evicted.
+ *
+ * The list is split into sublists, which are visited round-robin from
+ * a random starting point.  Each one gives up an equal share of what is
+ * still left to evict, taken from its tail; since headers are spread
+ * over the sublists by hash the tails are of about the same age, which
+ * keeps eviction close to LRU order.
+ *
+ * This function makes a "best effort".  It skips over any buffers
+ * it can't get a hash_lock on, and so may not catch all candidates.
+ * It may also return without evicting as much space as requested.
+ */
+static uint64_t
+arc_evict(arc_state_t *state, uint64_t spa, int64_t bytes,
+    arc_buf_contents_t type)
+{
+	multilist_t *ml;
+	uint64_t bytes_evicted = 0, skipped = 0, missed = 0;
+	uint64_t evicted, pass;
+	unsigned int i, idx, num;
+	int64_t target;
+
+	ASSERT(state == arc_mru || state == arc_mfu);
+
+top:
+	ml = &state->arcs_list[type];
+	num = multilist_get_num_sublists(ml);
+
+	do {
+		pass = 0;
+		idx = multilist_get_random_index(ml);
+		for (i = 0; i < num; i++, idx = (idx + 1) % num) {
+			if (bytes < 0) {
+				target = -1;
+			} else if (bytes_evicted >= bytes) {
+				break;
+			} else {
+				target = (bytes - bytes_evicted + num - i - 1) /
+				    (num - i);
+			}
+
+			evicted = arc_evict_sublist(state, idx, spa, target,
+			    type, &skipped, &missed);
+			bytes_evicted += evicted;
+			pass += evicted;
+		}
+	} while (bytes >= 0 && bytes_evicted < bytes && pass > 0);
 
-	if (list == &state->arcs_list[ARC_BUFC_DATA] &&
-	    (bytes < 0 || bytes_evicted < bytes)) {
-		/* Prevent second pass from recycling metadata into data */
-		recycle = FALSE;
+	if (type == ARC_BUFC_DATA && (bytes < 0 || bytes_evicted < bytes)) {
 		type = ARC_BUFC_METADATA;
-		list = &state->arcs_list[type];
 		goto top;
 	}
 
@@ -2188,31 +3146,31 @@ top:
 	 * this chore to the arc_reclaim_thread().
 	 */
 
-	return (stolen);
+	return (bytes_evicted);
 }
 
 /*
- * Remove buffers from list until we've removed the specified number of
- * bytes.  Destroy the buffers that are removed.
+ * Remove buffers from sublist idx of a ghost state list until target
+ * bytes have been deleted (or the whole sublist, if target is negative,
+ * in which case we also wait for busy hash locks).
  */
-static void
-arc_evict_ghost(arc_state_t *state, uint64_t spa, int64_t bytes,
-    arc_buf_contents_t type)
+static uint64_t
+arc_evict_ghost_sublist(arc_state_t *state, unsigned int idx, uint64_t spa,
+    int64_t target, arc_buf_contents_t type, uint64_t *skippedp)
 {
 	arc_buf_hdr_t *ab, *ab_prev;
 	arc_buf_hdr_t marker;
-	list_t *list = &state->arcs_list[type];
+	multilist_t *ml = &state->arcs_list[type];
+	multilist_sublist_t *mls;
 	kmutex_t *hash_lock;
 	uint64_t bytes_deleted = 0;
-	uint64_t bufs_skipped = 0;
 	int count = 0;
 
-	ASSERT(GHOST_STATE(state));
 	bzero(&marker, sizeof (marker));
-top:
-	mutex_enter(&state->arcs_mtx);
-	for (ab = list_tail(list); ab; ab = ab_prev) {
-		ab_prev = list_prev(list, ab);
+
+	mls = multilist_sublist_lock(ml, idx);
+	for (ab = multilist_sublist_tail(mls); ab; ab = ab_prev) {
+		ab_prev = multilist_sublist_prev(mls, ab);
 		if (ab->b_type > ARC_BUFC_NUMTYPES)
 			panic("invalid ab=%p", (void *)ab);
 		if (spa && ab->b_spa != spa)
@@ -2230,18 +3188,18 @@ top:
 		/*
 		 * It may take a long time to evict all the bufs requested.
 		 * To avoid blocking all arc activity, periodically drop
-		 * the arcs_mtx and give other threads a chance to run
+		 * the sublist lock and give other threads a chance to run
 		 * before reacquiring the lock.
 		 */
 		if (count++ > arc_evict_iterations) {
-			list_insert_after(list, ab, &marker);
-			mutex_exit(&state->arcs_mtx);
+			multilist_sublist_insert_after(mls, ab, &marker);
+			multilist_sublist_unlock(mls);
 #ifdef LINUX
 			kpreempt(KPREEMPT_SYNC);
 #endif
-			mutex_enter(&state->arcs_mtx);
-			ab_prev = list_prev(list, &marker);
-			list_remove(list, &marker);
+			mls = multilist_sublist_lock(ml, idx);
+			ab_prev = multilist_sublist_prev(mls, &marker);
+			multilist_sublist_remove(mls, &marker);
 			count = 0;
 			continue;
 		}
@@ -2254,10 +3212,19 @@ top:
 			if (ab->b_l2hdr != NULL) {
 				/*
 				 * This buffer is cached on the 2nd Level ARC;
-				 * don't destroy the header.
+				 * don't destroy the header, but trade it for
+				 * a slim one.  That takes l2arc_buflist_mtx,
+				 * so the sublist lock is dropped around it.
 				 */
+				multilist_sublist_insert_after(mls, ab,
+				    &marker);
 				arc_change_state(arc_l2c_only, ab, hash_lock);
+				multilist_sublist_unlock(mls);
+				(void) arc_hdr_realloc(ab, B_TRUE);
 				mutex_exit(hash_lock);
+				mls = multilist_sublist_lock(ml, idx);
+				ab_prev = multilist_sublist_prev(mls, &marker);
+				multilist_sublist_remove(mls, &marker);
 			} else {
 				arc_change_state(arc_anon, ab, hash_lock);
 				mutex_exit(hash_lock);
@@ -2265,30 +3232,73 @@ top:
 			}
 
 			DTRACE_PROBE1(arc__delete, arc_buf_hdr_t *, ab);
-			if (bytes >= 0 && bytes_deleted >= bytes)
+			if (target >= 0 && bytes_deleted >= target)
 				break;
-		} else if (bytes < 0) {
+		} else if (target < 0) {
 			/*
 			 * Insert a list marker and then wait for the
 			 * hash lock to become available. Once its
 			 * available, restart from where we left off.
 			 */
-			list_insert_after(list, ab, &marker);
-			mutex_exit(&state->arcs_mtx);
+			multilist_sublist_insert_after(mls, ab, &marker);
+			multilist_sublist_unlock(mls);
 			mutex_enter(hash_lock);
 			mutex_exit(hash_lock);
-			mutex_enter(&state->arcs_mtx);
-			ab_prev = list_prev(list, &marker);
-			list_remove(list, &marker);
+			mls = multilist_sublist_lock(ml, idx);
+			ab_prev = multilist_sublist_prev(mls, &marker);
+			multilist_sublist_remove(mls, &marker);
 		} else {
-			bufs_skipped += 1;
+			(*skippedp)++;
 		}
 	}
-	mutex_exit(&state->arcs_mtx);
+	multilist_sublist_unlock(mls);
+
+	return (bytes_deleted);
+}
+
+/*
+ * Remove buffers from list until we've removed the specified number of
+ * bytes.  Destroy the buffers that are removed.  The sublists are
+ * visited the same way as in arc_evict().
+ */
+static void
+arc_evict_ghost(arc_state_t *state, uint64_t spa, int64_t bytes,
+    arc_buf_contents_t type)
+{
+	multilist_t *ml;
+	uint64_t bytes_deleted = 0;
+	uint64_t bufs_skipped = 0;
+	uint64_t deleted, pass;
+	unsigned int i, idx, num;
+	int64_t target;
+
+	ASSERT(GHOST_STATE(state));
+top:
+	ml = &state->arcs_list[type];
+	num = multilist_get_num_sublists(ml);
+
+	do {
+		pass = 0;
+		idx = multilist_get_random_index(ml);
+		for (i = 0; i < num; i++, idx = (idx + 1) % num) {
+			if (bytes < 0) {
+				target = -1;
+			} else if (bytes_deleted >= bytes) {
+				break;
+			} else {
+				target = (bytes - bytes_deleted + num - i - 1) /
+				    (num - i);
+			}
+
+			deleted = arc_evict_ghost_sublist(state, idx, spa,
+			    target, type, &bufs_skipped);
+			bytes_deleted += deleted;
+			pass += deleted;
+		}
+	} while (bytes >= 0 && bytes_deleted < bytes && pass > 0);
 
-	if (list == &state->arcs_list[ARC_BUFC_DATA] &&
-	    (bytes < 0 || bytes_deleted < bytes)) {
-		list = &state->arcs_list[ARC_BUFC_METADATA];
+	if (type == ARC_BUFC_DATA && (bytes < 0 || bytes_deleted < bytes)) {
+		type = ARC_BUFC_METADATA;
 		goto top;
 	}
 
@@ -2302,8 +3312,12 @@ top:
 		    (longlong_t)bytes_deleted, state);
 }
 
+/*
+ * Evict from the MRU and MFU until arc_size is down to target, and trim
+ * the ghost lists to arc_c.
+ */
 static void
-arc_adjust(void)
+arc_adjust(uint64_t target)
 {
 	int64_t adjustment, delta;
 
@@ -2311,44 +3325,42 @@ arc_adjust(void)
 	 * Adjust MRU size
 	 */
 
-	adjustment = MIN((int64_t)(arc_size - arc_c),
+	adjustment = MIN((int64_t)(arc_size - target),
 	    (int64_t)(arc_anon->arcs_size + arc_mru->arcs_size - arc_p));
 
 	if (adjustment > 0 && arc_mru->arcs_size > 0) {
 		delta = MIN(arc_mru->arcs_size, adjustment);
-		(void) arc_evict(arc_mru, 0, delta, FALSE, ARC_BUFC_DATA);
+		(void) arc_evict(arc_mru, 0, delta, ARC_BUFC_DATA);
 		adjustment -= delta;
 	}
 
-	adjustment = MIN((int64_t)(arc_size - arc_c),
+	adjustment = MIN((int64_t)(arc_size - target),
 	    (int64_t)(arc_anon->arcs_size + arc_mru->arcs_size + arc_meta_used -
 	    arc_p));
 
 	if (adjustment > 0 && arc_mru->arcs_lsize[ARC_BUFC_METADATA] > 0) {
 		delta = MIN(arc_mru->arcs_lsize[ARC_BUFC_METADATA], adjustment);
-		(void) arc_evict(arc_mru, 0, delta, FALSE,
-		    ARC_BUFC_METADATA);
+		(void) arc_evict(arc_mru, 0, delta, ARC_BUFC_METADATA);
 	}
 
 	/*
 	 * Adjust MFU size
 	 */
 
-	adjustment = arc_size - arc_c;
+	adjustment = arc_size - target;
 
 	if (adjustment > 0 && arc_mfu->arcs_size > 0) {
 		delta = MIN(arc_mfu->arcs_size, adjustment);
-		(void) arc_evict(arc_mfu, 0, delta, FALSE, ARC_BUFC_DATA);
+		(void) arc_evict(arc_mfu, 0, delta, ARC_BUFC_DATA);
 		adjustment -= delta;
 	}
 
-	adjustment = arc_size - arc_c;
+	adjustment = arc_size - target;
 
 	if (adjustment > 0 && arc_mfu->arcs_lsize[ARC_BUFC_METADATA] > 0) {
 		int64_t delta = MIN(adjustment,
 		    arc_mfu->arcs_lsize[ARC_BUFC_METADATA]);
-		(void) arc_evict(arc_mfu, 0, delta, FALSE,
-		    ARC_BUFC_METADATA);
+		(void) arc_evict(arc_mfu, 0, delta, ARC_BUFC_METADATA);
 	}
 
 	/*
@@ -2438,8 +3450,9 @@ arc_do_user_evicts(void)
 
 /*
  * Evict only meta data objects from the cache leaving the data objects.
- * This is only used to enforce the tunable arc_meta_limit, if we are
- * unable to evict enough buffers notify the user via the prune callback.
+ * This is only used to enforce the tunable arc_meta_limit.  If it can't
+ * evict enough, callers that hold no hash locks may ask the users to
+ * drop references via arc_do_user_prune().
  */
 static void
 arc_adjust_meta(void)
@@ -2458,7 +3471,7 @@ arc_adjust_meta(void)
 
 	if (adjustmnt > 0 && arc_mru->arcs_lsize[ARC_BUFC_METADATA] > 0) {
 		delta = MIN(arc_mru->arcs_lsize[ARC_BUFC_METADATA], adjustmnt);
-		arc_evict(arc_mru, 0, delta, FALSE, ARC_BUFC_METADATA);
+		arc_evict(arc_mru, 0, delta, ARC_BUFC_METADATA);
 		adjustmnt -= delta;
 	}
 
@@ -2474,7 +3487,7 @@ arc_adjust_meta(void)
 
 	if (adjustmnt > 0 && arc_mfu->arcs_lsize[ARC_BUFC_METADATA] > 0) {
 		delta = MIN(arc_mfu->arcs_lsize[ARC_BUFC_METADATA], adjustmnt);
-		arc_evict(arc_mfu, 0, delta, FALSE, ARC_BUFC_METADATA);
+		arc_evict(arc_mfu, 0, delta, ARC_BUFC_METADATA);
 	}
 
 	adjustmnt = arc_mru->arcs_lsize[ARC_BUFC_METADATA] +
@@ -2494,9 +3507,6 @@ arc_adjust_meta(void)
 		    arc_mfu_ghost->arcs_lsize[ARC_BUFC_METADATA]);
 		arc_evict_ghost(arc_mfu_ghost, 0, delta, ARC_BUFC_METADATA);
 	}
-
-	if (arc_meta_used > arc_meta_limit)
-		arc_do_user_prune(zfs_arc_meta_prune);
 }
 
 /*
@@ -2511,23 +3521,23 @@ arc_flush(spa_t *spa)
 	if (spa)
 		guid = spa_load_guid(spa);
 
-	while (list_head(&arc_mru->arcs_list[ARC_BUFC_DATA])) {
-		(void) arc_evict(arc_mru, guid, -1, FALSE, ARC_BUFC_DATA);
+	while (!multilist_is_empty(&arc_mru->arcs_list[ARC_BUFC_DATA])) {
+		(void) arc_evict(arc_mru, guid, -1, ARC_BUFC_DATA);
 		if (spa)
 			break;
 	}
-	while (list_head(&arc_mru->arcs_list[ARC_BUFC_METADATA])) {
-		(void) arc_evict(arc_mru, guid, -1, FALSE, ARC_BUFC_METADATA);
+	while (!multilist_is_empty(&arc_mru->arcs_list[ARC_BUFC_METADATA])) {
+		(void) arc_evict(arc_mru, guid, -1, ARC_BUFC_METADATA);
 		if (spa)
 			break;
 	}
-	while (list_head(&arc_mfu->arcs_list[ARC_BUFC_DATA])) {
-		(void) arc_evict(arc_mfu, guid, -1, FALSE, ARC_BUFC_DATA);
+	while (!multilist_is_empty(&arc_mfu->arcs_list[ARC_BUFC_DATA])) {
+		(void) arc_evict(arc_mfu, guid, -1, ARC_BUFC_DATA);
 		if (spa)
 			break;
 	}
-	while (list_head(&arc_mfu->arcs_list[ARC_BUFC_METADATA])) {
-		(void) arc_evict(arc_mfu, guid, -1, FALSE, ARC_BUFC_METADATA);
+	while (!multilist_is_empty(&arc_mfu->arcs_list[ARC_BUFC_METADATA])) {
+		(void) arc_evict(arc_mfu, guid, -1, ARC_BUFC_METADATA);
 		if (spa)
 			break;
 	}
@@ -2570,7 +3580,7 @@ arc_shrink(uint64_t bytes)
 	}
 
 	if (arc_size > arc_c)
-		arc_adjust();
+		arc_adjust(arc_c);
 }
 
 static void
@@ -2822,7 +3832,7 @@ arc_reclaim_thread(void *dummy __unused)
          * used to avoid collapsing the arc_c value when only the
          * arc_meta_limit is being exceeded.
          */
-        arc_adjust();
+        arc_adjust(arc_c);
 
 
 #ifdef _KARNEL
@@ -2909,8 +3919,10 @@ arc_adapt_thread(void)
 			arc_no_grow = FALSE;
 
 		arc_adjust_meta();
+		if (arc_meta_used > arc_meta_limit)
+			arc_do_user_prune(zfs_arc_meta_prune);
 
-		arc_adjust();
+		arc_adjust(arc_c);
 
 		if (arc_eviction_list != NULL)
 			arc_do_user_evicts();
@@ -3075,6 +4087,22 @@ SPL_SHRINKER_DECLARE(arc_shrinker, arc_shrinker_func, DEFAULT_SEEKS);
 #endif
 #endif /* _KERNEL */
 
+/*
+ * The free headroom below arc_c at which the eviction thread starts,
+ * and the headroom it evicts back up to.
+ */
+static uint64_t
+arc_evict_lowat(void)
+{
+	return (arc_c >> zfs_arc_evict_lowat_shift);
+}
+
+static uint64_t
+arc_evict_hiwat(void)
+{
+	return (MAX(arc_c >> zfs_arc_evict_hiwat_shift, arc_evict_lowat()));
+}
+
 /*
  * Adapt arc info given the number of bytes we are trying to add and
  * the state that we are comming from.  This function is only called
@@ -3126,10 +4154,12 @@ arc_adapt(int bytes, arc_state_t *state)
 		return;
 
 	/*
-	 * If we're within (2 * maxblocksize) bytes of the target
-	 * cache size, increment the target cache size
+	 * If we're within (2 * maxblocksize) bytes of the size the
+	 * eviction thread keeps the cache at, increment the target
+	 * cache size
 	 */
-	if (arc_size > arc_c - (2ULL << SPA_MAXBLOCKSHIFT)) {
+	if (arc_size + arc_evict_hiwat() + (2ULL << SPA_MAXBLOCKSHIFT) >
+	    arc_c) {
 		atomic_add_64(&arc_c, (int64_t)bytes);
 		if (arc_c > arc_c_max)
 			arc_c = arc_c_max;
@@ -3142,8 +4172,8 @@ arc_adapt(int bytes, arc_state_t *state)
 }
 
 /*
- * Check if the cache has reached its limits and eviction is required
- * prior to insert.
+ * Check if the headroom below arc_c has dropped under the low watermark
+ * (or metadata is over its limit), so the eviction thread should run.
  */
 static int
 arc_evict_needed(arc_buf_contents_t type)
@@ -3151,34 +4181,90 @@ arc_evict_needed(arc_buf_contents_t type)
 	if (type == ARC_BUFC_METADATA && arc_meta_used >= arc_meta_limit)
 		return (1);
 
-	if (arc_no_grow)
-		return (1);
+	return (arc_size + arc_evict_lowat() > arc_c);
+}
+
+/*
+ * Wake the eviction thread, and if the cache is already over its
+ * target wait for it to make a pass.  Callers go ahead with their
+ * allocation after one pass, so a cache full of referenced buffers
+ * slows them down without deadlocking them.
+ */
+static void
+arc_evict_wait(void)
+{
+	if (arc_evict_running && arc_size <= arc_c)
+		return;
+
+	mutex_enter(&arc_evict_lock);
+	if (!arc_evict_running)
+		cv_signal(&arc_evict_cv);
+	if (arc_size > arc_c) {
+		ARCSTAT_BUMP(arcstat_evict_waits);
+		cv_wait(&arc_evict_waiters_cv, &arc_evict_lock);
+	}
+	mutex_exit(&arc_evict_lock);
+}
+
+/*
+ * Evicts ahead of demand, so that allocations find free headroom below
+ * arc_c instead of evicting under the state locks themselves.  Callers
+ * of arc_evict_wait() may hold a hash lock, so this thread must never
+ * block on one; in particular it does not run the prune callbacks, and
+ * it hands growing the hash table, which takes every hash lock in turn,
+ * to arc_hash_taskq.  buf_hash_table is only looked at here while no
+ * grow is in progress, since the grow frees the old table.
+ */
+static void
+arc_evict_thread(void)
+{
+	callb_cpr_t	cpr;
+	uint64_t	size;
+
+	CALLB_CPR_INIT(&cpr, &arc_evict_lock, callb_generic_cpr, FTAG);
+
+	mutex_enter(&arc_evict_lock);
+	while (arc_evict_thread_exit == 0) {
+		if (arc_evict_needed(ARC_BUFC_METADATA)) {
+			arc_evict_running = B_TRUE;
+			mutex_exit(&arc_evict_lock);
+
+			size = arc_size;
+			if (arc_meta_used > arc_meta_limit)
+				arc_adjust_meta();
+			arc_adjust(arc_c - MIN(arc_evict_hiwat(), arc_c));
+
+			mutex_enter(&arc_evict_lock);
+			arc_evict_running = B_FALSE;
+			cv_broadcast(&arc_evict_waiters_cv);
+
+			/* go again as long as eviction makes progress */
+			if (arc_size < size)
+				continue;
+		}
+
+		if (!arc_hash_growing && buf_hash_grow_needed() &&
+		    taskq_dispatch(arc_hash_taskq, buf_hash_grow_task, NULL,
+		    TQ_NOSLEEP) != 0)
+			arc_hash_growing = B_TRUE;
+
+		/* block until needed, or one second, whichever is shorter */
+		CALLB_CPR_SAFE_BEGIN(&cpr);
+		(void) cv_timedwait_interruptible(&arc_evict_cv,
+		    &arc_evict_lock, (ddi_get_lbolt() + hz));
+		CALLB_CPR_SAFE_END(&cpr, &arc_evict_lock);
+	}
 
-	return (arc_size > arc_c);
+	arc_evict_thread_exit = 0;
+	cv_broadcast(&arc_evict_cv);
+	CALLB_CPR_EXIT(&cpr);		/* drops arc_evict_lock */
+	thread_exit();
 }
 
 /*
  * The buffer, supplied as the first argument, needs a data block.
- * So, if we are at cache max, determine which cache should be victimized.
- * We have the following cases:
- *
- * 1. Insert for MRU, p > sizeof(arc_anon + arc_mru) ->
- * In this situation if we're out of space, but the resident size of the MFU is
- * under the limit, victimize the MFU cache to satisfy this insertion request.
- *
- * 2. Insert for MRU, p <= sizeof(arc_anon + arc_mru) ->
- * Here, we've used up all of the available space for the MRU, so we need to
- * evict from our own cache instead.  Evict from the set of resident MRU
- * entries.
- *
- * 3. Insert for MFU (c - p) > sizeof(arc_mfu) ->
- * c minus p represents the MFU space in the cache, since p is the size of the
- * cache that is dedicated to the MRU.  In this situation there's still space on
- * the MFU side, so the MRU side needs to be victimized.
- *
- * 4. Insert for MFU (c - p) < sizeof(arc_mfu) ->
- * MFU's resident set is consuming more space than it has been allotted.  In
- * this situation, we must victimize our own cache, the MFU, for this insertion.
+ * Eviction is left to arc_evict_thread(); this only wakes it when the
+ * headroom below arc_c runs low, and waits for it when there is none.
  */
 static void
 arc_get_data_buf(arc_buf_t *buf)
@@ -3186,91 +4272,24 @@ arc_get_data_buf(arc_buf_t *buf)
 	arc_state_t		*state = buf->b_hdr->b_state;
 	uint64_t		size = buf->b_hdr->b_size;
 	arc_buf_contents_t	type = buf->b_hdr->b_type;
-	arc_buf_contents_t	evict = ARC_BUFC_DATA;
-	boolean_t		recycle = TRUE;
 
 	arc_adapt(size, state);
 
-	/*
-	 * We have not yet reached cache maximum size,
-	 * just allocate a new buffer.
-	 */
-	if (!arc_evict_needed(type)) {
-		if (type == ARC_BUFC_METADATA) {
-			buf->b_data = zio_buf_alloc(size);
-			arc_space_consume(size, ARC_SPACE_META);
-		} else {
-			ASSERT(type == ARC_BUFC_DATA);
-			buf->b_data = zio_data_buf_alloc(size);
-			arc_space_consume(size, ARC_SPACE_DATA);
-		}
-		goto out;
-	}
-
-	/*
-	 * If we are prefetching from the mfu ghost list, this buffer
-	 * will end up on the mru list; so steal space from there.
-	 */
-	if (state == arc_mfu_ghost)
-		state = buf->b_hdr->b_flags & ARC_PREFETCH ? arc_mru : arc_mfu;
-	else if (state == arc_mru_ghost)
-		state = arc_mru;
-
-	if (state == arc_mru || state == arc_anon) {
-		uint64_t mru_used = arc_anon->arcs_size + arc_mru->arcs_size;
-		state = (arc_mfu->arcs_lsize[type] >= size &&
-		    arc_p > mru_used) ? arc_mfu : arc_mru;
-	} else {
-		/* MFU cases */
-		uint64_t mfu_space = arc_c - arc_p;
-		state =  (arc_mru->arcs_lsize[type] >= size &&
-		    mfu_space > arc_mfu->arcs_size) ? arc_mru : arc_mfu;
-	}
+	if (arc_evict_needed(type))
+		arc_evict_wait();
 
-	/*
-	 * Evict data buffers prior to metadata buffers, unless we're
-	 * over the metadata limit and adding a metadata buffer.
-	 */
 	if (type == ARC_BUFC_METADATA) {
-		if (arc_meta_used >= arc_meta_limit)
-			evict = ARC_BUFC_METADATA;
-		else
-			/*
-			 * In this case, we're evicting data while
-			 * adding metadata. Thus, to prevent recycling a
-			 * data buffer into a metadata buffer, recycling
-			 * is disabled in the following arc_evict call.
-			 */
-			recycle = FALSE;
+		buf->b_data = zio_buf_alloc(size);
+		arc_space_consume(size, ARC_SPACE_META);
+	} else {
+		ASSERT(type == ARC_BUFC_DATA);
+		buf->b_data = zio_data_buf_alloc(size);
+		arc_space_consume(size, ARC_SPACE_DATA);
 	}
 
-	if ((buf->b_data = arc_evict(state, 0, size, recycle, evict)) == NULL) {
-		if (type == ARC_BUFC_METADATA) {
-			buf->b_data = zio_buf_alloc(size);
-			arc_space_consume(size, ARC_SPACE_META);
-
-			/*
-			 * If we are unable to recycle an existing meta buffer
-			 * signal the reclaim thread.  It will notify users
-			 * via the prune callback to drop references.  The
-			 * prune callback in run in the context of the reclaim
-			 * thread to avoid deadlocking on the hash_lock.
-			 * Of course, only do this when recycle is true.
-			 */
-			if (recycle)
-				cv_signal(&arc_reclaim_thr_cv);
-		} else {
-			ASSERT(type == ARC_BUFC_DATA);
-			buf->b_data = zio_data_buf_alloc(size);
-			arc_space_consume(size, ARC_SPACE_DATA);
-		}
-
-		/* Only bump this if we tried to recycle and failed */
-		if (recycle)
-			ARCSTAT_BUMP(arcstat_recycle_miss);
-	}
 	ASSERT(buf->b_data != NULL);
-out:
+	arc_pstats_space(buf->b_hdr, size);
+
 	/*
 	 * Update the state size.  Note that ghost states have a
 	 * "ghost size" and so don't need to be updated.
@@ -3279,7 +4298,7 @@ out:
 		arc_buf_hdr_t *hdr = buf->b_hdr;
 
 		atomic_add_64(&hdr->b_state->arcs_size, size);
-		if (list_link_active(&hdr->b_arc_node)) {
+		if (multilist_link_active(&hdr->b_arc_node)) {
 			ASSERT(refcount_is_zero(&hdr->b_refcnt));
 			atomic_add_64(&hdr->b_state->arcs_lsize[type], size);
 		}
@@ -3330,7 +4349,7 @@ arc_access(arc_buf_hdr_t *buf, kmutex_t *hash_lock)
 		 */
 		if ((buf->b_flags & ARC_PREFETCH) != 0) {
 			if (refcount_count(&buf->b_refcnt) == 0) {
-				ASSERT(list_link_active(&buf->b_arc_node));
+				ASSERT(multilist_link_active(&buf->b_arc_node));
 			} else {
 				buf->b_flags &= ~ARC_PREFETCH;
 				atomic_inc_32(&buf->b_mru_hits);
@@ -3392,7 +4411,7 @@ arc_access(arc_buf_hdr_t *buf, kmutex_t *hash_lock)
 		 */
 		if ((buf->b_flags & ARC_PREFETCH) != 0) {
 			ASSERT(refcount_count(&buf->b_refcnt) == 0);
-			ASSERT(list_link_active(&buf->b_arc_node));
+			ASSERT(multilist_link_active(&buf->b_arc_node));
 		}
 		atomic_inc_32(&buf->b_mfu_hits);
 		ARCSTAT_BUMP(arcstat_mfu_hits);
@@ -3476,19 +4495,34 @@ arc_read_done(zio_t *zio)
 	 * it's in the hash table, and it should be legit since it's
 	 * not possible to evict it during the I/O.  The only possible
 	 * reason for it not to be found is if we were freed during the
-	 * read.
+	 * read.  The hdr of an embedded block pointer is never hashed.
 	 */
-	found = buf_hash_find(hdr->b_spa, &hdr->b_dva, hdr->b_birth,
-	    &hash_lock);
-
-	ASSERT((found == NULL && HDR_FREED_IN_READ(hdr) && hash_lock == NULL) ||
-	    (found == hdr && DVA_EQUAL(&hdr->b_dva, BP_IDENTITY(zio->io_bp))) ||
-	    (found == hdr && HDR_L2_READING(hdr)));
+	if (HDR_IN_HASH_TABLE(hdr)) {
+		found = buf_hash_find(hdr->b_spa, &hdr->b_dva, hdr->b_birth,
+		    &hash_lock);
+
+		ASSERT((found == NULL && HDR_FREED_IN_READ(hdr) &&
+		    hash_lock == NULL) ||
+		    (found == hdr &&
+		    DVA_EQUAL(&hdr->b_dva, BP_IDENTITY(zio->io_bp))) ||
+		    (found == hdr && HDR_L2_READING(hdr)));
+	} else {
+		hash_lock = NULL;
+	}
 
 	hdr->b_flags &= ~ARC_L2_EVICTED;
 	if (l2arc_noprefetch && (hdr->b_flags & ARC_PREFETCH))
 		hdr->b_flags &= ~ARC_L2CACHE;
 
+	/*
+	 * The block was read into the compressed copy, whose checksum
+	 * has been verified; fill in the logical buffer from it.
+	 */
+	if (hdr->b_cdata != NULL && zio->io_error == 0 &&
+	    zio_decompress_data(hdr->b_ccompress, hdr->b_cdata,
+	    buf->b_data, hdr->b_csize, hdr->b_size) != 0)
+		zio->io_error = SET_ERROR(EIO);
+
 	/* byteswap if necessary */
 	callback_list = hdr->b_acb;
 	ASSERT(callback_list != NULL);
@@ -3501,7 +4535,13 @@ arc_read_done(zio_t *zio)
 		    dmu_ot_byteswap[bswap].ob_func(buf->b_data, hdr->b_size);
 	}
 
-	arc_cksum_compute(buf, B_FALSE);
+	/*
+	 * The l2arc may write the compressed copy after the logical
+	 * buffer is gone, and l2arc_read_done() needs a checksum to
+	 * validate it against.
+	 */
+	arc_cksum_compute(buf, hdr->b_cdata != NULL && zio->io_error == 0 &&
+	    (hdr->b_flags & ARC_L2CACHE) && l2arc_ndev != 0);
 	arc_buf_watch(buf);
 
 	if (hash_lock && zio->io_error == 0 && hdr->b_state == arc_anon) {
@@ -3539,11 +4579,18 @@ arc_read_done(zio_t *zio)
 
 	if (zio->io_error != 0) {
 		hdr->b_flags |= ARC_IO_ERROR;
+		if (hdr->b_cdata != NULL)
+			arc_cdata_free(hdr);
 		if (hdr->b_state != arc_anon)
 			arc_change_state(arc_anon, hdr, hash_lock);
 		if (HDR_IN_HASH_TABLE(hdr))
 			buf_hash_remove(hdr);
 		freeable = refcount_is_zero(&hdr->b_refcnt);
+	} else if (hash_lock != NULL && HDR_BUF_AVAILABLE(hdr) &&
+	    arc_buf_demote_needed(hdr)) {
+		/* nobody wants the data yet, e.g. a prefetch */
+		hdr->b_flags &= ~ARC_BUF_AVAILABLE;
+		arc_buf_destroy(buf, TRUE);
 	}
 
 	/*
@@ -3612,17 +4659,28 @@ arc_read(zio_t *pio, spa_t *spa, const blkptr_t *bp, arc_done_func_t *done,
     void *private, zio_priority_t priority, int zio_flags, uint32_t *arc_flags,
     const zbookmark_t *zb)
 {
-	arc_buf_hdr_t *hdr;
+	arc_buf_hdr_t *hdr = NULL;
 	arc_buf_t *buf = NULL;
-	kmutex_t *hash_lock;
+	kmutex_t *hash_lock = NULL;
 	zio_t *rzio;
 	uint64_t guid = spa_load_guid(spa);
 	int rc = 0;
 
+	/*
+	 * The data of an embedded block pointer is in the bp itself, so
+	 * there is nothing to prefetch.  It is not cached either: its hdr
+	 * is anonymous and the "read" only decodes the bp.
+	 */
+	if (BP_IS_EMBEDDED(bp) && done == NULL)
+		return (0);
+
 top:
-	hdr = buf_hash_find(guid, BP_IDENTITY(bp), BP_PHYSICAL_BIRTH(bp),
-	    &hash_lock);
-	if (hdr && hdr->b_datacnt > 0) {
+	if (!BP_IS_EMBEDDED(bp)) {
+		hdr = buf_hash_find(guid, BP_IDENTITY(bp),
+		    BP_PHYSICAL_BIRTH(bp), &hash_lock);
+	}
+	if (hdr && !HDR_L2_ONLY(hdr) &&
+	    (hdr->b_datacnt > 0 || hdr->b_cdata != NULL)) {
 
 		*arc_flags |= ARC_CACHED;
 
@@ -3659,7 +4717,11 @@ top:
 
 		ASSERT(hdr->b_state == arc_mru || hdr->b_state == arc_mfu);
 
-		if (done) {
+		if (done && hdr->b_datacnt == 0) {
+			/* only the compressed copy is cached */
+			add_reference(hdr, hash_lock, private);
+			buf = arc_buf_decompress(hdr);
+		} else if (done) {
 			add_reference(hdr, hash_lock, private);
 			/*
 			 * If this block is already in use, create a new
@@ -3686,6 +4748,11 @@ top:
 			hdr->b_flags |= ARC_L2CACHE;
 		if (*arc_flags & ARC_L2COMPRESS)
 			hdr->b_flags |= ARC_L2COMPRESS;
+		/*
+		 * A prefetch hit holds no reference, so the hdr, and with
+		 * it what it is charged to, may go once the lock is dropped.
+		 */
+		arc_pstats_access(hdr, B_TRUE);
 		mutex_exit(hash_lock);
 		ARCSTAT_BUMP(arcstat_hits);
 		ARCSTAT_CONDSTAT(!(hdr->b_flags & ARC_PREFETCH),
@@ -3705,15 +4772,19 @@ top:
 
 		if (hdr == NULL) {
 			/* this block is not in the cache */
-			arc_buf_hdr_t	*exists;
+			arc_buf_hdr_t	*exists = NULL;
 			arc_buf_contents_t type = BP_GET_BUFC_TYPE(bp);
 			buf = arc_buf_alloc(spa, size, private, type);
 			hdr = buf->b_hdr;
-			hdr->b_dva = *BP_IDENTITY(bp);
-			hdr->b_birth = BP_PHYSICAL_BIRTH(bp);
-			hdr->b_cksum0 = bp->blk_cksum.zc_word[0];
-			exists = buf_hash_insert(hdr, &hash_lock);
-			if (exists) {
+			arc_hdr_set_pstats(hdr, zb->zb_objset,
+			    BP_GET_TYPE(bp));
+			if (!BP_IS_EMBEDDED(bp)) {
+				hdr->b_dva = *BP_IDENTITY(bp);
+				hdr->b_birth = BP_PHYSICAL_BIRTH(bp);
+				hdr->b_cksum0 = bp->blk_cksum.zc_word[0];
+				exists = buf_hash_insert(hdr, &hash_lock);
+			}
+			if (exists != NULL) {
 				/* somebody beat us to the hash insert */
 				mutex_exit(hash_lock);
 				buf_discard_identity(hdr);
@@ -3736,8 +4807,12 @@ top:
 			/* this block is in the ghost cache */
 			ASSERT(GHOST_STATE(hdr->b_state));
 			ASSERT(!HDR_IO_IN_PROGRESS(hdr));
+			if (HDR_L2_ONLY(hdr))
+				hdr = arc_hdr_realloc(hdr, B_FALSE);
 			ASSERT3U(refcount_count(&hdr->b_refcnt), ==, 0);
 			ASSERT(hdr->b_buf == NULL);
+			arc_hdr_set_pstats(hdr, zb->zb_objset,
+			    BP_GET_TYPE(bp));
 
 			/* if this is a prefetch, we don't have a reference */
 			if (*arc_flags & ARC_PREFETCH)
@@ -3785,7 +4860,21 @@ top:
 				vd = NULL;
 		}
 
-		mutex_exit(hash_lock);
+		/*
+		 * Unless the block comes from the l2arc, read it as it is
+		 * on disk into a compressed copy; arc_read_done() then
+		 * decompresses it into the buffer.
+		 */
+		if (vd == NULL && zfs_compressed_arc_enabled &&
+		    hdr->b_type == ARC_BUFC_DATA && !BP_IS_EMBEDDED(bp) &&
+		    BP_GET_COMPRESS(bp) != ZIO_COMPRESS_OFF &&
+		    !BP_SHOULD_BYTESWAP(bp) &&
+		    BP_GET_PSIZE(bp) < BP_GET_LSIZE(bp))
+			arc_cdata_alloc(hdr, BP_GET_COMPRESS(bp),
+			    BP_GET_PSIZE(bp));
+
+		if (hash_lock != NULL)
+			mutex_exit(hash_lock);
 
 		/*
 		 * At this point, we have a level 1 cache miss.  Try again in
@@ -3798,6 +4887,7 @@ top:
 		ARCSTAT_CONDSTAT(!(hdr->b_flags & ARC_PREFETCH),
 		    demand, prefetch, hdr->b_type != ARC_BUFC_METADATA,
 		    data, metadata, misses);
+		arc_pstats_access(hdr, B_FALSE);
 
 		if (vd != NULL && l2arc_ndev != 0 && !(l2arc_norw && devw)) {
 			/*
@@ -3886,8 +4976,14 @@ top:
 			}
 		}
 
-		rzio = zio_read(pio, spa, bp, buf->b_data, size,
-		    arc_read_done, buf, priority, zio_flags, zb);
+		if (hdr->b_cdata != NULL) {
+			rzio = zio_read(pio, spa, bp, hdr->b_cdata,
+			    hdr->b_csize, arc_read_done, buf, priority,
+			    zio_flags | ZIO_FLAG_RAW, zb);
+		} else {
+			rzio = zio_read(pio, spa, bp, buf->b_data, size,
+			    arc_read_done, buf, priority, zio_flags, zb);
+		}
 
 		if (*arc_flags & ARC_WAIT) {
 			rc = zio_wait(rzio);
@@ -4025,9 +5121,16 @@ arc_buf_evict(arc_buf_t *buf)
 	*bufp = buf->b_next;
 
 	ASSERT(buf->b_data != NULL);
-	arc_buf_destroy(buf, FALSE, FALSE);
+	arc_buf_destroy(buf, FALSE);
 
-	if (hdr->b_datacnt == 0) {
+	/*
+	 * A hdr with a compressed copy stays in its state; only
+	 * arc_evict() moves it to the ghost lists.
+	 */
+	if (hdr->b_datacnt == 0 && hdr->b_cdata != NULL) {
+		ASSERT(hdr->b_buf == NULL);
+		hdr->b_flags &= ~ARC_BUF_AVAILABLE;
+	} else if (hdr->b_datacnt == 0) {
 		arc_state_t *old_state = hdr->b_state;
 		arc_state_t *evicted_state;
 
@@ -4037,16 +5140,10 @@ arc_buf_evict(arc_buf_t *buf)
 		evicted_state =
 		    (old_state == arc_mru) ? arc_mru_ghost : arc_mfu_ghost;
 
-		mutex_enter(&old_state->arcs_mtx);
-		mutex_enter(&evicted_state->arcs_mtx);
-
 		arc_change_state(evicted_state, hdr, hash_lock);
 		ASSERT(HDR_IN_HASH_TABLE(hdr));
 		hdr->b_flags |= ARC_IN_HASH_TABLE;
 		hdr->b_flags &= ~ARC_BUF_AVAILABLE;
-
-		mutex_exit(&evicted_state->arcs_mtx);
-		mutex_exit(&old_state->arcs_mtx);
 	}
 	mutex_exit(hash_lock);
 	mutex_exit(&buf->b_evict_lock);
@@ -4114,6 +5211,8 @@ arc_release(arc_buf_t *buf, void *tag)
 		uint64_t spa = hdr->b_spa;
 		arc_buf_contents_t type = hdr->b_type;
 		uint32_t flags = hdr->b_flags;
+		arc_pstats_t *objset_pstats = hdr->b_objset_pstats;
+		arc_pstats_t *type_pstats = hdr->b_type_pstats;
 
 		ASSERT(hdr->b_buf != buf || buf->b_next != NULL);
 		/*
@@ -4156,6 +5255,10 @@ arc_release(arc_buf_t *buf, void *tag)
 		nhdr->b_type = type;
 		nhdr->b_buf = buf;
 		nhdr->b_state = arc_anon;
+		nhdr->b_objset_pstats = objset_pstats;
+		nhdr->b_type_pstats = type_pstats;
+		arc_pstats_add_ref(objset_pstats);
+		arc_pstats_add_ref(type_pstats);
 		nhdr->b_arc_access = 0;
 		nhdr->b_mru_hits = 0;
 		nhdr->b_mru_ghost_hits = 0;
@@ -4166,6 +5269,9 @@ arc_release(arc_buf_t *buf, void *tag)
 		nhdr->b_l2hdr = NULL;
 		nhdr->b_datacnt = 1;
 		nhdr->b_freeze_cksum = NULL;
+		nhdr->b_cdata = NULL;
+		nhdr->b_csize = 0;
+		nhdr->b_ccompress = ZIO_COMPRESS_OFF;
 		(void) refcount_add(&nhdr->b_refcnt, tag);
 		buf->b_hdr = nhdr;
 		mutex_exit(&buf->b_evict_lock);
@@ -4173,8 +5279,10 @@ arc_release(arc_buf_t *buf, void *tag)
 	} else {
 		mutex_exit(&buf->b_evict_lock);
 		ASSERT(refcount_count(&hdr->b_refcnt) == 1);
-		ASSERT(!list_link_active(&hdr->b_arc_node));
+		ASSERT(!multilist_link_active(&hdr->b_arc_node));
 		ASSERT(!HDR_IO_IN_PROGRESS(hdr));
+		if (hdr->b_cdata != NULL)
+			arc_cdata_free(hdr);
 		if (hdr->b_state != arc_anon)
 			arc_change_state(arc_anon, hdr, hash_lock);
 		hdr->b_arc_access = 0;
@@ -4299,18 +5407,22 @@ arc_write_done(zio_t *zio)
 	ASSERT(hdr->b_acb == NULL);
 
 	if (zio->io_error == 0) {
-		hdr->b_dva = *BP_IDENTITY(zio->io_bp);
-		hdr->b_birth = BP_PHYSICAL_BIRTH(zio->io_bp);
-		hdr->b_cksum0 = zio->io_bp->blk_cksum.zc_word[0];
+		if (BP_IS_EMBEDDED(zio->io_bp)) {
+			buf_discard_identity(hdr);
+		} else {
+			hdr->b_dva = *BP_IDENTITY(zio->io_bp);
+			hdr->b_birth = BP_PHYSICAL_BIRTH(zio->io_bp);
+			hdr->b_cksum0 = zio->io_bp->blk_cksum.zc_word[0];
+		}
 	} else {
 		ASSERT(BUF_EMPTY(hdr));
 	}
 
 	/*
-	 * If the block to be written was all-zero, we may have
-	 * compressed it away.  In this case no write was performed
-	 * so there will be no dva/birth/checksum.  The buffer must
-	 * therefore remain anonymous (and uncached).
+	 * If the block to be written was all-zero or was embedded in
+	 * its block pointer, no write was performed so there will be
+	 * no dva/birth/checksum.  The buffer must therefore remain
+	 * anonymous (and uncached).
 	 */
 	if (!BUF_EMPTY(hdr)) {
 		arc_buf_hdr_t *exists;
@@ -4331,7 +5443,8 @@ arc_write_done(zio_t *zio)
 				if (!BP_EQUAL(&zio->io_bp_orig, zio->io_bp))
 					panic("bad overwrite, hdr=%p exists=%p",
 					    (void *)hdr, (void *)exists);
-				ASSERT(refcount_is_zero(&exists->b_refcnt));
+				ASSERT(HDR_L2_ONLY(exists) ||
+				    refcount_is_zero(&exists->b_refcnt));
 				arc_change_state(arc_anon, exists, hash_lock);
 				mutex_exit(hash_lock);
 				arc_hdr_destroy(exists);
@@ -4386,6 +5499,7 @@ arc_write(zio_t *pio, spa_t *spa, uint64_t txg,
 		hdr->b_flags |= ARC_L2CACHE;
 	if (l2arc_compress)
 		hdr->b_flags |= ARC_L2COMPRESS;
+	arc_hdr_set_pstats(hdr, zb->zb_objset, zp->zp_type);
 	callback = kmem_zalloc(sizeof (arc_write_callback_t), KM_PUSHPAGE);
 	callback->awcb_ready = ready;
 	callback->awcb_physdone = physdone;
@@ -4416,6 +5530,15 @@ arc_memory_throttle(uint64_t reserve, uint64_t txg)
 	return (0);
 }
 
+/*
+ * The most the ARC may grow to; used to size caches layered on top of it.
+ */
+uint64_t
+arc_max_bytes(void)
+{
+	return (arc_c_max);
+}
+
 void
 arc_tempreserve_clear(uint64_t reserve)
 {
@@ -4512,16 +5635,77 @@ arc_kstat_update(kstat_t *ksp, int rw)
 		    &as->arcstat_mfu_ghost_size,
 		    &as->arcstat_mfu_ghost_evict_data,
 		    &as->arcstat_mfu_ghost_evict_metadata);
+		as->arcstat_mru_hdr_size.value.ui64 = arc_mru->arcs_hdr_size;
+		as->arcstat_mru_ghost_hdr_size.value.ui64 =
+		    arc_mru_ghost->arcs_hdr_size;
+		as->arcstat_mfu_hdr_size.value.ui64 = arc_mfu->arcs_hdr_size;
+		as->arcstat_mfu_ghost_hdr_size.value.ui64 =
+		    arc_mfu_ghost->arcs_hdr_size;
+		as->arcstat_l2c_only_hdr_size.value.ui64 =
+		    arc_l2c_only->arcs_hdr_size;
 	}
 
 	return (0);
 }
 
+/*
+ * Headers are spread over the sublists of a state list by the hash of
+ * their identity, which does not change while they are on the list.
+ */
+static unsigned int
+arc_state_multilist_index_func(multilist_t *ml, void *obj)
+{
+	arc_buf_hdr_t *hdr = obj;
+
+	ASSERT(!BUF_EMPTY(hdr));
+
+	return ((unsigned int)(buf_hash(hdr->b_spa, &hdr->b_dva,
+	    hdr->b_birth) % multilist_get_num_sublists(ml)));
+}
+
+static void
+arc_state_init(void)
+{
+	arc_state_t *states[] = { arc_mru, arc_mru_ghost, arc_mfu,
+	    arc_mfu_ghost };
+	unsigned int num_sublists = zfs_arc_num_sublists_per_state;
+	int i, t;
+
+	if (num_sublists == 0)
+		num_sublists = MAX(max_ncpus, 4);
+
+	for (i = 0; i < sizeof (states) / sizeof (states[0]); i++) {
+		for (t = 0; t < ARC_BUFC_NUMTYPES; t++) {
+			multilist_create(&states[i]->arcs_list[t],
+			    sizeof (arc_buf_hdr_t),
+			    offsetof(arc_buf_hdr_t, b_arc_node),
+			    num_sublists, arc_state_multilist_index_func);
+		}
+	}
+}
+
+static void
+arc_state_fini(void)
+{
+	arc_state_t *states[] = { arc_mru, arc_mru_ghost, arc_mfu,
+	    arc_mfu_ghost };
+	int i, t;
+
+	for (i = 0; i < sizeof (states) / sizeof (states[0]); i++) {
+		for (t = 0; t < ARC_BUFC_NUMTYPES; t++)
+			multilist_destroy(&states[i]->arcs_list[t]);
+	}
+}
+
 void
 arc_init(void)
 {
 	mutex_init(&arc_reclaim_thr_lock, NULL, MUTEX_DEFAULT, NULL);
 	cv_init(&arc_reclaim_thr_cv, NULL, CV_DEFAULT, NULL);
+	mutex_init(&arc_evict_lock, NULL, MUTEX_DEFAULT, NULL);
+	cv_init(&arc_evict_cv, NULL, CV_DEFAULT, NULL);
+	cv_init(&arc_evict_waiters_cv, NULL, CV_DEFAULT, NULL);
+	arc_pstats_init();
 
 	/* Convert seconds to clock ticks */
 	zfs_arc_min_prefetch_lifespan = 1 * hz;
@@ -4596,33 +5780,7 @@ arc_init(void)
 	arc_l2c_only = &ARC_l2c_only;
 	arc_size = 0;
 
-	mutex_init(&arc_anon->arcs_mtx, NULL, MUTEX_DEFAULT, NULL);
-	mutex_init(&arc_mru->arcs_mtx, NULL, MUTEX_DEFAULT, NULL);
-	mutex_init(&arc_mru_ghost->arcs_mtx, NULL, MUTEX_DEFAULT, NULL);
-	mutex_init(&arc_mfu->arcs_mtx, NULL, MUTEX_DEFAULT, NULL);
-	mutex_init(&arc_mfu_ghost->arcs_mtx, NULL, MUTEX_DEFAULT, NULL);
-	mutex_init(&arc_l2c_only->arcs_mtx, NULL, MUTEX_DEFAULT, NULL);
-
-	list_create(&arc_mru->arcs_list[ARC_BUFC_METADATA],
-	    sizeof (arc_buf_hdr_t), offsetof(arc_buf_hdr_t, b_arc_node));
-	list_create(&arc_mru->arcs_list[ARC_BUFC_DATA],
-	    sizeof (arc_buf_hdr_t), offsetof(arc_buf_hdr_t, b_arc_node));
-	list_create(&arc_mru_ghost->arcs_list[ARC_BUFC_METADATA],
-	    sizeof (arc_buf_hdr_t), offsetof(arc_buf_hdr_t, b_arc_node));
-	list_create(&arc_mru_ghost->arcs_list[ARC_BUFC_DATA],
-	    sizeof (arc_buf_hdr_t), offsetof(arc_buf_hdr_t, b_arc_node));
-	list_create(&arc_mfu->arcs_list[ARC_BUFC_METADATA],
-	    sizeof (arc_buf_hdr_t), offsetof(arc_buf_hdr_t, b_arc_node));
-	list_create(&arc_mfu->arcs_list[ARC_BUFC_DATA],
-	    sizeof (arc_buf_hdr_t), offsetof(arc_buf_hdr_t, b_arc_node));
-	list_create(&arc_mfu_ghost->arcs_list[ARC_BUFC_METADATA],
-	    sizeof (arc_buf_hdr_t), offsetof(arc_buf_hdr_t, b_arc_node));
-	list_create(&arc_mfu_ghost->arcs_list[ARC_BUFC_DATA],
-	    sizeof (arc_buf_hdr_t), offsetof(arc_buf_hdr_t, b_arc_node));
-	list_create(&arc_l2c_only->arcs_list[ARC_BUFC_METADATA],
-	    sizeof (arc_buf_hdr_t), offsetof(arc_buf_hdr_t, b_arc_node));
-	list_create(&arc_l2c_only->arcs_list[ARC_BUFC_DATA],
-	    sizeof (arc_buf_hdr_t), offsetof(arc_buf_hdr_t, b_arc_node));
+	arc_state_init();
 
 	arc_anon->arcs_state = ARC_STATE_ANON;
 	arc_mru->arcs_state = ARC_STATE_MRU;
@@ -4653,6 +5811,13 @@ arc_init(void)
 	(void) thread_create(NULL, 0, arc_reclaim_thread, NULL, 0, &p0,
 	    TS_RUN, minclsyspri);
 
+	arc_hash_taskq = taskq_create("arc_hash_taskq", 1, minclsyspri,
+	    1, 1, 0);
+
+	arc_evict_thread_exit = 0;
+	(void) thread_create(NULL, 0, arc_evict_thread, NULL, 0, &p0,
+	    TS_RUN, minclsyspri);
+
 #if defined (__OPPLE__) && defined(_KERNEL)
 	mutex_init(&arc_vmpressure_thr_lock, NULL, MUTEX_DEFAULT, NULL);
 	cv_init(&arc_vmpressure_thr_cv, NULL, CV_DEFAULT, NULL);
@@ -4704,6 +5869,17 @@ arc_fini(void)
 		cv_wait(&arc_reclaim_thr_cv, &arc_reclaim_thr_lock);
 	mutex_exit(&arc_reclaim_thr_lock);
 
+	mutex_enter(&arc_evict_lock);
+	arc_evict_thread_exit = 1;
+	while (arc_evict_thread_exit != 0) {
+		cv_signal(&arc_evict_cv);
+		cv_wait(&arc_evict_cv, &arc_evict_lock);
+	}
+	mutex_exit(&arc_evict_lock);
+
+	/* waits for a grow still in progress */
+	taskq_destroy(arc_hash_taskq);
+
 #if defined (__OPPLE__) && defined(_KERNEL)
     printf("Quitting vmpressure thread\n");
 	mutex_enter(&arc_vmpressure_thr_lock);
@@ -4737,28 +5913,18 @@ arc_fini(void)
 	mutex_destroy(&arc_eviction_mtx);
 	mutex_destroy(&arc_reclaim_thr_lock);
 	cv_destroy(&arc_reclaim_thr_cv);
+	mutex_destroy(&arc_evict_lock);
+	cv_destroy(&arc_evict_cv);
+	cv_destroy(&arc_evict_waiters_cv);
 #if defined (__OPPLE__) && defined(_KERNEL)
 	mutex_destroy(&arc_vmpressure_thr_lock);
 	cv_destroy(&arc_vmpressure_thr_cv);
 #endif
 
-	list_destroy(&arc_mru->arcs_list[ARC_BUFC_METADATA]);
-	list_destroy(&arc_mru_ghost->arcs_list[ARC_BUFC_METADATA]);
-	list_destroy(&arc_mfu->arcs_list[ARC_BUFC_METADATA]);
-	list_destroy(&arc_mfu_ghost->arcs_list[ARC_BUFC_METADATA]);
-	list_destroy(&arc_mru->arcs_list[ARC_BUFC_DATA]);
-	list_destroy(&arc_mru_ghost->arcs_list[ARC_BUFC_DATA]);
-	list_destroy(&arc_mfu->arcs_list[ARC_BUFC_DATA]);
-	list_destroy(&arc_mfu_ghost->arcs_list[ARC_BUFC_DATA]);
-
-	mutex_destroy(&arc_anon->arcs_mtx);
-	mutex_destroy(&arc_mru->arcs_mtx);
-	mutex_destroy(&arc_mru_ghost->arcs_mtx);
-	mutex_destroy(&arc_mfu->arcs_mtx);
-	mutex_destroy(&arc_mfu_ghost->arcs_mtx);
-	mutex_destroy(&arc_l2c_only->arcs_mtx);
+	arc_state_fini();
 
 	buf_fini();
+	arc_pstats_fini();
 
 #ifdef _KERNEL
     arc_unregister_oids();
@@ -4885,6 +6051,47 @@ arc_fini(void)
  * 8. If an ARC buffer is written (and dirtied) which also exists in the
  * L2ARC, the now stale L2ARC buffer is immediately dropped.
  *
+ * 9. The contents of the L2ARC survive an export/import or reboot; see
+ * "Persistent L2ARC" below.
+ *
+ * Persistent L2ARC
+ *
+ * The buffers the feed thread writes are also described in a log kept on
+ * the device itself, so that the buffer list can be rebuilt when the
+ * device is added back to its pool:
+ *
+ *	+--------+--------+------+--------+------+--------+-----
+ *	| labels | devhdr | bufs | logblk | bufs | logblk | ...
+ *	+--------+--------+------+--------+------+--------+-----
+ *	              |               ^                ^   |
+ *	              |               '----- prev -----+---'
+ *	              '---------- dh_start_lbp --------'
+ *
+ * - The device header sits in the first sector after the front vdev
+ *   labels.  It records the pool and vdev guids, the write and evict
+ *   hands, and points at the newest log block.
+ *
+ * - Each 128k log block holds one entry per buffer written since the
+ *   previous log block (identity, device address, sizes, compression
+ *   and the buffer's freeze checksum) and points at the previous log
+ *   block, forming a chain from the newest to the oldest.  A log block
+ *   is written once it is full, right after the buffers it describes.
+ *
+ * - The header is rewritten after log blocks have been committed and
+ *   whenever l2arc_evict() moves the hands, before anything is written
+ *   over the evicted region.  Buffers whose entries are still in the
+ *   log block being filled are not rebuilt.
+ *
+ * - On l2arc_add_vdev() a valid header restores the hands and a rebuild
+ *   thread walks the chain, creating L2ARC-only headers for every entry
+ *   whose block is not cached already.  The device is not written to
+ *   until the rebuild is done.  The walk ends at a log block that
+ *   overlaps the evicted region, fails its checksum, or crosses the
+ *   write hand, or when the ARC runs short of metadata space.
+ *
+ * - A rebuilt buffer is checked against its freeze checksum when it is
+ *   read, so stale contents are caught and read from the pool instead.
+ *
  * The performance of the L2ARC can be tweaked by a number of tunables, which
  * may be necessary for different workloads:
  *
@@ -4899,6 +6106,7 @@ arc_fini(void)
  *				since more compressed buffers are likely to
  *				be present
  *	l2arc_feed_secs		seconds between L2ARC writing
+ *	l2arc_rebuild_enabled	rebuild devices from their log on import
  *
  * Tunables may be removed or added as future performance improvements are
  * integrated, and also may become zpool properties.
@@ -4977,17 +6185,17 @@ l2arc_write_interval(clock_t began, uint64_t wanted, uint64_t wrote)
 }
 
 static void
-l2arc_hdr_stat_add(void)
+l2arc_hdr_stat_add(arc_buf_hdr_t *hdr)
 {
-	ARCSTAT_INCR(arcstat_l2_hdr_size, HDR_SIZE);
-	ARCSTAT_INCR(arcstat_hdr_size, -HDR_SIZE);
+	ARCSTAT_INCR(arcstat_l2_hdr_size, ARC_HDR_SIZE(hdr));
+	ARCSTAT_INCR(arcstat_hdr_size, -ARC_HDR_SIZE(hdr));
 }
 
 static void
-l2arc_hdr_stat_remove(void)
+l2arc_hdr_stat_remove(arc_buf_hdr_t *hdr)
 {
-	ARCSTAT_INCR(arcstat_l2_hdr_size, -HDR_SIZE);
-	ARCSTAT_INCR(arcstat_hdr_size, HDR_SIZE);
+	ARCSTAT_INCR(arcstat_l2_hdr_size, -ARC_HDR_SIZE(hdr));
+	ARCSTAT_INCR(arcstat_hdr_size, ARC_HDR_SIZE(hdr));
 }
 
 /*
@@ -5029,10 +6237,13 @@ l2arc_dev_get_next(void)
 		else if (next == first)
 			break;
 
-	} while (vdev_is_dead(next->l2ad_vdev));
+	} while (vdev_is_dead(next->l2ad_vdev) || next->l2ad_rebuild);
 
-	/* if we were unable to find any usable vdevs, return NULL */
-	if (vdev_is_dead(next->l2ad_vdev))
+	/*
+	 * If we were unable to find any usable vdevs, return NULL.  A
+	 * device that is still being rebuilt is not written to.
+	 */
+	if (vdev_is_dead(next->l2ad_vdev) || next->l2ad_rebuild)
 		next = NULL;
 
 	l2arc_dev_last = next;
@@ -5139,6 +6350,17 @@ l2arc_write_done(zio_t *zio)
 			kmem_cache_free(l2arc_hdr_cache, abl2);
 			arc_space_return(L2HDR_SIZE, ARC_SPACE_L2HDRS);
 			ARCSTAT_INCR(arcstat_l2_size, -ab->b_size);
+
+			/*
+			 * An L2ARC-only header has nothing left to
+			 * describe.
+			 */
+			if (ab->b_state == arc_l2c_only) {
+				arc_change_state(arc_anon, ab, hash_lock);
+				mutex_exit(hash_lock);
+				arc_hdr_destroy(ab);
+				continue;
+			}
 		}
 
 		/*
@@ -5244,38 +6466,33 @@ l2arc_read_done(zio_t *zio)
  * performance.
  *
  * Currently the metadata lists are hit first, MFU then MRU, followed by
- * the data lists.  This function returns a locked list, and also returns
- * the lock pointer.
+ * the data lists.  This function returns a locked sublist picked at
+ * random, so that successive feeds spread over all of them without
+ * holding more than one sublist lock at a time.
  */
-static list_t *
-l2arc_list_locked(int list_num, kmutex_t **lock)
+static multilist_sublist_t *
+l2arc_sublist_lock(int list_num)
 {
-	list_t *list = NULL;
+	multilist_t *ml = NULL;
 
 	ASSERT(list_num >= 0 && list_num <= 3);
 
 	switch (list_num) {
 	case 0:
-		list = &arc_mfu->arcs_list[ARC_BUFC_METADATA];
-		*lock = &arc_mfu->arcs_mtx;
+		ml = &arc_mfu->arcs_list[ARC_BUFC_METADATA];
 		break;
 	case 1:
-		list = &arc_mru->arcs_list[ARC_BUFC_METADATA];
-		*lock = &arc_mru->arcs_mtx;
+		ml = &arc_mru->arcs_list[ARC_BUFC_METADATA];
 		break;
 	case 2:
-		list = &arc_mfu->arcs_list[ARC_BUFC_DATA];
-		*lock = &arc_mfu->arcs_mtx;
+		ml = &arc_mfu->arcs_list[ARC_BUFC_DATA];
 		break;
 	case 3:
-		list = &arc_mru->arcs_list[ARC_BUFC_DATA];
-		*lock = &arc_mru->arcs_mtx;
+		ml = &arc_mru->arcs_list[ARC_BUFC_DATA];
 		break;
 	}
 
-	ASSERT(!(MUTEX_HELD(*lock)));
-	mutex_enter(*lock);
-	return (list);
+	return (multilist_sublist_lock(ml, multilist_get_random_index(ml)));
 }
 
 /*
@@ -5292,13 +6509,25 @@ l2arc_evict(l2arc_dev_t *dev, uint64_t distance, boolean_t all)
 	arc_buf_hdr_t *ab, *ab_prev;
 	kmutex_t *hash_lock;
 	uint64_t taddr;
+	boolean_t wrap, wrapped = B_FALSE;
 
 	buflist = dev->l2ad_buflist;
 
 	if (buflist == NULL)
 		return;
 
-	if (!all && dev->l2ad_first) {
+restart:
+	/*
+	 * If the next write would not fit before the end of the device,
+	 * evict to the end, then move both hands back to the start and
+	 * evict from there.  Wrapping here rather than after the write
+	 * keeps the hand valid whatever distance the caller asks for,
+	 * including after the hands were restored by a rebuild.
+	 */
+	wrap = (!all && !wrapped &&
+	    dev->l2ad_hand >= (dev->l2ad_end - distance));
+
+	if (!all && !wrap && dev->l2ad_first) {
 		/*
 		 * This is the first sweep through the device.  There is
 		 * nothing to evict.
@@ -5306,7 +6535,9 @@ l2arc_evict(l2arc_dev_t *dev, uint64_t distance, boolean_t all)
 		return;
 	}
 
-	if (dev->l2ad_hand >= (dev->l2ad_end - (2 * distance))) {
+	if (wrap) {
+		taddr = dev->l2ad_end;
+	} else if (dev->l2ad_hand >= (dev->l2ad_end - (2 * distance))) {
 		/*
 		 * When nearing the end of the device, evict to the end
 		 * before the device write hand jumps to the start.
@@ -5407,8 +6638,25 @@ top:
 	}
 	mutex_exit(&l2arc_buflist_mtx);
 
-	vdev_space_update(dev->l2ad_vdev, -(taddr - dev->l2ad_evict), 0, 0);
+	/* nothing was allocated past the hand on the first sweep */
+	if (!wrap || !dev->l2ad_first)
+		vdev_space_update(dev->l2ad_vdev,
+		    -(taddr - dev->l2ad_evict), 0, 0);
 	dev->l2ad_evict = taddr;
+
+	if (wrap) {
+		/*
+		 * Account for the unused gap at the end as written; it is
+		 * returned when the hand next evicts past it.
+		 */
+		vdev_space_update(dev->l2ad_vdev,
+		    dev->l2ad_end - dev->l2ad_hand, 0, 0);
+		dev->l2ad_hand = dev->l2ad_start;
+		dev->l2ad_evict = dev->l2ad_start;
+		dev->l2ad_first = B_FALSE;
+		wrapped = B_TRUE;
+		goto restart;
+	}
 }
 
 /*
@@ -5427,12 +6675,11 @@ l2arc_write_buffers(spa_t *spa, l2arc_dev_t *dev, uint64_t target_sz,
     boolean_t *headroom_boost)
 {
 	arc_buf_hdr_t *ab, *ab_prev, *head;
-	list_t *list;
+	multilist_sublist_t *mls;
 	uint64_t write_asize, write_psize, write_sz, headroom,
 	    buf_compress_minsz;
 	void *buf_data;
-	kmutex_t *list_lock = NULL;
-	boolean_t full;
+	boolean_t full, committed;
 	l2arc_write_callback_t *cb;
 	zio_t *pio, *wzio;
 	uint64_t guid = spa_load_guid(spa);
@@ -5446,7 +6693,7 @@ l2arc_write_buffers(spa_t *spa, l2arc_dev_t *dev, uint64_t target_sz,
 
 	pio = NULL;
 	write_sz = write_asize = write_psize = 0;
-	full = B_FALSE;
+	full = committed = B_FALSE;
 	head = kmem_cache_alloc(hdr_cache, KM_PUSHPAGE);
 	head->b_flags |= ARC_L2_WRITE_HEAD;
 
@@ -5463,7 +6710,7 @@ l2arc_write_buffers(spa_t *spa, l2arc_dev_t *dev, uint64_t target_sz,
 	for (try = 0; try <= 3; try++) {
 		uint64_t passed_sz = 0;
 
-		list = l2arc_list_locked(try, &list_lock);
+		mls = l2arc_sublist_lock(try);
 
 		/*
 		 * L2ARC fast warmup.
@@ -5472,9 +6719,9 @@ l2arc_write_buffers(spa_t *spa, l2arc_dev_t *dev, uint64_t target_sz,
 		 * head of the ARC lists rather than the tail.
 		 */
 		if (arc_warm == B_FALSE)
-			ab = list_head(list);
+			ab = multilist_sublist_head(mls);
 		else
-			ab = list_tail(list);
+			ab = multilist_sublist_tail(mls);
 
 		headroom = target_sz * l2arc_headroom;
 		if (do_headroom_boost)
@@ -5484,11 +6731,12 @@ l2arc_write_buffers(spa_t *spa, l2arc_dev_t *dev, uint64_t target_sz,
 			l2arc_buf_hdr_t *l2hdr;
 			kmutex_t *hash_lock;
 			uint64_t buf_sz;
+			boolean_t use_cdata;
 
 			if (arc_warm == B_FALSE)
-				ab_prev = list_next(list, ab);
+				ab_prev = multilist_sublist_next(mls, ab);
 			else
-				ab_prev = list_prev(list, ab);
+				ab_prev = multilist_sublist_prev(mls, ab);
 
 			hash_lock = HDR_LOCK(ab);
 			if (!mutex_tryenter(hash_lock)) {
@@ -5512,6 +6760,19 @@ l2arc_write_buffers(spa_t *spa, l2arc_dev_t *dev, uint64_t target_sz,
 				continue;
 			}
 
+			/*
+			 * An LZ4 compressed copy is already in the format
+			 * l2arc_read_done() expects, so it is written out
+			 * as is; other hdrs need their logical buffer.
+			 */
+			use_cdata = (ab->b_cdata != NULL &&
+			    ab->b_ccompress == ZIO_COMPRESS_LZ4 &&
+			    ab->b_freeze_cksum != NULL && !l2arc_nocompress);
+			if (ab->b_buf == NULL && !use_cdata) {
+				mutex_exit(hash_lock);
+				continue;
+			}
+
 			if ((write_sz + ab->b_size) > target_sz) {
 				full = B_TRUE;
 				mutex_exit(hash_lock);
@@ -5552,9 +6813,18 @@ l2arc_write_buffers(spa_t *spa, l2arc_dev_t *dev, uint64_t target_sz,
 			 * can't access without holding the ARC list locks
 			 * (which we want to avoid during compression/writing)
 			 */
-			l2hdr->b_compress = ZIO_COMPRESS_OFF;
-			l2hdr->b_asize = ab->b_size;
-			l2hdr->b_tmp_cdata = ab->b_buf->b_data;
+			if (use_cdata) {
+				l2hdr->b_compress = ZIO_COMPRESS_LZ4;
+				l2hdr->b_asize = ab->b_csize;
+				l2hdr->b_tmp_cdata =
+				    zio_data_buf_alloc(ab->b_size);
+				bcopy(ab->b_cdata, l2hdr->b_tmp_cdata,
+				    ab->b_csize);
+			} else {
+				l2hdr->b_compress = ZIO_COMPRESS_OFF;
+				l2hdr->b_asize = ab->b_size;
+				l2hdr->b_tmp_cdata = ab->b_buf->b_data;
+			}
 			l2hdr->b_hits = 0;
 
 			buf_sz = ab->b_size;
@@ -5565,16 +6835,19 @@ l2arc_write_buffers(spa_t *spa, l2arc_dev_t *dev, uint64_t target_sz,
 			/*
 			 * Compute and store the buffer cksum before
 			 * writing.  On debug the cksum is verified first.
+			 * A compressed copy had it computed when read.
 			 */
-			arc_cksum_verify(ab->b_buf);
-			arc_cksum_compute(ab->b_buf, B_TRUE);
+			if (ab->b_buf != NULL) {
+				arc_cksum_verify(ab->b_buf);
+				arc_cksum_compute(ab->b_buf, B_TRUE);
+			}
 
 			mutex_exit(hash_lock);
 
 			write_sz += buf_sz;
 		}
 
-		mutex_exit(list_lock);
+		multilist_sublist_unlock(mls);
 
 		if (full == B_TRUE)
 			break;
@@ -5608,6 +6881,7 @@ l2arc_write_buffers(spa_t *spa, l2arc_dev_t *dev, uint64_t target_sz,
 		l2hdr->b_daddr = dev->l2ad_hand;
 
 		if (!l2arc_nocompress && (ab->b_flags & ARC_L2COMPRESS) &&
+		    l2hdr->b_compress == ZIO_COMPRESS_OFF &&
 		    l2hdr->b_asize >= buf_compress_minsz) {
 			if (l2arc_compress_buf(l2hdr)) {
 				/*
@@ -5646,6 +6920,15 @@ l2arc_write_buffers(spa_t *spa, l2arc_dev_t *dev, uint64_t target_sz,
 			write_psize += buf_p_sz;
 			dev->l2ad_hand += buf_p_sz;
 		}
+
+		/*
+		 * Record the buffer in the device's log.  A full log block
+		 * is written out right behind the buffers it describes.
+		 */
+		if (l2arc_log_blk_insert(dev, ab)) {
+			write_psize += l2arc_log_blk_commit(dev, pio);
+			committed = B_TRUE;
+		}
 	}
 
     mutex_exit(&l2arc_buflist_mtx);
@@ -5663,21 +6946,27 @@ l2arc_write_buffers(spa_t *spa, l2arc_dev_t *dev, uint64_t target_sz,
 	vdev_space_update(dev->l2ad_vdev, write_psize, 0, 0);
 
 	/*
-	 * Bump device hand to the device start if it is approaching the end.
-	 * l2arc_evict() will already have evicted ahead for this case.
+	 * The device hand is moved back to the start by l2arc_evict()
+	 * before a write that would not fit.
 	 */
-	if (dev->l2ad_hand >= (dev->l2ad_end - target_sz)) {
-		vdev_space_update(dev->l2ad_vdev,
-		    dev->l2ad_end - dev->l2ad_hand, 0, 0);
-		dev->l2ad_hand = dev->l2ad_start;
-		dev->l2ad_evict = dev->l2ad_start;
-		dev->l2ad_first = B_FALSE;
-	}
-
 	dev->l2ad_writing = B_TRUE;
-	(void) zio_wait(pio);
+	if (zio_wait(pio) != 0 && committed) {
+		/*
+		 * A log block may not have made it to disk.  Rather than
+		 * point the device header at it, start a new log chain.
+		 */
+		bzero(&dev->l2ad_dev_hdr->dh_start_lbp,
+		    sizeof (l2arc_log_blkptr_t));
+	}
 	dev->l2ad_writing = B_FALSE;
 
+	/*
+	 * Only now that the log blocks are on disk may the device header
+	 * point at them.
+	 */
+	if (committed)
+		l2arc_dev_hdr_update(dev);
+
 	return (write_asize);
 }
 
@@ -5704,7 +6993,7 @@ static boolean_t
 l2arc_compress_buf(l2arc_buf_hdr_t *l2hdr)
 {
 	void *cdata;
-	size_t csize, len;
+	size_t csize, len, rounded;
 
 	ASSERT(l2hdr->b_compress == ZIO_COMPRESS_OFF);
 	ASSERT(l2hdr->b_tmp_cdata != NULL);
@@ -5714,6 +7003,12 @@ l2arc_compress_buf(l2arc_buf_hdr_t *l2hdr)
 	csize = zio_compress_data(ZIO_COMPRESS_LZ4, l2hdr->b_tmp_cdata,
 	    cdata, l2hdr->b_asize);
 
+	rounded = P2ROUNDUP(csize, (size_t)SPA_MINBLOCKSIZE);
+	if (rounded > csize) {
+		bzero((char *)cdata + csize, rounded - csize);
+		csize = rounded;
+	}
+
 	if (csize == 0) {
 		/* zero block, indicate that there's nothing to write */
 		zio_data_buf_free(cdata, len);
@@ -5903,9 +7198,15 @@ l2arc_feed_thread(void)
 		size = l2arc_write_size();
 
 		/*
-		 * Evict L2ARC buffers that will be overwritten.
+		 * Evict L2ARC buffers that will be overwritten, making room
+		 * for the log blocks as well.  The device header must
+		 * reflect the eviction before anything is written over the
+		 * evicted region, or a rebuild could trust stale log blocks.
 		 */
-		l2arc_evict(dev, size, B_FALSE);
+		l2arc_evict(dev, size + l2arc_log_blk_overhead(size), B_FALSE);
+		if (dev->l2ad_dev_hdr->dh_magic != L2ARC_DEV_HDR_MAGIC ||
+		    dev->l2ad_dev_hdr->dh_evict != dev->l2ad_evict)
+			l2arc_dev_hdr_update(dev);
 
 		/*
 		 * Write ARC buffers.
@@ -5949,21 +7250,29 @@ void
 l2arc_add_vdev(spa_t *spa, vdev_t *vd)
 {
 	l2arc_dev_t *adddev;
+	uint64_t hdr_asize;
 
 	ASSERT(!l2arc_vdev_present(vd));
 
 	/*
-	 * Create a new l2arc device entry.
+	 * Create a new l2arc device entry.  The device header takes the
+	 * first allocatable sector after the front labels.
 	 */
+	hdr_asize = vdev_psize_to_asize(vd, SPA_MINBLOCKSIZE);
 	adddev = kmem_zalloc(sizeof (l2arc_dev_t), KM_SLEEP);
 	adddev->l2ad_spa = spa;
 	adddev->l2ad_vdev = vd;
-	adddev->l2ad_start = VDEV_LABEL_START_SIZE;
+	adddev->l2ad_start = VDEV_LABEL_START_SIZE + hdr_asize;
 	adddev->l2ad_end = VDEV_LABEL_START_SIZE + vdev_get_min_asize(vd);
 	adddev->l2ad_hand = adddev->l2ad_start;
 	adddev->l2ad_evict = adddev->l2ad_start;
 	adddev->l2ad_first = B_TRUE;
 	adddev->l2ad_writing = B_FALSE;
+	adddev->l2ad_dev_hdr_asize = hdr_asize;
+	adddev->l2ad_dev_hdr = zio_buf_alloc(hdr_asize);
+	bzero(adddev->l2ad_dev_hdr, hdr_asize);
+	adddev->l2ad_log_blk = zio_buf_alloc(L2ARC_LOG_BLK_SIZE);
+	bzero(adddev->l2ad_log_blk, L2ARC_LOG_BLK_SIZE);
 	list_link_init(&adddev->l2ad_node);
 
 	/*
@@ -5974,7 +7283,36 @@ l2arc_add_vdev(spa_t *spa, vdev_t *vd)
 	list_create(adddev->l2ad_buflist, sizeof (arc_buf_hdr_t),
 	    offsetof(arc_buf_hdr_t, b_l2node));
 
-	vdev_space_update(vd, 0, 0, adddev->l2ad_end - adddev->l2ad_hand);
+	vdev_space_update(vd, 0, 0, adddev->l2ad_end - adddev->l2ad_start);
+
+	/*
+	 * If the device carries a valid header from an earlier import,
+	 * pick up where the feed thread left off and rebuild the buffer
+	 * list from the device's log in the background.  A tryimport
+	 * only peeks at the pool, so it does not rebuild.
+	 */
+	if (l2arc_dev_hdr_read(adddev) && l2arc_rebuild_enabled &&
+	    spa_load_state(spa) != SPA_LOAD_TRYIMPORT) {
+		l2arc_dev_hdr_phys_t *dh = adddev->l2ad_dev_hdr;
+
+		adddev->l2ad_hand = dh->dh_hand;
+		adddev->l2ad_evict = dh->dh_evict;
+		adddev->l2ad_first = !!(dh->dh_flags &
+		    L2ARC_DEV_HDR_EVICT_FIRST);
+		adddev->l2ad_rebuild = B_TRUE;
+
+		/* the region l2arc_evict() has not yet reclaimed is in use */
+		if (adddev->l2ad_first)
+			vdev_space_update(vd, adddev->l2ad_hand -
+			    adddev->l2ad_start, 0, 0);
+		else
+			vdev_space_update(vd, (adddev->l2ad_end -
+			    adddev->l2ad_start) - (adddev->l2ad_evict -
+			    adddev->l2ad_hand), 0, 0);
+	} else {
+		/* start over, with an empty log chain */
+		bzero(adddev->l2ad_dev_hdr, hdr_asize);
+	}
 
 	/*
 	 * Add device to global list
@@ -5983,6 +7321,10 @@ l2arc_add_vdev(spa_t *spa, vdev_t *vd)
 	list_insert_head(l2arc_dev_list, adddev);
 	atomic_inc_64(&l2arc_ndev);
 	mutex_exit(&l2arc_dev_mtx);
+
+	if (adddev->l2ad_rebuild)
+		(void) thread_create(NULL, 0, l2arc_dev_rebuild_thread,
+		    adddev, 0, &p0, TS_RUN, minclsyspri);
 }
 
 /*
@@ -6006,6 +7348,17 @@ l2arc_remove_vdev(vdev_t *vd)
 	}
 	ASSERT(remdev != NULL);
 
+	/*
+	 * Stop a rebuild still running against the device.  The rebuild
+	 * thread never blocks on the config lock, so this cannot deadlock
+	 * with a caller holding it.
+	 */
+	mutex_enter(&l2arc_rebuild_thr_lock);
+	remdev->l2ad_rebuild_cancel = B_TRUE;
+	while (remdev->l2ad_rebuild)
+		cv_wait(&l2arc_rebuild_thr_cv, &l2arc_rebuild_thr_lock);
+	mutex_exit(&l2arc_rebuild_thr_lock);
+
 	/*
 	 * Remove device from global list
 	 */
@@ -6020,6 +7373,8 @@ l2arc_remove_vdev(vdev_t *vd)
 	l2arc_evict(remdev, 0, B_TRUE);
 	list_destroy(remdev->l2ad_buflist);
 	kmem_free(remdev->l2ad_buflist, sizeof (list_t));
+	zio_buf_free(remdev->l2ad_dev_hdr, remdev->l2ad_dev_hdr_asize);
+	zio_buf_free(remdev->l2ad_log_blk, L2ARC_LOG_BLK_SIZE);
 	kmem_free(remdev, sizeof (l2arc_dev_t));
 }
 
@@ -6036,6 +7391,8 @@ l2arc_init(void)
 	mutex_init(&l2arc_dev_mtx, NULL, MUTEX_DEFAULT, NULL);
 	mutex_init(&l2arc_buflist_mtx, NULL, MUTEX_DEFAULT, NULL);
 	mutex_init(&l2arc_free_on_write_mtx, NULL, MUTEX_DEFAULT, NULL);
+	mutex_init(&l2arc_rebuild_thr_lock, NULL, MUTEX_DEFAULT, NULL);
+	cv_init(&l2arc_rebuild_thr_cv, NULL, CV_DEFAULT, NULL);
 
 	l2arc_dev_list = &L2ARC_dev_list;
 	l2arc_free_on_write = &L2ARC_free_on_write;
@@ -6061,6 +7418,8 @@ l2arc_fini(void)
 	mutex_destroy(&l2arc_dev_mtx);
 	mutex_destroy(&l2arc_buflist_mtx);
 	mutex_destroy(&l2arc_free_on_write_mtx);
+	mutex_destroy(&l2arc_rebuild_thr_lock);
+	cv_destroy(&l2arc_rebuild_thr_cv);
 
 	list_destroy(l2arc_dev_list);
 	list_destroy(l2arc_free_on_write);
@@ -6090,6 +7449,423 @@ l2arc_stop(void)
 	mutex_exit(&l2arc_feed_thr_lock);
 }
 
+/*
+ * Persistent L2ARC
+ *
+ * The functions below maintain and read back the log that lets a cache
+ * device be rebuilt.  See "Persistent L2ARC" in the block comment above
+ * l2arc_write_eligible() for the layout.
+ */
+
+/*
+ * Returns B_TRUE if check lies within the range [bottom, top] of the
+ * device, where a range with bottom > top wraps around the end.
+ */
+static boolean_t
+l2arc_range_check_overlap(uint64_t bottom, uint64_t top, uint64_t check)
+{
+	if (bottom < top)
+		return (bottom <= check && check <= top);
+	else if (bottom > top)
+		return (check <= top || bottom <= check);
+	else
+		return (check == top);
+}
+
+/*
+ * Returns the room to set aside for the log blocks written along with
+ * write_sz bytes of buffers.
+ */
+static uint64_t
+l2arc_log_blk_overhead(uint64_t write_sz)
+{
+	return ((write_sz / SPA_MINBLOCKSIZE / L2ARC_LOG_BLK_ENTRIES + 1) *
+	    L2ARC_LOG_BLK_SIZE);
+}
+
+/*
+ * A log block can only be trusted if neither it nor its payload has
+ * been evicted, i.e. none of it overlaps the region between the write
+ * hand and the evict hand.  On the first sweep nothing is evicted yet.
+ */
+static boolean_t
+l2arc_log_blkptr_valid(l2arc_dev_t *dev, const l2arc_log_blkptr_t *lbp)
+{
+	uint64_t asize = vdev_psize_to_asize(dev->l2ad_vdev,
+	    L2ARC_LOG_BLK_SIZE);
+	uint64_t start = lbp->lbp_payload_start;
+	uint64_t end = lbp->lbp_daddr + asize - 1;
+	boolean_t evicted;
+
+	if (start < dev->l2ad_start || start >= dev->l2ad_end ||
+	    lbp->lbp_daddr < dev->l2ad_start ||
+	    lbp->lbp_daddr + asize > dev->l2ad_end)
+		return (B_FALSE);
+
+	evicted =
+	    l2arc_range_check_overlap(start, end, dev->l2ad_hand) ||
+	    l2arc_range_check_overlap(start, end, dev->l2ad_evict) ||
+	    l2arc_range_check_overlap(dev->l2ad_hand, dev->l2ad_evict, start) ||
+	    l2arc_range_check_overlap(dev->l2ad_hand, dev->l2ad_evict, end);
+
+	return (!evicted || dev->l2ad_first);
+}
+
+/*
+ * Reads the device header.  Returns B_TRUE if it is ours and describes
+ * this device as it is configured now.
+ */
+static boolean_t
+l2arc_dev_hdr_read(l2arc_dev_t *dev)
+{
+	l2arc_dev_hdr_phys_t *dh = dev->l2ad_dev_hdr;
+	zio_cksum_t cksum;
+	int err;
+
+	err = zio_wait(zio_read_phys(NULL, dev->l2ad_vdev,
+	    VDEV_LABEL_START_SIZE, dev->l2ad_dev_hdr_asize, dh,
+	    ZIO_CHECKSUM_OFF, NULL, NULL, ZIO_PRIORITY_SYNC_READ,
+	    ZIO_FLAG_DONT_CACHE | ZIO_FLAG_CANFAIL | ZIO_FLAG_DONT_PROPAGATE |
+	    ZIO_FLAG_DONT_RETRY | ZIO_FLAG_CONFIG_WRITER, B_FALSE));
+	if (err != 0) {
+		ARCSTAT_BUMP(arcstat_l2_rebuild_io_errors);
+		return (B_FALSE);
+	}
+
+	/* an unused device, or one that was never persistent */
+	if (dh->dh_magic != L2ARC_DEV_HDR_MAGIC &&
+	    dh->dh_magic != BSWAP_64(L2ARC_DEV_HDR_MAGIC))
+		return (B_FALSE);
+
+	fletcher_4_native(dh, offsetof(l2arc_dev_hdr_phys_t, dh_self_cksum),
+	    &cksum);
+
+	if (dh->dh_magic != L2ARC_DEV_HDR_MAGIC ||
+	    dh->dh_version != L2ARC_PERSIST_VERSION ||
+	    !ZIO_CHECKSUM_EQUAL(cksum, dh->dh_self_cksum) ||
+	    dh->dh_spa_guid != spa_guid(dev->l2ad_spa) ||
+	    dh->dh_vdev_guid != dev->l2ad_vdev->vdev_guid ||
+	    dh->dh_start != dev->l2ad_start ||
+	    dh->dh_end != dev->l2ad_end ||
+	    dh->dh_hand < dev->l2ad_start || dh->dh_hand > dev->l2ad_end ||
+	    dh->dh_evict < dev->l2ad_start || dh->dh_evict > dev->l2ad_end) {
+		ARCSTAT_BUMP(arcstat_l2_rebuild_unsupported);
+		return (B_FALSE);
+	}
+
+	return (B_TRUE);
+}
+
+/*
+ * Writes the in-core device header out to the device.  Called from the
+ * feed thread, with the spa config lock held.
+ */
+static void
+l2arc_dev_hdr_update(l2arc_dev_t *dev)
+{
+	l2arc_dev_hdr_phys_t *dh = dev->l2ad_dev_hdr;
+	int err;
+
+	dh->dh_magic = L2ARC_DEV_HDR_MAGIC;
+	dh->dh_version = L2ARC_PERSIST_VERSION;
+	dh->dh_spa_guid = spa_guid(dev->l2ad_spa);
+	dh->dh_vdev_guid = dev->l2ad_vdev->vdev_guid;
+	dh->dh_flags = 0;
+	if (dev->l2ad_first)
+		dh->dh_flags |= L2ARC_DEV_HDR_EVICT_FIRST;
+	dh->dh_start = dev->l2ad_start;
+	dh->dh_end = dev->l2ad_end;
+	dh->dh_hand = dev->l2ad_hand;
+	dh->dh_evict = dev->l2ad_evict;
+	fletcher_4_native(dh, offsetof(l2arc_dev_hdr_phys_t, dh_self_cksum),
+	    &dh->dh_self_cksum);
+
+	err = zio_wait(zio_write_phys(NULL, dev->l2ad_vdev,
+	    VDEV_LABEL_START_SIZE, dev->l2ad_dev_hdr_asize, dh,
+	    ZIO_CHECKSUM_OFF, NULL, NULL, ZIO_PRIORITY_ASYNC_WRITE,
+	    ZIO_FLAG_CANFAIL, B_FALSE));
+	if (err != 0)
+		ARCSTAT_BUMP(arcstat_l2_dev_hdr_write_errors);
+}
+
+/*
+ * Adds a buffer that has just been issued for writing to the log block
+ * being filled.  Returns B_TRUE if the log block is now full and must
+ * be committed.  The hdr is protected by its ARC_L2_WRITING flag and by
+ * l2arc_buflist_mtx, as in the write loop of l2arc_write_buffers().
+ */
+static boolean_t
+l2arc_log_blk_insert(l2arc_dev_t *dev, arc_buf_hdr_t *ab)
+{
+	l2arc_log_blk_phys_t *lb = dev->l2ad_log_blk;
+	l2arc_buf_hdr_t *l2hdr = ab->b_l2hdr;
+	l2arc_log_ent_phys_t *le;
+	boolean_t have_cksum = B_FALSE;
+
+	ASSERT(MUTEX_HELD(&l2arc_buflist_mtx));
+	ASSERT(!HDR_L2_ONLY(ab));
+	ASSERT3U(dev->l2ad_log_ent_idx, <, L2ARC_LOG_BLK_ENTRIES);
+
+	le = &lb->lb_entries[dev->l2ad_log_ent_idx];
+
+	/*
+	 * Without the freeze checksum a rebuilt buffer could not be told
+	 * apart from whatever overwrote it, so it is not logged.
+	 */
+	mutex_enter(&ab->b_freeze_lock);
+	if (ab->b_freeze_cksum != NULL) {
+		le->le_freeze_cksum = *ab->b_freeze_cksum;
+		have_cksum = B_TRUE;
+	}
+	mutex_exit(&ab->b_freeze_lock);
+	if (!have_cksum)
+		return (B_FALSE);
+
+	le->le_dva = ab->b_dva;
+	le->le_birth = ab->b_birth;
+	le->le_cksum0 = ab->b_cksum0;
+	le->le_daddr = l2hdr->b_daddr;
+	le->le_prop = 0;
+	L2BLK_SET_LSIZE(le->le_prop, ab->b_size);
+	L2BLK_SET_ASIZE(le->le_prop, l2hdr->b_asize);
+	L2BLK_SET_COMPRESS(le->le_prop, l2hdr->b_compress);
+	L2BLK_SET_TYPE(le->le_prop, ab->b_type);
+
+	if (dev->l2ad_log_ent_idx == 0)
+		dev->l2ad_log_payload_start = l2hdr->b_daddr;
+	dev->l2ad_log_ent_idx++;
+
+	return (dev->l2ad_log_ent_idx == L2ARC_LOG_BLK_ENTRIES);
+}
+
+static void
+l2arc_log_blk_write_done(zio_t *zio)
+{
+	zio_buf_free(zio->io_private, L2ARC_LOG_BLK_SIZE);
+}
+
+/*
+ * Issues the write of the full log block at the device write hand, as a
+ * child of pio, and links it into the in-core device header.  The header
+ * itself is written once pio is done.  Returns the space allocated.
+ */
+static uint64_t
+l2arc_log_blk_commit(l2arc_dev_t *dev, zio_t *pio)
+{
+	l2arc_log_blk_phys_t *lb = dev->l2ad_log_blk;
+	l2arc_log_blkptr_t *lbp = &dev->l2ad_dev_hdr->dh_start_lbp;
+	uint64_t asize;
+	zio_t *wzio;
+
+	ASSERT3U(dev->l2ad_log_ent_idx, ==, L2ARC_LOG_BLK_ENTRIES);
+
+	lb->lb_magic = L2ARC_LOG_BLK_MAGIC;
+	lb->lb_nents = dev->l2ad_log_ent_idx;
+	lb->lb_prev_lbp = *lbp;
+
+	lbp->lbp_daddr = dev->l2ad_hand;
+	lbp->lbp_payload_start = dev->l2ad_log_payload_start;
+	fletcher_4_native(lb, L2ARC_LOG_BLK_SIZE, &lbp->lbp_cksum);
+
+	wzio = zio_write_phys(pio, dev->l2ad_vdev, dev->l2ad_hand,
+	    L2ARC_LOG_BLK_SIZE, lb, ZIO_CHECKSUM_OFF,
+	    l2arc_log_blk_write_done, lb, ZIO_PRIORITY_ASYNC_WRITE,
+	    ZIO_FLAG_CANFAIL, B_FALSE);
+	DTRACE_PROBE2(l2arc__write, vdev_t *, dev->l2ad_vdev, zio_t *, wzio);
+	(void) zio_nowait(wzio);
+
+	asize = vdev_psize_to_asize(dev->l2ad_vdev, L2ARC_LOG_BLK_SIZE);
+	dev->l2ad_hand += asize;
+
+	/* the block now belongs to the zio; start filling a new one */
+	dev->l2ad_log_blk = zio_buf_alloc(L2ARC_LOG_BLK_SIZE);
+	bzero(dev->l2ad_log_blk, L2ARC_LOG_BLK_SIZE);
+	dev->l2ad_log_ent_idx = 0;
+	dev->l2ad_log_payload_start = 0;
+
+	ARCSTAT_BUMP(arcstat_l2_log_blk_writes);
+
+	return (asize);
+}
+
+/*
+ * Reads the log block lbp points at into lb and verifies it.  The spa
+ * config lock is only tried, so that l2arc_remove_vdev() can cancel the
+ * rebuild while holding it as writer.
+ */
+static int
+l2arc_log_blk_read(l2arc_dev_t *dev, const l2arc_log_blkptr_t *lbp,
+    l2arc_log_blk_phys_t *lb)
+{
+	spa_t *spa = dev->l2ad_spa;
+	zio_cksum_t cksum;
+	int err;
+
+	while (!spa_config_tryenter(spa, SCL_L2ARC, dev, RW_READER)) {
+		if (dev->l2ad_rebuild_cancel)
+			return (SET_ERROR(ECANCELED));
+		delay(1);
+	}
+
+	err = zio_wait(zio_read_phys(NULL, dev->l2ad_vdev, lbp->lbp_daddr,
+	    L2ARC_LOG_BLK_SIZE, lb, ZIO_CHECKSUM_OFF, NULL, NULL,
+	    ZIO_PRIORITY_ASYNC_READ, ZIO_FLAG_DONT_CACHE | ZIO_FLAG_CANFAIL |
+	    ZIO_FLAG_DONT_PROPAGATE | ZIO_FLAG_DONT_RETRY, B_FALSE));
+	spa_config_exit(spa, SCL_L2ARC, dev);
+
+	if (err != 0) {
+		ARCSTAT_BUMP(arcstat_l2_rebuild_io_errors);
+		return (err);
+	}
+
+	fletcher_4_native(lb, L2ARC_LOG_BLK_SIZE, &cksum);
+	if (!ZIO_CHECKSUM_EQUAL(cksum, lbp->lbp_cksum) ||
+	    lb->lb_magic != L2ARC_LOG_BLK_MAGIC ||
+	    lb->lb_nents > L2ARC_LOG_BLK_ENTRIES) {
+		ARCSTAT_BUMP(arcstat_l2_rebuild_cksum_lb_errors);
+		return (SET_ERROR(ECKSUM));
+	}
+
+	return (0);
+}
+
+/*
+ * Recreates an L2ARC-only hdr from a log entry, unless the block is
+ * already cached.
+ */
+static void
+l2arc_hdr_restore(l2arc_dev_t *dev, const l2arc_log_ent_phys_t *le)
+{
+	arc_buf_hdr_t *hdr, *exists;
+	l2arc_buf_hdr_t *l2hdr;
+	kmutex_t *hash_lock;
+	uint64_t lsize = L2BLK_GET_LSIZE(le->le_prop);
+	uint64_t asize = L2BLK_GET_ASIZE(le->le_prop);
+	enum zio_compress compress = L2BLK_GET_COMPRESS(le->le_prop);
+	arc_buf_contents_t type = L2BLK_GET_TYPE(le->le_prop);
+
+	if (lsize > SPA_MAXBLOCKSIZE || asize > lsize ||
+	    compress >= ZIO_COMPRESS_FUNCTIONS ||
+	    (type != ARC_BUFC_DATA && type != ARC_BUFC_METADATA) ||
+	    le->le_daddr < dev->l2ad_start ||
+	    le->le_daddr + asize > dev->l2ad_end)
+		return;
+
+	hdr = kmem_cache_alloc(hdr_l2only_cache, KM_PUSHPAGE);
+	ASSERT(BUF_EMPTY(hdr));
+	hdr->b_dva = le->le_dva;
+	hdr->b_birth = le->le_birth;
+	hdr->b_cksum0 = le->le_cksum0;
+	hdr->b_size = lsize;
+	hdr->b_type = type;
+	hdr->b_spa = spa_load_guid(dev->l2ad_spa);
+	hdr->b_state = arc_anon;
+	hdr->b_flags = ARC_L2_ONLY | ARC_L2CACHE;
+	if (compress == ZIO_COMPRESS_LZ4)
+		hdr->b_flags |= ARC_L2COMPRESS;
+	hdr->b_freeze_cksum = kmem_alloc(sizeof (zio_cksum_t), KM_SLEEP);
+	*hdr->b_freeze_cksum = le->le_freeze_cksum;
+
+	exists = buf_hash_insert(hdr, &hash_lock);
+	if (exists != NULL) {
+		/* the block was read or cached again in the meantime */
+		mutex_exit(hash_lock);
+		arc_hdr_destroy(hdr);
+		ARCSTAT_BUMP(arcstat_l2_rebuild_bufs_precached);
+		return;
+	}
+
+	l2hdr = kmem_cache_alloc(l2arc_hdr_cache, KM_PUSHPAGE);
+	l2hdr->b_dev = dev;
+	l2hdr->b_daddr = le->le_daddr;
+	l2hdr->b_compress = compress;
+	l2hdr->b_asize = asize;
+	l2hdr->b_hits = 0;
+	l2hdr->b_tmp_cdata = NULL;
+	arc_space_consume(L2HDR_SIZE, ARC_SPACE_L2HDRS);
+
+	/*
+	 * Log blocks are walked newest first, so appending keeps the
+	 * oldest buffers at the tail, where l2arc_evict() starts.
+	 */
+	mutex_enter(&l2arc_buflist_mtx);
+	hdr->b_l2hdr = l2hdr;
+	list_insert_tail(dev->l2ad_buflist, hdr);
+	mutex_exit(&l2arc_buflist_mtx);
+
+	ARCSTAT_INCR(arcstat_l2_size, lsize);
+	ARCSTAT_INCR(arcstat_l2_asize, asize);
+	arc_change_state(arc_l2c_only, hdr, hash_lock);
+	mutex_exit(hash_lock);
+
+	ARCSTAT_BUMP(arcstat_l2_rebuild_bufs);
+	ARCSTAT_INCR(arcstat_l2_rebuild_size, lsize);
+}
+
+/*
+ * Walks the log chain from the newest log block back, restoring the
+ * buffers each block describes, until the chain runs into the evicted
+ * region, a block fails to verify, or the rebuild is cancelled.
+ */
+static void
+l2arc_rebuild(l2arc_dev_t *dev)
+{
+	l2arc_log_blkptr_t lbp = dev->l2ad_dev_hdr->dh_start_lbp;
+	l2arc_log_blk_phys_t *lb;
+	int i, err = 0;
+
+	lb = zio_buf_alloc(L2ARC_LOG_BLK_SIZE);
+
+	while (l2arc_log_blkptr_valid(dev, &lbp)) {
+		if (dev->l2ad_rebuild_cancel) {
+			err = SET_ERROR(ECANCELED);
+			break;
+		}
+
+		/* headers are metadata, don't push the ARC over its limit */
+		if (arc_meta_used >= arc_meta_limit) {
+			ARCSTAT_BUMP(arcstat_l2_rebuild_abort_lowmem);
+			err = SET_ERROR(ENOMEM);
+			break;
+		}
+
+		if ((err = l2arc_log_blk_read(dev, &lbp, lb)) != 0)
+			break;
+
+		for (i = lb->lb_nents - 1; i >= 0; i--)
+			l2arc_hdr_restore(dev, &lb->lb_entries[i]);
+		ARCSTAT_BUMP(arcstat_l2_rebuild_log_blks);
+
+		/*
+		 * Stop rather than follow the chain past the write hand,
+		 * into blocks that have already been overwritten.
+		 */
+		if (l2arc_range_check_overlap(lb->lb_prev_lbp.lbp_payload_start,
+		    lbp.lbp_daddr, dev->l2ad_hand))
+			break;
+
+		lbp = lb->lb_prev_lbp;
+	}
+
+	if (err == 0)
+		ARCSTAT_BUMP(arcstat_l2_rebuild_success);
+
+	zio_buf_free(lb, L2ARC_LOG_BLK_SIZE);
+}
+
+static void
+l2arc_dev_rebuild_thread(l2arc_dev_t *dev)
+{
+	l2arc_rebuild(dev);
+
+	mutex_enter(&l2arc_rebuild_thr_lock);
+	dev->l2ad_rebuild = B_FALSE;
+	cv_broadcast(&l2arc_rebuild_thr_cv);
+	mutex_exit(&l2arc_rebuild_thr_lock);
+
+	thread_exit();
+}
+
 #if defined(_KERNEL) && defined(HAVE_SPL)
 EXPORT_SYMBOL(arc_read);
 EXPORT_SYMBOL(arc_buf_remove_ref);
@@ -6122,6 +7898,14 @@ MODULE_PARM_DESC(zfs_arc_p_dampener_disable, "disable arc_p adapt dampener");
 module_param(zfs_arc_shrink_shift, int, 0644);
 MODULE_PARM_DESC(zfs_arc_shrink_shift, "log2(fraction of arc to reclaim)");
 
+module_param(zfs_arc_evict_lowat_shift, int, 0644);
+MODULE_PARM_DESC(zfs_arc_evict_lowat_shift,
+	"log2(fraction of arc kept free before eviction starts)");
+
+module_param(zfs_arc_evict_hiwat_shift, int, 0644);
+MODULE_PARM_DESC(zfs_arc_evict_hiwat_shift,
+	"log2(fraction of arc kept free by each eviction pass)");
+
 module_param(zfs_disable_dup_eviction, int, 0644);
 MODULE_PARM_DESC(zfs_disable_dup_eviction, "disable duplicate buffer eviction");
 
@@ -6131,6 +7915,18 @@ MODULE_PARM_DESC(zfs_arc_memory_throttle_disable, "disable memory throttle");
 module_param(zfs_arc_min_prefetch_lifespan, int, 0644);
 MODULE_PARM_DESC(zfs_arc_min_prefetch_lifespan, "Min life of prefetch block");
 
+module_param(zfs_arc_num_sublists_per_state, int, 0644);
+MODULE_PARM_DESC(zfs_arc_num_sublists_per_state,
+	"Number of sublists per ARC state list (0 = one per CPU)");
+
+module_param(zfs_arc_hash_max_load, int, 0644);
+MODULE_PARM_DESC(zfs_arc_hash_max_load,
+	"Average hdrs per ARC hash bucket before the table is grown");
+
+module_param(zfs_compressed_arc_enabled, int, 0644);
+MODULE_PARM_DESC(zfs_compressed_arc_enabled,
+	"Keep compressed copies of blocks in the ARC");
+
 module_param(l2arc_write_max, ulong, 0644);
 MODULE_PARM_DESC(l2arc_write_max, "Max write bytes per interval");
 
@@ -6161,6 +7957,9 @@ MODULE_PARM_DESC(l2arc_feed_again, "Turbo L2ARC warmup");
 module_param(l2arc_norw, int, 0644);
 MODULE_PARM_DESC(l2arc_norw, "No reads during writes");
 
+module_param(l2arc_rebuild_enabled, int, 0644);
+MODULE_PARM_DESC(l2arc_rebuild_enabled, "Rebuild L2ARC devices on import");
+
 #endif
 
 #ifdef _KERNEL
@@ -6179,6 +7978,7 @@ void arc_register_oids(void)
     sysctl_register_oid(&sysctl__zfs_l2arc_noprefetch);
     sysctl_register_oid(&sysctl__zfs_l2arc_feed_again);
     sysctl_register_oid(&sysctl__zfs_l2arc_norw);
+    sysctl_register_oid(&sysctl__zfs_l2arc_rebuild_enabled);
     sysctl_register_oid(&sysctl__zfs_anon_size);
     sysctl_register_oid(&sysctl__zfs_anon_metadata_lsize);
     sysctl_register_oid(&sysctl__zfs_anon_data_lsize);
@@ -6223,6 +8023,7 @@ void arc_unregister_oids(void)
     sysctl_unregister_oid(&sysctl__zfs_l2arc_noprefetch);
     sysctl_unregister_oid(&sysctl__zfs_l2arc_feed_again);
     sysctl_unregister_oid(&sysctl__zfs_l2arc_norw);
+    sysctl_unregister_oid(&sysctl__zfs_l2arc_rebuild_enabled);
     sysctl_unregister_oid(&sysctl__zfs_anon_size);
     sysctl_unregister_oid(&sysctl__zfs_anon_metadata_lsize);
     sysctl_unregister_oid(&sysctl__zfs_anon_data_lsize);
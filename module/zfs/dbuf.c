@@ -40,6 +40,7 @@
 #include <sys/dmu_zfetch.h>
 #include <sys/sa.h>
 #include <sys/sa_impl.h>
+#include <sys/callb.h>
 
 //
 // FIXME
@@ -79,6 +80,84 @@ static void dbuf_destroy(dmu_buf_impl_t *db);
 static boolean_t dbuf_undirty(dmu_buf_impl_t *db, dmu_tx_t *tx);
 static void dbuf_write(dbuf_dirty_record_t *dr, arc_buf_t *data, dmu_tx_t *tx);
 
+/*
+ * Unreferenced dbufs are kept on one of two LRU caches, for data and
+ * metadata, instead of being destroyed when their last hold goes away.
+ * A dbuf on a cache keeps its hold on the ARC buffer, so the caches are
+ * bounded separately: a cache whose size grows past its target wakes
+ * dbuf_evict_thread(), which evicts down to dbuf_cache_lowater_pct below
+ * the target.  Eviction is never done by the releasing thread, which may
+ * hold dnode locks that dbuf_clear() would need.  A max_bytes of 0 sizes
+ * a cache from zfs_arc_max.
+ */
+unsigned long dbuf_cache_max_bytes = 0;
+unsigned long dbuf_metadata_cache_max_bytes = 0;
+int dbuf_cache_shift = 5;
+int dbuf_metadata_cache_shift = 6;
+uint_t dbuf_cache_lowater_pct = 10;
+
+typedef struct dbuf_cache {
+	multilist_t	dc_cache;
+	uint64_t	dc_size;
+	uint64_t	dc_count;
+} dbuf_cache_t;
+
+static dbuf_cache_t dbuf_caches[DB_CACHE_MAX];
+
+static kmutex_t dbuf_evict_lock;
+static kcondvar_t dbuf_evict_cv;
+static boolean_t dbuf_evict_thread_exit;
+
+typedef struct dbuf_cache_stats {
+	kstat_named_t cache_count;
+	kstat_named_t cache_size_bytes;
+	kstat_named_t cache_size_bytes_max;
+	kstat_named_t cache_target_bytes;
+	kstat_named_t cache_hits;
+	kstat_named_t cache_evicts;
+	kstat_named_t metadata_cache_count;
+	kstat_named_t metadata_cache_size_bytes;
+	kstat_named_t metadata_cache_size_bytes_max;
+	kstat_named_t metadata_cache_target_bytes;
+	kstat_named_t metadata_cache_hits;
+	kstat_named_t metadata_cache_evicts;
+} dbuf_cache_stats_t;
+
+static dbuf_cache_stats_t dbuf_cache_stats = {
+	{ "cache_count",			KSTAT_DATA_UINT64 },
+	{ "cache_size_bytes",			KSTAT_DATA_UINT64 },
+	{ "cache_size_bytes_max",		KSTAT_DATA_UINT64 },
+	{ "cache_target_bytes",			KSTAT_DATA_UINT64 },
+	{ "cache_hits",				KSTAT_DATA_UINT64 },
+	{ "cache_evicts",			KSTAT_DATA_UINT64 },
+	{ "metadata_cache_count",		KSTAT_DATA_UINT64 },
+	{ "metadata_cache_size_bytes",		KSTAT_DATA_UINT64 },
+	{ "metadata_cache_size_bytes_max",	KSTAT_DATA_UINT64 },
+	{ "metadata_cache_target_bytes",	KSTAT_DATA_UINT64 },
+	{ "metadata_cache_hits",		KSTAT_DATA_UINT64 },
+	{ "metadata_cache_evicts",		KSTAT_DATA_UINT64 },
+};
+
+static kstat_t *dbuf_cache_ksp;
+
+#define	DBUF_STAT_BUMP(stat)	\
+	atomic_add_64(&dbuf_cache_stats.stat.value.ui64, 1)
+#define	DBUF_CACHE_STAT_BUMP(which, stat)				\
+	do {								\
+		if ((which) == DB_DBUF_METADATA_CACHE)			\
+			DBUF_STAT_BUMP(metadata_cache_##stat);		\
+		else							\
+			DBUF_STAT_BUMP(cache_##stat);			\
+	} while (0)
+#define	DBUF_STAT_MAX(stat, val)					\
+	do {								\
+		uint64_t m;						\
+		while ((val) > (m = dbuf_cache_stats.stat.value.ui64) &&\
+		    (m != atomic_cas_64(				\
+		    &dbuf_cache_stats.stat.value.ui64, m, (val))))	\
+			continue;					\
+	} while (0)
+
 /*
  * Global data structures and functions for the dbuf cache.
  */
@@ -95,6 +174,7 @@ dbuf_cons(void *vdb, void *unused, int kmflag)
 	cv_init(&db->db_changed, NULL, CV_DEFAULT, NULL);
 	refcount_create(&db->db_holds);
 	list_link_init(&db->db_link);
+	multilist_link_init(&db->db_cache_link);
 	return (0);
 }
 
@@ -113,7 +193,11 @@ dbuf_dest(void *vdb, void *unused)
  */
 static dbuf_hash_table_t dbuf_hash_table;
 
-static uint64_t dbuf_hash_count;
+/*
+ * Average number of dbufs per hash bucket above which the hash table
+ * is doubled in size.
+ */
+int dbuf_hash_max_load = 2;
 
 static uint64_t
 dbuf_hash(void *os, uint64_t obj, uint8_t lvl, uint64_t blkid)
@@ -142,6 +226,30 @@ dbuf_hash(void *os, uint64_t obj, uint8_t lvl, uint64_t blkid)
 	(dbuf)->db_level == (level) &&			\
 	(dbuf)->db_blkid == (blkid))
 
+/*
+ * Return the bucket of the given hash, in whichever array its stripe
+ * currently lives in.  The stripe's mutex must be held.
+ */
+static inline dmu_buf_impl_t **
+dbuf_hash_bucket(dbuf_hash_table_t *h, uint64_t hv)
+{
+	dbuf_hash_buckets_t *hb = DBUF_HASH_LOCK(h, hv)->hl_buckets;
+
+	ASSERT(MUTEX_HELD(DBUF_HASH_MUTEX(h, hv)));
+	return (&hb->hb_table[hv & hb->hb_mask]);
+}
+
+static inline void
+dbuf_hash_enter(dbuf_hash_table_t *h, uint64_t hv)
+{
+	kmutex_t *hash_lock = DBUF_HASH_MUTEX(h, hv);
+
+	if (!mutex_tryenter(hash_lock)) {
+		atomic_add_64(&h->hash_lock_contended, 1);
+		mutex_enter(hash_lock);
+	}
+}
+
 dmu_buf_impl_t *
 dbuf_find(dnode_t *dn, uint8_t level, uint64_t blkid)
 {
@@ -149,25 +257,24 @@ dbuf_find(dnode_t *dn, uint8_t level, uint64_t blkid)
 	objset_t *os = dn->dn_objset;
 	uint64_t obj;
 	uint64_t hv;
-	uint64_t idx;
 	dmu_buf_impl_t *db;
 
 	obj = dn->dn_object;
 	hv = DBUF_HASH(os, obj, level, blkid);
-	idx = hv & h->hash_table_mask;
 
-	mutex_enter(DBUF_HASH_MUTEX(h, idx));
-	for (db = h->hash_table[idx]; db != NULL; db = db->db_hash_next) {
+	dbuf_hash_enter(h, hv);
+	for (db = *dbuf_hash_bucket(h, hv); db != NULL;
+	    db = db->db_hash_next) {
 		if (DBUF_EQUAL(db, os, obj, level, blkid)) {
 			mutex_enter(&db->db_mtx);
 			if (db->db_state != DB_EVICTING) {
-				mutex_exit(DBUF_HASH_MUTEX(h, idx));
+				mutex_exit(DBUF_HASH_MUTEX(h, hv));
 				return (db);
 			}
 			mutex_exit(&db->db_mtx);
 		}
 	}
-	mutex_exit(DBUF_HASH_MUTEX(h, idx));
+	mutex_exit(DBUF_HASH_MUTEX(h, hv));
 	return (NULL);
 }
 
@@ -184,19 +291,19 @@ dbuf_hash_insert(dmu_buf_impl_t *db)
 	objset_t *os = db->db_objset;
 	uint64_t obj = db->db.db_object;
 	int level = db->db_level;
-	uint64_t blkid, hv, idx;
-	dmu_buf_impl_t *dbf;
+	uint64_t blkid, hv;
+	dmu_buf_impl_t *dbf, **bucket;
 
 	blkid = db->db_blkid;
 	hv = DBUF_HASH(os, obj, level, blkid);
-	idx = hv & h->hash_table_mask;
 
-	mutex_enter(DBUF_HASH_MUTEX(h, idx));
-	for (dbf = h->hash_table[idx]; dbf != NULL; dbf = dbf->db_hash_next) {
+	dbuf_hash_enter(h, hv);
+	bucket = dbuf_hash_bucket(h, hv);
+	for (dbf = *bucket; dbf != NULL; dbf = dbf->db_hash_next) {
 		if (DBUF_EQUAL(dbf, os, obj, level, blkid)) {
 			mutex_enter(&dbf->db_mtx);
 			if (dbf->db_state != DB_EVICTING) {
-				mutex_exit(DBUF_HASH_MUTEX(h, idx));
+				mutex_exit(DBUF_HASH_MUTEX(h, hv));
 				return (dbf);
 			}
 			mutex_exit(&dbf->db_mtx);
@@ -204,10 +311,10 @@ dbuf_hash_insert(dmu_buf_impl_t *db)
 	}
 
 	mutex_enter(&db->db_mtx);
-	db->db_hash_next = h->hash_table[idx];
-	h->hash_table[idx] = db;
-	mutex_exit(DBUF_HASH_MUTEX(h, idx));
-	atomic_add_64(&dbuf_hash_count, 1);
+	db->db_hash_next = *bucket;
+	*bucket = db;
+	DBUF_HASH_LOCK(h, hv)->hl_count++;
+	mutex_exit(DBUF_HASH_MUTEX(h, hv));
 
 	return (NULL);
 }
@@ -220,12 +327,11 @@ static void
 dbuf_hash_remove(dmu_buf_impl_t *db)
 {
 	dbuf_hash_table_t *h = &dbuf_hash_table;
-	uint64_t hv, idx;
+	uint64_t hv;
 	dmu_buf_impl_t *dbf, **dbp;
 
 	hv = DBUF_HASH(db->db_objset, db->db.db_object,
 	    db->db_level, db->db_blkid);
-	idx = hv & h->hash_table_mask;
 
 	/*
 	 * We musn't hold db_mtx to maintin lock ordering:
@@ -235,16 +341,127 @@ dbuf_hash_remove(dmu_buf_impl_t *db)
 	ASSERT(db->db_state == DB_EVICTING);
 	ASSERT(!MUTEX_HELD(&db->db_mtx));
 
-	mutex_enter(DBUF_HASH_MUTEX(h, idx));
-	dbp = &h->hash_table[idx];
+	mutex_enter(DBUF_HASH_MUTEX(h, hv));
+	dbp = dbuf_hash_bucket(h, hv);
 	while ((dbf = *dbp) != db) {
 		dbp = &dbf->db_hash_next;
 		ASSERT(dbf != NULL);
 	}
 	*dbp = db->db_hash_next;
 	db->db_hash_next = NULL;
-	mutex_exit(DBUF_HASH_MUTEX(h, idx));
-	atomic_add_64(&dbuf_hash_count, -1);
+	DBUF_HASH_LOCK(h, hv)->hl_count--;
+	mutex_exit(DBUF_HASH_MUTEX(h, hv));
+}
+
+static dbuf_hash_buckets_t *
+dbuf_hash_buckets_alloc(uint64_t hsize, int kmflag)
+{
+	dbuf_hash_buckets_t *hb;
+
+	hb = kmem_alloc(sizeof (dbuf_hash_buckets_t), KM_SLEEP);
+	hb->hb_mask = hsize - 1;
+#if defined(_KERNEL) && defined(HAVE_SPL)
+	/*
+	 * Large allocations which do not require contiguous pages
+	 * should be using vmem_alloc() in the linux kernel
+	 */
+	hb->hb_table = vmem_zalloc(hsize * sizeof (void *), kmflag);
+#else
+	hb->hb_table = kmem_zalloc(hsize * sizeof (void *), kmflag);
+#endif
+	if (hb->hb_table == NULL) {
+		kmem_free(hb, sizeof (dbuf_hash_buckets_t));
+		return (NULL);
+	}
+
+	return (hb);
+}
+
+static void
+dbuf_hash_buckets_free(dbuf_hash_buckets_t *hb)
+{
+#if defined(_KERNEL) && defined(HAVE_SPL)
+	vmem_free(hb->hb_table, (hb->hb_mask + 1) * sizeof (void *));
+#else
+	kmem_free(hb->hb_table, (hb->hb_mask + 1) * sizeof (void *));
+#endif
+	kmem_free(hb, sizeof (dbuf_hash_buckets_t));
+}
+
+/*
+ * The table is grown once the average chain holds more than
+ * dbuf_hash_max_load dbufs, up to a bucket per page of memory.  The
+ * stripe counts are read without their mutexes, which is good enough
+ * to decide on a resize.
+ */
+static boolean_t
+dbuf_hash_grow_needed(void)
+{
+	dbuf_hash_table_t *h = &dbuf_hash_table;
+	uint64_t nbuckets = h->hash_table_mask + 1;
+	uint64_t count = 0;
+	uint64_t i;
+
+	for (i = 0; i <= h->hash_mutex_mask; i++)
+		count += h->hash_mutexes[i].hl_count;
+
+	return (count > nbuckets * MAX(dbuf_hash_max_load, 1) &&
+	    nbuckets * 2 <= physmem);
+}
+
+/*
+ * Double the size of the hash table.  This runs on dbuf_evict_thread()
+ * between eviction passes.  Nobody waits on that thread, since
+ * dbuf_evict_notify() only signals it, so it may sleep on a busy hash
+ * mutex without holding anyone up but the eviction.
+ *
+ * Each stripe's dbufs, DB_EVICTING ones included, are rehashed into the
+ * new array under the stripe's mutex, and hl_buckets is switched before
+ * the mutex is dropped.  dbuf_find(), dbuf_hash_insert() and
+ * dbuf_hash_remove() on other stripes carry on meanwhile, and hl_count
+ * stays right since no dbuf changes stripe.  The dbuf_stats.c walkers
+ * also only follow hl_buckets under the stripe's mutex, so nothing can
+ * be looking at the old array once the last stripe has moved.
+ */
+static boolean_t
+dbuf_hash_grow(void)
+{
+	dbuf_hash_table_t *h = &dbuf_hash_table;
+	dbuf_hash_buckets_t *ohb = h->hash_buckets;
+	dbuf_hash_buckets_t *nhb;
+	uint64_t s, i;
+
+	nhb = dbuf_hash_buckets_alloc((ohb->hb_mask + 1) << 1, KM_NOSLEEP);
+	if (nhb == NULL)
+		return (B_FALSE);
+
+	for (s = 0; s <= h->hash_mutex_mask; s++) {
+		dbuf_hash_lock_t *hl = &h->hash_mutexes[s];
+
+		mutex_enter(&hl->hl_lock);
+		ASSERT3P(hl->hl_buckets, ==, ohb);
+		for (i = s; i <= ohb->hb_mask; i += h->hash_mutex_mask + 1) {
+			dmu_buf_impl_t *db, **bucket;
+
+			while ((db = ohb->hb_table[i]) != NULL) {
+				ohb->hb_table[i] = db->db_hash_next;
+				bucket = &nhb->hb_table[dbuf_hash(
+				    db->db_objset, db->db.db_object,
+				    db->db_level, db->db_blkid) & nhb->hb_mask];
+				db->db_hash_next = *bucket;
+				*bucket = db;
+			}
+		}
+		hl->hl_buckets = nhb;
+		mutex_exit(&hl->hl_lock);
+	}
+
+	h->hash_buckets = nhb;
+	h->hash_table_mask = nhb->hb_mask;
+	dbuf_hash_buckets_free(ohb);
+	atomic_add_64(&h->hash_resizes, 1);
+
+	return (B_TRUE);
 }
 
 static arc_evict_func_t dbuf_do_evict;
@@ -292,68 +509,314 @@ dbuf_evict(dmu_buf_impl_t *db)
 	dbuf_destroy(db);
 }
 
+/*
+ * Each dbuf cache is a multilist; a dbuf always goes on the sublist its
+ * identity hashes to.
+ */
+static unsigned int
+dbuf_cache_multilist_index_func(multilist_t *ml, void *obj)
+{
+	dmu_buf_impl_t *db = obj;
+
+	return (dbuf_hash(db->db_objset, db->db.db_object, db->db_level,
+	    db->db_blkid) % multilist_get_num_sublists(ml));
+}
+
+static uint64_t
+dbuf_cache_target_bytes(dbuf_cached_state_t which)
+{
+	if (which == DB_DBUF_METADATA_CACHE) {
+		if (dbuf_metadata_cache_max_bytes != 0)
+			return (dbuf_metadata_cache_max_bytes);
+		return (arc_max_bytes() >> dbuf_metadata_cache_shift);
+	}
+
+	if (dbuf_cache_max_bytes != 0)
+		return (dbuf_cache_max_bytes);
+	return (arc_max_bytes() >> dbuf_cache_shift);
+}
+
+static boolean_t
+dbuf_cache_above_target(dbuf_cached_state_t which)
+{
+	return (dbuf_caches[which].dc_size > dbuf_cache_target_bytes(which));
+}
+
+static boolean_t
+dbuf_cache_above_lowater(dbuf_cached_state_t which)
+{
+	uint64_t target = dbuf_cache_target_bytes(which);
+	uint64_t lowater = target * MIN(dbuf_cache_lowater_pct, 100) / 100;
+
+	return (dbuf_caches[which].dc_size > target - lowater);
+}
+
+/*
+ * Put a dbuf that just lost its last hold on the head of its cache.  It
+ * keeps its hold on the ARC buffer until it is evicted from the cache.
+ */
+static void
+dbuf_cache_insert(dmu_buf_impl_t *db)
+{
+	dbuf_cached_state_t which;
+	dbuf_cache_t *dc;
+	uint64_t size;
+
+	ASSERT(MUTEX_HELD(&db->db_mtx));
+	ASSERT(refcount_is_zero(&db->db_holds));
+	ASSERT3U(db->db_caching_status, ==, DB_NO_CACHE);
+	ASSERT(db->db_buf != NULL);
+
+	which = dbuf_is_metadata(db) ?
+	    DB_DBUF_METADATA_CACHE : DB_DBUF_CACHE;
+	dc = &dbuf_caches[which];
+
+	db->db_caching_status = which;
+	multilist_insert(&dc->dc_cache, db);
+	size = atomic_add_64_nv(&dc->dc_size, db->db.db_size);
+	atomic_add_64(&dc->dc_count, 1);
+
+	if (which == DB_DBUF_METADATA_CACHE)
+		DBUF_STAT_MAX(metadata_cache_size_bytes_max, size);
+	else
+		DBUF_STAT_MAX(cache_size_bytes_max, size);
+}
+
+/*
+ * Take a dbuf off its cache.  Its hold on the ARC buffer is left to the
+ * caller, which either turns it into a hold of its own or drops it.
+ */
+static void
+dbuf_cache_remove(dmu_buf_impl_t *db)
+{
+	dbuf_cache_t *dc = &dbuf_caches[db->db_caching_status];
+
+	ASSERT(MUTEX_HELD(&db->db_mtx));
+	ASSERT(refcount_is_zero(&db->db_holds));
+	ASSERT3U(db->db_caching_status, !=, DB_NO_CACHE);
+
+	multilist_remove(&dc->dc_cache, db);
+	atomic_add_64(&dc->dc_size, -db->db.db_size);
+	atomic_add_64(&dc->dc_count, -1);
+	db->db_caching_status = DB_NO_CACHE;
+}
+
+/*
+ * Evict the least recently released dbuf of a random sublist of the
+ * cache.  The sublist lock is taken before db_mtx here, the reverse of
+ * the release path, so dbufs whose lock is busy are skipped.
+ */
+static boolean_t
+dbuf_evict_one(dbuf_cached_state_t which)
+{
+	multilist_t *ml = &dbuf_caches[which].dc_cache;
+	multilist_sublist_t *mls;
+	dmu_buf_impl_t *db;
+
+	mls = multilist_sublist_lock(ml, multilist_get_random_index(ml));
+	for (db = multilist_sublist_tail(mls); db != NULL;
+	    db = multilist_sublist_prev(mls, db)) {
+		if (mutex_tryenter(&db->db_mtx))
+			break;
+	}
+	multilist_sublist_unlock(mls);
+
+	if (db == NULL)
+		return (B_FALSE);
+
+	/* dbuf_clear() takes it off the cache and drops db_mtx */
+	DBUF_CACHE_STAT_BUMP(which, evicts);
+	dbuf_clear(db);
+
+	return (B_TRUE);
+}
+
+/*
+ * Called after a dbuf was added to a cache, without any db_mtx held.
+ */
+static void
+dbuf_evict_notify(dbuf_cached_state_t which)
+{
+	if (!dbuf_cache_above_target(which))
+		return;
+
+	mutex_enter(&dbuf_evict_lock);
+	cv_signal(&dbuf_evict_cv);
+	mutex_exit(&dbuf_evict_lock);
+}
+
+static void
+dbuf_evict_thread(void)
+{
+	callb_cpr_t cpr;
+	int which;
+
+	CALLB_CPR_INIT(&cpr, &dbuf_evict_lock, callb_generic_cpr, FTAG);
+
+	mutex_enter(&dbuf_evict_lock);
+	while (!dbuf_evict_thread_exit) {
+		boolean_t evicting = B_FALSE;
+
+		for (which = DB_DBUF_CACHE; which < DB_CACHE_MAX; which++)
+			if (dbuf_cache_above_target(which))
+				evicting = B_TRUE;
+
+		if (!evicting && dbuf_hash_grow_needed()) {
+			boolean_t grown;
+
+			mutex_exit(&dbuf_evict_lock);
+			grown = dbuf_hash_grow();
+			mutex_enter(&dbuf_evict_lock);
+
+			if (grown)
+				continue;
+		}
+
+		if (!evicting) {
+			CALLB_CPR_SAFE_BEGIN(&cpr);
+			(void) cv_timedwait_interruptible(&dbuf_evict_cv,
+			    &dbuf_evict_lock, ddi_get_lbolt() + hz);
+			CALLB_CPR_SAFE_END(&cpr, &dbuf_evict_lock);
+			continue;
+		}
+		mutex_exit(&dbuf_evict_lock);
+
+		for (which = DB_DBUF_CACHE; which < DB_CACHE_MAX; which++) {
+			while (dbuf_cache_above_lowater(which) &&
+			    !dbuf_evict_thread_exit) {
+				if (!dbuf_evict_one(which))
+					break;
+			}
+		}
+
+		mutex_enter(&dbuf_evict_lock);
+	}
+
+	dbuf_evict_thread_exit = B_FALSE;
+	cv_broadcast(&dbuf_evict_cv);
+	CALLB_CPR_EXIT(&cpr);		/* drops dbuf_evict_lock */
+	thread_exit();
+}
+
+static int
+dbuf_cache_kstat_update(kstat_t *ksp, int rw)
+{
+	dbuf_cache_stats_t *ds = ksp->ks_data;
+
+	if (rw == KSTAT_WRITE)
+		return (SET_ERROR(EACCES));
+
+	ds->cache_count.value.ui64 = dbuf_caches[DB_DBUF_CACHE].dc_count;
+	ds->cache_size_bytes.value.ui64 = dbuf_caches[DB_DBUF_CACHE].dc_size;
+	ds->cache_target_bytes.value.ui64 =
+	    dbuf_cache_target_bytes(DB_DBUF_CACHE);
+	ds->metadata_cache_count.value.ui64 =
+	    dbuf_caches[DB_DBUF_METADATA_CACHE].dc_count;
+	ds->metadata_cache_size_bytes.value.ui64 =
+	    dbuf_caches[DB_DBUF_METADATA_CACHE].dc_size;
+	ds->metadata_cache_target_bytes.value.ui64 =
+	    dbuf_cache_target_bytes(DB_DBUF_METADATA_CACHE);
+
+	return (0);
+}
+
 void
 dbuf_init(void)
 {
 	uint64_t hsize = 1ULL << 16;
+	uint64_t nlocks = DBUF_MUTEXES;
 	dbuf_hash_table_t *h = &dbuf_hash_table;
-	int i;
+	uint64_t i;
 
 	/*
-	 * The hash table is big enough to fill all of physical memory
-	 * with an average 4K block size.  The table will take up
-	 * totalmem*sizeof(void*)/4K (i.e. 2MB/GB with 8-byte pointers).
+	 * The hash table starts out big enough to fill all of physical
+	 * memory with an average 64K block size, taking up
+	 * totalmem*sizeof(void*)/64K (i.e. 128KB/GB with 8-byte pointers),
+	 * and is grown by dbuf_hash_grow() when blocks are smaller.
 	 */
-	while (hsize * 4096 < (uint64_t)physmem * PAGESIZE)
+	while (hsize * 65536 < (uint64_t)physmem * PAGESIZE)
 		hsize <<= 1;
 
-retry:
-	h->hash_table_mask = hsize - 1;
-
-    //printf("[dbuf] init hsize is 0x%llx mask is 0x%llx\n", hsize, h->hash_table_mask);
-
-	h->hash_table = kmem_zalloc(hsize * sizeof (void *), KM_PUSHPAGE);
-
-	if (h->hash_table == NULL) {
+	while ((h->hash_buckets = dbuf_hash_buckets_alloc(hsize,
+	    KM_NOSLEEP)) == NULL) {
 		/* XXX - we should really return an error instead of assert */
 		ASSERT(hsize > (1ULL << 10));
 		hsize >>= 1;
-		goto retry;
 	}
+	h->hash_table_mask = hsize - 1;
 
-    //printf("[dbuf] hash_table allocated %llu bytes (hsize %llu)\n",
-    //       hsize * sizeof (void *),
-    //      hsize);
+	while (nlocks < max_ncpus * DBUF_MUTEXES_PER_CPU && nlocks < hsize)
+		nlocks <<= 1;
+	nlocks = MIN(nlocks, hsize);
+	h->hash_mutex_mask = nlocks - 1;
+	h->hash_mutexes = kmem_zalloc(nlocks * sizeof (dbuf_hash_lock_t),
+	    KM_SLEEP);
+	for (i = 0; i < nlocks; i++) {
+		mutex_init(&h->hash_mutexes[i].hl_lock, NULL, MUTEX_DEFAULT,
+		    NULL);
+		h->hash_mutexes[i].hl_buckets = h->hash_buckets;
+	}
 
 	dbuf_cache = kmem_cache_create("dmu_buf_impl_t",
 	    sizeof (dmu_buf_impl_t),
 	    0, dbuf_cons, dbuf_dest, NULL, NULL, NULL, 0);
 
-	for (i = 0; i < DBUF_MUTEXES; i++)
-		mutex_init(&h->hash_mutexes[i], NULL, MUTEX_DEFAULT, NULL);
-
 	dbuf_stats_init(h);
+
+	for (i = DB_DBUF_CACHE; i < DB_CACHE_MAX; i++) {
+		multilist_create(&dbuf_caches[i].dc_cache,
+		    sizeof (dmu_buf_impl_t),
+		    offsetof(dmu_buf_impl_t, db_cache_link),
+		    MAX(max_ncpus, 4), dbuf_cache_multilist_index_func);
+	}
+
+	dbuf_cache_ksp = kstat_create("zfs", 0, "dbufstats", "misc",
+	    KSTAT_TYPE_NAMED, sizeof (dbuf_cache_stats) /
+	    sizeof (kstat_named_t), KSTAT_FLAG_VIRTUAL);
+	if (dbuf_cache_ksp != NULL) {
+		dbuf_cache_ksp->ks_data = &dbuf_cache_stats;
+		dbuf_cache_ksp->ks_update = dbuf_cache_kstat_update;
+		kstat_install(dbuf_cache_ksp);
+	}
+
+	mutex_init(&dbuf_evict_lock, NULL, MUTEX_DEFAULT, NULL);
+	cv_init(&dbuf_evict_cv, NULL, CV_DEFAULT, NULL);
+	dbuf_evict_thread_exit = B_FALSE;
+	(void) thread_create(NULL, 0, dbuf_evict_thread, NULL, 0, &p0,
+	    TS_RUN, minclsyspri);
 }
 
 void
 dbuf_fini(void)
 {
 	dbuf_hash_table_t *h = &dbuf_hash_table;
-	int i;
+	uint64_t i;
+
+	mutex_enter(&dbuf_evict_lock);
+	dbuf_evict_thread_exit = B_TRUE;
+	while (dbuf_evict_thread_exit) {
+		cv_signal(&dbuf_evict_cv);
+		cv_wait(&dbuf_evict_cv, &dbuf_evict_lock);
+	}
+	mutex_exit(&dbuf_evict_lock);
+	mutex_destroy(&dbuf_evict_lock);
+	cv_destroy(&dbuf_evict_cv);
+
+	if (dbuf_cache_ksp != NULL) {
+		kstat_delete(dbuf_cache_ksp);
+		dbuf_cache_ksp = NULL;
+	}
+
+	for (i = DB_DBUF_CACHE; i < DB_CACHE_MAX; i++)
+		multilist_destroy(&dbuf_caches[i].dc_cache);
 
 	dbuf_stats_destroy();
 
-	for (i = 0; i < DBUF_MUTEXES; i++)
-		mutex_destroy(&h->hash_mutexes[i]);
-#if defined(_KERNEL) && defined(HAVE_SPL)
-	/*
-	 * Large allocations which do not require contiguous pages
-	 * should be using vmem_free() in the linux kernel
-	 */
-	vmem_free(h->hash_table, (h->hash_table_mask + 1) * sizeof (void *));
-#else
-	kmem_free(h->hash_table, (h->hash_table_mask + 1) * sizeof (void *));
-#endif
+	for (i = 0; i <= h->hash_mutex_mask; i++)
+		mutex_destroy(&h->hash_mutexes[i].hl_lock);
+	kmem_free(h->hash_mutexes,
+	    (h->hash_mutex_mask + 1) * sizeof (dbuf_hash_lock_t));
+	dbuf_hash_buckets_free(h->hash_buckets);
 	kmem_cache_destroy(dbuf_cache);
 }
 
@@ -660,7 +1123,6 @@ dbuf_read(dmu_buf_impl_t *db, zio_t *zio, uint32_t flags)
 {
 	int err = 0;
 	int havepzio = (zio != NULL);
-	int prefetch;
 	dnode_t *dn;
 
 	/*
@@ -677,17 +1139,10 @@ dbuf_read(dmu_buf_impl_t *db, zio_t *zio, uint32_t flags)
 	if ((flags & DB_RF_HAVESTRUCT) == 0)
 		rw_enter(&dn->dn_struct_rwlock, RW_READER);
 
-	prefetch = db->db_level == 0 && db->db_blkid != DMU_BONUS_BLKID &&
-	    (flags & DB_RF_NOPREFETCH) == 0 && dn != NULL &&
-	    DBUF_IS_CACHEABLE(db);
-
 	mutex_enter(&db->db_mtx);
 
 	if (db->db_state == DB_CACHED) {
 		mutex_exit(&db->db_mtx);
-		if (prefetch)
-			dmu_zfetch(&dn->dn_zfetch, db->db.db_offset,
-			    db->db.db_size, TRUE);
 		if ((flags & DB_RF_HAVESTRUCT) == 0)
 			rw_exit(&dn->dn_struct_rwlock);
 		DB_DNODE_EXIT(db);
@@ -700,10 +1155,6 @@ dbuf_read(dmu_buf_impl_t *db, zio_t *zio, uint32_t flags)
 
 		/* dbuf_read_impl has dropped db_mtx for us */
 
-		if (prefetch)
-			dmu_zfetch(&dn->dn_zfetch, db->db.db_offset,
-			    db->db.db_size, flags & DB_RF_CACHED);
-
 		if ((flags & DB_RF_HAVESTRUCT) == 0)
 			rw_exit(&dn->dn_struct_rwlock);
 		DB_DNODE_EXIT(db);
@@ -720,9 +1171,6 @@ dbuf_read(dmu_buf_impl_t *db, zio_t *zio, uint32_t flags)
 		 * occurred and the dbuf went to UNCACHED.
 		 */
 		mutex_exit(&db->db_mtx);
-		if (prefetch)
-			dmu_zfetch(&dn->dn_zfetch, db->db.db_offset,
-			    db->db.db_size, TRUE);
 		if ((flags & DB_RF_HAVESTRUCT) == 0)
 			rw_exit(&dn->dn_struct_rwlock);
 		DB_DNODE_EXIT(db);
@@ -1615,6 +2063,11 @@ dbuf_clear(dmu_buf_impl_t *db)
 	ASSERT(MUTEX_HELD(&db->db_mtx));
 	ASSERT(refcount_is_zero(&db->db_holds));
 
+	if (db->db_caching_status != DB_NO_CACHE) {
+		dbuf_cache_remove(db);
+		VERIFY(!arc_buf_remove_ref(db->db_buf, db));
+	}
+
 	dbuf_evict_user(db);
 
 	if (db->db_state == DB_CACHED) {
@@ -1901,8 +2354,14 @@ dbuf_destroy(dmu_buf_impl_t *db)
     dmubufholds--;
 }
 
+/*
+ * Start an asynchronous read of the block at the given level and blkid of
+ * dn into the ARC, if it is not already cached.  The indirect block that
+ * points to it is read synchronously if it is not cached, so prefetching
+ * level 1 blocks ahead of level 0 ones avoids waiting for them.
+ */
 void
-dbuf_prefetch(dnode_t *dn, uint64_t blkid, zio_priority_t prio)
+dbuf_prefetch(dnode_t *dn, int level, uint64_t blkid, zio_priority_t prio)
 {
 	dmu_buf_impl_t *db = NULL;
 	blkptr_t *bp = NULL;
@@ -1910,11 +2369,11 @@ dbuf_prefetch(dnode_t *dn, uint64_t blkid, zio_priority_t prio)
 	ASSERT(blkid != DMU_BONUS_BLKID);
 	ASSERT(RW_LOCK_HELD(&dn->dn_struct_rwlock));
 
-	if (dnode_block_freed(dn, blkid))
+	if (level == 0 && dnode_block_freed(dn, blkid))
 		return;
 
 	/* dbuf_find() returns with db_mtx held */
-	if ((db = dbuf_find(dn, 0, blkid))) {
+	if ((db = dbuf_find(dn, level, blkid))) {
 		/*
 		 * This dbuf is already in the cache.  We assume that
 		 * it is already CACHED, or else about to be either
@@ -1924,17 +2383,17 @@ dbuf_prefetch(dnode_t *dn, uint64_t blkid, zio_priority_t prio)
 		return;
 	}
 
-	if (dbuf_findbp(dn, 0, blkid, TRUE, &db, &bp, NULL) == 0) {
+	if (dbuf_findbp(dn, level, blkid, TRUE, &db, &bp, NULL) == 0) {
 		if (bp && !BP_IS_HOLE(bp)) {
 			dsl_dataset_t *ds = dn->dn_objset->os_dsl_dataset;
 			uint32_t aflags = ARC_NOWAIT | ARC_PREFETCH;
 			zbookmark_t zb;
 
 			SET_BOOKMARK(&zb, ds ? ds->ds_object : DMU_META_OBJSET,
-			    dn->dn_object, 0, blkid);
+			    dn->dn_object, level, blkid);
 
 			(void) arc_read(NULL, dn->dn_objset->os_spa,
-                            bp, NULL, NULL, prio,
+			    bp, NULL, NULL, prio,
 			    ZIO_FLAG_CANFAIL | ZIO_FLAG_SPECULATIVE,
 			    &aflags, &zb);
 		}
@@ -1987,7 +2446,12 @@ top:
 					dh->dh_parent, dh->dh_bp);
 	}
 
-	if (dh->dh_db->db_buf && refcount_is_zero(&dh->dh_db->db_holds)) {
+	if (dh->dh_db->db_caching_status != DB_NO_CACHE) {
+		/* the cache's hold on the ARC buffer becomes ours */
+		DBUF_CACHE_STAT_BUMP(dh->dh_db->db_caching_status, hits);
+		dbuf_cache_remove(dh->dh_db);
+	} else if (dh->dh_db->db_buf &&
+	    refcount_is_zero(&dh->dh_db->db_holds)) {
 		arc_buf_add_ref(dh->dh_db->db_buf, dh->dh_db);
 		if (dh->dh_db->db_buf->b_data == NULL) {
 			dbuf_clear(dh->dh_db);
@@ -2115,8 +2579,8 @@ dbuf_spill_set_blksz(dmu_buf_t *db_fake, uint64_t blksz, dmu_tx_t *tx)
 		return (SET_ERROR(ENOTSUP));
 	if (blksz == 0)
 		blksz = SPA_MINBLOCKSIZE;
-	if (blksz > SPA_MAXBLOCKSIZE)
-		blksz = SPA_MAXBLOCKSIZE;
+	if (blksz > SPA_OLD_MAXBLOCKSIZE)
+		blksz = SPA_OLD_MAXBLOCKSIZE;
 	else
 		blksz = P2ROUNDUP(blksz, SPA_MINBLOCKSIZE);
 
@@ -2165,6 +2629,7 @@ dbuf_rele(dmu_buf_impl_t *db, void *tag)
 void
 dbuf_rele_and_unlock(dmu_buf_impl_t *db, void *tag)
 {
+	dbuf_cached_state_t which;
 	int64_t holds;
 
 	ASSERT(MUTEX_HELD(&db->db_mtx));
@@ -2223,8 +2688,6 @@ dbuf_rele_and_unlock(dmu_buf_impl_t *db, void *tag)
 			VERIFY(arc_buf_remove_ref(buf, db));
 			dbuf_evict(db);
 		} else {
-			VERIFY(!arc_buf_remove_ref(db->db_buf, db));
-
 			/*
 			 * A dbuf will be eligible for eviction if either the
 			 * 'primarycache' property is set or a duplicate
@@ -2239,12 +2702,20 @@ dbuf_rele_and_unlock(dmu_buf_impl_t *db, void *tag)
 			 * if multiple buffers are referencing the same
 			 * block on-disk. If so, then we simply evict
 			 * ourselves.
+			 *
+			 * Otherwise the dbuf goes on the dbuf cache, which
+			 * keeps our hold on the ARC buffer.
 			 */
 			if (!DBUF_IS_CACHEABLE(db) ||
-			    arc_buf_eviction_needed(db->db_buf))
+			    arc_buf_eviction_needed(db->db_buf)) {
+				VERIFY(!arc_buf_remove_ref(db->db_buf, db));
 				dbuf_clear(db);
-			else
+			} else {
+				dbuf_cache_insert(db);
+				which = db->db_caching_status;
 				mutex_exit(&db->db_mtx);
+				dbuf_evict_notify(which);
+			}
 		}
 	} else {
 		mutex_exit(&db->db_mtx);
@@ -2620,7 +3091,7 @@ dbuf_write_ready(zio_t *zio, arc_buf_t *buf, void *vdb)
 	zio->io_prev_space_delta = delta;
 
 	if (BP_IS_HOLE(bp)) {
-		ASSERT(bp->blk_fill == 0);
+		ASSERT(BP_GET_FILL(bp) == 0);
 		DB_DNODE_EXIT(db);
 		return;
 	}
@@ -2664,12 +3135,13 @@ dbuf_write_ready(zio_t *zio, arc_buf_t *buf, void *vdb)
 		for (i = db->db.db_size >> SPA_BLKPTRSHIFT; i > 0; i--, ibp++) {
 			if (BP_IS_HOLE(ibp))
 				continue;
-			fill += ibp->blk_fill;
+			fill += BP_GET_FILL(ibp);
 		}
 	}
 	DB_DNODE_EXIT(db);
 
-	bp->blk_fill = fill;
+	if (!BP_IS_EMBEDDED(bp))
+		bp->blk_fill = fill;
 
 	mutex_exit(&db->db_mtx);
 }
@@ -2979,4 +3451,30 @@ EXPORT_SYMBOL(dmu_buf_set_user_ie);
 EXPORT_SYMBOL(dmu_buf_update_user);
 EXPORT_SYMBOL(dmu_buf_get_user);
 EXPORT_SYMBOL(dmu_buf_freeable);
+
+module_param(dbuf_cache_max_bytes, ulong, 0644);
+MODULE_PARM_DESC(dbuf_cache_max_bytes,
+	"Maximum size in bytes of the dbuf cache.");
+
+module_param(dbuf_metadata_cache_max_bytes, ulong, 0644);
+MODULE_PARM_DESC(dbuf_metadata_cache_max_bytes,
+	"Maximum size in bytes of the dbuf metadata cache.");
+
+module_param(dbuf_cache_shift, int, 0644);
+MODULE_PARM_DESC(dbuf_cache_shift,
+	"Set the size of the dbuf cache to a log2 fraction of arc size.");
+
+module_param(dbuf_metadata_cache_shift, int, 0644);
+MODULE_PARM_DESC(dbuf_metadata_cache_shift,
+	"Set the size of the dbuf metadata cache to a log2 fraction of "
+	"arc size.");
+
+module_param(dbuf_hash_max_load, int, 0644);
+MODULE_PARM_DESC(dbuf_hash_max_load,
+	"Average dbufs per hash bucket before the table is grown");
+
+module_param(dbuf_cache_lowater_pct, uint, 0644);
+MODULE_PARM_DESC(dbuf_cache_lowater_pct,
+	"Percentage below dbuf_cache_max_bytes when the evict thread stops "
+	"evicting dbufs.");
 #endif
@@ -46,13 +46,14 @@ static int
 dbuf_stats_hash_table_headers(char *buf, size_t size)
 {
 	size = snprintf(buf, size - 1,
-	    "%-88s | %-124s | %s\n"
-	    "%-16s %-8s %-8s %-8s %-8s %-8s %-8s %-5s %-5s %5s | "
+	    "%-92s | %-124s | %s\n"
+	    "%-16s %-8s %-8s %-8s %-8s %-8s %-8s %-5s %-5s %5s %-3s | "
 	    "%-5s %-5s %-6s %-8s %-6s %-8s %-12s "
 	    "%-6s %-6s %-6s %-6s %-6s %-8s %-8s %-8s %-5s | "
 	    "%-6s %-6s %-8s %-8s %-6s %-6s %-5s %-8s %-8s\n",
 	    "dbuf", "arcbuf", "dnode", "pool", "objset", "object", "level",
-	    "blkid", "offset", "dbsize", "meta", "state", "dbholds", "list",
+	    "blkid", "offset", "dbsize", "meta", "state", "dbholds", "dbc",
+	    "list",
 	    "atype", "index", "flags", "count", "asize", "access",
 	    "mru", "gmru", "mfu", "gmfu", "l2", "l2_dattr", "l2_asize",
 	    "l2_comp", "aholds", "dtype", "btype", "data_bs", "meta_bs",
@@ -76,7 +77,8 @@ __dbuf_stats_hash_table_data(char *buf, size_t size, dmu_buf_impl_t *db)
 		__dmu_object_info_from_dnode(dn, &doi);
 
 	size = snprintf(buf, size - 1,
-	    "%-16s %-8llu %-8lld %-8lld %-8lld %-8llu %-8llu %-5d %-5d %-5lu | "
+	    "%-16s %-8llu %-8lld %-8lld %-8lld %-8llu %-8llu %-5d %-5d %-5lu "
+	    "%-3d | "
 	    "%-5d %-5d %-6lld 0x%-6x %-6lu %-8llu %-12llu "
 	    "%-6lu %-6lu %-6lu %-6lu %-6lu %-8llu %-8llu %-8d %-5lu | "
 	    "%-6d %-6d %-8lu %-8lu %-6llu %-6lu %-5lu %-8llu %-8llu\n",
@@ -91,6 +93,7 @@ __dbuf_stats_hash_table_data(char *buf, size_t size, dmu_buf_impl_t *db)
 	    !!dbuf_is_metadata(db),
 	    db->db_state,
 	    (ulong_t)refcount_count(&db->db_holds),
+	    db->db_caching_status,
 	    /* arc_buf_info_t */
 	    abi.abi_state_type,
 	    abi.abi_state_contents,
@@ -128,15 +131,26 @@ dbuf_stats_hash_table_data(char *buf, size_t size, void *data)
 {
 	dbuf_stats_t *dsh = (dbuf_stats_t *)data;
 	dbuf_hash_table_t *h = dsh->hash;
+	dbuf_hash_buckets_t *hb;
 	dmu_buf_impl_t *db;
 	int length, error = 0;
 
 	ASSERT3S(dsh->idx, >=, 0);
-	ASSERT3S(dsh->idx, <=, h->hash_table_mask);
 	memset(buf, 0, size);
 
 	mutex_enter(DBUF_HASH_MUTEX(h, dsh->idx));
-	for (db = h->hash_table[dsh->idx]; db != NULL; db = db->db_hash_next) {
+
+	/*
+	 * While the table is being grown, a stripe that has not been moved
+	 * yet is only walked at its indexes in the old, smaller array.
+	 */
+	hb = DBUF_HASH_LOCK(h, dsh->idx)->hl_buckets;
+	if (dsh->idx > hb->hb_mask) {
+		mutex_exit(DBUF_HASH_MUTEX(h, dsh->idx));
+		return (0);
+	}
+
+	for (db = hb->hb_table[dsh->idx]; db != NULL; db = db->db_hash_next) {
 		/*
 		 * Returning ENOMEM will cause the data and header functions
 		 * to be called with a larger scratch buffers.
@@ -212,15 +226,119 @@ dbuf_stats_hash_table_destroy(void)
 	mutex_destroy(&dsh->lock);
 }
 
+/*
+ * ==========================================================================
+ * Dbuf Hash Occupancy Routines
+ * ==========================================================================
+ */
+typedef struct dbuf_hash_stats {
+	kstat_named_t buckets;
+	kstat_named_t mutexes;
+	kstat_named_t elements;
+	kstat_named_t occupied;
+	kstat_named_t chains;
+	kstat_named_t chain_max;
+	kstat_named_t lock_contended;
+	kstat_named_t resizes;
+} dbuf_hash_stats_t;
+
+static dbuf_hash_stats_t dbuf_hash_stats = {
+	{ "buckets",		KSTAT_DATA_UINT64 },
+	{ "mutexes",		KSTAT_DATA_UINT64 },
+	{ "elements",		KSTAT_DATA_UINT64 },
+	{ "occupied",		KSTAT_DATA_UINT64 },
+	{ "chains",		KSTAT_DATA_UINT64 },
+	{ "chain_max",		KSTAT_DATA_UINT64 },
+	{ "lock_contended",	KSTAT_DATA_UINT64 },
+	{ "resizes",		KSTAT_DATA_UINT64 },
+};
+
+static kstat_t *dbuf_hash_ksp;
+
+/*
+ * Walk the whole table, one stripe at a time, to count the occupied
+ * buckets, the buckets with more than one dbuf and the longest chain.
+ */
+static int
+dbuf_stats_hash_update(kstat_t *ksp, int rw)
+{
+	dbuf_hash_table_t *h = ksp->ks_private;
+	dbuf_hash_stats_t *hs = ksp->ks_data;
+	uint64_t elements = 0, occupied = 0, chains = 0, chain_max = 0;
+	uint64_t s, i, len;
+
+	if (rw == KSTAT_WRITE)
+		return (EACCES);
+
+	for (s = 0; s <= h->hash_mutex_mask; s++) {
+		dbuf_hash_lock_t *hl = &h->hash_mutexes[s];
+		dmu_buf_impl_t *db;
+
+		mutex_enter(&hl->hl_lock);
+		for (i = s; i <= hl->hl_buckets->hb_mask;
+		    i += h->hash_mutex_mask + 1) {
+			len = 0;
+			for (db = hl->hl_buckets->hb_table[i]; db != NULL;
+			    db = db->db_hash_next)
+				len++;
+
+			if (len > 0)
+				occupied++;
+			if (len > 1)
+				chains++;
+			chain_max = MAX(chain_max, len);
+		}
+		elements += hl->hl_count;
+		mutex_exit(&hl->hl_lock);
+	}
+
+	hs->buckets.value.ui64 = h->hash_table_mask + 1;
+	hs->mutexes.value.ui64 = h->hash_mutex_mask + 1;
+	hs->elements.value.ui64 = elements;
+	hs->occupied.value.ui64 = occupied;
+	hs->chains.value.ui64 = chains;
+	hs->chain_max.value.ui64 = chain_max;
+	hs->lock_contended.value.ui64 = h->hash_lock_contended;
+	hs->resizes.value.ui64 = h->hash_resizes;
+
+	return (0);
+}
+
+static void
+dbuf_stats_hash_init(dbuf_hash_table_t *hash)
+{
+	dbuf_hash_ksp = kstat_create("zfs", 0, "dbufhash", "misc",
+	    KSTAT_TYPE_NAMED, sizeof (dbuf_hash_stats) /
+	    sizeof (kstat_named_t), KSTAT_FLAG_VIRTUAL);
+
+	if (dbuf_hash_ksp) {
+		dbuf_hash_ksp->ks_data = &dbuf_hash_stats;
+		dbuf_hash_ksp->ks_private = hash;
+		dbuf_hash_ksp->ks_update = dbuf_stats_hash_update;
+		kstat_install(dbuf_hash_ksp);
+	}
+}
+
+static void
+dbuf_stats_hash_destroy(void)
+{
+	if (dbuf_hash_ksp) {
+		kstat_delete(dbuf_hash_ksp);
+		dbuf_hash_ksp = NULL;
+	}
+}
+
 void
 dbuf_stats_init(dbuf_hash_table_t *hash)
 {
 	dbuf_stats_hash_table_init(hash);
+	dbuf_stats_hash_init(hash);
 }
 
 void
 dbuf_stats_destroy(void)
 {
+	dbuf_stats_hash_destroy();
 	dbuf_stats_hash_table_destroy();
 }
 
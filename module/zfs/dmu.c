@@ -55,6 +55,13 @@
  */
 int zfs_nopwrite_enabled = 1;
 
+/*
+ * Largest recordsize or volblocksize which may be set, on pools with the
+ * large_blocks feature.  Blocks above 1MB are allowed on disk, up to
+ * SPA_MAXBLOCKSIZE, but must be opted into by raising this.
+ */
+int zfs_max_recordsize = 1 * 1024 * 1024;
+
 const dmu_object_type_info_t dmu_ot[DMU_OT_NUMTYPES] = {
 	{	DMU_BSWAP_UINT8,	TRUE,	"unallocated"		},
 	{	DMU_BSWAP_ZAP,		TRUE,	"object directory"	},
@@ -363,26 +370,23 @@ dmu_spill_hold_by_bonus(dmu_buf_t *bonus, void *tag, dmu_buf_t **dbp)
 }
 
 /*
- * Note: longer-term, we should modify all of the dmu_buf_*() interfaces
- * to take a held dnode rather than <os, object> -- the lookup is wasteful,
- * and can induce severe lock contention when writing to several files
- * whose dnodes are in the same block.
+ * Hold the dbufs of length bytes of dn at offset and, if read is set, issue
+ * reads of those that aren't cached as children of zio.  The dbufs may
+ * still be being read, by zio or by another thread, when this returns;
+ * once zio is done, dmu_buf_wait_array() waits for the rest.
  */
 static int
-dmu_buf_hold_array_by_dnode(dnode_t *dn, uint64_t offset, uint64_t length,
-    int read, void *tag, int *numbufsp, dmu_buf_t ***dbpp, uint32_t flags)
+dmu_buf_hold_array_issue(dnode_t *dn, uint64_t offset, uint64_t length,
+    int read, void *tag, int *numbufsp, dmu_buf_t ***dbpp, uint32_t flags,
+    zio_t *zio)
 {
 	dmu_buf_t **dbp;
 	uint64_t blkid, nblks, i;
 	uint32_t dbuf_flags;
-	int err;
-	zio_t *zio;
 
 	ASSERT(length <= DMU_MAX_ACCESS);
 
 	dbuf_flags = DB_RF_CANFAIL | DB_RF_NEVERWAIT | DB_RF_HAVESTRUCT;
-	if (flags & DMU_READ_NO_PREFETCH || length > zfetch_array_rd_sz)
-		dbuf_flags |= DB_RF_NOPREFETCH;
 
 	rw_enter(&dn->dn_struct_rwlock, RW_READER);
 	if (dn->dn_datablkshift) {
@@ -405,14 +409,13 @@ dmu_buf_hold_array_by_dnode(dnode_t *dn, uint64_t offset, uint64_t length,
 	dbp = kmem_zalloc(sizeof (dmu_buf_t *) * nblks,
 	    KM_PUSHPAGE | KM_NODEBUG);
 
-	zio = zio_root(dn->dn_objset->os_spa, NULL, NULL, ZIO_FLAG_CANFAIL);
 	blkid = dbuf_whichblock(dn, offset);
+
 	for (i = 0; i < nblks; i++) {
 		dmu_buf_impl_t *db = dbuf_hold(dn, blkid+i, tag);
 		if (db == NULL) {
 			rw_exit(&dn->dn_struct_rwlock);
 			dmu_buf_rele_array(dbp, nblks, tag);
-			zio_nowait(zio);
 			return (SET_ERROR(EIO));
 		}
 		/* initiate async i/o */
@@ -421,35 +424,82 @@ dmu_buf_hold_array_by_dnode(dnode_t *dn, uint64_t offset, uint64_t length,
 		}
 		dbp[i] = &db->db;
 	}
+
+	/*
+	 * The whole access is handed to the prefetcher at once, rather than
+	 * a block at a time from dbuf_read().  This is done only after the
+	 * demand reads above have been issued, so that they are queued ahead
+	 * of the prefetch I/O they would otherwise wait behind.  Writes only
+	 * prefetch the indirect blocks that they will need to dirty.
+	 */
+	if ((flags & DMU_READ_NO_PREFETCH) == 0 &&
+	    length <= zfetch_array_rd_sz) {
+		dmu_zfetch(&dn->dn_zfetch, blkid, nblks,
+		    read && dn->dn_objset->os_primary_cache == ZFS_CACHE_ALL);
+	}
 	rw_exit(&dn->dn_struct_rwlock);
 
-	/* wait for async i/o */
-	err = zio_wait(zio);
+	*numbufsp = nblks;
+	*dbpp = dbp;
+	return (0);
+}
+
+/*
+ * Wait for the dbufs read by another thread to complete, after the zio
+ * passed to dmu_buf_hold_array_issue() is done.
+ */
+static int
+dmu_buf_wait_array(dmu_buf_t **dbp, int numbufs)
+{
+	int i, err = 0;
+
+	for (i = 0; i < numbufs && err == 0; i++) {
+		dmu_buf_impl_t *db = (dmu_buf_impl_t *)dbp[i];
+		mutex_enter(&db->db_mtx);
+		while (db->db_state == DB_READ ||
+		    db->db_state == DB_FILL)
+			cv_wait(&db->db_changed, &db->db_mtx);
+		if (db->db_state == DB_UNCACHED)
+			err = SET_ERROR(EIO);
+		mutex_exit(&db->db_mtx);
+	}
+
+	return (err);
+}
+
+/*
+ * Note: longer-term, we should modify all of the dmu_buf_*() interfaces
+ * to take a held dnode rather than <os, object> -- the lookup is wasteful,
+ * and can induce severe lock contention when writing to several files
+ * whose dnodes are in the same block.
+ */
+static int
+dmu_buf_hold_array_by_dnode(dnode_t *dn, uint64_t offset, uint64_t length,
+    int read, void *tag, int *numbufsp, dmu_buf_t ***dbpp, uint32_t flags)
+{
+	int err;
+	zio_t *zio;
+
+	zio = zio_root(dn->dn_objset->os_spa, NULL, NULL, ZIO_FLAG_CANFAIL);
+	err = dmu_buf_hold_array_issue(dn, offset, length, read, tag,
+	    numbufsp, dbpp, flags, zio);
 	if (err) {
-		dmu_buf_rele_array(dbp, nblks, tag);
+		zio_nowait(zio);
 		return (err);
 	}
 
+	/* wait for async i/o */
+	err = zio_wait(zio);
+
 	/* wait for other io to complete */
-	if (read) {
-		for (i = 0; i < nblks; i++) {
-			dmu_buf_impl_t *db = (dmu_buf_impl_t *)dbp[i];
-			mutex_enter(&db->db_mtx);
-			while (db->db_state == DB_READ ||
-			    db->db_state == DB_FILL)
-				cv_wait(&db->db_changed, &db->db_mtx);
-			if (db->db_state == DB_UNCACHED)
-				err = SET_ERROR(EIO);
-			mutex_exit(&db->db_mtx);
-			if (err) {
-				dmu_buf_rele_array(dbp, nblks, tag);
-				return (err);
-			}
-		}
+	if (err == 0 && read)
+		err = dmu_buf_wait_array(*dbpp, *numbufsp);
+
+	if (err) {
+		dmu_buf_rele_array(*dbpp, *numbufsp, tag);
+		return (err);
 	}
 
-	*numbufsp = nblks;
-	*dbpp = dbp;
 	return (0);
 }
 
@@ -534,7 +584,7 @@ dmu_prefetch(objset_t *os, uint64_t object, uint64_t offset, uint64_t len)
 
 		rw_enter(&dn->dn_struct_rwlock, RW_READER);
 		blkid = dbuf_whichblock(dn, object * sizeof (dnode_phys_t));
-		dbuf_prefetch(dn, blkid, ZIO_PRIORITY_SYNC_READ);
+		dbuf_prefetch(dn, 0, blkid, ZIO_PRIORITY_SYNC_READ);
 		rw_exit(&dn->dn_struct_rwlock);
 		return;
 	}
@@ -562,7 +612,7 @@ dmu_prefetch(objset_t *os, uint64_t object, uint64_t offset, uint64_t len)
 
 		blkid = dbuf_whichblock(dn, offset);
 		for (i = 0; i < nblks; i++)
-			dbuf_prefetch(dn, blkid + i, ZIO_PRIORITY_SYNC_READ);
+			dbuf_prefetch(dn, 0, blkid + i, ZIO_PRIORITY_SYNC_READ);
 	}
 
 	rw_exit(&dn->dn_struct_rwlock);
@@ -791,6 +841,165 @@ dmu_read(objset_t *os, uint64_t object, uint64_t offset, uint64_t size,
 	return (err);
 }
 
+/*
+ * Up to DMU_MAX_ACCESS / 2 bytes of one range of a dmu_read_async(), held
+ * by a single dmu_buf_hold_array_issue().
+ */
+typedef struct dmu_read_async_hold {
+	uint64_t	drh_offset;
+	uint64_t	drh_size;
+	char		*drh_buf;
+	dmu_buf_t	**drh_dbp;
+	int		drh_numbufs;
+} dmu_read_async_hold_t;
+
+typedef struct dmu_read_async {
+	objset_t		*dra_os;
+	dmu_read_async_hold_t	*dra_holds;
+	int			dra_nholds;
+	int			dra_error;
+	dmu_read_done_func_t	*dra_done;
+	void			*dra_arg;
+} dmu_read_async_t;
+
+/*
+ * Once all of the reads issued by dmu_read_async() are done, wait for any
+ * dbufs that other threads were reading, copy the data out, release the
+ * dbufs and let the caller know.
+ */
+static void
+dmu_read_async_task(void *arg)
+{
+	dmu_read_async_t *dra = arg;
+	int err = dra->dra_error;
+	int h, i;
+
+	for (h = 0; h < dra->dra_nholds; h++) {
+		dmu_read_async_hold_t *drh = &dra->dra_holds[h];
+		uint64_t offset = drh->drh_offset;
+		uint64_t size = drh->drh_size;
+		char *buf = drh->drh_buf;
+
+		/* holds after one that couldn't be issued were never made */
+		if (drh->drh_dbp == NULL)
+			continue;
+
+		if (err == 0)
+			err = dmu_buf_wait_array(drh->drh_dbp,
+			    drh->drh_numbufs);
+
+		for (i = 0; err == 0 && i < drh->drh_numbufs; i++) {
+			dmu_buf_t *db = drh->drh_dbp[i];
+			int bufoff = offset - db->db_offset;
+			int tocpy = (int)MIN(db->db_size - bufoff, size);
+
+			bcopy((char *)db->db_data + bufoff, buf, tocpy);
+
+			offset += tocpy;
+			size -= tocpy;
+			buf += tocpy;
+		}
+
+		dmu_buf_rele_array(drh->drh_dbp, drh->drh_numbufs, dra);
+	}
+
+	dra->dra_done(dra->dra_arg, err);
+
+	kmem_free(dra->dra_holds,
+	    MAX(dra->dra_nholds, 1) * sizeof (dmu_read_async_hold_t));
+	kmem_free(dra, sizeof (dmu_read_async_t));
+}
+
+/*
+ * The copying, and any waiting for dbufs read by other threads, is left to
+ * dp_read_taskq rather than done in the zio's completion context.
+ */
+static void
+dmu_read_async_done(zio_t *zio)
+{
+	dmu_read_async_t *dra = zio->io_private;
+
+	if (dra->dra_error == 0)
+		dra->dra_error = zio->io_error;
+
+	VERIFY(taskq_dispatch(dmu_objset_pool(dra->dra_os)->dp_read_taskq,
+	    dmu_read_async_task, dra, TQ_PUSHPAGE) != 0);
+}
+
+void
+dmu_read_async(objset_t *os, dmu_read_range_t *ranges, int nranges,
+    uint32_t flags, dmu_read_done_func_t *done, void *arg)
+{
+	dmu_read_async_t *dra;
+	dmu_read_async_hold_t *drh;
+	dnode_t *dn;
+	zio_t *zio;
+	uint64_t offset, size;
+	char *buf;
+	int i, h, err = 0;
+
+	dra = kmem_zalloc(sizeof (dmu_read_async_t), KM_PUSHPAGE);
+	dra->dra_os = os;
+	dra->dra_done = done;
+	dra->dra_arg = arg;
+	for (i = 0; i < nranges; i++) {
+		dra->dra_nholds += howmany(ranges[i].dmr_size,
+		    DMU_MAX_ACCESS / 2);
+	}
+	dra->dra_holds = kmem_zalloc(MAX(dra->dra_nholds, 1) *
+	    sizeof (dmu_read_async_hold_t), KM_PUSHPAGE);
+
+	zio = zio_root(os->os_spa, dmu_read_async_done, dra,
+	    ZIO_FLAG_CANFAIL);
+
+	for (i = 0, h = 0; i < nranges && err == 0; i++) {
+		offset = ranges[i].dmr_offset;
+		size = ranges[i].dmr_size;
+		buf = ranges[i].dmr_buf;
+
+		err = dnode_hold(os, ranges[i].dmr_object, FTAG, &dn);
+		if (err)
+			break;
+
+		/*
+		 * Deal with odd block sizes, where there can't be data past
+		 * the first block, as dmu_read() does.
+		 */
+		if (dn->dn_maxblkid == 0) {
+			uint64_t newsz = offset > dn->dn_datablksz ? 0 :
+			    MIN(size, dn->dn_datablksz - offset);
+			bzero(buf + newsz, size - newsz);
+			size = newsz;
+		}
+
+		while (size > 0) {
+			drh = &dra->dra_holds[h++];
+			drh->drh_offset = offset;
+			drh->drh_size = MIN(size, DMU_MAX_ACCESS / 2);
+			drh->drh_buf = buf;
+
+			err = dmu_buf_hold_array_issue(dn, drh->drh_offset,
+			    drh->drh_size, TRUE, dra, &drh->drh_numbufs,
+			    &drh->drh_dbp, flags, zio);
+			if (err)
+				break;
+
+			offset += drh->drh_size;
+			size -= drh->drh_size;
+			buf += drh->drh_size;
+		}
+
+		dnode_rele(dn, FTAG);
+	}
+
+	/*
+	 * Whatever was issued is still waited for and released before the
+	 * error is reported.
+	 */
+	dra->dra_error = err;
+	zio_nowait(zio);
+}
+
 void
 dmu_write(objset_t *os, uint64_t object, uint64_t offset, uint64_t size,
     const void *buf, dmu_tx_t *tx)
@@ -1649,7 +1858,7 @@ dmu_sync_ready(zio_t *zio, arc_buf_t *buf, void *varg)
 			 * block size still needs to be known for replay.
 			 */
 			BP_SET_LSIZE(bp, db->db_size);
-		} else {
+		} else if (!BP_IS_EMBEDDED(bp)) {
 			ASSERT(BP_GET_LEVEL(bp) == 0);
 			bp->blk_fill = 1;
 		}
@@ -1906,6 +2115,11 @@ dmu_object_set_blocksize(objset_t *os, uint64_t object, uint64_t size, int ibs,
 	dnode_t *dn;
 	int err;
 
+	/* Blocks larger than 128K need the large_blocks feature */
+	if (size > SPA_OLD_MAXBLOCKSIZE &&
+	    size > spa_maxblocksize(dmu_objset_spa(os)))
+		return (SET_ERROR(ENOTSUP));
+
 	err = dnode_hold(os, object, FTAG, &dn);
 	if (err)
 		return (err);
@@ -2050,7 +2264,7 @@ dmu_offset_next(objset_t *os, uint64_t object, boolean_t hole, uint64_t *off)
 	 * we go trundling through the block pointers.
 	 */
 	for (i = 0; i < TXG_SIZE; i++) {
-		if (list_link_active(&dn->dn_dirty_link[i]))
+		if (multilist_link_active(&dn->dn_dirty_link[i]))
 			break;
 	}
 	if (i != TXG_SIZE) {
@@ -2086,7 +2300,7 @@ __dmu_object_info_from_dnode(dnode_t *dn, dmu_object_info_t *doi)
 	doi->doi_max_offset = (dn->dn_maxblkid + 1) * dn->dn_datablksz;
 	doi->doi_fill_count = 0;
 	for (i = 0; i < dnp->dn_nblkptr; i++)
-		doi->doi_fill_count += dnp->dn_blkptr[i].blk_fill;
+		doi->doi_fill_count += BP_GET_FILL(&dnp->dn_blkptr[i]);
 }
 
 void
@@ -2285,6 +2499,7 @@ EXPORT_SYMBOL(dmu_free_range);
 EXPORT_SYMBOL(dmu_free_long_range);
 EXPORT_SYMBOL(dmu_free_long_object);
 EXPORT_SYMBOL(dmu_read);
+EXPORT_SYMBOL(dmu_read_async);
 EXPORT_SYMBOL(dmu_write);
 EXPORT_SYMBOL(dmu_prealloc);
 EXPORT_SYMBOL(dmu_object_info);
@@ -2308,4 +2523,7 @@ MODULE_PARM_DESC(zfs_mdcomp_disable, "Disable meta data compression");
 module_param(zfs_nopwrite_enabled, int, 0644);
 MODULE_PARM_DESC(zfs_nopwrite_enabled, "Enable NOP writes");
 
+module_param(zfs_max_recordsize, int, 0644);
+MODULE_PARM_DESC(zfs_max_recordsize, "Max allowed record size");
+
 #endif
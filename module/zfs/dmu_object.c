@@ -28,6 +28,13 @@
 #include <sys/dmu_tx.h>
 #include <sys/dnode.h>
 
+/*
+ * Each CPU allocates object numbers from a chunk of its own, of
+ * 2^dmu_object_alloc_chunk_shift objects, so that concurrent creates in
+ * a dataset only take os_obj_lock once per chunk.
+ */
+int dmu_object_alloc_chunk_shift = 7;
+
 uint64_t
 dmu_object_alloc(objset_t *os, dmu_object_type_t ot, int blocksize,
     dmu_object_type_t bonustype, int bonuslen, dmu_tx_t *tx)
@@ -35,29 +42,69 @@ dmu_object_alloc(objset_t *os, dmu_object_type_t ot, int blocksize,
 	uint64_t object;
 	uint64_t L2_dnode_count = DNODES_PER_BLOCK <<
 	    (DMU_META_DNODE(os)->dn_indblkshift - SPA_BLKPTRSHIFT);
-	dnode_t *dn = NULL;
+	uint64_t *cpuobj = &os->os_obj_next_percpu[CPU_SEQID %
+	    os->os_obj_next_percpu_len];
+	uint64_t dnodes_per_chunk = 1ULL << dmu_object_alloc_chunk_shift;
+	dnode_t *dn;
 	int restarted = B_FALSE;
 
-	mutex_enter(&os->os_obj_lock);
+	/*
+	 * A chunk is at least a dnode block, so that CPUs do not dirty
+	 * the same block of the meta dnode, and at most an L2 bp worth
+	 * of dnodes, so that the search for a sparse L2 bp below is made
+	 * on a chunk boundary.
+	 */
+	dnodes_per_chunk = MAX(dnodes_per_chunk, DNODES_PER_BLOCK);
+	dnodes_per_chunk = MIN(dnodes_per_chunk, L2_dnode_count);
+
+	object = *cpuobj;
 	for (;;) {
-		object = os->os_obj_next;
 		/*
-		 * Each time we polish off an L2 bp worth of dnodes
-		 * (2^13 objects), move to another L2 bp that's still
-		 * reasonably sparse (at most 1/4 full).  Look from the
-		 * beginning once, but after that keep looking from here.
-		 * If we can't find one, just keep going from here.
+		 * When this CPU's chunk is used up, claim the next one.
 		 */
-		if (P2PHASE(object, L2_dnode_count) == 0) {
-			uint64_t offset = restarted ? object << DNODE_SHIFT : 0;
-			int error = dnode_next_offset(DMU_META_DNODE(os),
-			    DNODE_FIND_HOLE,
-			    &offset, 2, DNODES_PER_BLOCK >> 2, 0);
-			restarted = B_TRUE;
-			if (error == 0)
-				object = offset >> DNODE_SHIFT;
+		if (P2PHASE(object, dnodes_per_chunk) == 0) {
+			mutex_enter(&os->os_obj_lock);
+			object = os->os_obj_next_chunk;
+			ASSERT0(P2PHASE(object, dnodes_per_chunk));
+
+			/*
+			 * Each time we polish off an L2 bp worth of dnodes
+			 * (2^13 objects), move to another L2 bp that's
+			 * still reasonably sparse (at most 1/4 full).  Look
+			 * from the beginning once, but after that keep
+			 * looking from here.  If we can't find one, just
+			 * keep going from here.
+			 */
+			if (P2PHASE(object, L2_dnode_count) == 0) {
+				uint64_t offset = restarted ?
+				    object << DNODE_SHIFT : 0;
+				int error = dnode_next_offset(
+				    DMU_META_DNODE(os), DNODE_FIND_HOLE,
+				    &offset, 2, DNODES_PER_BLOCK >> 2, 0);
+				restarted = B_TRUE;
+				if (error == 0)
+					object = offset >> DNODE_SHIFT;
+			}
+
+			/*
+			 * A hole found above need not be on a chunk
+			 * boundary; the chunk then runs to the next one.
+			 */
+			os->os_obj_next_chunk =
+			    P2ALIGN(object, dnodes_per_chunk) +
+			    dnodes_per_chunk;
+			(void) atomic_swap_64(cpuobj, object);
+			mutex_exit(&os->os_obj_lock);
 		}
-		os->os_obj_next = ++object;
+
+		/*
+		 * Claim the next object number of this CPU's chunk.  Other
+		 * threads on this CPU may be claiming them too, so the
+		 * number is taken atomically.  A number claimed twice, from
+		 * a chunk refilled meanwhile, is caught by
+		 * DNODE_MUST_BE_FREE, which only one thread can satisfy.
+		 */
+		object = atomic_inc_64_nv(cpuobj) - 1;
 
 		/*
 		 * XXX We should check for an i/o error here and return
@@ -65,20 +112,25 @@ dmu_object_alloc(objset_t *os, dmu_object_type_t ot, int blocksize,
 		 * dmu_tx_assign(), but there is currently no mechanism
 		 * to do so.
 		 */
+		dn = NULL;
 		(void) dnode_hold_impl(os, object, DNODE_MUST_BE_FREE,
 		    FTAG, &dn);
-		if (dn)
+		if (dn != NULL) {
+			dnode_allocate(dn, ot, blocksize, 0, bonustype,
+			    bonuslen, tx);
+			dnode_rele(dn, FTAG);
 			break;
+		}
 
-		if (dmu_object_next(os, &object, B_TRUE, 0) == 0)
-			os->os_obj_next = object - 1;
+		/*
+		 * The object is in use, so skip to the next hole, or to
+		 * the next dnode block if there is none.
+		 */
+		if (dmu_object_next(os, &object, B_TRUE, 0) != 0)
+			object = P2ROUNDUP(object + 1, DNODES_PER_BLOCK);
+		(void) atomic_swap_64(cpuobj, object);
 	}
 
-	dnode_allocate(dn, ot, blocksize, 0, bonustype, bonuslen, tx);
-	dnode_rele(dn, FTAG);
-
-	mutex_exit(&os->os_obj_lock);
-
 	dmu_tx_add_new_object(tx, os, object);
 	return (object);
 }
@@ -202,4 +254,8 @@ EXPORT_SYMBOL(dmu_object_claim);
 EXPORT_SYMBOL(dmu_object_reclaim);
 EXPORT_SYMBOL(dmu_object_free);
 EXPORT_SYMBOL(dmu_object_next);
+
+module_param(dmu_object_alloc_chunk_shift, int, 0644);
+MODULE_PARM_DESC(dmu_object_alloc_chunk_shift,
+	"CPU-specific allocator grabs 2^N objects at once");
 #endif
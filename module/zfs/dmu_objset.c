@@ -53,6 +53,19 @@
  */
 krwlock_t os_lock;
 
+/*
+ * The dirty dnodes of an objset are split into sublists by dnode block,
+ * so that dnodes sharing a block are synced by the same thread.
+ */
+static unsigned int
+dmu_objset_dnode_index_func(multilist_t *ml, void *obj)
+{
+	dnode_t *dn = obj;
+
+	return ((dn->dn_object >> DNODES_PER_BLOCK_SHIFT) %
+	    multilist_get_num_sublists(ml));
+}
+
 void
 dmu_objset_init(void)
 {
@@ -228,6 +241,14 @@ sync_changed_cb(void *arg, uint64_t newval)
 		zil_set_sync(os->os_zil, newval);
 }
 
+static void
+recordsize_changed_cb(void *arg, uint64_t newval)
+{
+	objset_t *os = arg;
+
+	os->os_recordsize = newval;
+}
+
 static void
 logbias_changed_cb(void *arg, uint64_t newval)
 {
@@ -323,6 +344,7 @@ dmu_objset_open_impl(spa_t *spa, dsl_dataset_t *ds, blkptr_t *bp,
 	 * default (fletcher2/off).  Snapshots don't need to know about
 	 * checksum/compression/copies.
 	 */
+	os->os_recordsize = SPA_OLD_MAXBLOCKSIZE;
 	if (ds) {
 		err = dsl_prop_register(ds,
 		    zfs_prop_to_name(ZFS_PROP_PRIMARYCACHE),
@@ -363,6 +385,11 @@ dmu_objset_open_impl(spa_t *spa, dsl_dataset_t *ds, blkptr_t *bp,
 				    zfs_prop_to_name(ZFS_PROP_SYNC),
 				    sync_changed_cb, os);
 			}
+			if (err == 0) {
+				err = dsl_prop_register(ds,
+				    zfs_prop_to_name(ZFS_PROP_RECORDSIZE),
+				    recordsize_changed_cb, os);
+			}
 		}
 		if (err != 0) {
 			VERIFY(arc_buf_remove_ref(os->os_phys_buf,
@@ -388,10 +415,12 @@ dmu_objset_open_impl(spa_t *spa, dsl_dataset_t *ds, blkptr_t *bp,
 	os->os_zil = zil_alloc(os, &os->os_zil_header);
 
 	for (i = 0; i < TXG_SIZE; i++) {
-		list_create(&os->os_dirty_dnodes[i], sizeof (dnode_t),
-		    offsetof(dnode_t, dn_dirty_link[i]));
-		list_create(&os->os_free_dnodes[i], sizeof (dnode_t),
-		    offsetof(dnode_t, dn_dirty_link[i]));
+		multilist_create(&os->os_dirty_dnodes[i], sizeof (dnode_t),
+		    offsetof(dnode_t, dn_dirty_link[i]), MAX(max_ncpus, 1),
+		    dmu_objset_dnode_index_func);
+		multilist_create(&os->os_free_dnodes[i], sizeof (dnode_t),
+		    offsetof(dnode_t, dn_dirty_link[i]), MAX(max_ncpus, 1),
+		    dmu_objset_dnode_index_func);
 	}
 	list_create(&os->os_dnodes, sizeof (dnode_t),
 	    offsetof(dnode_t, dn_link));
@@ -400,6 +429,9 @@ dmu_objset_open_impl(spa_t *spa, dsl_dataset_t *ds, blkptr_t *bp,
 
 	mutex_init(&os->os_lock, NULL, MUTEX_DEFAULT, NULL);
 	mutex_init(&os->os_obj_lock, NULL, MUTEX_DEFAULT, NULL);
+	os->os_obj_next_percpu_len = MAX(max_ncpus, 1);
+	os->os_obj_next_percpu = kmem_zalloc(os->os_obj_next_percpu_len *
+	    sizeof (os->os_obj_next_percpu[0]), KM_SLEEP);
 	mutex_init(&os->os_user_ptr_lock, NULL, MUTEX_DEFAULT, NULL);
 
 	DMU_META_DNODE(os) = dnode_special_open(os,
@@ -623,6 +655,9 @@ dmu_objset_evict(objset_t *os)
 			VERIFY0(dsl_prop_unregister(ds,
 			    zfs_prop_to_name(ZFS_PROP_SYNC),
 			    sync_changed_cb, os));
+			VERIFY0(dsl_prop_unregister(ds,
+			    zfs_prop_to_name(ZFS_PROP_RECORDSIZE),
+			    recordsize_changed_cb, os));
 		}
 		VERIFY0(dsl_prop_unregister(ds,
 		    zfs_prop_to_name(ZFS_PROP_PRIMARYCACHE),
@@ -657,8 +692,14 @@ dmu_objset_evict(objset_t *os)
 	rw_enter(&os_lock, RW_READER);
 	rw_exit(&os_lock);
 
+	for (t = 0; t < TXG_SIZE; t++) {
+		multilist_destroy(&os->os_dirty_dnodes[t]);
+		multilist_destroy(&os->os_free_dnodes[t]);
+	}
 	mutex_destroy(&os->os_lock);
 	mutex_destroy(&os->os_obj_lock);
+	kmem_free(os->os_obj_next_percpu, os->os_obj_next_percpu_len *
+	    sizeof (os->os_obj_next_percpu[0]));
 	mutex_destroy(&os->os_user_ptr_lock);
 	kmem_free(os, sizeof (objset_t));
 }
@@ -924,11 +965,12 @@ dmu_objset_snapshot_one(const char *fsname, const char *snapname)
 }
 
 static void
-dmu_objset_sync_dnodes(list_t *list, list_t *newlist, dmu_tx_t *tx)
+dmu_objset_sync_dnodes(multilist_sublist_t *list, list_t *newlist,
+    dmu_tx_t *tx)
 {
 	dnode_t *dn;
 
-	while ((dn = list_head(list))) {
+	while ((dn = multilist_sublist_head(list))) {
 		ASSERT(dn->dn_object != DMU_META_DNODE_OBJECT);
 		ASSERT(dn->dn_dbuf->db_data_pending);
 		/*
@@ -939,10 +981,12 @@ dmu_objset_sync_dnodes(list_t *list, list_t *newlist, dmu_tx_t *tx)
 		ASSERT(dn->dn_zio);
 
 		ASSERT3U(dn->dn_nlevels, <=, DN_MAX_LEVELS);
-		list_remove(list, dn);
+		multilist_sublist_remove(list, dn);
 
 		if (newlist) {
-			(void) dnode_add_ref(dn, newlist);
+			/* released by dmu_objset_do_userquota_updates() */
+			(void) dnode_add_ref(dn,
+			    &dn->dn_objset->os_synced_dnodes);
 			list_insert_tail(newlist, dn);
 		}
 
@@ -950,6 +994,106 @@ dmu_objset_sync_dnodes(list_t *list, list_t *newlist, dmu_tx_t *tx)
 	}
 }
 
+/*
+ * Tracks the sublists of one dirty or free list still being synced, so
+ * that datasets synced in parallel only wait for their own dnodes.
+ */
+typedef struct sync_dnodes_list {
+	kmutex_t sdl_lock;
+	kcondvar_t sdl_cv;
+	unsigned int sdl_pending;
+} sync_dnodes_list_t;
+
+typedef struct sync_dnodes_arg {
+	objset_t *sda_os;
+	multilist_t *sda_list;
+	unsigned int sda_sublist_idx;
+	boolean_t sda_synced;
+	dmu_tx_t *sda_tx;
+	sync_dnodes_list_t *sda_sdl;
+} sync_dnodes_arg_t;
+
+/*
+ * Sync the dnodes of one sublist.  The dnodes are put on a private list
+ * for the user/group space accounting, which is only spliced onto
+ * os_synced_dnodes at the end, so that the tasks do not contend on it.
+ */
+static void
+dmu_objset_sync_dnodes_task(void *arg)
+{
+	sync_dnodes_arg_t *sda = arg;
+	sync_dnodes_list_t *sdl = sda->sda_sdl;
+	objset_t *os = sda->sda_os;
+	int txgoff = sda->sda_tx->tx_txg & TXG_MASK;
+	multilist_sublist_t *mls;
+	list_t synced;
+
+	if (sda->sda_synced) {
+		list_create(&synced, sizeof (dnode_t),
+		    offsetof(dnode_t, dn_dirty_link[txgoff]));
+	}
+
+	mls = multilist_sublist_lock(sda->sda_list, sda->sda_sublist_idx);
+	dmu_objset_sync_dnodes(mls, sda->sda_synced ? &synced : NULL,
+	    sda->sda_tx);
+	multilist_sublist_unlock(mls);
+
+	if (sda->sda_synced) {
+		mutex_enter(&os->os_lock);
+		list_move_tail(&os->os_synced_dnodes, &synced);
+		mutex_exit(&os->os_lock);
+		list_destroy(&synced);
+	}
+
+	kmem_free(sda, sizeof (sync_dnodes_arg_t));
+
+	mutex_enter(&sdl->sdl_lock);
+	if (--sdl->sdl_pending == 0)
+		cv_broadcast(&sdl->sdl_cv);
+	mutex_exit(&sdl->sdl_lock);
+}
+
+/*
+ * Sync all dnodes of a dirty or free list, one taskq entry per sublist,
+ * and wait for them.  The caller relies on every dnode having been
+ * synced, and thus every dnode block write having all of its children,
+ * when this returns.
+ */
+static void
+dmu_objset_sync_dnode_list(objset_t *os, multilist_t *ml, boolean_t synced,
+    dmu_tx_t *tx)
+{
+	taskq_t *tq = dmu_objset_pool(os)->dp_sync_taskq;
+	sync_dnodes_list_t sdl;
+	unsigned int i;
+
+	mutex_init(&sdl.sdl_lock, NULL, MUTEX_DEFAULT, NULL);
+	cv_init(&sdl.sdl_cv, NULL, CV_DEFAULT, NULL);
+	sdl.sdl_pending = multilist_get_num_sublists(ml);
+
+	for (i = 0; i < multilist_get_num_sublists(ml); i++) {
+		sync_dnodes_arg_t *sda;
+
+		sda = kmem_alloc(sizeof (sync_dnodes_arg_t), KM_PUSHPAGE);
+		sda->sda_os = os;
+		sda->sda_list = ml;
+		sda->sda_sublist_idx = i;
+		sda->sda_synced = synced;
+		sda->sda_tx = tx;
+		sda->sda_sdl = &sdl;
+		(void) taskq_dispatch(tq, dmu_objset_sync_dnodes_task, sda,
+		    TQ_SLEEP);
+	}
+
+	mutex_enter(&sdl.sdl_lock);
+	while (sdl.sdl_pending != 0)
+		cv_wait(&sdl.sdl_cv, &sdl.sdl_lock);
+	mutex_exit(&sdl.sdl_lock);
+
+	cv_destroy(&sdl.sdl_cv);
+	mutex_destroy(&sdl.sdl_lock);
+}
+
 /* ARGSUSED */
 static void
 dmu_objset_write_ready(zio_t *zio, arc_buf_t *abuf, void *arg)
@@ -972,7 +1116,7 @@ dmu_objset_write_ready(zio_t *zio, arc_buf_t *abuf, void *arg)
 	 */
 	bp->blk_fill = 0;
 	for (i = 0; i < dnp->dn_nblkptr; i++)
-		bp->blk_fill += dnp->dn_blkptr[i].blk_fill;
+		bp->blk_fill += BP_GET_FILL(&dnp->dn_blkptr[i]);
 }
 
 /* ARGSUSED */
@@ -1003,7 +1147,7 @@ dmu_objset_sync(objset_t *os, zio_t *pio, dmu_tx_t *tx)
 	zio_prop_t zp;
 	zio_t *zio;
 	list_t *list;
-	list_t *newlist = NULL;
+	boolean_t synced = B_FALSE;
 	dbuf_dirty_record_t *dr;
 
 	dprintf_ds(os->os_dsl_dataset, "txg=%llu\n", tx->tx_txg);
@@ -1056,17 +1200,29 @@ dmu_objset_sync(objset_t *os, zio_t *pio, dmu_tx_t *tx)
 	txgoff = tx->tx_txg & TXG_MASK;
 
 	if (dmu_objset_userused_enabled(os)) {
-		newlist = &os->os_synced_dnodes;
+		synced = B_TRUE;
 		/*
 		 * We must create the list here because it uses the
 		 * dn_dirty_link[] of this txg.
 		 */
-		list_create(newlist, sizeof (dnode_t),
+		list_create(&os->os_synced_dnodes, sizeof (dnode_t),
 		    offsetof(dnode_t, dn_dirty_link[txgoff]));
 	}
 
-	dmu_objset_sync_dnodes(&os->os_free_dnodes[txgoff], newlist, tx);
-	dmu_objset_sync_dnodes(&os->os_dirty_dnodes[txgoff], newlist, tx);
+	/*
+	 * The dnodes are synced in parallel, the freed ones before the
+	 * dirty ones as before.  The meta-dnode was synced above, and its
+	 * dnode block writes are only issued below, once all dnodes in
+	 * them have been synced.
+	 */
+	if (os->os_dsl_dataset != NULL)
+		dsl_pool_sync_dnodes_enter(dmu_objset_pool(os));
+	dmu_objset_sync_dnode_list(os, &os->os_free_dnodes[txgoff], synced,
+	    tx);
+	dmu_objset_sync_dnode_list(os, &os->os_dirty_dnodes[txgoff], synced,
+	    tx);
+	if (os->os_dsl_dataset != NULL)
+		dsl_pool_sync_dnodes_exit(dmu_objset_pool(os));
 
 	list = &DMU_META_DNODE(os)->dn_dirty_records[txgoff];
 	while ((dr = list_head(list))) {
@@ -1086,8 +1242,8 @@ dmu_objset_sync(objset_t *os, zio_t *pio, dmu_tx_t *tx)
 boolean_t
 dmu_objset_is_dirty(objset_t *os, uint64_t txg)
 {
-	return (!list_is_empty(&os->os_dirty_dnodes[txg & TXG_MASK]) ||
-	    !list_is_empty(&os->os_free_dnodes[txg & TXG_MASK]));
+	return (!multilist_is_empty(&os->os_dirty_dnodes[txg & TXG_MASK]) ||
+	    !multilist_is_empty(&os->os_free_dnodes[txg & TXG_MASK]));
 }
 
 static objset_used_cb_t *used_cbs[DMU_OST_NUMTYPES];
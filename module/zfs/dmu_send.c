@@ -50,6 +50,7 @@
 #include <sys/zfs_onexit.h>
 #include <sys/dmu_send.h>
 #include <sys/dsl_destroy.h>
+#include <sys/zfeature.h>
 
 
 /* Set this tunable to TRUE to replace corrupt data with 0x2f5baddb10c */
@@ -236,13 +237,25 @@ dump_data(dmu_sendarg_t *dsp, dmu_object_type_t type,
 	drrw->drr_offset = offset;
 	drrw->drr_length = blksz;
 	drrw->drr_toguid = dsp->dsa_toguid;
-	drrw->drr_checksumtype = BP_GET_CHECKSUM(bp);
-	if (zio_checksum_table[drrw->drr_checksumtype].ci_dedup)
-		drrw->drr_checksumflags |= DRR_CHECKSUM_DEDUP;
-	DDK_SET_LSIZE(&drrw->drr_key, BP_GET_LSIZE(bp));
-	DDK_SET_PSIZE(&drrw->drr_key, BP_GET_PSIZE(bp));
-	DDK_SET_COMPRESS(&drrw->drr_key, BP_GET_COMPRESS(bp));
-	drrw->drr_key.ddk_cksum = bp->blk_cksum;
+	if (bp == NULL || BP_IS_EMBEDDED(bp)) {
+		/*
+		 * There's no pre-computed checksum for a piece of a split
+		 * large block or for data embedded in its block pointer,
+		 * so (like fletcher4-checksummed blocks) userland will have
+		 * to compute a dedup-capable checksum itself.  Embedded data
+		 * is sent decoded, as a normal write; the receiving pool
+		 * embeds it again if it can.
+		 */
+		drrw->drr_checksumtype = ZIO_CHECKSUM_OFF;
+	} else {
+		drrw->drr_checksumtype = BP_GET_CHECKSUM(bp);
+		if (zio_checksum_table[drrw->drr_checksumtype].ci_dedup)
+			drrw->drr_checksumflags |= DRR_CHECKSUM_DEDUP;
+		DDK_SET_LSIZE(&drrw->drr_key, BP_GET_LSIZE(bp));
+		DDK_SET_PSIZE(&drrw->drr_key, BP_GET_PSIZE(bp));
+		DDK_SET_COMPRESS(&drrw->drr_key, BP_GET_COMPRESS(bp));
+		drrw->drr_key.ddk_cksum = bp->blk_cksum;
+	}
 
 	if (dump_bytes(dsp, dsp->dsa_drr, sizeof (dmu_replay_record_t)) != 0)
 		return (SET_ERROR(EINTR));
@@ -352,6 +365,9 @@ dump_dnode(dmu_sendarg_t *dsp, uint64_t object, dnode_phys_t *dnp)
 	drro->drr_bonustype = dnp->dn_bonustype;
 	drro->drr_blksz = dnp->dn_datablkszsec << SPA_MINBLOCKSHIFT;
 	drro->drr_bonuslen = dnp->dn_bonuslen;
+	if ((dsp->dsa_featureflags & DMU_BACKUP_FEATURE_LARGE_BLOCKS) == 0 &&
+	    drro->drr_blksz > SPA_OLD_MAXBLOCKSIZE)
+		drro->drr_blksz = SPA_OLD_MAXBLOCKSIZE;
 	drro->drr_checksumtype = dnp->dn_checksum;
 	drro->drr_compress = dnp->dn_compress;
 	drro->drr_toguid = dsp->dsa_toguid;
@@ -436,6 +452,7 @@ backup_cb(spa_t *spa, zilog_t *zilog, const blkptr_t *bp,
 		uint32_t aflags = ARC_WAIT;
 		arc_buf_t *abuf;
 		int blksz = BP_GET_LSIZE(bp);
+		uint64_t offset;
 
 		if (arc_read(NULL, spa, bp, arc_getbuf_func, &abuf,
 		    ZIO_PRIORITY_ASYNC_READ, ZIO_FLAG_CANFAIL,
@@ -454,8 +471,29 @@ backup_cb(spa_t *spa, zilog_t *zilog, const blkptr_t *bp,
 			}
 		}
 
-		err = dump_data(dsp, type, zb->zb_object, zb->zb_blkid * blksz,
-		    blksz, bp, abuf->b_data);
+		offset = zb->zb_blkid * blksz;
+
+		if (!(dsp->dsa_featureflags &
+		    DMU_BACKUP_FEATURE_LARGE_BLOCKS) &&
+		    blksz > SPA_OLD_MAXBLOCKSIZE) {
+			char *buf = abuf->b_data;
+
+			/*
+			 * The receiver can't take blocks this large, so
+			 * send the block as a series of 128k writes.
+			 */
+			while (blksz > 0 && err == 0) {
+				int n = MIN(blksz, SPA_OLD_MAXBLOCKSIZE);
+				err = dump_data(dsp, type, zb->zb_object,
+				    offset, n, NULL, buf);
+				offset += n;
+				buf += n;
+				blksz -= n;
+			}
+		} else {
+			err = dump_data(dsp, type, zb->zb_object, offset,
+			    blksz, bp, abuf->b_data);
+		}
 		(void) arc_buf_remove_ref(abuf, &abuf);
 	}
 
@@ -468,13 +506,15 @@ backup_cb(spa_t *spa, zilog_t *zilog, const blkptr_t *bp,
  */
 static int
 dmu_send_impl(void *tag, dsl_pool_t *dp, dsl_dataset_t *ds,
-    dsl_dataset_t *fromds, int outfd, struct vnode *vp, offset_t *off)
+    dsl_dataset_t *fromds, boolean_t large_block_ok, int outfd,
+    struct vnode *vp, offset_t *off)
 {
 	objset_t *os;
 	dmu_replay_record_t *drr;
 	dmu_sendarg_t *dsp;
 	int err;
 	uint64_t fromtxg = 0;
+	uint64_t featureflags = 0;
 
 	if (fromds != NULL && !dsl_dataset_is_before(ds, fromds)) {
 		dsl_dataset_rele(fromds, tag);
@@ -510,13 +550,18 @@ dmu_send_impl(void *tag, dsl_pool_t *dp, dsl_dataset_t *ds,
 			return (SET_ERROR(EINVAL));
 		}
 		if (version >= ZPL_VERSION_SA) {
-			DMU_SET_FEATUREFLAGS(
-			    drr->drr_u.drr_begin.drr_versioninfo,
-			    DMU_BACKUP_FEATURE_SA_SPILL);
+			featureflags |= DMU_BACKUP_FEATURE_SA_SPILL;
 		}
 	}
 #endif
 
+	if (large_block_ok && spa_feature_is_active(dp->dp_spa,
+	    &spa_feature_table[SPA_FEATURE_LARGE_BLOCKS]))
+		featureflags |= DMU_BACKUP_FEATURE_LARGE_BLOCKS;
+
+	DMU_SET_FEATUREFLAGS(drr->drr_u.drr_begin.drr_versioninfo,
+	    featureflags);
+
 	drr->drr_u.drr_begin.drr_creation_time =
 	    ds->ds_phys->ds_creation_time;
 	drr->drr_u.drr_begin.drr_type = dmu_objset_type(os);
@@ -545,6 +590,7 @@ dmu_send_impl(void *tag, dsl_pool_t *dp, dsl_dataset_t *ds,
 	dsp->dsa_os = os;
 	dsp->dsa_off = off;
 	dsp->dsa_toguid = ds->ds_phys->ds_guid;
+	dsp->dsa_featureflags = featureflags;
 	ZIO_SET_CHECKSUM(&dsp->dsa_zc, 0, 0, 0, 0);
 	dsp->dsa_pending_op = PENDING_NONE;
 	dsp->dsa_incremental = (fromtxg != 0);
@@ -600,7 +646,7 @@ out:
 
 int
 dmu_send_obj(const char *pool, uint64_t tosnap, uint64_t fromsnap,
-    int outfd, struct vnode *vp, offset_t *off)
+    boolean_t large_block_ok, int outfd, struct vnode *vp, offset_t *off)
 {
 	dsl_pool_t *dp;
 	dsl_dataset_t *ds;
@@ -626,12 +672,13 @@ dmu_send_obj(const char *pool, uint64_t tosnap, uint64_t fromsnap,
 		}
 	}
 
-	return (dmu_send_impl(FTAG, dp, ds, fromds, outfd, vp, off));
+	return (dmu_send_impl(FTAG, dp, ds, fromds, large_block_ok,
+	    outfd, vp, off));
 }
 
 int
 dmu_send(const char *tosnap, const char *fromsnap,
-    int outfd, struct vnode *vp, offset_t *off)
+    boolean_t large_block_ok, int outfd, struct vnode *vp, offset_t *off)
 {
 	dsl_pool_t *dp;
 	dsl_dataset_t *ds;
@@ -661,7 +708,8 @@ dmu_send(const char *tosnap, const char *fromsnap,
 			return (err);
 		}
 	}
-	return (dmu_send_impl(FTAG, dp, ds, fromds, outfd, vp, off));
+	return (dmu_send_impl(FTAG, dp, ds, fromds, large_block_ok,
+	    outfd, vp, off));
 }
 
 int
@@ -828,6 +876,14 @@ dmu_recv_begin_check(void *arg, dmu_tx_t *tx)
 		return (SET_ERROR(ENOTSUP));
 	}
 
+	/* Large block streams need the large_blocks feature enabled */
+	if ((DMU_GET_FEATUREFLAGS(drrb->drr_versioninfo) &
+	    DMU_BACKUP_FEATURE_LARGE_BLOCKS) &&
+	    !spa_feature_is_enabled(dp->dp_spa,
+	    &spa_feature_table[SPA_FEATURE_LARGE_BLOCKS])) {
+		return (SET_ERROR(ENOTSUP));
+	}
+
 	error = dsl_dataset_hold(dp, tofs, FTAG, &ds);
 	if (error == 0) {
 		/* target fs already exists; recv into temp clone */
@@ -937,6 +993,15 @@ dmu_recv_begin_sync(void *arg, dmu_tx_t *tx)
 	dmu_buf_will_dirty(newds->ds_dbuf, tx);
 	newds->ds_phys->ds_flags |= DS_FLAG_INCONSISTENT;
 
+	/* The received blocks may be larger than 128k */
+	if ((DMU_GET_FEATUREFLAGS(drrb->drr_versioninfo) &
+	    DMU_BACKUP_FEATURE_LARGE_BLOCKS) &&
+	    !spa_feature_is_active(dp->dp_spa,
+	    &spa_feature_table[SPA_FEATURE_LARGE_BLOCKS])) {
+		spa_feature_incr(dp->dp_spa,
+		    &spa_feature_table[SPA_FEATURE_LARGE_BLOCKS], tx);
+	}
+
 	/*
 	 * If we actually created a non-clone, we need to create the
 	 * objset in our new dataset.
@@ -1057,6 +1122,17 @@ restore_read(struct restorearg *ra, int len)
 	/* some things will require 8-byte alignment, so everything must */
 	ASSERT0(len % 8);
 
+	/*
+	 * Large block streams can carry records bigger than the initial
+	 * buffer.  Callers copy the record header before reading its
+	 * payload, so the old buffer can simply be replaced.
+	 */
+	if (len > ra->bufsize) {
+		vmem_free(ra->buf, ra->bufsize);
+		ra->bufsize = len;
+		ra->buf = vmem_alloc(ra->bufsize, KM_SLEEP);
+	}
+
 	while (done < len) {
 		ssize_t resid;
 
@@ -1182,7 +1258,7 @@ restore_object(struct restorearg *ra, objset_t *os, struct drr_object *drro)
 	    drro->drr_compress >= ZIO_COMPRESS_FUNCTIONS ||
 	    P2PHASE(drro->drr_blksz, SPA_MINBLOCKSIZE) ||
 	    drro->drr_blksz < SPA_MINBLOCKSIZE ||
-	    drro->drr_blksz > SPA_MAXBLOCKSIZE ||
+	    drro->drr_blksz > spa_maxblocksize(dmu_objset_spa(os)) ||
 	    drro->drr_bonuslen > DN_MAX_BONUSLEN) {
 		return (SET_ERROR(EINVAL));
 	}
@@ -1287,6 +1363,7 @@ restore_write(struct restorearg *ra, objset_t *os,
 	int err;
 
 	if (drrw->drr_offset + drrw->drr_length < drrw->drr_offset ||
+	    drrw->drr_length > SPA_MAXBLOCKSIZE ||
 	    !DMU_OT_IS_VALID(drrw->drr_type))
 		return (SET_ERROR(EINVAL));
 
@@ -1385,7 +1462,7 @@ restore_spill(struct restorearg *ra, objset_t *os, struct drr_spill *drrs)
 	int err;
 
 	if (drrs->drr_length < SPA_MINBLOCKSIZE ||
-	    drrs->drr_length > SPA_MAXBLOCKSIZE)
+	    drrs->drr_length > SPA_OLD_MAXBLOCKSIZE)
 		return (SET_ERROR(EINVAL));
 
 	data = restore_read(ra, drrs->drr_length);
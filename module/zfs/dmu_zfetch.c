@@ -36,58 +36,56 @@
 #include <sys/kstat.h>
 
 /*
- * I'm against tune-ables, but these should probably exist as tweakable globals
- * until we can get this working the way we want it to.
+ * This is the DMU's predictive prefetcher.  Each dnode keeps up to
+ * zfetch_max_streams streams, each of which expects the next access at
+ * zs_blkid.  An access that continues a stream is a hit: the stream's
+ * prefetch distance doubles, up to zfetch_max_distance bytes, and the
+ * data blocks up to that distance ahead of the access are prefetched.
+ * An access that jumps ahead within the blocks a stream has already
+ * prefetched is a miss for that stream, and halves its distance.  An
+ * access that matches no stream starts a new one, which begins prefetching
+ * once it is hit.
+ *
+ * The level 1 indirect blocks are prefetched 1 << ZFETCH_IDISTANCE_SHIFT
+ * times as far ahead as the data (covering up to zfetch_max_idistance
+ * bytes of data), so that prefetching data blocks rarely has to wait to
+ * read the indirect block that points to them.
+ *
+ * Lookups take zf_rwlock as reader and the matching stream's zs_lock;
+ * zf_rwlock is only taken as writer to add and reclaim streams.  The
+ * prefetches themselves are issued with neither lock held.
  */
 
-int zfs_prefetch_disable = 0;
+int zfs_prefetch_disable = B_FALSE;
 
 /* max # of streams per zfetch */
 unsigned int	zfetch_max_streams = 8;
 /* min time before stream reclaim */
 unsigned int	zfetch_min_sec_reap = 2;
-/* max number of blocks to fetch at a time */
-unsigned int	zfetch_block_cap = 256;
-/* number of bytes in a array_read at which we stop prefetching (1Mb) */
+/* max bytes of data to prefetch ahead of a stream (8MB) */
+unsigned int	zfetch_max_distance = 8 * 1024 * 1024;
+/* max bytes of data whose indirect blocks are prefetched (64MB) */
+unsigned int	zfetch_max_idistance = 64 * 1024 * 1024;
+/* number of bytes in a array_read at which we stop prefetching (1MB) */
 unsigned long	zfetch_array_rd_sz = 1024 * 1024;
 
-/* forward decls for static routines */
-static boolean_t	dmu_zfetch_colinear(zfetch_t *, zstream_t *);
-static void		dmu_zfetch_dofetch(zfetch_t *, zstream_t *);
-static uint64_t		dmu_zfetch_fetch(dnode_t *, uint64_t, uint64_t);
-static uint64_t		dmu_zfetch_fetchsz(dnode_t *, uint64_t, uint64_t);
-static boolean_t	dmu_zfetch_find(zfetch_t *, zstream_t *, int);
-static int		dmu_zfetch_stream_insert(zfetch_t *, zstream_t *);
-static zstream_t	*dmu_zfetch_stream_reclaim(zfetch_t *);
-static void		dmu_zfetch_stream_remove(zfetch_t *, zstream_t *);
-static int		dmu_zfetch_streams_equal(zstream_t *, zstream_t *);
+/* indirect blocks are prefetched 8 times as far ahead as data */
+#define	ZFETCH_IDISTANCE_SHIFT	3
 
 typedef struct zfetch_stats {
 	kstat_named_t zfetchstat_hits;
 	kstat_named_t zfetchstat_misses;
-	kstat_named_t zfetchstat_colinear_hits;
-	kstat_named_t zfetchstat_colinear_misses;
-	kstat_named_t zfetchstat_stride_hits;
-	kstat_named_t zfetchstat_stride_misses;
-	kstat_named_t zfetchstat_reclaim_successes;
-	kstat_named_t zfetchstat_reclaim_failures;
-	kstat_named_t zfetchstat_stream_resets;
-	kstat_named_t zfetchstat_stream_noresets;
-	kstat_named_t zfetchstat_bogus_streams;
+	kstat_named_t zfetchstat_useless;
+	kstat_named_t zfetchstat_max_streams;
+	kstat_named_t zfetchstat_distance;
 } zfetch_stats_t;
 
 static zfetch_stats_t zfetch_stats = {
 	{ "hits",			KSTAT_DATA_UINT64 },
 	{ "misses",			KSTAT_DATA_UINT64 },
-	{ "colinear_hits",		KSTAT_DATA_UINT64 },
-	{ "colinear_misses",		KSTAT_DATA_UINT64 },
-	{ "stride_hits",		KSTAT_DATA_UINT64 },
-	{ "stride_misses",		KSTAT_DATA_UINT64 },
-	{ "reclaim_successes",		KSTAT_DATA_UINT64 },
-	{ "reclaim_failures",		KSTAT_DATA_UINT64 },
-	{ "streams_resets",		KSTAT_DATA_UINT64 },
-	{ "streams_noresets",		KSTAT_DATA_UINT64 },
-	{ "bogus_streams",		KSTAT_DATA_UINT64 },
+	{ "useless",			KSTAT_DATA_UINT64 },
+	{ "max_streams",		KSTAT_DATA_UINT64 },
+	{ "distance",			KSTAT_DATA_UINT64 },
 };
 
 #define	ZFETCHSTAT_INCR(stat, val) \
@@ -95,145 +93,20 @@ static zfetch_stats_t zfetch_stats = {
 
 #define	ZFETCHSTAT_BUMP(stat)		ZFETCHSTAT_INCR(stat, 1);
 
-kstat_t		*zfetch_ksp;
-
-/*
- * Given a zfetch structure and a zstream structure, determine whether the
- * blocks to be read are part of a co-linear pair of existing prefetch
- * streams.  If a set is found, coalesce the streams, removing one, and
- * configure the prefetch so it looks for a strided access pattern.
- *
- * In other words: if we find two sequential access streams that are
- * the same length and distance N appart, and this read is N from the
- * last stream, then we are probably in a strided access pattern.  So
- * combine the two sequential streams into a single strided stream.
- *
- * Returns whether co-linear streams were found.
- */
-static boolean_t
-dmu_zfetch_colinear(zfetch_t *zf, zstream_t *zh)
-{
-	zstream_t	*z_walk;
-	zstream_t	*z_comp;
-
-	if (! rw_tryenter(&zf->zf_rwlock, RW_WRITER))
-		return (0);
+#define	ZFETCHSTAT_SET(stat, val) \
+	zfetch_stats.stat.value.ui64 = (val);
 
-	if (zh == NULL) {
-		rw_exit(&zf->zf_rwlock);
-		return (0);
-	}
-
-	for (z_walk = list_head(&zf->zf_stream); z_walk;
-	    z_walk = list_next(&zf->zf_stream, z_walk)) {
-		for (z_comp = list_next(&zf->zf_stream, z_walk); z_comp;
-		    z_comp = list_next(&zf->zf_stream, z_comp)) {
-			int64_t		diff;
-
-			if (z_walk->zst_len != z_walk->zst_stride ||
-			    z_comp->zst_len != z_comp->zst_stride) {
-				continue;
-			}
-
-			diff = z_comp->zst_offset - z_walk->zst_offset;
-			if (z_comp->zst_offset + diff == zh->zst_offset) {
-				z_walk->zst_offset = zh->zst_offset;
-				z_walk->zst_direction = diff < 0 ?
-				    ZFETCH_BACKWARD : ZFETCH_FORWARD;
-				z_walk->zst_stride =
-				    diff * z_walk->zst_direction;
-				z_walk->zst_ph_offset =
-				    zh->zst_offset + z_walk->zst_stride;
-				dmu_zfetch_stream_remove(zf, z_comp);
-				mutex_destroy(&z_comp->zst_lock);
-				kmem_free(z_comp, sizeof (zstream_t));
-
-				dmu_zfetch_dofetch(zf, z_walk);
-
-				rw_exit(&zf->zf_rwlock);
-				return (1);
-			}
-
-			diff = z_walk->zst_offset - z_comp->zst_offset;
-			if (z_walk->zst_offset + diff == zh->zst_offset) {
-				z_walk->zst_offset = zh->zst_offset;
-				z_walk->zst_direction = diff < 0 ?
-				    ZFETCH_BACKWARD : ZFETCH_FORWARD;
-				z_walk->zst_stride =
-				    diff * z_walk->zst_direction;
-				z_walk->zst_ph_offset =
-				    zh->zst_offset + z_walk->zst_stride;
-				dmu_zfetch_stream_remove(zf, z_comp);
-				mutex_destroy(&z_comp->zst_lock);
-				kmem_free(z_comp, sizeof (zstream_t));
-
-				dmu_zfetch_dofetch(zf, z_walk);
-
-				rw_exit(&zf->zf_rwlock);
-				return (1);
-			}
-		}
-	}
-
-	rw_exit(&zf->zf_rwlock);
-	return (0);
-}
+kstat_t		*zfetch_ksp;
 
 /*
- * Given a zstream_t, determine the bounds of the prefetch.  Then call the
- * routine that actually prefetches the individual blocks.
+ * How an access of the blocks [blkid, end_blkid) relates to a stream.
  */
-static void
-dmu_zfetch_dofetch(zfetch_t *zf, zstream_t *zs)
-{
-	uint64_t	prefetch_tail;
-	uint64_t	prefetch_limit;
-	uint64_t	prefetch_ofst;
-	uint64_t	prefetch_len;
-	uint64_t	blocks_fetched;
-
-	zs->zst_stride = MAX((int64_t)zs->zst_stride, zs->zst_len);
-	zs->zst_cap = MIN(zfetch_block_cap, 2 * zs->zst_cap);
-
-	prefetch_tail = MAX((int64_t)zs->zst_ph_offset,
-	    (int64_t)(zs->zst_offset + zs->zst_stride));
-	/*
-	 * XXX: use a faster division method?
-	 */
-	prefetch_limit = zs->zst_offset + zs->zst_len +
-	    (zs->zst_cap * zs->zst_stride) / zs->zst_len;
-
-	while (prefetch_tail < prefetch_limit) {
-		prefetch_ofst = zs->zst_offset + zs->zst_direction *
-		    (prefetch_tail - zs->zst_offset);
-
-		prefetch_len = zs->zst_len;
-
-		/*
-		 * Don't prefetch beyond the end of the file, if working
-		 * backwards.
-		 */
-		if ((zs->zst_direction == ZFETCH_BACKWARD) &&
-		    (prefetch_ofst > prefetch_tail)) {
-			prefetch_len += prefetch_ofst;
-			prefetch_ofst = 0;
-		}
-
-		/* don't prefetch more than we're supposed to */
-		if (prefetch_len > zs->zst_len)
-			break;
-
-		blocks_fetched = dmu_zfetch_fetch(zf->zf_dnode,
-		    prefetch_ofst, zs->zst_len);
-
-		prefetch_tail += zs->zst_stride;
-		/* stop if we've run out of stuff to prefetch */
-		if (blocks_fetched < zs->zst_len)
-			break;
-	}
-	zs->zst_ph_offset = prefetch_tail;
-	zs->zst_last = ddi_get_lbolt();
-}
+typedef enum zfetch_match {
+	ZFETCH_NONE,		/* unrelated to the stream */
+	ZFETCH_HIT,		/* includes the block the stream expects */
+	ZFETCH_REPEAT,		/* ends where the stream's last access ended */
+	ZFETCH_SKIP		/* jumps ahead into the prefetched blocks */
+} zfetch_match_t;
 
 void
 zfetch_init(void)
@@ -272,266 +145,50 @@ dmu_zfetch_init(zfetch_t *zf, dnode_t *dno)
 
 	zf->zf_dnode = dno;
 	zf->zf_stream_cnt = 0;
-	zf->zf_alloc_fail = 0;
 
 	list_create(&zf->zf_stream, sizeof (zstream_t),
-	    offsetof(zstream_t, zst_node));
+	    offsetof(zstream_t, zs_node));
 
 	rw_init(&zf->zf_rwlock, NULL, RW_DEFAULT, NULL);
 }
 
 /*
- * This function computes the actual size, in blocks, that can be prefetched,
- * and fetches it.
- */
-static uint64_t
-dmu_zfetch_fetch(dnode_t *dn, uint64_t blkid, uint64_t nblks)
-{
-	uint64_t	fetchsz;
-	uint64_t	i;
-
-	fetchsz = dmu_zfetch_fetchsz(dn, blkid, nblks);
-
-	for (i = 0; i < fetchsz; i++) {
-		dbuf_prefetch(dn, blkid + i, ZIO_PRIORITY_ASYNC_READ);
-	}
-
-	return (fetchsz);
-}
-
-/*
- * this function returns the number of blocks that would be prefetched, based
- * upon the supplied dnode, blockid, and nblks.  This is used so that we can
- * update streams in place, and then prefetch with their old value after the
- * fact.  This way, we can delay the prefetch, but subsequent accesses to the
- * stream won't result in the same data being prefetched multiple times.
- */
-static uint64_t
-dmu_zfetch_fetchsz(dnode_t *dn, uint64_t blkid, uint64_t nblks)
-{
-	uint64_t	fetchsz;
-
-	if (blkid > dn->dn_maxblkid) {
-		return (0);
-	}
-
-	/* compute fetch size */
-	if (blkid + nblks + 1 > dn->dn_maxblkid) {
-		fetchsz = (dn->dn_maxblkid - blkid) + 1;
-		ASSERT(blkid + fetchsz - 1 <= dn->dn_maxblkid);
-	} else {
-		fetchsz = nblks;
-	}
-
-
-	return (fetchsz);
-}
-
-/*
- * given a zfetch and a zstream structure, see if there is an associated zstream
- * for this block read.  If so, it starts a prefetch for the stream it
- * located and returns true, otherwise it returns false
+ * Remove a stream from its zfetch and free it.  Any blocks it prefetched
+ * that were never read are counted as useless.
  */
-static boolean_t
-dmu_zfetch_find(zfetch_t *zf, zstream_t *zh, int prefetched)
+static void
+dmu_zfetch_stream_remove(zfetch_t *zf, zstream_t *zs)
 {
-	zstream_t	*zs;
-	int64_t		diff;
-	int		reset = !prefetched;
-	int		rc = 0;
-
-	if (zh == NULL)
-		return (0);
-
-	/*
-	 * XXX: This locking strategy is a bit coarse; however, it's impact has
-	 * yet to be tested.  If this turns out to be an issue, it can be
-	 * modified in a number of different ways.
-	 */
-
-	rw_enter(&zf->zf_rwlock, RW_READER);
-top:
-
-	for (zs = list_head(&zf->zf_stream); zs;
-	    zs = list_next(&zf->zf_stream, zs)) {
-
-		/*
-		 * XXX - should this be an assert?
-		 */
-		if (zs->zst_len == 0) {
-			/* bogus stream */
-			ZFETCHSTAT_BUMP(zfetchstat_bogus_streams);
-			continue;
-		}
-
-		/*
-		 * We hit this case when we are in a strided prefetch stream:
-		 * we will read "len" blocks before "striding".
-		 */
-		if (zh->zst_offset >= zs->zst_offset &&
-		    zh->zst_offset < zs->zst_offset + zs->zst_len) {
-			if (prefetched) {
-				/* already fetched */
-				ZFETCHSTAT_BUMP(zfetchstat_stride_hits);
-				rc = 1;
-				goto out;
-			} else {
-				ZFETCHSTAT_BUMP(zfetchstat_stride_misses);
-			}
-		}
-
-		/*
-		 * This is the forward sequential read case: we increment
-		 * len by one each time we hit here, so we will enter this
-		 * case on every read.
-		 */
-		if (zh->zst_offset == zs->zst_offset + zs->zst_len) {
-
-			reset = !prefetched && zs->zst_len > 1;
-
-			mutex_enter(&zs->zst_lock);
-
-			if (zh->zst_offset != zs->zst_offset + zs->zst_len) {
-				mutex_exit(&zs->zst_lock);
-				goto top;
-			}
-			zs->zst_len += zh->zst_len;
-			diff = zs->zst_len - zfetch_block_cap;
-			if (diff > 0) {
-				zs->zst_offset += diff;
-				zs->zst_len = zs->zst_len > diff ?
-				    zs->zst_len - diff : 0;
-			}
-			zs->zst_direction = ZFETCH_FORWARD;
-
-			break;
-
-		/*
-		 * Same as above, but reading backwards through the file.
-		 */
-		} else if (zh->zst_offset == zs->zst_offset - zh->zst_len) {
-			/* backwards sequential access */
-
-			reset = !prefetched && zs->zst_len > 1;
-
-			mutex_enter(&zs->zst_lock);
-
-			if (zh->zst_offset != zs->zst_offset - zh->zst_len) {
-				mutex_exit(&zs->zst_lock);
-				goto top;
-			}
-
-			zs->zst_offset = zs->zst_offset > zh->zst_len ?
-			    zs->zst_offset - zh->zst_len : 0;
-			zs->zst_ph_offset = zs->zst_ph_offset > zh->zst_len ?
-			    zs->zst_ph_offset - zh->zst_len : 0;
-			zs->zst_len += zh->zst_len;
-
-			diff = zs->zst_len - zfetch_block_cap;
-			if (diff > 0) {
-				zs->zst_ph_offset = zs->zst_ph_offset > diff ?
-				    zs->zst_ph_offset - diff : 0;
-				zs->zst_len = zs->zst_len > diff ?
-				    zs->zst_len - diff : zs->zst_len;
-			}
-			zs->zst_direction = ZFETCH_BACKWARD;
-
-			break;
-
-		} else if ((zh->zst_offset - zs->zst_offset - zs->zst_stride <
-		    zs->zst_len) && (zs->zst_len != zs->zst_stride)) {
-			/* strided forward access */
-
-			mutex_enter(&zs->zst_lock);
-
-			if ((zh->zst_offset - zs->zst_offset - zs->zst_stride >=
-			    zs->zst_len) || (zs->zst_len == zs->zst_stride)) {
-				mutex_exit(&zs->zst_lock);
-				goto top;
-			}
-
-			zs->zst_offset += zs->zst_stride;
-			zs->zst_direction = ZFETCH_FORWARD;
-
-			break;
-
-		} else if ((zh->zst_offset - zs->zst_offset + zs->zst_stride <
-		    zs->zst_len) && (zs->zst_len != zs->zst_stride)) {
-			/* strided reverse access */
-
-			mutex_enter(&zs->zst_lock);
-
-			if ((zh->zst_offset - zs->zst_offset + zs->zst_stride >=
-			    zs->zst_len) || (zs->zst_len == zs->zst_stride)) {
-				mutex_exit(&zs->zst_lock);
-				goto top;
-			}
-
-			zs->zst_offset = zs->zst_offset > zs->zst_stride ?
-			    zs->zst_offset - zs->zst_stride : 0;
-			zs->zst_ph_offset = (zs->zst_ph_offset >
-			    (2 * zs->zst_stride)) ?
-			    (zs->zst_ph_offset - (2 * zs->zst_stride)) : 0;
-			zs->zst_direction = ZFETCH_BACKWARD;
+	ASSERT(RW_WRITE_HELD(&zf->zf_rwlock));
 
-			break;
-		}
+	if (zs->zs_pf_blkid > zs->zs_blkid) {
+		ZFETCHSTAT_INCR(zfetchstat_useless,
+		    zs->zs_pf_blkid - zs->zs_blkid);
 	}
 
-	if (zs) {
-		if (reset) {
-			zstream_t *remove = zs;
-
-			ZFETCHSTAT_BUMP(zfetchstat_stream_resets);
-			rc = 0;
-			mutex_exit(&zs->zst_lock);
-			rw_exit(&zf->zf_rwlock);
-			rw_enter(&zf->zf_rwlock, RW_WRITER);
-			/*
-			 * Relocate the stream, in case someone removes
-			 * it while we were acquiring the WRITER lock.
-			 */
-			for (zs = list_head(&zf->zf_stream); zs;
-			    zs = list_next(&zf->zf_stream, zs)) {
-				if (zs == remove) {
-					dmu_zfetch_stream_remove(zf, zs);
-					mutex_destroy(&zs->zst_lock);
-					kmem_free(zs, sizeof (zstream_t));
-					break;
-				}
-			}
-		} else {
-			ZFETCHSTAT_BUMP(zfetchstat_stream_noresets);
-			rc = 1;
-			dmu_zfetch_dofetch(zf, zs);
-			mutex_exit(&zs->zst_lock);
-		}
-	}
-out:
-	rw_exit(&zf->zf_rwlock);
-	return (rc);
+	list_remove(&zf->zf_stream, zs);
+	zf->zf_stream_cnt--;
+	mutex_destroy(&zs->zs_lock);
+	kmem_free(zs, sizeof (zstream_t));
 }
 
 /*
  * Clean-up state associated with a zfetch structure.  This frees allocated
- * structure members, empties the zf_stream tree, and generally makes things
+ * structure members, empties the zf_stream list, and generally makes things
  * nice.  This doesn't free the zfetch_t itself, that's left to the caller.
  */
 void
 dmu_zfetch_rele(zfetch_t *zf)
 {
 	zstream_t	*zs;
-	zstream_t	*zs_next;
 
 	ASSERT(!RW_LOCK_HELD(&zf->zf_rwlock));
 
-	for (zs = list_head(&zf->zf_stream); zs; zs = zs_next) {
-		zs_next = list_next(&zf->zf_stream, zs);
+	rw_enter(&zf->zf_rwlock, RW_WRITER);
+	while ((zs = list_head(&zf->zf_stream)) != NULL)
+		dmu_zfetch_stream_remove(zf, zs);
+	rw_exit(&zf->zf_rwlock);
 
-		list_remove(&zf->zf_stream, zs);
-		mutex_destroy(&zs->zst_lock);
-		kmem_free(zs, sizeof (zstream_t));
-	}
 	list_destroy(&zf->zf_stream);
 	rw_destroy(&zf->zf_rwlock);
 
@@ -539,195 +196,178 @@ dmu_zfetch_rele(zfetch_t *zf)
 }
 
 /*
- * Given a zfetch and zstream structure, insert the zstream structure into the
- * AVL tree contained within the zfetch structure.  Peform the appropriate
- * book-keeping.  It is possible that another thread has inserted a stream which
- * matches one that we are about to insert, so we must be sure to check for this
- * case.  If one is found, return failure, and let the caller cleanup the
- * duplicates.
+ * Start a stream that expects its next access at blkid, after an access of
+ * nblks blocks.  Streams that have not been hit for zfetch_min_sec_reap
+ * seconds are reclaimed first; if the dnode still has as many streams as
+ * it is allowed, no stream is created.
  */
-static int
-dmu_zfetch_stream_insert(zfetch_t *zf, zstream_t *zs)
+static void
+dmu_zfetch_stream_create(zfetch_t *zf, uint64_t blkid, uint64_t nblks)
 {
-	zstream_t	*zs_walk;
+	dnode_t		*dn = zf->zf_dnode;
+	zstream_t	*zs;
 	zstream_t	*zs_next;
+	hrtime_t	now = gethrtime();
+	uint64_t	max_streams;
 
 	ASSERT(RW_WRITE_HELD(&zf->zf_rwlock));
 
-	for (zs_walk = list_head(&zf->zf_stream); zs_walk; zs_walk = zs_next) {
-		zs_next = list_next(&zf->zf_stream, zs_walk);
+	for (zs = list_head(&zf->zf_stream); zs != NULL; zs = zs_next) {
+		zs_next = list_next(&zf->zf_stream, zs);
+
+		if ((now - zs->zs_atime) / NANOSEC >= zfetch_min_sec_reap)
+			dmu_zfetch_stream_remove(zf, zs);
+	}
 
-		if (dmu_zfetch_streams_equal(zs_walk, zs)) {
-			return (0);
-		}
+	/*
+	 * A file too small to hold zfetch_max_distance bytes per stream
+	 * gets fewer streams, but always at least one.
+	 */
+	max_streams = MAX(1, MIN(zfetch_max_streams,
+	    (dn->dn_maxblkid << dn->dn_datablkshift) / zfetch_max_distance));
+	if (zf->zf_stream_cnt >= max_streams) {
+		ZFETCHSTAT_BUMP(zfetchstat_max_streams);
+		return;
 	}
 
+	zs = kmem_zalloc(sizeof (zstream_t), KM_PUSHPAGE);
+	zs->zs_blkid = blkid;
+	zs->zs_pf_blkid = blkid;
+	zs->zs_ipf_blkid = blkid;
+	zs->zs_distance = nblks;
+	zs->zs_atime = now;
+	mutex_init(&zs->zs_lock, NULL, MUTEX_DEFAULT, NULL);
+
 	list_insert_head(&zf->zf_stream, zs);
 	zf->zf_stream_cnt++;
-	return (1);
 }
 
-
-/*
- * Walk the list of zstreams in the given zfetch, find an old one (by time), and
- * reclaim it for use by the caller.
- */
-static zstream_t *
-dmu_zfetch_stream_reclaim(zfetch_t *zf)
+static zfetch_match_t
+dmu_zfetch_match(zstream_t *zs, uint64_t blkid, uint64_t end_blkid)
 {
-	zstream_t	*zs;
-
-	if (! rw_tryenter(&zf->zf_rwlock, RW_WRITER))
-		return (0);
-
-	for (zs = list_head(&zf->zf_stream); zs;
-	    zs = list_next(&zf->zf_stream, zs)) {
-
-		if (((ddi_get_lbolt() - zs->zst_last)/hz) > zfetch_min_sec_reap)
-			break;
-	}
-
-	if (zs) {
-		dmu_zfetch_stream_remove(zf, zs);
-		mutex_destroy(&zs->zst_lock);
-		bzero(zs, sizeof (zstream_t));
-	} else {
-		zf->zf_alloc_fail++;
-	}
-	rw_exit(&zf->zf_rwlock);
-
-	return (zs);
+	if (blkid <= zs->zs_blkid && end_blkid > zs->zs_blkid)
+		return (ZFETCH_HIT);
+	if (end_blkid == zs->zs_blkid)
+		return (ZFETCH_REPEAT);
+	if (blkid > zs->zs_blkid && blkid < zs->zs_pf_blkid)
+		return (ZFETCH_SKIP);
+	return (ZFETCH_NONE);
 }
 
 /*
- * Given a zfetch and zstream structure, remove the zstream structure from its
- * container in the zfetch structure.  Perform the appropriate book-keeping.
+ * This is the prefetch entry point, called for each access of nblks blocks
+ * starting at blkid, with the dnode's dn_struct_rwlock held.  It advances
+ * the stream the access belongs to, and prefetches ahead of it.  Data
+ * blocks are only prefetched if fetch_data is set; otherwise, as for
+ * writes, only the indirect blocks are.
  */
-static void
-dmu_zfetch_stream_remove(zfetch_t *zf, zstream_t *zs)
-{
-	ASSERT(RW_WRITE_HELD(&zf->zf_rwlock));
-
-	list_remove(&zf->zf_stream, zs);
-	zf->zf_stream_cnt--;
-}
-
-static int
-dmu_zfetch_streams_equal(zstream_t *zs1, zstream_t *zs2)
+void
+dmu_zfetch(zfetch_t *zf, uint64_t blkid, uint64_t nblks, boolean_t fetch_data)
 {
-	if (zs1->zst_offset != zs2->zst_offset)
-		return (0);
+	dnode_t		*dn = zf->zf_dnode;
+	zstream_t	*zs;
+	zfetch_match_t	match = ZFETCH_NONE;
+	uint64_t	end_blkid, max_blkid, max_blks, max_iblks;
+	uint64_t	pf_start, pf_end, ipf_start, ipf_end, i;
+	int		epbs;
 
-	if (zs1->zst_len != zs2->zst_len)
-		return (0);
+	ASSERT(RW_LOCK_HELD(&dn->dn_struct_rwlock));
 
-	if (zs1->zst_stride != zs2->zst_stride)
-		return (0);
+	if (zfs_prefetch_disable)
+		return;
 
-	if (zs1->zst_ph_offset != zs2->zst_ph_offset)
-		return (0);
+	/* files that aren't ln2 blocksz are only one block -- nothing to do */
+	if (dn->dn_datablkshift == 0 || nblks == 0)
+		return;
 
-	if (zs1->zst_cap != zs2->zst_cap)
-		return (0);
+	end_blkid = blkid + nblks;
 
-	if (zs1->zst_direction != zs2->zst_direction)
-		return (0);
+	rw_enter(&zf->zf_rwlock, RW_READER);
 
-	return (1);
-}
+	for (zs = list_head(&zf->zf_stream); zs != NULL;
+	    zs = list_next(&zf->zf_stream, zs)) {
+		if (dmu_zfetch_match(zs, blkid, end_blkid) == ZFETCH_NONE)
+			continue;
 
-/*
- * This is the prefetch entry point.  It calls all of the other dmu_zfetch
- * routines to create, delete, find, or operate upon prefetch streams.
- */
-void
-dmu_zfetch(zfetch_t *zf, uint64_t offset, uint64_t size, int prefetched)
-{
-	zstream_t	zst;
-	zstream_t	*newstream;
-	boolean_t	fetched;
-	int		inserted;
-	unsigned int	blkshft;
-	uint64_t	blksz;
+		/* the stream may have moved on before we locked it */
+		mutex_enter(&zs->zs_lock);
+		match = dmu_zfetch_match(zs, blkid, end_blkid);
+		if (match != ZFETCH_NONE)
+			break;
+		mutex_exit(&zs->zs_lock);
+	}
 
-	if (zfs_prefetch_disable)
+	if (zs == NULL) {
+		/*
+		 * This access is not part of any stream, so start one.  If
+		 * someone else holds zf_rwlock, don't wait for it; the next
+		 * access will try again.
+		 */
+		ZFETCHSTAT_BUMP(zfetchstat_misses);
+		if (rw_tryupgrade(&zf->zf_rwlock))
+			dmu_zfetch_stream_create(zf, end_blkid, nblks);
+		rw_exit(&zf->zf_rwlock);
 		return;
+	}
 
-	/* files that aren't ln2 blocksz are only one block -- nothing to do */
-	if (!zf->zf_dnode->dn_datablkshift)
+	if (match == ZFETCH_REPEAT) {
+		/* another access to the block the stream last read */
+		mutex_exit(&zs->zs_lock);
+		rw_exit(&zf->zf_rwlock);
 		return;
+	}
 
-	/* convert offset and size, into blockid and nblocks */
-	blkshft = zf->zf_dnode->dn_datablkshift;
-	blksz = (1 << blkshft);
-
-	bzero(&zst, sizeof (zstream_t));
-	zst.zst_offset = offset >> blkshft;
-	zst.zst_len = (P2ROUNDUP(offset + size, blksz) -
-	    P2ALIGN(offset, blksz)) >> blkshft;
-
-	fetched = dmu_zfetch_find(zf, &zst, prefetched);
-	if (fetched) {
+	max_blks = MAX(zfetch_max_distance >> dn->dn_datablkshift, 1);
+	if (match == ZFETCH_HIT) {
 		ZFETCHSTAT_BUMP(zfetchstat_hits);
+		zs->zs_distance = MIN(zs->zs_distance << 1, max_blks);
 	} else {
+		/* the blocks skipped over were prefetched for nothing */
 		ZFETCHSTAT_BUMP(zfetchstat_misses);
-		if ((fetched = dmu_zfetch_colinear(zf, &zst))) {
-			ZFETCHSTAT_BUMP(zfetchstat_colinear_hits);
-		} else {
-			ZFETCHSTAT_BUMP(zfetchstat_colinear_misses);
-		}
+		ZFETCHSTAT_INCR(zfetchstat_useless, blkid - zs->zs_blkid);
+		zs->zs_distance = MAX(zs->zs_distance >> 1, 1);
 	}
+	ZFETCHSTAT_SET(zfetchstat_distance,
+	    zs->zs_distance << dn->dn_datablkshift);
 
-	if (!fetched) {
-		newstream = dmu_zfetch_stream_reclaim(zf);
+	zs->zs_blkid = end_blkid;
+	zs->zs_atime = gethrtime();
+	max_blkid = dn->dn_maxblkid + 1;
 
-		/*
-		 * we still couldn't find a stream, drop the lock, and allocate
-		 * one if possible.  Otherwise, give up and go home.
-		 */
-		if (newstream) {
-			ZFETCHSTAT_BUMP(zfetchstat_reclaim_successes);
-		} else {
-			uint64_t	maxblocks;
-			uint32_t	max_streams;
-			uint32_t	cur_streams;
-
-			ZFETCHSTAT_BUMP(zfetchstat_reclaim_failures);
-			cur_streams = zf->zf_stream_cnt;
-			maxblocks = zf->zf_dnode->dn_maxblkid;
-
-			max_streams = MIN(zfetch_max_streams,
-			    (maxblocks / zfetch_block_cap));
-			if (max_streams == 0) {
-				max_streams++;
-			}
-
-			if (cur_streams >= max_streams) {
-				return;
-			}
-			newstream =
-			    kmem_zalloc(sizeof (zstream_t), KM_PUSHPAGE);
-		}
-
-		newstream->zst_offset = zst.zst_offset;
-		newstream->zst_len = zst.zst_len;
-		newstream->zst_stride = zst.zst_len;
-		newstream->zst_ph_offset = zst.zst_len + zst.zst_offset;
-		newstream->zst_cap = zst.zst_len;
-		newstream->zst_direction = ZFETCH_FORWARD;
-		newstream->zst_last = ddi_get_lbolt();
-
-		mutex_init(&newstream->zst_lock, NULL, MUTEX_DEFAULT, NULL);
-
-		rw_enter(&zf->zf_rwlock, RW_WRITER);
-		inserted = dmu_zfetch_stream_insert(zf, newstream);
-		rw_exit(&zf->zf_rwlock);
+	pf_start = MAX(zs->zs_pf_blkid, end_blkid);
+	if (fetch_data)
+		pf_end = MIN(end_blkid + zs->zs_distance, max_blkid);
+	else
+		pf_end = end_blkid;
+	pf_end = MAX(pf_start, pf_end);
+	zs->zs_pf_blkid = pf_end;
 
-		if (!inserted) {
-			mutex_destroy(&newstream->zst_lock);
-			kmem_free(newstream, sizeof (zstream_t));
-		}
+	/*
+	 * The indirect blocks of the data within the data prefetch distance
+	 * are read by dbuf_prefetch() itself, so only prefetch those beyond
+	 * it.
+	 */
+	max_iblks = MAX(zfetch_max_idistance >> dn->dn_datablkshift, 1);
+	ipf_start = MAX(zs->zs_ipf_blkid, pf_end);
+	ipf_end = MIN(end_blkid +
+	    MIN(zs->zs_distance << ZFETCH_IDISTANCE_SHIFT, max_iblks),
+	    max_blkid);
+	ipf_end = MAX(ipf_start, ipf_end);
+	zs->zs_ipf_blkid = ipf_end;
+
+	mutex_exit(&zs->zs_lock);
+	rw_exit(&zf->zf_rwlock);
+
+	if (dn->dn_nlevels > 1) {
+		epbs = dn->dn_indblkshift - SPA_BLKPTRSHIFT;
+		ipf_start = P2ROUNDUP(ipf_start, 1ULL << epbs) >> epbs;
+		ipf_end = P2ROUNDUP(ipf_end, 1ULL << epbs) >> epbs;
+		for (i = ipf_start; i < ipf_end; i++)
+			dbuf_prefetch(dn, 1, i, ZIO_PRIORITY_ASYNC_READ);
 	}
+
+	for (i = pf_start; i < pf_end; i++)
+		dbuf_prefetch(dn, 0, i, ZIO_PRIORITY_ASYNC_READ);
 }
 
 #if defined(_KERNEL) && defined(HAVE_SPL)
@@ -740,8 +380,12 @@ MODULE_PARM_DESC(zfetch_max_streams, "Max number of streams per zfetch");
 module_param(zfetch_min_sec_reap, uint, 0644);
 MODULE_PARM_DESC(zfetch_min_sec_reap, "Min time before stream reclaim");
 
-module_param(zfetch_block_cap, uint, 0644);
-MODULE_PARM_DESC(zfetch_block_cap, "Max number of blocks to fetch at a time");
+module_param(zfetch_max_distance, uint, 0644);
+MODULE_PARM_DESC(zfetch_max_distance, "Max bytes to prefetch per stream");
+
+module_param(zfetch_max_idistance, uint, 0644);
+MODULE_PARM_DESC(zfetch_max_idistance,
+	"Max bytes of data whose indirect blocks are prefetched per stream");
 
 module_param(zfetch_array_rd_sz, ulong, 0644);
 MODULE_PARM_DESC(zfetch_array_rd_sz, "Number of bytes in a array_read");
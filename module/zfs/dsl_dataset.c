@@ -58,7 +58,7 @@
 
 #define	DS_REF_MAX	(1ULL << 62)
 
-#define	DSL_DEADLIST_BLOCKSIZE	SPA_MAXBLOCKSIZE
+#define	DSL_DEADLIST_BLOCKSIZE	SPA_OLD_MAXBLOCKSIZE
 
 /*
  * Figure out how much of this delta should be propogated to the dsl_dir
@@ -1584,7 +1584,7 @@ dsl_dataset_space(dsl_dataset_t *ds,
 		else
 			*availbytesp = 0;
 	}
-	*usedobjsp = ds->ds_phys->ds_bp.blk_fill;
+	*usedobjsp = BP_GET_FILL(&ds->ds_phys->ds_bp);
 	*availobjsp = DN_MAX_OBJECT - *usedobjsp;
 }
 
@@ -126,6 +126,18 @@ int zfs_delay_min_dirty_percent = 60;
  */
 unsigned long zfs_delay_scale = 1000 * 1000 * 1000 / 2000;
 
+/*
+ * Number of threads, as a percentage of CPUs, of each of the taskqs that
+ * sync dirty datasets, and the dirty dnodes of a dataset, in parallel.
+ */
+int zfs_sync_taskq_batch_pct = 75;
+
+/*
+ * Number of threads, as a percentage of CPUs, of the taskq that completes
+ * dmu_read_async() requests.
+ */
+int zfs_read_taskq_batch_pct = 75;
+
 hrtime_t zfs_throttle_delay = MSEC2NSEC(10);
 hrtime_t zfs_throttle_resolution = MSEC2NSEC(10);
 
@@ -174,10 +186,20 @@ dsl_pool_open_impl(spa_t *spa, uint64_t txg)
 	    offsetof(dsl_sync_task_t, dst_node));
 
 	mutex_init(&dp->dp_lock, NULL, MUTEX_DEFAULT, NULL);
+	mutex_init(&dp->dp_empty_bpobj_lock, NULL, MUTEX_DEFAULT, NULL);
 	cv_init(&dp->dp_spaceavail_cv, NULL, CV_DEFAULT, NULL);
 
 	dp->dp_iput_taskq = taskq_create("zfs_iput_taskq", 1, minclsyspri,
 	    1, 4, 0);
+	dp->dp_sync_taskq = taskq_create("dp_sync_taskq",
+	    zfs_sync_taskq_batch_pct, minclsyspri, 1, INT_MAX,
+	    TASKQ_THREADS_CPU_PCT);
+	dp->dp_sync_ds_taskq = taskq_create("dp_sync_ds_taskq",
+	    zfs_sync_taskq_batch_pct, minclsyspri, 1, INT_MAX,
+	    TASKQ_THREADS_CPU_PCT);
+	dp->dp_read_taskq = taskq_create("dp_read_taskq",
+	    zfs_read_taskq_batch_pct, minclsyspri, 1, INT_MAX,
+	    TASKQ_THREADS_CPU_PCT);
 
 	return (dp);
 }
@@ -321,7 +343,11 @@ dsl_pool_close(dsl_pool_t *dp)
 	dsl_scan_fini(dp);
 	rrw_destroy(&dp->dp_config_rwlock);
 	mutex_destroy(&dp->dp_lock);
+	mutex_destroy(&dp->dp_empty_bpobj_lock);
 	taskq_destroy(dp->dp_iput_taskq);
+	taskq_destroy(dp->dp_sync_taskq);
+	taskq_destroy(dp->dp_sync_ds_taskq);
+	taskq_destroy(dp->dp_read_taskq);
 	if (dp->dp_blkstats)
 		kmem_free(dp->dp_blkstats, sizeof (zfs_all_blkstats_t));
 	kmem_free(dp, sizeof (dsl_pool_t));
@@ -369,7 +395,7 @@ dsl_pool_create(spa_t *spa, nvlist_t *zplprops, uint64_t txg)
 		    FREE_DIR_NAME, &dp->dp_free_dir));
 
 		/* create and open the free_bplist */
-		obj = bpobj_alloc(dp->dp_meta_objset, SPA_MAXBLOCKSIZE, tx);
+		obj = bpobj_alloc(dp->dp_meta_objset, SPA_OLD_MAXBLOCKSIZE, tx);
 		VERIFY(zap_add(dp->dp_meta_objset, DMU_POOL_DIRECTORY_OBJECT,
 		    DMU_POOL_FREE_BPOBJ, sizeof (uint64_t), 1, &obj, tx) == 0);
 		VERIFY0(bpobj_open(&dp->dp_free_bpobj,
@@ -450,6 +476,69 @@ dsl_pool_dirty_delta(dsl_pool_t *dp, int64_t delta)
 		cv_signal(&dp->dp_spaceavail_cv);
 }
 
+/*
+ * The dnodes of several datasets are synced at once, so TXG_SYNC_DNODES
+ * is the wall-clock time during which the dnodes of at least one dataset
+ * were being synced, rather than the sum over the datasets.  The MOS's
+ * dnodes are left out; they are part of TXG_SYNC_MOS.
+ */
+void
+dsl_pool_sync_dnodes_enter(dsl_pool_t *dp)
+{
+	mutex_enter(&dp->dp_lock);
+	if (dp->dp_sync_dnodes_active++ == 0)
+		dp->dp_sync_dnodes_start = gethrtime();
+	mutex_exit(&dp->dp_lock);
+}
+
+void
+dsl_pool_sync_dnodes_exit(dsl_pool_t *dp)
+{
+	mutex_enter(&dp->dp_lock);
+	ASSERT(dp->dp_sync_dnodes_active > 0);
+	if (--dp->dp_sync_dnodes_active == 0) {
+		dp->dp_sync_times[TXG_SYNC_DNODES] +=
+		    gethrtime() - dp->dp_sync_dnodes_start;
+	}
+	mutex_exit(&dp->dp_lock);
+}
+
+typedef struct dsl_pool_sync_arg {
+	dsl_dataset_t *dpsa_ds;
+	zio_t *dpsa_zio;
+	dmu_tx_t *dpsa_tx;
+} dsl_pool_sync_arg_t;
+
+static void
+dsl_pool_sync_dataset_task(void *arg)
+{
+	dsl_pool_sync_arg_t *dpsa = arg;
+
+	dsl_dataset_sync(dpsa->dpsa_ds, dpsa->dpsa_zio, dpsa->dpsa_tx);
+	kmem_free(dpsa, sizeof (dsl_pool_sync_arg_t));
+}
+
+/*
+ * Sync a dirty dataset on dp_sync_ds_taskq.  Datasets are independent of
+ * each other until the MOS is synced, which dsl_pool_sync() only does
+ * after it has waited for the taskq, and then for the zio.  The dnodes
+ * of each dataset are in turn synced on dp_sync_taskq, which must not be
+ * the same taskq, as the dataset tasks block waiting for them.
+ */
+static void
+dsl_pool_sync_dataset(dsl_pool_t *dp, dsl_dataset_t *ds, zio_t *zio,
+    dmu_tx_t *tx)
+{
+	dsl_pool_sync_arg_t *dpsa;
+
+	dpsa = kmem_alloc(sizeof (dsl_pool_sync_arg_t), KM_PUSHPAGE);
+	dpsa->dpsa_ds = ds;
+	dpsa->dpsa_zio = zio;
+	dpsa->dpsa_tx = tx;
+	(void) taskq_dispatch(dp->dp_sync_ds_taskq,
+	    dsl_pool_sync_dataset_task, dpsa, TQ_SLEEP);
+}
+
 void
 dsl_pool_sync(dsl_pool_t *dp, uint64_t txg)
 {
@@ -459,6 +548,7 @@ dsl_pool_sync(dsl_pool_t *dp, uint64_t txg)
 	dsl_dataset_t *ds;
 	objset_t *mos = dp->dp_meta_objset;
 	list_t synced_datasets;
+	hrtime_t start;
 
 	list_create(&synced_datasets, sizeof (dsl_dataset_t),
 	    offsetof(dsl_dataset_t, ds_synced_link));
@@ -468,18 +558,25 @@ dsl_pool_sync(dsl_pool_t *dp, uint64_t txg)
 	/*
 	 * Write out all dirty blocks of dirty datasets.
 	 */
+	start = gethrtime();
 	zio = zio_root(dp->dp_spa, NULL, NULL, ZIO_FLAG_MUSTSUCCEED);
-	while ((ds = txg_list_remove(&dp->dp_dirty_datasets, txg)) != NULL) {
-		/*
-		 * We must not sync any non-MOS datasets twice, because
-		 * we may have taken a snapshot of them.  However, we
-		 * may sync newly-created datasets on pass 2.
-		 */
-		ASSERT(!list_link_active(&ds->ds_synced_link));
-		list_insert_tail(&synced_datasets, ds);
-		dsl_dataset_sync(ds, zio, tx);
-	}
+	do {
+		while ((ds = txg_list_remove(&dp->dp_dirty_datasets,
+		    txg)) != NULL) {
+			/*
+			 * We must not sync any non-MOS datasets twice,
+			 * because we may have taken a snapshot of them.
+			 * However, we may sync newly-created datasets on
+			 * pass 2.
+			 */
+			ASSERT(!list_link_active(&ds->ds_synced_link));
+			list_insert_tail(&synced_datasets, ds);
+			dsl_pool_sync_dataset(dp, ds, zio, tx);
+		}
+		taskq_wait(dp->dp_sync_ds_taskq);
+	} while (!txg_list_empty(&dp->dp_dirty_datasets, txg));
 	VERIFY0(zio_wait(zio));
+	dp->dp_sync_times[TXG_SYNC_DATASETS] += gethrtime() - start;
 
 	/*
 	 * We have written all of the accounted dirty data, so our
@@ -494,10 +591,12 @@ dsl_pool_sync(dsl_pool_t *dp, uint64_t txg)
 	 * After the data blocks have been written (ensured by the zio_wait()
 	 * above), update the user/group space accounting.
 	 */
+	start = gethrtime();
 	for (ds = list_head(&synced_datasets); ds != NULL;
 	    ds = list_next(&synced_datasets, ds)) {
 		dmu_objset_do_userquota_updates(ds->ds_objset, tx);
 	}
+	dp->dp_sync_times[TXG_SYNC_USERQUOTA] += gethrtime() - start;
 
 	/*
 	 * Sync the datasets again to push out the changes due to
@@ -506,13 +605,19 @@ dsl_pool_sync(dsl_pool_t *dp, uint64_t txg)
 	 * user accounting information (and we won't get confused
 	 * about which blocks are part of the snapshot).
 	 */
+	start = gethrtime();
 	zio = zio_root(dp->dp_spa, NULL, NULL, ZIO_FLAG_MUSTSUCCEED);
-	while ((ds = txg_list_remove(&dp->dp_dirty_datasets, txg)) != NULL) {
-		ASSERT(list_link_active(&ds->ds_synced_link));
-		dmu_buf_rele(ds->ds_dbuf, ds);
-		dsl_dataset_sync(ds, zio, tx);
-	}
+	do {
+		while ((ds = txg_list_remove(&dp->dp_dirty_datasets,
+		    txg)) != NULL) {
+			ASSERT(list_link_active(&ds->ds_synced_link));
+			dmu_buf_rele(ds->ds_dbuf, ds);
+			dsl_pool_sync_dataset(dp, ds, zio, tx);
+		}
+		taskq_wait(dp->dp_sync_ds_taskq);
+	} while (!txg_list_empty(&dp->dp_dirty_datasets, txg));
 	VERIFY0(zio_wait(zio));
+	dp->dp_sync_times[TXG_SYNC_DATASETS] += gethrtime() - start;
 
 	/*
 	 * Now that the datasets have been completely synced, we can
@@ -549,9 +654,10 @@ dsl_pool_sync(dsl_pool_t *dp, uint64_t txg)
 		dp->dp_mos_uncompressed_delta = 0;
 	}
 
-	if (list_head(&mos->os_dirty_dnodes[txg & TXG_MASK]) != NULL ||
-	    list_head(&mos->os_free_dnodes[txg & TXG_MASK]) != NULL) {
+	if (dmu_objset_is_dirty(mos, txg)) {
+		start = gethrtime();
 		dsl_pool_sync_mos(dp, tx);
+		dp->dp_sync_times[TXG_SYNC_MOS] += gethrtime() - start;
 	}
 
 	/*
@@ -570,8 +676,10 @@ dsl_pool_sync(dsl_pool_t *dp, uint64_t txg)
 		 * were syncing.
 		 */
 		ASSERT3U(spa_sync_pass(dp->dp_spa), ==, 1);
+		start = gethrtime();
 		while ((dst = txg_list_remove(&dp->dp_sync_tasks, txg)) != NULL)
 			dsl_sync_task_sync(dst, tx);
+		dp->dp_sync_times[TXG_SYNC_TASKS] += gethrtime() - start;
 	}
 
 	dmu_tx_commit(tx);
@@ -803,7 +911,7 @@ dsl_pool_upgrade_dir_clones(dsl_pool_t *dp, dmu_tx_t *tx)
 	 * subobj support.  So call dmu_object_alloc() directly.
 	 */
 	obj = dmu_object_alloc(dp->dp_meta_objset, DMU_OT_BPOBJ,
-	    SPA_MAXBLOCKSIZE, DMU_OT_BPOBJ_HDR, sizeof (bpobj_phys_t), tx);
+	    SPA_OLD_MAXBLOCKSIZE, DMU_OT_BPOBJ_HDR, sizeof (bpobj_phys_t), tx);
 	VERIFY0(zap_add(dp->dp_meta_objset, DMU_POOL_DIRECTORY_OBJECT,
 	    DMU_POOL_FREE_BPOBJ, sizeof (uint64_t), 1, &obj, tx));
 	VERIFY0(bpobj_open(&dp->dp_free_bpobj, dp->dp_meta_objset, obj));
@@ -1054,3 +1162,12 @@ dsl_pool_config_held(dsl_pool_t *dp)
     return (RRW_LOCK_HELD(&dp->dp_config_rwlock));
 }
 
+#if defined(_KERNEL) && defined(HAVE_SPL)
+module_param(zfs_sync_taskq_batch_pct, int, 0644);
+MODULE_PARM_DESC(zfs_sync_taskq_batch_pct,
+	"Max percent of CPUs that are used to sync dirty dnodes");
+
+module_param(zfs_read_taskq_batch_pct, int, 0644);
+MODULE_PARM_DESC(zfs_read_taskq_batch_pct,
+	"Max percent of CPUs that are used to complete async reads");
+#endif
@@ -26,13 +26,14 @@
 
 
 
-#include <sys/debug.h>
-#include <sys/types.h>
+#include <sys/zfs_context.h>
+#include <sys/zio_compress.h>
 
 #ifdef _KERNEL
 
 #include <sys/systm.h>
 #include <sys/zmod.h>
+#include <libkern/zlib.h>
 
 typedef size_t zlen_t;
 #define	compress_func	z_compress_level
@@ -49,14 +50,184 @@ typedef uLongf zlen_t;
 
 #endif
 
+/*
+ * compress2() and uncompress() allocate the zlib state on every call and
+ * free it on return, which for deflate is over 256K: a large kmem
+ * allocation in the kernel, and an mmap()/munmap() pair plus page faults
+ * in userland, for each block.
+ *
+ * Instead each CPU has a workspace, allocated the first time it is
+ * needed and kept until gzip_fini().  The deflate and inflate streams
+ * are set up with allocators which carve their state out of the
+ * workspace and free nothing; the whole workspace is reused by the next
+ * block.  A thread which finds its CPU's workspace busy takes any idle
+ * one, and if there is none, or the workspace turns out to be too small
+ * for this zlib, falls back to compress2() and uncompress().
+ *
+ * Set zfs_gzip_workspace to 0 to always use the allocating path.
+ */
+int zfs_gzip_workspace = 1;
+
+#define	GZIP_WS_SIZE	(320 * 1024)
+#define	GZIP_WS_ALIGN	16
+
+typedef struct gzip_ws {
+	kmutex_t	gw_lock;
+	uint8_t		*gw_buf;	/* GZIP_WS_SIZE bytes, or NULL */
+	size_t		gw_used;	/* bytes handed to zlib so far */
+} gzip_ws_t;
+
+static gzip_ws_t *gzip_ws;
+static int gzip_ws_count;
+
+static voidpf
+gzip_ws_alloc(voidpf opaque, uInt items, uInt size)
+{
+	gzip_ws_t *gw = opaque;
+	size_t len = P2ROUNDUP((size_t)items * size, (size_t)GZIP_WS_ALIGN);
+	voidpf ptr;
+
+	if (len > GZIP_WS_SIZE - gw->gw_used)
+		return (Z_NULL);
+
+	ptr = gw->gw_buf + gw->gw_used;
+	gw->gw_used += len;
+
+	return (ptr);
+}
+
+/*ARGSUSED*/
+static void
+gzip_ws_free(voidpf opaque, voidpf ptr)
+{
+}
+
+/*
+ * Take an idle workspace, preferring the current CPU's.
+ */
+static gzip_ws_t *
+gzip_ws_get(void)
+{
+	gzip_ws_t *gw;
+	int i, start;
+
+	if (!zfs_gzip_workspace || gzip_ws == NULL)
+		return (NULL);
+
+	start = CPU_SEQID % gzip_ws_count;
+	for (i = 0; i < gzip_ws_count; i++) {
+		gw = &gzip_ws[(start + i) % gzip_ws_count];
+		if (!mutex_tryenter(&gw->gw_lock))
+			continue;
+
+		if (gw->gw_buf == NULL)
+			gw->gw_buf = vmem_alloc(GZIP_WS_SIZE, KM_NOSLEEP);
+
+		if (gw->gw_buf == NULL) {
+			mutex_exit(&gw->gw_lock);
+			return (NULL);
+		}
+
+		gw->gw_used = 0;
+		return (gw);
+	}
+
+	return (NULL);
+}
+
+static void
+gzip_ws_put(gzip_ws_t *gw)
+{
+	mutex_exit(&gw->gw_lock);
+}
+
+static void
+gzip_ws_stream(gzip_ws_t *gw, z_stream *zs, void *src, size_t s_len,
+    void *dst, size_t d_len)
+{
+	bzero(zs, sizeof (z_stream));
+	zs->next_in = src;
+	zs->avail_in = s_len;
+	zs->next_out = dst;
+	zs->avail_out = d_len;
+	zs->zalloc = gzip_ws_alloc;
+	zs->zfree = gzip_ws_free;
+	zs->opaque = gw;
+}
+
+/*
+ * compress2() with the zlib state in gw.
+ */
+static int
+gzip_ws_compress(gzip_ws_t *gw, void *dst, zlen_t *dstlen, void *src,
+    size_t s_len, int level)
+{
+	z_stream zs;
+	int err;
+
+	gzip_ws_stream(gw, &zs, src, s_len, dst, *dstlen);
+
+	if ((err = deflateInit(&zs, level)) != Z_OK)
+		return (err);
+
+	err = deflate(&zs, Z_FINISH);
+	if (err != Z_STREAM_END) {
+		(void) deflateEnd(&zs);
+		return (err == Z_OK ? Z_BUF_ERROR : err);
+	}
+
+	*dstlen = zs.total_out;
+	return (deflateEnd(&zs));
+}
+
+/*
+ * uncompress() with the zlib state in gw.
+ */
+static int
+gzip_ws_uncompress(gzip_ws_t *gw, void *dst, zlen_t *dstlen, void *src,
+    size_t s_len)
+{
+	z_stream zs;
+	int err;
+
+	gzip_ws_stream(gw, &zs, src, s_len, dst, *dstlen);
+
+	if ((err = inflateInit(&zs)) != Z_OK)
+		return (err);
+
+	err = inflate(&zs, Z_FINISH);
+	if (err != Z_STREAM_END) {
+		(void) inflateEnd(&zs);
+		if (err == Z_NEED_DICT ||
+		    (err == Z_BUF_ERROR && zs.avail_in == 0))
+			return (Z_DATA_ERROR);
+		return (err);
+	}
+
+	*dstlen = zs.total_out;
+	return (inflateEnd(&zs));
+}
+
 size_t
 gzip_compress(void *s_start, void *d_start, size_t s_len, size_t d_len, int n)
 {
 	zlen_t dstlen = d_len;
+	gzip_ws_t *gw;
+	int err = Z_MEM_ERROR;
 
 	ASSERT(d_len <= s_len);
 
-	if (compress_func(d_start, &dstlen, s_start, s_len, n) != Z_OK) {
+	if ((gw = gzip_ws_get()) != NULL) {
+		err = gzip_ws_compress(gw, d_start, &dstlen, s_start, s_len, n);
+		gzip_ws_put(gw);
+	}
+
+	if (err == Z_MEM_ERROR) {
+		dstlen = d_len;
+		err = compress_func(d_start, &dstlen, s_start, s_len, n);
+	}
+
+	if (err != Z_OK) {
 		if (d_len != s_len)
 			return (s_len);
 
@@ -72,11 +243,58 @@ int
 gzip_decompress(void *s_start, void *d_start, size_t s_len, size_t d_len, int n)
 {
 	zlen_t dstlen = d_len;
+	gzip_ws_t *gw;
+	int err = Z_MEM_ERROR;
 
 	ASSERT(d_len >= s_len);
 
-	if (uncompress_func(d_start, &dstlen, s_start, s_len) != Z_OK)
+	if ((gw = gzip_ws_get()) != NULL) {
+		err = gzip_ws_uncompress(gw, d_start, &dstlen, s_start, s_len);
+		gzip_ws_put(gw);
+	}
+
+	if (err == Z_MEM_ERROR) {
+		dstlen = d_len;
+		err = uncompress_func(d_start, &dstlen, s_start, s_len);
+	}
+
+	if (err != Z_OK)
 		return (-1);
 
 	return (0);
 }
+
+void
+gzip_init(void)
+{
+	int i;
+
+	gzip_ws_count = max_ncpus;
+	gzip_ws = kmem_zalloc(gzip_ws_count * sizeof (gzip_ws_t), KM_SLEEP);
+
+	for (i = 0; i < gzip_ws_count; i++)
+		mutex_init(&gzip_ws[i].gw_lock, NULL, MUTEX_DEFAULT, NULL);
+}
+
+void
+gzip_fini(void)
+{
+	int i;
+
+	if (gzip_ws == NULL)
+		return;
+
+	for (i = 0; i < gzip_ws_count; i++) {
+		if (gzip_ws[i].gw_buf != NULL)
+			vmem_free(gzip_ws[i].gw_buf, GZIP_WS_SIZE);
+		mutex_destroy(&gzip_ws[i].gw_lock);
+	}
+
+	kmem_free(gzip_ws, gzip_ws_count * sizeof (gzip_ws_t));
+	gzip_ws = NULL;
+}
+
+#if defined(_KERNEL) && defined(HAVE_SPL)
+module_param(zfs_gzip_workspace, int, 0644);
+MODULE_PARM_DESC(zfs_gzip_workspace, "Reuse per-CPU zlib workspaces for gzip");
+#endif
@@ -91,7 +91,7 @@ int metaslab_debug = 0;
  * an allocation of this size then it switches to using more
  * aggressive strategy (i.e search by size rather than offset).
  */
-uint64_t metaslab_df_alloc_threshold = SPA_MAXBLOCKSIZE;
+uint64_t metaslab_df_alloc_threshold = SPA_OLD_MAXBLOCKSIZE;
 
 /*
  * The minimum free space, in percent, which must be available
@@ -105,7 +105,7 @@ int metaslab_df_free_pct = 4;
  * A metaslab is considered "free" if it contains a contiguous
  * segment which is greater than metaslab_min_alloc_size.
  */
-uint64_t metaslab_min_alloc_size = DMU_MAX_ACCESS;
+uint64_t metaslab_min_alloc_size = 10 << 20;
 
 /*
  * Max number of space_maps to prefetch.
@@ -26,13 +26,16 @@
 #include <sys/zfs_context.h>
 #include <sys/zio.h>
 #include <sys/zio_checksum.h>
+#include <sys/sha256.h>
 
 /*
  * SHA-256 checksum, as specified in FIPS 180-3, available at:
  * http://csrc.nist.gov/publications/PubsFIPS.html
  *
  * This is a very compact implementation of SHA-256.
- * It is designed to be simple and portable, not to be fast.
+ * It is designed to be simple and portable, not to be fast.  Faster
+ * implementations of the compression function are selected at runtime
+ * by sha256_init(), see sha256_shani.c and sha256_avx2.c.
  */
 
 /*
@@ -51,7 +54,7 @@
 #define	sigma0(x)	(Rot32(x, 7) ^ Rot32(x, 18) ^ ((x) >> 3))
 #define	sigma1(x)	(Rot32(x, 17) ^ Rot32(x, 19) ^ ((x) >> 10))
 
-static const uint32_t SHA256_K[64] = {
+const uint32_t SHA256_K[64] = {
 	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
 	0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
 	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
@@ -97,17 +100,61 @@ SHA256Transform(uint32_t *H, const uint8_t *cp)
 }
 
 void
-zio_checksum_SHA256(const void *buf, uint64_t size, zio_cksum_t *zcp)
+sha256_scalar_block(uint32_t *H, const uint8_t *data, uint64_t nblks)
+{
+	uint64_t i;
+
+	for (i = 0; i < nblks; i++)
+		SHA256Transform(H, data + i * SHA256_BLOCK_SIZE);
+}
+
+static boolean_t
+sha256_scalar_valid(void)
+{
+	return (B_TRUE);
+}
+
+const sha256_ops_t sha256_scalar_ops = {
+	.so_block = sha256_scalar_block,
+	.so_multi = NULL,
+	.so_valid = sha256_scalar_valid,
+	.so_name = "scalar"
+};
+
+static const sha256_ops_t *sha256_impls[] = {
+#if defined(HAVE_SIMD_X86)
+	&sha256_shani_ops,
+	&sha256_avx2_ops,
+#endif
+	&sha256_scalar_ops
+};
+
+#define	SHA256_IMPLS	(sizeof (sha256_impls) / sizeof (sha256_impls[0]))
+
+/*
+ * Consumers which never call sha256_init(), such as libzfs, get the
+ * portable code.
+ */
+static const sha256_ops_t *sha256_impl = &sha256_scalar_ops;
+static boolean_t sha256_impl_ok[SHA256_IMPLS];
+
+static const uint32_t sha256_iv[8] = {
+	0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+	0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+/*
+ * Hash the trailing partial block of buf and the padding.  H must already
+ * cover the size / 64 full blocks.
+ */
+static void
+sha256_final(const sha256_ops_t *ops, uint32_t *H, const void *buf,
+    uint64_t size, zio_cksum_t *zcp)
 {
-	uint32_t H[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
-	    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
 	uint8_t pad[128];
 	int i, padsize;
 
-	for (i = 0; i < (size & ~63ULL); i += 64)
-		SHA256Transform(H, (uint8_t *)buf + i);
-
-	for (padsize = 0; i < size; i++)
+	for (padsize = 0, i = size & ~63ULL; i < size; i++)
 		pad[padsize++] = *((uint8_t *)buf + i);
 
 	for (pad[padsize++] = 0x80; (padsize & 63) != 56; padsize++)
@@ -116,8 +163,7 @@ zio_checksum_SHA256(const void *buf, uint64_t size, zio_cksum_t *zcp)
 	for (i = 56; i >= 0; i -= 8)
 		pad[padsize++] = (size << 3) >> i;
 
-	for (i = 0; i < padsize; i += 64)
-		SHA256Transform(H, pad + i);
+	ops->so_block(H, pad, padsize / SHA256_BLOCK_SIZE);
 
 	ZIO_SET_CHECKSUM(zcp,
 	    (uint64_t)H[0] << 32 | H[1],
@@ -125,3 +171,221 @@ zio_checksum_SHA256(const void *buf, uint64_t size, zio_cksum_t *zcp)
 	    (uint64_t)H[4] << 32 | H[5],
 	    (uint64_t)H[6] << 32 | H[7]);
 }
+
+static void
+sha256_compute(const sha256_ops_t *ops, const void *buf, uint64_t size,
+    zio_cksum_t *zcp)
+{
+	uint32_t H[8];
+
+	bcopy(sha256_iv, H, sizeof (H));
+	ops->so_block(H, buf, size / SHA256_BLOCK_SIZE);
+	sha256_final(ops, H, buf, size, zcp);
+}
+
+static void
+sha256_compute_multi(const sha256_ops_t *ops, const void **buf,
+    const uint64_t *size, zio_cksum_t *zcp, int n)
+{
+	uint32_t H[SHA256_MB_LANES][8];
+	uint64_t nblks[SHA256_MB_LANES];
+	int i, j, lanes;
+
+	if (ops->so_multi == NULL) {
+		for (i = 0; i < n; i++)
+			sha256_compute(ops, buf[i], size[i], &zcp[i]);
+		return;
+	}
+
+	for (i = 0; i < n; i += lanes) {
+		lanes = MIN(n - i, SHA256_MB_LANES);
+		for (j = 0; j < lanes; j++) {
+			bcopy(sha256_iv, H[j], sizeof (H[j]));
+			nblks[j] = size[i + j] / SHA256_BLOCK_SIZE;
+		}
+
+		ops->so_multi(H, (const uint8_t **)&buf[i], nblks, lanes);
+
+		for (j = 0; j < lanes; j++)
+			sha256_final(ops, H[j], buf[i + j], size[i + j],
+			    &zcp[i + j]);
+	}
+}
+
+void
+zio_checksum_SHA256(const void *buf, uint64_t size, zio_cksum_t *zcp)
+{
+	sha256_compute(sha256_impl, buf, size, zcp);
+}
+
+/*
+ * Checksum n independent buffers.  With a multi-buffer implementation this
+ * is considerably faster than n calls to zio_checksum_SHA256().
+ */
+void
+zio_checksum_SHA256_multi(const void **buf, const uint64_t *size,
+    zio_cksum_t *zcp, int n)
+{
+	sha256_compute_multi(sha256_impl, buf, size, zcp, n);
+}
+
+/*
+ * Known answers from FIPS 180-2 appendix B and the empty message.
+ */
+static const struct {
+	const char	*st_msg;
+	uint32_t	st_digest[8];
+} sha256_kat[] = {
+	{ "", { 0xe3b0c442, 0x98fc1c14, 0x9afbf4c8, 0x996fb924,
+	    0x27ae41e4, 0x649b934c, 0xa495991b, 0x7852b855 } },
+	{ "abc", { 0xba7816bf, 0x8f01cfea, 0x414140de, 0x5dae2223,
+	    0xb00361a3, 0x96177a9c, 0xb410ff61, 0xf20015ad } },
+	{ "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+	    { 0x248d6a61, 0xd20638b8, 0xe5c02693, 0x0c3e6039,
+	    0xa33ce459, 0x64ff2167, 0xf6ecedd4, 0x19db06c1 } },
+	{ "abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmn"
+	    "hijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu",
+	    { 0xcf5b16a7, 0x78af8380, 0x036ce59e, 0x7b049237,
+	    0x0b249b11, 0xe8f07a51, 0xafac4503, 0x7afee9d1 } },
+};
+
+#define	SHA256_KAT		(sizeof (sha256_kat) / sizeof (sha256_kat[0]))
+#define	SHA256_TEST_SIZE	\
+	(SPA_OLD_MAXBLOCKSIZE + SHA256_MB_LANES * 4096)
+
+static boolean_t
+sha256_selftest(const sha256_ops_t *ops, const uint8_t *buf)
+{
+	const void *bufs[SHA256_MB_LANES];
+	uint64_t sizes[SHA256_MB_LANES];
+	zio_cksum_t zc, ref[SHA256_MB_LANES], multi[SHA256_MB_LANES];
+	uint64_t size;
+	int i, j;
+
+	for (i = 0; i < SHA256_KAT; i++) {
+		const uint32_t *d = sha256_kat[i].st_digest;
+
+		sha256_compute(ops, sha256_kat[i].st_msg,
+		    strlen(sha256_kat[i].st_msg), &zc);
+		if (zc.zc_word[0] != ((uint64_t)d[0] << 32 | d[1]) ||
+		    zc.zc_word[1] != ((uint64_t)d[2] << 32 | d[3]) ||
+		    zc.zc_word[2] != ((uint64_t)d[4] << 32 | d[5]) ||
+		    zc.zc_word[3] != ((uint64_t)d[6] << 32 | d[7]))
+			return (B_FALSE);
+	}
+
+	/*
+	 * Every power of two size up to the largest block, and one byte less
+	 * to exercise the padding, at varying buffer alignments.
+	 */
+	for (size = 1; size <= SPA_OLD_MAXBLOCKSIZE; size <<= 1) {
+		for (j = 0; j <= 1; j++) {
+			sha256_compute(&sha256_scalar_ops, buf + size % 61,
+			    size - j, &zc);
+			sha256_compute(ops, buf + size % 61, size - j, &ref[0]);
+			if (!ZIO_CHECKSUM_EQUAL(zc, ref[0]))
+				return (B_FALSE);
+		}
+	}
+
+	/*
+	 * Batches of every width with mixed sizes, so that lanes run out of
+	 * blocks at different times.
+	 */
+	for (i = 1; i <= SHA256_MB_LANES; i++) {
+		for (j = 0; j < i; j++) {
+			bufs[j] = buf + j * 4096 + j;
+			sizes[j] = (SPA_OLD_MAXBLOCKSIZE >> ((i + j) % 9)) -
+			    (j & 1) * 13;
+			sha256_compute(&sha256_scalar_ops, bufs[j], sizes[j],
+			    &ref[j]);
+		}
+		sha256_compute_multi(ops, bufs, sizes, multi, i);
+		for (j = 0; j < i; j++) {
+			if (!ZIO_CHECKSUM_EQUAL(ref[j], multi[j]))
+				return (B_FALSE);
+		}
+	}
+
+	return (B_TRUE);
+}
+
+/*
+ * Pick the first implementation, in order of preference, which the CPU
+ * supports and which passes the known answer and comparison tests.
+ */
+void
+sha256_init(void)
+{
+	uint8_t *buf;
+	uint64_t x = 0x5a5a5a5a5a5a5a5aULL;
+	int i;
+
+	buf = kmem_alloc(SHA256_TEST_SIZE, KM_SLEEP);
+	for (i = 0; i < SHA256_TEST_SIZE; i++) {
+		x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+		buf[i] = x >> 56;
+	}
+
+	sha256_impl = &sha256_scalar_ops;
+	for (i = 0; i < SHA256_IMPLS; i++) {
+		const sha256_ops_t *ops = sha256_impls[i];
+
+		sha256_impl_ok[i] = B_FALSE;
+		if (!ops->so_valid())
+			continue;
+		if (!sha256_selftest(ops, buf)) {
+			cmn_err(CE_WARN, "sha256: %s implementation "
+			    "failed self-test, disabled", ops->so_name);
+			continue;
+		}
+		sha256_impl_ok[i] = B_TRUE;
+		if (sha256_impl == &sha256_scalar_ops)
+			sha256_impl = ops;
+	}
+
+	kmem_free(buf, SHA256_TEST_SIZE);
+}
+
+void
+sha256_fini(void)
+{
+	sha256_impl = &sha256_scalar_ops;
+}
+
+/*
+ * Select an implementation by name.  Only implementations which passed
+ * the self-test may be selected.
+ */
+int
+sha256_impl_set(const char *name)
+{
+	int i;
+
+	for (i = 0; i < SHA256_IMPLS; i++) {
+		if (strcmp(sha256_impls[i]->so_name, name) != 0)
+			continue;
+		if (!sha256_impl_ok[i] &&
+		    sha256_impls[i] != &sha256_scalar_ops)
+			return (ENOTSUP);
+		sha256_impl = sha256_impls[i];
+		return (0);
+	}
+
+	return (EINVAL);
+}
+
+const char *
+sha256_impl_get(void)
+{
+	return (sha256_impl->so_name);
+}
+
+/*
+ * Whether zio_checksum_SHA256_multi() is worth batching for.
+ */
+boolean_t
+sha256_impl_multi(void)
+{
+	return (sha256_impl->so_multi != NULL);
+}
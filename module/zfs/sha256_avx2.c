@@ -0,0 +1,196 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * AVX2 multi-buffer SHA-256.
+ *
+ * SHA-256 is serial within a buffer, but independent buffers can be
+ * hashed side by side: each 32-bit element of a 256-bit vector carries
+ * one of eight buffers, and the unmodified scalar algorithm is run on
+ * whole vectors.  The state is kept word-major (st[word][lane]) so that
+ * each working variable is a single vector.
+ *
+ * Lanes with fewer blocks drop out as they finish; their slot keeps
+ * hashing a dummy block and its result is ignored.  Once a single lane
+ * is left it is finished with the scalar code.  A single buffer gains
+ * nothing here, so so_block is the scalar code.
+ */
+
+#include <sys/zfs_context.h>
+#include <sys/spa.h>
+#include <sys/sha256.h>
+#include <sys/simd.h>
+
+#if defined(HAVE_SIMD_X86)
+
+typedef uint32_t v8su_t __attribute__((vector_size(32)));
+typedef uint32_t v8su_u_t __attribute__((vector_size(32), aligned(1),
+    may_alias));
+typedef uint32_t u32_u_t __attribute__((aligned(1), may_alias));
+
+#define	AVX2_ATTR	__attribute__((noinline, target("avx2")))
+
+/*
+ * Upper bound on the blocks per lane hashed in one kfpu section, so that
+ * a section covers about one maximum sized block worth of data.
+ */
+#define	SHA256_AVX2_KFPU_BLOCKS	\
+	(SPA_OLD_MAXBLOCKSIZE / SHA256_BLOCK_SIZE / SHA256_MB_LANES)
+
+#define	VROT(x, s)	(((x) >> (s)) | ((x) << (32 - (s))))
+#define	VCH(x, y, z)	((z) ^ ((x) & ((y) ^ (z))))
+#define	VMAJ(x, y, z)	(((x) & (y)) ^ ((z) & ((x) ^ (y))))
+#define	VSIGMA0(x)	(VROT(x, 2) ^ VROT(x, 13) ^ VROT(x, 22))
+#define	VSIGMA1(x)	(VROT(x, 6) ^ VROT(x, 11) ^ VROT(x, 25))
+#define	Vsigma0(x)	(VROT(x, 7) ^ VROT(x, 18) ^ ((x) >> 3))
+#define	Vsigma1(x)	(VROT(x, 17) ^ VROT(x, 19) ^ ((x) >> 10))
+
+#define	BE32(p)		__builtin_bswap32(*(const u32_u_t *)(p))
+
+static void AVX2_ATTR
+sha256_avx2_impl(uint32_t (*st)[SHA256_MB_LANES], const uint8_t **data,
+    const uint64_t *stride, uint64_t nblks)
+{
+	const uint8_t *p[SHA256_MB_LANES];
+	v8su_t a, b, c, d, e, f, g, h, T1, T2, W[16];
+	v8su_t s[8];
+	uint64_t n;
+	int t, l;
+
+	for (l = 0; l < SHA256_MB_LANES; l++)
+		p[l] = data[l];
+
+	a = *(v8su_u_t *)st[0]; b = *(v8su_u_t *)st[1];
+	c = *(v8su_u_t *)st[2]; d = *(v8su_u_t *)st[3];
+	e = *(v8su_u_t *)st[4]; f = *(v8su_u_t *)st[5];
+	g = *(v8su_u_t *)st[6]; h = *(v8su_u_t *)st[7];
+
+	for (n = 0; n < nblks; n++) {
+		s[0] = a; s[1] = b; s[2] = c; s[3] = d;
+		s[4] = e; s[5] = f; s[6] = g; s[7] = h;
+
+		for (t = 0; t < 16; t++) {
+			W[t] = (v8su_t){
+			    BE32(p[0] + 4 * t), BE32(p[1] + 4 * t),
+			    BE32(p[2] + 4 * t), BE32(p[3] + 4 * t),
+			    BE32(p[4] + 4 * t), BE32(p[5] + 4 * t),
+			    BE32(p[6] + 4 * t), BE32(p[7] + 4 * t) };
+		}
+
+		for (t = 0; t < 64; t++) {
+			if (t >= 16) {
+				W[t & 15] += Vsigma1(W[(t - 2) & 15]) +
+				    W[(t - 7) & 15] + Vsigma0(W[(t - 15) & 15]);
+			}
+			T1 = h + VSIGMA1(e) + VCH(e, f, g) + SHA256_K[t] +
+			    W[t & 15];
+			T2 = VSIGMA0(a) + VMAJ(a, b, c);
+			h = g; g = f; f = e; e = d + T1;
+			d = c; c = b; b = a; a = T1 + T2;
+		}
+
+		a += s[0]; b += s[1]; c += s[2]; d += s[3];
+		e += s[4]; f += s[5]; g += s[6]; h += s[7];
+
+		for (l = 0; l < SHA256_MB_LANES; l++)
+			p[l] += stride[l];
+	}
+
+	*(v8su_u_t *)st[0] = a; *(v8su_u_t *)st[1] = b;
+	*(v8su_u_t *)st[2] = c; *(v8su_u_t *)st[3] = d;
+	*(v8su_u_t *)st[4] = e; *(v8su_u_t *)st[5] = f;
+	*(v8su_u_t *)st[6] = g; *(v8su_u_t *)st[7] = h;
+}
+
+static void
+sha256_avx2_multi(uint32_t (*H)[8], const uint8_t **data,
+    const uint64_t *nblks, int n)
+{
+	static const uint8_t dummy[SHA256_BLOCK_SIZE];
+	uint32_t st[8][SHA256_MB_LANES];
+	const uint8_t *p[SHA256_MB_LANES];
+	uint64_t left[SHA256_MB_LANES], stride[SHA256_MB_LANES];
+	uint64_t todo;
+	kfpu_state_t kfpu;
+	int l, w, active, last;
+
+	ASSERT3S(n, <=, SHA256_MB_LANES);
+
+	for (l = 0; l < SHA256_MB_LANES; l++) {
+		p[l] = (l < n) ? data[l] : dummy;
+		left[l] = (l < n) ? nblks[l] : 0;
+		for (w = 0; w < 8; w++)
+			st[w][l] = (l < n) ? H[l][w] : 0;
+	}
+
+	for (;;) {
+		todo = SHA256_AVX2_KFPU_BLOCKS;
+		active = 0;
+		last = 0;
+		for (l = 0; l < SHA256_MB_LANES; l++) {
+			if (left[l] == 0) {
+				stride[l] = 0;
+				p[l] = dummy;
+				continue;
+			}
+			stride[l] = SHA256_BLOCK_SIZE;
+			todo = MIN(todo, left[l]);
+			active++;
+			last = l;
+		}
+
+		if (active == 0)
+			break;
+
+		if (active == 1) {
+			sha256_scalar_block(H[last], p[last], left[last]);
+			break;
+		}
+
+		kfpu_begin(&kfpu);
+		sha256_avx2_impl(st, p, stride, todo);
+		kfpu_end(&kfpu);
+
+		for (l = 0; l < SHA256_MB_LANES; l++) {
+			if (left[l] == 0)
+				continue;
+			for (w = 0; w < 8; w++)
+				H[l][w] = st[w][l];
+			p[l] += todo * SHA256_BLOCK_SIZE;
+			left[l] -= todo;
+		}
+	}
+}
+
+static boolean_t
+sha256_avx2_valid(void)
+{
+	return (zfs_avx2_available());
+}
+
+const sha256_ops_t sha256_avx2_ops = {
+	.so_block = sha256_scalar_block,
+	.so_multi = sha256_avx2_multi,
+	.so_valid = sha256_avx2_valid,
+	.so_name = "avx2"
+};
+
+#endif /* HAVE_SIMD_X86 */
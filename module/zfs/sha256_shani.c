@@ -0,0 +1,140 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * SHA-256 compression function using the x86 SHA extensions.
+ *
+ * sha256rnds2 performs two rounds and expects the working variables split
+ * across two registers as ABEF and CDGH (highest word first), so the state
+ * is shuffled into that form on entry and back on exit.  The message
+ * schedule is computed four words at a time by sha256msg1/sha256msg2.
+ */
+
+#include <sys/zfs_context.h>
+#include <sys/spa.h>
+#include <sys/sha256.h>
+#include <sys/simd.h>
+
+#if defined(HAVE_SIMD_X86)
+
+typedef int v4si_t __attribute__((vector_size(16)));
+typedef int v4si_u_t __attribute__((vector_size(16), aligned(1),
+    may_alias));
+typedef char v16qi_t __attribute__((vector_size(16)));
+
+#define	SHA_ATTR	__attribute__((noinline, target("sha,sse4.1")))
+
+#define	SHUF(x, a, b, c, d)	((v4si_t){ (x)[a], (x)[b], (x)[c], (x)[d] })
+#define	LOADU(p)		(*(const v4si_u_t *)(p))
+#define	STOREU(p, v)		(*(v4si_u_t *)(p) = (v))
+
+static void SHA_ATTR
+sha256_shani_block_impl(uint32_t *H, const uint8_t *data, uint64_t nblks)
+{
+	const v16qi_t bswap = { 3, 2, 1, 0, 7, 6, 5, 4,
+	    11, 10, 9, 8, 15, 14, 13, 12 };
+	v4si_t abef, cdgh, abef_save, cdgh_save, t;
+	v4si_t m0, m1, m2, m3, w, msg;
+	uint64_t n;
+	int i;
+
+	/* {a, b, c, d}, {e, f, g, h} -> {f, e, b, a}, {h, g, d, c} */
+	t = LOADU(&H[0]);
+	cdgh = LOADU(&H[4]);
+	abef = (v4si_t){ cdgh[1], cdgh[0], t[1], t[0] };
+	cdgh = (v4si_t){ cdgh[3], cdgh[2], t[3], t[2] };
+
+	for (n = 0; n < nblks; n++, data += SHA256_BLOCK_SIZE) {
+		abef_save = abef;
+		cdgh_save = cdgh;
+
+		m0 = (v4si_t)__builtin_ia32_pshufb128(
+		    (v16qi_t)LOADU(data), bswap);
+		m1 = (v4si_t)__builtin_ia32_pshufb128(
+		    (v16qi_t)LOADU(data + 16), bswap);
+		m2 = (v4si_t)__builtin_ia32_pshufb128(
+		    (v16qi_t)LOADU(data + 32), bswap);
+		m3 = (v4si_t)__builtin_ia32_pshufb128(
+		    (v16qi_t)LOADU(data + 48), bswap);
+
+		/*
+		 * m0..m3 hold W[4i..4i+15]; each pass consumes m0 and
+		 * computes W[4i+16..4i+19] from the window.
+		 */
+		for (i = 0; i < 16; i++) {
+			msg = m0 + LOADU(&SHA256_K[4 * i]);
+			cdgh = __builtin_ia32_sha256rnds2(cdgh, abef, msg);
+			msg = SHUF(msg, 2, 3, 0, 0);
+			abef = __builtin_ia32_sha256rnds2(abef, cdgh, msg);
+
+			w = __builtin_ia32_sha256msg1(m0, m1) +
+			    (v4si_t){ m2[1], m2[2], m2[3], m3[0] };
+			w = __builtin_ia32_sha256msg2(w, m3);
+			m0 = m1;
+			m1 = m2;
+			m2 = m3;
+			m3 = w;
+		}
+
+		abef += abef_save;
+		cdgh += cdgh_save;
+	}
+
+	STOREU(&H[0], ((v4si_t){ abef[3], abef[2], cdgh[3], cdgh[2] }));
+	STOREU(&H[4], ((v4si_t){ abef[1], abef[0], cdgh[1], cdgh[0] }));
+}
+
+/*
+ * Upper bound on the blocks hashed in one kfpu section, so that a section
+ * covers at most one SPA_OLD_MAXBLOCKSIZE block however large the buffer.
+ */
+#define	SHA256_SHANI_KFPU_BLOCKS	(SPA_OLD_MAXBLOCKSIZE / SHA256_BLOCK_SIZE)
+
+static void
+sha256_shani_block(uint32_t *H, const uint8_t *data, uint64_t nblks)
+{
+	kfpu_state_t kfpu;
+	uint64_t n;
+
+	while (nblks > 0) {
+		n = MIN(nblks, SHA256_SHANI_KFPU_BLOCKS);
+		kfpu_begin(&kfpu);
+		sha256_shani_block_impl(H, data, n);
+		kfpu_end(&kfpu);
+		data += n * SHA256_BLOCK_SIZE;
+		nblks -= n;
+	}
+}
+
+static boolean_t
+sha256_shani_valid(void)
+{
+	return (zfs_shani_available());
+}
+
+const sha256_ops_t sha256_shani_ops = {
+	.so_block = sha256_shani_block,
+	.so_multi = NULL,
+	.so_valid = sha256_shani_valid,
+	.so_name = "shani"
+};
+
+#endif /* HAVE_SIMD_X86 */
@@ -0,0 +1,223 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+#include <sys/zfs_context.h>
+#include <sys/zio.h>
+#include <sys/zio_checksum.h>
+
+/*
+ * Skein-512-256 checksum, as specified in "The Skein Hash Function
+ * Family", version 1.3, available at: http://www.skein-hash.info/
+ *
+ * Skein chains the Threefish-512 block cipher through its UBI mode:
+ * each 64 byte block is encrypted under the previous chaining value
+ * with a tweak holding the byte position and the kind of input, and the
+ * result is xor'ed with the block.  Everything is 64-bit adds, rotates
+ * and xors, which makes it the fastest of the strong checksums on 64-bit
+ * CPUs without SHA extensions.
+ *
+ * The checksum is keyed with the pool's checksum salt (the first UBI
+ * pass absorbs it), so that colliding blocks cannot be prepared without
+ * knowing the salt of the pool they are aimed at.  Like SHA-512/256, the
+ * digest is stored as its bytes in memory order.
+ */
+
+#define	SKEIN_BLOCK_SIZE	64
+#define	SKEIN_WORDS		8
+
+#define	SKEIN_KS_PARITY		0x1bd11bdaa9fc1a22ULL
+#define	SKEIN_SCHEMA_VER	0x0000000133414853ULL	/* "SHA3", v1 */
+
+/* tweak word 1: block type and first/final flags */
+#define	SKEIN_T1_FIRST		(1ULL << 62)
+#define	SKEIN_T1_FINAL		(1ULL << 63)
+#define	SKEIN_T1_KEY		(0ULL << 56)
+#define	SKEIN_T1_CFG		(4ULL << 56)
+#define	SKEIN_T1_MSG		(48ULL << 56)
+#define	SKEIN_T1_OUT		(63ULL << 56)
+
+#define	Rot64(x, s)	(((x) << (s)) | ((x) >> (64 - (s))))
+
+#define	MIX(a, b, r)							\
+	do {								\
+		X##a += X##b;						\
+		X##b = Rot64(X##b, r) ^ X##a;				\
+	} while (0)
+
+/*
+ * Four Threefish-512 rounds.  The word permutation is folded into the
+ * choice of word pairs, so no data moves between rounds.
+ */
+#define	ROUND4(r0, r1, r2, r3, r4, r5, r6, r7,				\
+	    r8, r9, r10, r11, r12, r13, r14, r15)			\
+	do {								\
+		MIX(0, 1, r0);	MIX(2, 3, r1);				\
+		MIX(4, 5, r2);	MIX(6, 7, r3);				\
+		MIX(2, 1, r4);	MIX(4, 7, r5);				\
+		MIX(6, 5, r6);	MIX(0, 3, r7);				\
+		MIX(4, 1, r8);	MIX(6, 3, r9);				\
+		MIX(0, 5, r10);	MIX(2, 7, r11);				\
+		MIX(6, 1, r12);	MIX(0, 7, r13);				\
+		MIX(2, 5, r14);	MIX(4, 3, r15);				\
+	} while (0)
+
+/*
+ * Add subkey s.  s is always a constant, so the key and tweak indexes
+ * are resolved at compile time and the state stays in registers.
+ */
+#define	INJECT(s)							\
+	do {								\
+		X0 += K[((s) + 0) % 9];	X1 += K[((s) + 1) % 9];		\
+		X2 += K[((s) + 2) % 9];	X3 += K[((s) + 3) % 9];		\
+		X4 += K[((s) + 4) % 9];					\
+		X5 += K[((s) + 5) % 9] + T[(s) % 3];			\
+		X6 += K[((s) + 6) % 9] + T[((s) + 1) % 3];		\
+		X7 += K[((s) + 7) % 9] + (s);				\
+	} while (0)
+
+/* Eight rounds followed by subkeys s and s + 1. */
+#define	ROUND8(s)							\
+	do {								\
+		ROUND4(46, 36, 19, 37, 33, 27, 14, 42,			\
+		    17, 49, 36, 39, 44, 9, 54, 56);			\
+		INJECT(s);						\
+		ROUND4(39, 30, 34, 24, 13, 50, 10, 17,			\
+		    25, 29, 39, 43, 8, 35, 56, 22);			\
+		INJECT((s) + 1);					\
+	} while (0)
+
+static uint64_t
+skein_load64(const uint8_t *p)
+{
+	return ((uint64_t)p[0] | (uint64_t)p[1] << 8 |
+	    (uint64_t)p[2] << 16 | (uint64_t)p[3] << 24 |
+	    (uint64_t)p[4] << 32 | (uint64_t)p[5] << 40 |
+	    (uint64_t)p[6] << 48 | (uint64_t)p[7] << 56);
+}
+
+/*
+ * One UBI block: G = Threefish-512(key G, tweak t0/t1, block) ^ block.
+ */
+static void
+skein_ubi_block(uint64_t *G, const uint8_t *blk, uint64_t t0, uint64_t t1)
+{
+	uint64_t K[SKEIN_WORDS + 1], T[3], M[SKEIN_WORDS];
+	uint64_t X0, X1, X2, X3, X4, X5, X6, X7;
+	int i;
+
+	K[SKEIN_WORDS] = SKEIN_KS_PARITY;
+	for (i = 0; i < SKEIN_WORDS; i++) {
+		K[i] = G[i];
+		K[SKEIN_WORDS] ^= G[i];
+		M[i] = skein_load64(blk + i * 8);
+	}
+	T[0] = t0;
+	T[1] = t1;
+	T[2] = t0 ^ t1;
+
+	X0 = M[0]; X1 = M[1]; X2 = M[2]; X3 = M[3];
+	X4 = M[4]; X5 = M[5]; X6 = M[6]; X7 = M[7];
+	INJECT(0);
+
+	ROUND8(1);
+	ROUND8(3);
+	ROUND8(5);
+	ROUND8(7);
+	ROUND8(9);
+	ROUND8(11);
+	ROUND8(13);
+	ROUND8(15);
+	ROUND8(17);
+
+	G[0] = X0 ^ M[0]; G[1] = X1 ^ M[1];
+	G[2] = X2 ^ M[2]; G[3] = X3 ^ M[3];
+	G[4] = X4 ^ M[4]; G[5] = X5 ^ M[5];
+	G[6] = X6 ^ M[6]; G[7] = X7 ^ M[7];
+}
+
+/*
+ * Run UBI over a whole input of the given type.  An empty input is
+ * still one (zero) block.
+ */
+static void
+skein_ubi(uint64_t *G, const uint8_t *buf, uint64_t size, uint64_t type)
+{
+	uint8_t last[SKEIN_BLOCK_SIZE];
+	uint64_t t1 = type | SKEIN_T1_FIRST;
+	uint64_t pos = 0;
+
+	for (; size - pos > SKEIN_BLOCK_SIZE; pos += SKEIN_BLOCK_SIZE) {
+		skein_ubi_block(G, buf + pos, pos + SKEIN_BLOCK_SIZE, t1);
+		t1 = type;
+	}
+
+	bzero(last, sizeof (last));
+	bcopy(buf + pos, last, size - pos);
+	skein_ubi_block(G, last, size, t1 | SKEIN_T1_FINAL);
+}
+
+static void
+zio_checksum_skein(const void *buf, uint64_t size,
+    const zio_cksum_salt_t *salt, zio_cksum_t *zcp)
+{
+	uint64_t G[SKEIN_WORDS];
+	uint8_t cfg[32], out[8];
+	uint8_t *digest = (uint8_t *)zcp;
+	int i;
+
+	bzero(G, sizeof (G));
+	skein_ubi(G, salt->zcs_bytes, sizeof (salt->zcs_bytes), SKEIN_T1_KEY);
+
+	bzero(cfg, sizeof (cfg));
+	for (i = 0; i < 8; i++) {
+		cfg[i] = SKEIN_SCHEMA_VER >> (8 * i);
+		cfg[8 + i] = (uint64_t)(sizeof (zio_cksum_t) * 8) >> (8 * i);
+	}
+	skein_ubi(G, cfg, sizeof (cfg), SKEIN_T1_CFG);
+
+	skein_ubi(G, buf, size, SKEIN_T1_MSG);
+
+	bzero(out, sizeof (out));
+	skein_ubi(G, out, sizeof (out), SKEIN_T1_OUT);
+
+	for (i = 0; i < sizeof (zio_cksum_t); i++)
+		digest[i] = G[i / 8] >> (8 * (i % 8));
+}
+
+void
+zio_checksum_skein_native(const void *buf, uint64_t size,
+    const zio_cksum_salt_t *salt, zio_cksum_t *zcp)
+{
+	zio_checksum_skein(buf, size, salt, zcp);
+}
+
+void
+zio_checksum_skein_byteswap(const void *buf, uint64_t size,
+    const zio_cksum_salt_t *salt, zio_cksum_t *zcp)
+{
+	zio_cksum_t tmp;
+
+	zio_checksum_skein(buf, size, salt, &tmp);
+	zcp->zc_word[0] = BSWAP_64(tmp.zc_word[0]);
+	zcp->zc_word[1] = BSWAP_64(tmp.zc_word[1]);
+	zcp->zc_word[2] = BSWAP_64(tmp.zc_word[2]);
+	zcp->zc_word[3] = BSWAP_64(tmp.zc_word[3]);
+}
@@ -29,11 +29,13 @@
 #include <sys/zio.h>
 #include <sys/zio_checksum.h>
 #include <sys/zio_compress.h>
+#include <sys/sha256.h>
 #include <sys/dmu.h>
 #include <sys/dmu_tx.h>
 #include <sys/zap.h>
 #include <sys/zil.h>
 #include <sys/vdev_impl.h>
+#include <sys/vdev_raidz.h>
 #include <sys/metaslab.h>
 #include <sys/uberblock_impl.h>
 #include <sys/txg.h>
@@ -48,9 +50,11 @@
 #include <sys/metaslab_impl.h>
 #include <sys/arc.h>
 #include <sys/ddt.h>
+#include <sys/zfeature.h>
 #include <sys/stropts.h>
 #include "zfs_prop.h"
 #include "zfeature_common.h"
+#include "zfs_fletcher.h"
 
 /*
  * SPA locking
@@ -467,7 +471,7 @@ spa_add(const char *name, nvlist_t *config, const char *altroot)
 {
 	spa_t *spa;
 	spa_config_dirent_t *dp;
-	int t;
+	int i, t;
 
 	ASSERT(MUTEX_HELD(&spa_namespace_lock));
 
@@ -501,6 +505,9 @@ spa_add(const char *name, nvlist_t *config, const char *altroot)
 
 	spa->spa_deadman_synctime = MSEC2NSEC(zfs_deadman_synctime_ms);
 
+	for (i = 0; i < SPA_FEATURES; i++)
+		spa->spa_feat_refcount_cache[i] = SPA_FEATURE_DISABLED;
+
 	refcount_create(&spa->spa_refcount);
 	spa_config_lock_init(spa);
 	spa_stats_init(spa);
@@ -1505,6 +1512,20 @@ spa_deflate(spa_t *spa)
 	return (spa->spa_deflate);
 }
 
+/*
+ * Return the largest block size the pool can hold: SPA_MAXBLOCKSIZE once
+ * the large_blocks feature is enabled, SPA_OLD_MAXBLOCKSIZE before.
+ */
+uint64_t
+spa_maxblocksize(spa_t *spa)
+{
+	if (spa_feature_is_enabled(spa,
+	    &spa_feature_table[SPA_FEATURE_LARGE_BLOCKS]))
+		return (SPA_MAXBLOCKSIZE);
+	else
+		return (SPA_OLD_MAXBLOCKSIZE);
+}
+
 metaslab_class_t *
 spa_normal_class(spa_t *spa)
 {
@@ -1564,7 +1585,7 @@ bp_get_dsize_sync(spa_t *spa, const blkptr_t *bp)
 	uint64_t dsize = 0;
 	int d;
 
-	for (d = 0; d < SPA_DVAS_PER_BP; d++)
+	for (d = 0; d < BP_GET_NDVAS(bp); d++)
 		dsize += dva_get_dsize_sync(spa, &bp->blk_dva[d]);
 
 	return (dsize);
@@ -1578,7 +1599,7 @@ bp_get_dsize(spa_t *spa, const blkptr_t *bp)
 
 	spa_config_enter(spa, SCL_VDEV, FTAG, RW_READER);
 
-	for (d = 0; d < SPA_DVAS_PER_BP; d++)
+	for (d = 0; d < BP_GET_NDVAS(bp); d++)
 		dsize += dva_get_dsize_sync(spa, &bp->blk_dva[d]);
 
 	spa_config_exit(spa, SCL_VDEV, FTAG);
@@ -1659,6 +1680,10 @@ spa_init(int mode)
 	refcount_init();
 	unique_init();
 	space_map_init();
+	kfpu_init();
+	fletcher_4_init();
+	vdev_raidz_math_init();
+	sha256_init();
 	ddt_init();
 	zio_init();
 	dmu_init();
@@ -1683,6 +1708,9 @@ spa_fini(void)
 	dmu_fini();
 	zio_fini();
 	ddt_fini();
+	sha256_fini();
+	vdev_raidz_math_fini();
+	fletcher_4_fini();
 	space_map_fini();
 	unique_fini();
 	refcount_fini();
@@ -21,6 +21,8 @@
 
 #include <sys/zfs_context.h>
 #include <sys/spa_impl.h>
+#include <sys/arc.h>
+#include <sys/dmu.h>
 
 /*
  * Keeps stats on last N reads per spa_t, disabled by default.
@@ -252,6 +254,7 @@ typedef struct spa_txg_history {
 	uint64_t	writes;		/* number of write operations */
 	uint64_t	ndirty;		/* number of dirty bytes */
 	hrtime_t	times[TXG_STATE_COMMITTED]; /* completion times */
+	uint64_t	sync_times[TXG_SYNC_PHASES]; /* sync phase times */
 	list_node_t	sth_link;
 } spa_txg_history_t;
 
@@ -259,9 +262,11 @@ static int
 spa_txg_history_headers(char *buf, size_t size)
 {
 	size = snprintf(buf, size - 1, "%-8s %-16s %-5s %-12s %-12s %-12s "
-	    "%-8s %-8s %-12s %-12s %-12s %-12s\n", "txg", "birth", "state",
+	    "%-8s %-8s %-12s %-12s %-12s %-12s "
+	    "%-12s %-12s %-12s %-12s %-12s\n", "txg", "birth", "state",
 	    "ndirty", "nread", "nwritten", "reads", "writes",
-	    "otime", "qtime", "wtime", "stime");
+	    "otime", "qtime", "wtime", "stime",
+	    "dstime", "dntime", "uqtime", "mtime", "sttime");
 	buf[size] = '\0';
 
 	return (0);
@@ -301,13 +306,19 @@ spa_txg_history_data(char *buf, size_t size, void *data)
 		    sth->times[TXG_STATE_WAIT_FOR_SYNC];
 
 	size = snprintf(buf, size - 1, "%-8llu %-16llu %-5c %-12llu "
-	    "%-12llu %-12llu %-8llu %-8llu %-12llu %-12llu %-12llu %-12llu\n",
+	    "%-12llu %-12llu %-8llu %-8llu %-12llu %-12llu %-12llu %-12llu "
+	    "%-12llu %-12llu %-12llu %-12llu %-12llu\n",
 	    (longlong_t)sth->txg, sth->times[TXG_STATE_BIRTH], state,
 	    (u_longlong_t)sth->ndirty,
 	    (u_longlong_t)sth->nread, (u_longlong_t)sth->nwritten,
 	    (u_longlong_t)sth->reads, (u_longlong_t)sth->writes,
 	    (u_longlong_t)open, (u_longlong_t)quiesce, (u_longlong_t)wait,
-	    (u_longlong_t)sync);
+	    (u_longlong_t)sync,
+	    (u_longlong_t)sth->sync_times[TXG_SYNC_DATASETS],
+	    (u_longlong_t)sth->sync_times[TXG_SYNC_DNODES],
+	    (u_longlong_t)sth->sync_times[TXG_SYNC_USERQUOTA],
+	    (u_longlong_t)sth->sync_times[TXG_SYNC_MOS],
+	    (u_longlong_t)sth->sync_times[TXG_SYNC_TASKS]);
 	buf[size] = '\0';
 
 	return (0);
@@ -511,6 +522,35 @@ spa_txg_history_set_io(spa_t *spa, uint64_t txg, uint64_t nread,
 	return (error);
 }
 
+/*
+ * Set txg sync phase times.
+ */
+int
+spa_txg_history_set_sync(spa_t *spa, uint64_t txg,
+    const uint64_t *sync_times)
+{
+	spa_stats_history_t *ssh = &spa->spa_stats.txg_history;
+	spa_txg_history_t *sth;
+	int error = ENOENT;
+
+	if (zfs_txg_history == 0)
+		return (0);
+
+	mutex_enter(&ssh->lock);
+	for (sth = list_head(&ssh->list); sth != NULL;
+	    sth = list_next(&ssh->list, sth)) {
+		if (sth->txg == txg) {
+			bcopy(sync_times, sth->sync_times,
+			    sizeof (sth->sync_times));
+			error = 0;
+			break;
+		}
+	}
+	mutex_exit(&ssh->lock);
+
+	return (error);
+}
+
 /*
  * ==========================================================================
  * SPA TX Assign Histogram Routines
@@ -663,6 +703,181 @@ spa_io_history_destroy(spa_t *spa)
 	mutex_destroy(&ssh->lock);
 }
 
+/*
+ * ==========================================================================
+ * SPA ARC Statistics Routines
+ * ==========================================================================
+ */
+
+/*
+ * ARC residency and hits/misses of each objset ("arc_objsets") and each
+ * object type ("arc_types") of the pool.  The rows are folded from the
+ * ARC's per-CPU counters by arc_pool_stats() each time the kstat is read
+ * and kept in ssh->_private until the next read.
+ */
+static int
+spa_arc_stats_headers(char *buf, size_t size, const char *id)
+{
+	size = snprintf(buf, size - 1, "%-24s %-12s %-12s %-12s %-12s "
+	    "%-12s %-12s %-12s\n", id, "size", "dd_hits", "dd_misses",
+	    "dm_hits", "dm_misses", "pf_hits", "pf_misses");
+	buf[size] = '\0';
+
+	return (0);
+}
+
+static int
+spa_arc_objsets_headers(char *buf, size_t size)
+{
+	return (spa_arc_stats_headers(buf, size, "objset"));
+}
+
+static int
+spa_arc_types_headers(char *buf, size_t size)
+{
+	return (spa_arc_stats_headers(buf, size, "type"));
+}
+
+static int
+spa_arc_stats_data(char *buf, size_t size, const char *id,
+    arc_pool_stat_t *aps)
+{
+	size = snprintf(buf, size - 1, "%-24s %-12llu %-12llu %-12llu "
+	    "%-12llu %-12llu %-12llu %-12llu\n", id,
+	    (u_longlong_t)aps->aps_value[ARC_PSTAT_SIZE],
+	    (u_longlong_t)aps->aps_value[ARC_PSTAT_DEMAND_DATA_HITS],
+	    (u_longlong_t)aps->aps_value[ARC_PSTAT_DEMAND_DATA_MISSES],
+	    (u_longlong_t)aps->aps_value[ARC_PSTAT_DEMAND_METADATA_HITS],
+	    (u_longlong_t)aps->aps_value[ARC_PSTAT_DEMAND_METADATA_MISSES],
+	    (u_longlong_t)aps->aps_value[ARC_PSTAT_PREFETCH_HITS],
+	    (u_longlong_t)aps->aps_value[ARC_PSTAT_PREFETCH_MISSES]);
+	buf[size] = '\0';
+
+	return (0);
+}
+
+static int
+spa_arc_objsets_data(char *buf, size_t size, void *data)
+{
+	arc_pool_stat_t *aps = (arc_pool_stat_t *)data;
+	char id[24];
+
+	(void) snprintf(id, sizeof (id), "0x%llx",
+	    (u_longlong_t)aps->aps_id);
+
+	return (spa_arc_stats_data(buf, size, id, aps));
+}
+
+static int
+spa_arc_types_data(char *buf, size_t size, void *data)
+{
+	arc_pool_stat_t *aps = (arc_pool_stat_t *)data;
+	char id[24];
+
+	if (aps->aps_id < DMU_OT_NUMTYPES)
+		(void) strlcpy(id, dmu_ot[aps->aps_id].ot_name, sizeof (id));
+	else
+		(void) snprintf(id, sizeof (id), "0x%llx",
+		    (u_longlong_t)aps->aps_id);
+
+	return (spa_arc_stats_data(buf, size, id, aps));
+}
+
+static spa_stats_history_t *
+spa_arc_stats_ssh(kstat_t *ksp)
+{
+	spa_t *spa = ksp->ks_private;
+
+	if (ksp == spa->spa_stats.arc_types.kstat)
+		return (&spa->spa_stats.arc_types);
+
+	return (&spa->spa_stats.arc_objsets);
+}
+
+static void *
+spa_arc_stats_addr(kstat_t *ksp, off_t n)
+{
+	spa_stats_history_t *ssh = spa_arc_stats_ssh(ksp);
+
+	ASSERT(MUTEX_HELD(&ssh->lock));
+
+	if (n >= ssh->size)
+		return (NULL);
+
+	return ((arc_pool_stat_t *)ssh->_private + n);
+}
+
+/*
+ * Replace the previous snapshot with a fresh one on every read.  The
+ * ssh->lock will be held until ksp->ks_ndata entries are processed.
+ */
+static int
+spa_arc_stats_update(kstat_t *ksp, int rw)
+{
+	spa_t *spa = ksp->ks_private;
+	spa_stats_history_t *ssh = spa_arc_stats_ssh(ksp);
+	arc_pool_stat_t *aps;
+	uint64_t n;
+
+	if (rw == KSTAT_WRITE)
+		return (SET_ERROR(EACCES));
+
+	arc_pool_stats(spa_load_guid(spa),
+	    ssh == &spa->spa_stats.arc_types, &aps, &n);
+
+	if (ssh->_private != NULL)
+		kmem_free(ssh->_private, ssh->size * sizeof (arc_pool_stat_t));
+	ssh->_private = aps;
+	ssh->size = n;
+
+	ksp->ks_ndata = n;
+	ksp->ks_data_size = n * sizeof (arc_pool_stat_t);
+
+	return (0);
+}
+
+static void
+spa_arc_stats_init(spa_t *spa, spa_stats_history_t *ssh, char *kname,
+    int (*headers)(char *, size_t), int (*data)(char *, size_t, void *))
+{
+	char name[KSTAT_STRLEN];
+	kstat_t *ksp;
+
+	mutex_init(&ssh->lock, NULL, MUTEX_DEFAULT, NULL);
+
+	ssh->count = 0;
+	ssh->size = 0;
+	ssh->_private = NULL;
+
+	(void) snprintf(name, KSTAT_STRLEN, "zfs/%s", spa_name(spa));
+	name[KSTAT_STRLEN-1] = '\0';
+
+	ksp = kstat_create(name, 0, kname, "misc",
+	    KSTAT_TYPE_RAW, 0, KSTAT_FLAG_VIRTUAL);
+	ssh->kstat = ksp;
+
+	if (ksp) {
+		ksp->ks_lock = &ssh->lock;
+		ksp->ks_data = NULL;
+		ksp->ks_private = spa;
+		ksp->ks_update = spa_arc_stats_update;
+		kstat_set_raw_ops(ksp, headers, data, spa_arc_stats_addr);
+		kstat_install(ksp);
+	}
+}
+
+static void
+spa_arc_stats_destroy(spa_stats_history_t *ssh)
+{
+	if (ssh->kstat)
+		kstat_delete(ssh->kstat);
+
+	if (ssh->_private != NULL)
+		kmem_free(ssh->_private, ssh->size * sizeof (arc_pool_stat_t));
+
+	mutex_destroy(&ssh->lock);
+}
+
 void
 spa_stats_init(spa_t *spa)
 {
@@ -670,11 +885,17 @@ spa_stats_init(spa_t *spa)
 	spa_txg_history_init(spa);
 	spa_tx_assign_init(spa);
 	spa_io_history_init(spa);
+	spa_arc_stats_init(spa, &spa->spa_stats.arc_objsets, "arc_objsets",
+	    spa_arc_objsets_headers, spa_arc_objsets_data);
+	spa_arc_stats_init(spa, &spa->spa_stats.arc_types, "arc_types",
+	    spa_arc_types_headers, spa_arc_types_data);
 }
 
 void
 spa_stats_destroy(spa_t *spa)
 {
+	spa_arc_stats_destroy(&spa->spa_stats.arc_types);
+	spa_arc_stats_destroy(&spa->spa_stats.arc_objsets);
 	spa_tx_assign_destroy(spa);
 	spa_txg_history_destroy(spa);
 	spa_read_history_destroy(spa);
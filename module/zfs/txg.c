@@ -559,6 +559,7 @@ txg_sync_thread(void *arg)
 		spa_txg_history_set(spa, txg, TXG_STATE_WAIT_FOR_SYNC,
 		    gethrtime());
 		ndirty = dp->dp_dirty_pertxg[txg & TXG_MASK];
+		bzero(dp->dp_sync_times, sizeof (dp->dp_sync_times));
 
 		start = ddi_get_lbolt();
 		spa_sync(spa, txg);
@@ -582,6 +583,7 @@ txg_sync_thread(void *arg)
 		    vs2->vs_ops[ZIO_TYPE_READ]-vs1->vs_ops[ZIO_TYPE_READ],
 		    vs2->vs_ops[ZIO_TYPE_WRITE]-vs1->vs_ops[ZIO_TYPE_WRITE],
 		    ndirty);
+		spa_txg_history_set_sync(spa, txg, dp->dp_sync_times);
 		spa_txg_history_set(spa, txg, TXG_STATE_SYNCED, gethrtime());
 	}
 }
@@ -27,6 +27,7 @@
 #include <sys/zfs_context.h>
 #include <sys/spa.h>
 #include <sys/vdev_impl.h>
+#include <sys/vdev_raidz.h>
 #include <sys/zio.h>
 #include <sys/zio_checksum.h>
 #include <sys/fs/zfs.h>
@@ -99,38 +100,6 @@
  * or in concert to recover missing data columns.
  */
 
-typedef struct raidz_col {
-	uint64_t rc_devidx;		/* child device index for I/O */
-	uint64_t rc_offset;		/* device offset */
-	uint64_t rc_size;		/* I/O size */
-	void *rc_data;			/* I/O data */
-	void *rc_gdata;			/* used to store the "good" version */
-	int rc_error;			/* I/O error for this device */
-	uint8_t rc_tried;		/* Did we attempt this I/O column? */
-	uint8_t rc_skipped;		/* Did we skip this I/O column? */
-} raidz_col_t;
-
-typedef struct raidz_map {
-	uint64_t rm_cols;		/* Regular column count */
-	uint64_t rm_scols;		/* Count including skipped columns */
-	uint64_t rm_bigcols;		/* Number of oversized columns */
-	uint64_t rm_asize;		/* Actual total I/O size */
-	uint64_t rm_missingdata;	/* Count of missing data devices */
-	uint64_t rm_missingparity;	/* Count of missing parity devices */
-	uint64_t rm_firstdatacol;	/* First data column/parity count */
-	uint64_t rm_nskip;		/* Skipped sectors for padding */
-	uint64_t rm_skipstart;		/* Column index of padding start */
-	void *rm_datacopy;		/* rm_asize-buffer of copied data */
-	uintptr_t rm_reports;		/* # of referencing checksum reports */
-	uint8_t	rm_freed;		/* map no longer has referencing ZIO */
-	uint8_t	rm_ecksuminjected;	/* checksum error was injected */
-	raidz_col_t rm_col[1];		/* Flexible array of I/O columns */
-} raidz_map_t;
-
-#define	VDEV_RAIDZ_P		0
-#define	VDEV_RAIDZ_Q		1
-#define	VDEV_RAIDZ_R		2
-
 #define	VDEV_RAIDZ_MUL_2(x)	(((x) << 1) ^ (((x) & 0x80) ? 0x1d : 0))
 #define	VDEV_RAIDZ_MUL_4(x)	(VDEV_RAIDZ_MUL_2(VDEV_RAIDZ_MUL_2(x)))
 
@@ -582,7 +551,7 @@ vdev_raidz_map_alloc(zio_t *zio, uint64_t unit_shift, uint64_t dcols,
 	return (rm);
 }
 
-static void
+void
 vdev_raidz_generate_parity_p(raidz_map_t *rm)
 {
 	uint64_t *p, *src, pcount, ccount, i;
@@ -609,7 +578,7 @@ vdev_raidz_generate_parity_p(raidz_map_t *rm)
 	}
 }
 
-static void
+void
 vdev_raidz_generate_parity_pq(raidz_map_t *rm)
 {
 	uint64_t *p, *q, *src, pcnt, ccnt, mask, i;
@@ -661,7 +630,7 @@ vdev_raidz_generate_parity_pq(raidz_map_t *rm)
 	}
 }
 
-static void
+void
 vdev_raidz_generate_parity_pqr(raidz_map_t *rm)
 {
 	uint64_t *p, *q, *r, *src, pcnt, ccnt, mask, i;
@@ -731,23 +700,83 @@ vdev_raidz_generate_parity(raidz_map_t *rm)
 {
 	switch (rm->rm_firstdatacol) {
 	case 1:
-		vdev_raidz_generate_parity_p(rm);
-		break;
 	case 2:
-		vdev_raidz_generate_parity_pq(rm);
-		break;
 	case 3:
-		vdev_raidz_generate_parity_pqr(rm);
+		vdev_raidz_math_generate(rm, rm->rm_firstdatacol);
 		break;
 	default:
 		cmn_err(CE_PANIC, "invalid RAID-Z configuration");
 	}
 }
 
+/*
+ * Multiply a buffer by a constant in the field and either store the result
+ * in dst or add it to dst.  This is the building block of all of the
+ * reconstruction routines below; vectorized versions are provided by
+ * vdev_raidz_math.c.
+ */
+void
+vdev_raidz_mul_add(void *dst, const void *src, uint64_t size, uint8_t c,
+    boolean_t add)
+{
+	uint8_t *d = dst;
+	const uint8_t *s = src;
+	uint64_t *d64 = dst;
+	const uint64_t *s64 = src;
+	uint64_t i;
+	int log, ll;
+
+	if (c == 0) {
+		if (!add)
+			bzero(dst, size);
+		return;
+	}
+
+	if (c == 1) {
+		ASSERT0(size % sizeof (uint64_t));
+		if (add) {
+			for (i = 0; i < size / sizeof (uint64_t); i++)
+				d64[i] ^= s64[i];
+		} else {
+			bcopy(src, dst, size);
+		}
+		return;
+	}
+
+	log = vdev_raidz_log2[c];
+	for (i = 0; i < size; i++) {
+		uint8_t val = 0;
+
+		if (s[i] != 0) {
+			if ((ll = log + vdev_raidz_log2[s[i]]) >= 255)
+				ll -= 255;
+			val = vdev_raidz_pow2[ll];
+		}
+
+		if (add)
+			d[i] ^= val;
+		else
+			d[i] = val;
+	}
+}
+
+/*
+ * Multiply two elements of the field.
+ */
+uint8_t
+vdev_raidz_gf_mul(uint8_t a, uint8_t b)
+{
+	if (a == 0 || b == 0)
+		return (0);
+
+	return (vdev_raidz_exp2(a, vdev_raidz_log2[b]));
+}
+
 static int
 vdev_raidz_reconstruct_p(raidz_map_t *rm, int *tgts, int ntgts)
 {
-	uint64_t *dst, *src, xcount, ccount, count, i;
+	uint64_t xsize, csize;
+	void *dst;
 	int x = tgts[0];
 	int c;
 
@@ -755,29 +784,24 @@ vdev_raidz_reconstruct_p(raidz_map_t *rm, int *tgts, int ntgts)
 	ASSERT(x >= rm->rm_firstdatacol);
 	ASSERT(x < rm->rm_cols);
 
-	xcount = rm->rm_col[x].rc_size / sizeof (src[0]);
-	ASSERT(xcount <= rm->rm_col[VDEV_RAIDZ_P].rc_size / sizeof (src[0]));
-	ASSERT(xcount > 0);
+	xsize = rm->rm_col[x].rc_size;
+	ASSERT(xsize <= rm->rm_col[VDEV_RAIDZ_P].rc_size);
+	ASSERT(xsize > 0);
 
-	src = rm->rm_col[VDEV_RAIDZ_P].rc_data;
+	/*
+	 * D_x = P + D_0 + ... + D_n-1, excluding D_x itself.
+	 */
 	dst = rm->rm_col[x].rc_data;
-	for (i = 0; i < xcount; i++, dst++, src++) {
-		*dst = *src;
-	}
+	vdev_raidz_math_mul_add(dst, rm->rm_col[VDEV_RAIDZ_P].rc_data, xsize,
+	    1, B_FALSE);
 
 	for (c = rm->rm_firstdatacol; c < rm->rm_cols; c++) {
-		src = rm->rm_col[c].rc_data;
-		dst = rm->rm_col[x].rc_data;
-
 		if (c == x)
 			continue;
 
-		ccount = rm->rm_col[c].rc_size / sizeof (src[0]);
-		count = MIN(ccount, xcount);
-
-		for (i = 0; i < count; i++, dst++, src++) {
-			*dst ^= *src;
-		}
+		csize = MIN(rm->rm_col[c].rc_size, xsize);
+		vdev_raidz_math_mul_add(dst, rm->rm_col[c].rc_data, csize,
+		    1, B_TRUE);
 	}
 
 	return (1 << VDEV_RAIDZ_P);
@@ -786,56 +810,42 @@ vdev_raidz_reconstruct_p(raidz_map_t *rm, int *tgts, int ntgts)
 static int
 vdev_raidz_reconstruct_q(raidz_map_t *rm, int *tgts, int ntgts)
 {
-	uint64_t *dst, *src, xcount, ccount, count, mask, i;
-	uint8_t *b;
+	uint64_t xsize, csize;
+	void *dst;
 	int x = tgts[0];
-	int c, j, exp;
+	int c, exp, e;
 
 	ASSERT(ntgts == 1);
 
-	xcount = rm->rm_col[x].rc_size / sizeof (src[0]);
-	ASSERT(xcount <= rm->rm_col[VDEV_RAIDZ_Q].rc_size / sizeof (src[0]));
+	xsize = rm->rm_col[x].rc_size;
+	ASSERT(xsize <= rm->rm_col[VDEV_RAIDZ_Q].rc_size);
 
-	for (c = rm->rm_firstdatacol; c < rm->rm_cols; c++) {
-		src = rm->rm_col[c].rc_data;
-		dst = rm->rm_col[x].rc_data;
+	/*
+	 * Q = 2^(n-1-c) * D_c summed over all data columns c, with short
+	 * columns treated as zero padded, so
+	 *
+	 *	D_x = 2^-(n-1-x) * (Q + sum(2^(n-1-c) * D_c, c != x))
+	 *
+	 * Distributing the leading factor gives one multiplier per column,
+	 * so D_x is built as a weighted sum over Q and the surviving data
+	 * columns in a single pass each.
+	 */
+	exp = 255 - (rm->rm_cols - 1 - x);
+	dst = rm->rm_col[x].rc_data;
+	vdev_raidz_math_mul_add(dst, rm->rm_col[VDEV_RAIDZ_Q].rc_data, xsize,
+	    vdev_raidz_pow2[exp], B_FALSE);
 
+	for (c = rm->rm_firstdatacol; c < rm->rm_cols; c++) {
 		if (c == x)
-			ccount = 0;
-		else
-			ccount = rm->rm_col[c].rc_size / sizeof (src[0]);
-
-		count = MIN(ccount, xcount);
-
-		if (c == rm->rm_firstdatacol) {
-			for (i = 0; i < count; i++, dst++, src++) {
-				*dst = *src;
-			}
-			for (; i < xcount; i++, dst++) {
-				*dst = 0;
-			}
-
-		} else {
-			for (i = 0; i < count; i++, dst++, src++) {
-				VDEV_RAIDZ_64MUL_2(*dst, mask);
-				*dst ^= *src;
-			}
+			continue;
 
-			for (; i < xcount; i++, dst++) {
-				VDEV_RAIDZ_64MUL_2(*dst, mask);
-			}
-		}
-	}
+		e = exp + (rm->rm_cols - 1 - c);
+		if (e >= 255)
+			e -= 255;
 
-	src = rm->rm_col[VDEV_RAIDZ_Q].rc_data;
-	dst = rm->rm_col[x].rc_data;
-	exp = 255 - (rm->rm_cols - 1 - x);
-
-	for (i = 0; i < xcount; i++, dst++, src++) {
-		*dst ^= *src;
-		for (j = 0, b = (uint8_t *)dst; j < 8; j++, b++) {
-			*b = vdev_raidz_exp2(*b, exp);
-		}
+		csize = MIN(rm->rm_col[c].rc_size, xsize);
+		vdev_raidz_math_mul_add(dst, rm->rm_col[c].rc_data, csize,
+		    vdev_raidz_pow2[e], B_TRUE);
 	}
 
 	return (1 << VDEV_RAIDZ_Q);
@@ -844,11 +854,12 @@ vdev_raidz_reconstruct_q(raidz_map_t *rm, int *tgts, int ntgts)
 static int
 vdev_raidz_reconstruct_pq(raidz_map_t *rm, int *tgts, int ntgts)
 {
-	uint8_t *p, *q, *pxy, *qxy, *xd, *yd, tmp, a, b, aexp, bexp;
-	void *pdata, *qdata;
-	uint64_t xsize, ysize, i;
+	uint8_t tmp, a, b, amul, bmul, coeff;
+	void *pdata, *qdata, *xd, *yd;
+	uint64_t xsize, ysize, csize;
 	int x = tgts[0];
 	int y = tgts[1];
+	int c;
 
 	ASSERT(ntgts == 2);
 	ASSERT(x < y);
@@ -857,39 +868,16 @@ vdev_raidz_reconstruct_pq(raidz_map_t *rm, int *tgts, int ntgts)
 
 	ASSERT(rm->rm_col[x].rc_size >= rm->rm_col[y].rc_size);
 
-	/*
-	 * Move the parity data aside -- we're going to compute parity as
-	 * though columns x and y were full of zeros -- Pxy and Qxy. We want to
-	 * reuse the parity generation mechanism without trashing the actual
-	 * parity so we make those columns appear to be full of zeros by
-	 * setting their lengths to zero.
-	 */
 	pdata = rm->rm_col[VDEV_RAIDZ_P].rc_data;
 	qdata = rm->rm_col[VDEV_RAIDZ_Q].rc_data;
 	xsize = rm->rm_col[x].rc_size;
 	ysize = rm->rm_col[y].rc_size;
-
-	rm->rm_col[VDEV_RAIDZ_P].rc_data =
-	    zio_buf_alloc(rm->rm_col[VDEV_RAIDZ_P].rc_size);
-	rm->rm_col[VDEV_RAIDZ_Q].rc_data =
-	    zio_buf_alloc(rm->rm_col[VDEV_RAIDZ_Q].rc_size);
-	rm->rm_col[x].rc_size = 0;
-	rm->rm_col[y].rc_size = 0;
-
-	vdev_raidz_generate_parity_pq(rm);
-
-	rm->rm_col[x].rc_size = xsize;
-	rm->rm_col[y].rc_size = ysize;
-
-	p = pdata;
-	q = qdata;
-	pxy = rm->rm_col[VDEV_RAIDZ_P].rc_data;
-	qxy = rm->rm_col[VDEV_RAIDZ_Q].rc_data;
 	xd = rm->rm_col[x].rc_data;
 	yd = rm->rm_col[y].rc_data;
 
 	/*
-	 * We now have:
+	 * Let Pxy and Qxy be the parity computed as though columns x and y
+	 * were full of zeros:
 	 *	Pxy = P + D_x + D_y
 	 *	Qxy = Q + 2^(ndevs - 1 - x) * D_x + 2^(ndevs - 1 - y) * D_y
 	 *
@@ -901,33 +889,37 @@ vdev_raidz_reconstruct_pq(raidz_map_t *rm, int *tgts, int ntgts)
 	 *
 	 * With D_x in hand, we can easily solve for D_y:
 	 *	D_y = P + Pxy + D_x
+	 *
+	 * Rather than materializing Pxy and Qxy, expand them over the
+	 * surviving data columns: each column c contributes
+	 * (A + B * 2^(ndevs - 1 - c)) * D_c to D_x and D_c to D_y.
 	 */
-
 	a = vdev_raidz_pow2[255 + x - y];
 	b = vdev_raidz_pow2[255 - (rm->rm_cols - 1 - x)];
 	tmp = 255 - vdev_raidz_log2[a ^ 1];
 
-	aexp = vdev_raidz_log2[vdev_raidz_exp2(a, tmp)];
-	bexp = vdev_raidz_log2[vdev_raidz_exp2(b, tmp)];
+	amul = vdev_raidz_exp2(a, tmp);
+	bmul = vdev_raidz_exp2(b, tmp);
 
-	for (i = 0; i < xsize; i++, p++, q++, pxy++, qxy++, xd++, yd++) {
-		*xd = vdev_raidz_exp2(*p ^ *pxy, aexp) ^
-		    vdev_raidz_exp2(*q ^ *qxy, bexp);
+	vdev_raidz_math_mul_add(xd, pdata, xsize, amul, B_FALSE);
+	vdev_raidz_math_mul_add(xd, qdata, xsize, bmul, B_TRUE);
+	vdev_raidz_math_mul_add(yd, pdata, ysize, 1, B_FALSE);
 
-		if (i < ysize)
-			*yd = *p ^ *pxy ^ *xd;
-	}
+	for (c = rm->rm_firstdatacol; c < rm->rm_cols; c++) {
+		if (c == x || c == y)
+			continue;
 
-	zio_buf_free(rm->rm_col[VDEV_RAIDZ_P].rc_data,
-	    rm->rm_col[VDEV_RAIDZ_P].rc_size);
-	zio_buf_free(rm->rm_col[VDEV_RAIDZ_Q].rc_data,
-	    rm->rm_col[VDEV_RAIDZ_Q].rc_size);
+		coeff = amul ^ vdev_raidz_exp2(bmul, rm->rm_cols - 1 - c);
+		csize = MIN(rm->rm_col[c].rc_size, xsize);
+		vdev_raidz_math_mul_add(xd, rm->rm_col[c].rc_data, csize,
+		    coeff, B_TRUE);
 
-	/*
-	 * Restore the saved parity data.
-	 */
-	rm->rm_col[VDEV_RAIDZ_P].rc_data = pdata;
-	rm->rm_col[VDEV_RAIDZ_Q].rc_data = qdata;
+		csize = MIN(rm->rm_col[c].rc_size, ysize);
+		vdev_raidz_math_mul_add(yd, rm->rm_col[c].rc_data, csize,
+		    1, B_TRUE);
+	}
+
+	vdev_raidz_math_mul_add(yd, xd, ysize, 1, B_TRUE);
 
 	return ((1 << VDEV_RAIDZ_P) | (1 << VDEV_RAIDZ_Q));
 }
@@ -1214,76 +1206,36 @@ static void
 vdev_raidz_matrix_reconstruct(raidz_map_t *rm, int n, int nmissing,
     int *missing, uint8_t **invrows, const uint8_t *used)
 {
-	int i, j, x, cc, c;
-	uint8_t *src;
-	uint64_t ccount;
-	uint8_t *dst[VDEV_RAIDZ_MAXPARITY];
-	uint64_t dcount[VDEV_RAIDZ_MAXPARITY];
-	uint8_t log = 0;
-	uint8_t val;
-	int ll;
-	uint8_t *invlog[VDEV_RAIDZ_MAXPARITY];
-	uint8_t *p, *pp;
-	size_t psize;
-
-	psize = sizeof (invlog[0][0]) * n * nmissing;
-	p = kmem_alloc(psize, KM_PUSHPAGE);
-
-	for (pp = p, i = 0; i < nmissing; i++) {
-		invlog[i] = pp;
-		pp += n;
-	}
-
-	for (i = 0; i < nmissing; i++) {
-		for (j = 0; j < n; j++) {
-			ASSERT3U(invrows[i][j], !=, 0);
-			invlog[i][j] = vdev_raidz_log2[invrows[i][j]];
-		}
-	}
+	int i, j, cc, c;
+	void *src;
+	uint64_t ccount, dcount;
 
+	/*
+	 * Each missing column is the dot product of its row of the inverse
+	 * matrix with the surviving columns, accumulated one column at a
+	 * time.
+	 */
 	for (i = 0; i < n; i++) {
 		c = used[i];
 		ASSERT3U(c, <, rm->rm_cols);
 
 		src = rm->rm_col[c].rc_data;
 		ccount = rm->rm_col[c].rc_size;
+
+		ASSERT(ccount >= rm->rm_col[missing[0]].rc_size || i > 0);
+
 		for (j = 0; j < nmissing; j++) {
 			cc = missing[j] + rm->rm_firstdatacol;
 			ASSERT3U(cc, >=, rm->rm_firstdatacol);
 			ASSERT3U(cc, <, rm->rm_cols);
 			ASSERT3U(cc, !=, c);
+			ASSERT3U(invrows[j][i], !=, 0);
 
-			dst[j] = rm->rm_col[cc].rc_data;
-			dcount[j] = rm->rm_col[cc].rc_size;
-		}
-
-		ASSERT(ccount >= rm->rm_col[missing[0]].rc_size || i > 0);
-
-		for (x = 0; x < ccount; x++, src++) {
-			if (*src != 0)
-				log = vdev_raidz_log2[*src];
-
-			for (cc = 0; cc < nmissing; cc++) {
-				if (x >= dcount[cc])
-					continue;
-
-				if (*src == 0) {
-					val = 0;
-				} else {
-					if ((ll = log + invlog[cc][i]) >= 255)
-						ll -= 255;
-					val = vdev_raidz_pow2[ll];
-				}
-
-				if (i == 0)
-					dst[cc][x] = val;
-				else
-					dst[cc][x] ^= val;
-			}
+			dcount = rm->rm_col[cc].rc_size;
+			vdev_raidz_math_mul_add(rm->rm_col[cc].rc_data, src,
+			    MIN(ccount, dcount), invrows[j][i], i != 0);
 		}
 	}
-
-	kmem_free(p, psize);
 }
 
 static int
@@ -1392,7 +1344,7 @@ vdev_raidz_reconstruct_general(raidz_map_t *rm, int *tgts, int ntgts)
 	return (code);
 }
 
-static int
+int
 vdev_raidz_reconstruct(raidz_map_t *rm, int *t, int nt)
 {
 	int tgts[VDEV_RAIDZ_MAXPARITY], *dt;
@@ -0,0 +1,302 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+#include <sys/zfs_context.h>
+#include <sys/spa.h>
+#include <sys/vdev_raidz.h>
+
+/*
+ * Selection of the RAID-Z math implementation.
+ *
+ * All implementations are checked against the scalar reference code in
+ * vdev_raidz.c at vdev_raidz_math_init() time, on a set of pseudo-random
+ * maps laid out the same way vdev_raidz_map_alloc() lays out real I/O:
+ * varying parity, column count and block size, with and without short
+ * columns.  The multiply-add primitive used for reconstruction is checked
+ * with every coefficient.  An implementation which produces a different
+ * result for any of them is never used.
+ */
+
+const raidz_math_ops_t vdev_raidz_scalar_ops = {
+	.rmo_gen = {
+		vdev_raidz_generate_parity_p,
+		vdev_raidz_generate_parity_pq,
+		vdev_raidz_generate_parity_pqr
+	},
+	.rmo_mul_add = vdev_raidz_mul_add,
+	.rmo_valid = NULL,
+	.rmo_name = "scalar"
+};
+
+/* In order of preference. */
+static const raidz_math_ops_t *vdev_raidz_impls[] = {
+#if defined(HAVE_SIMD_X86)
+	&vdev_raidz_avx2_ops,
+	&vdev_raidz_ssse3_ops,
+	&vdev_raidz_sse2_ops,
+#endif
+	&vdev_raidz_scalar_ops,
+};
+
+#define	RAIDZ_IMPLS	(sizeof (vdev_raidz_impls) / sizeof (vdev_raidz_impls[0]))
+
+static const raidz_math_ops_t *vdev_raidz_math_ops = &vdev_raidz_scalar_ops;
+static boolean_t vdev_raidz_impl_ok[RAIDZ_IMPLS];
+
+#define	RAIDZ_TEST_MAPS		100
+#define	RAIDZ_TEST_MAXCOLS	20
+#define	RAIDZ_TEST_MAXSECTORS	\
+	(SPA_OLD_MAXBLOCKSIZE >> SPA_MINBLOCKSHIFT)
+
+void
+vdev_raidz_math_generate(raidz_map_t *rm, int nparity)
+{
+	ASSERT3S(nparity, >=, 1);
+	ASSERT3S(nparity, <=, rm->rm_firstdatacol);
+
+	vdev_raidz_math_ops->rmo_gen[nparity - 1](rm);
+}
+
+void
+vdev_raidz_math_mul_add(void *dst, const void *src, uint64_t size,
+    uint8_t c, boolean_t add)
+{
+	if (size == 0)
+		return;
+
+	vdev_raidz_math_ops->rmo_mul_add(dst, src, size, c, add);
+}
+
+static uint64_t
+vdev_raidz_test_rand(uint64_t *seed)
+{
+	*seed = *seed * 6364136223846793005ULL + 1442695040888963407ULL;
+	return (*seed >> 33);
+}
+
+/*
+ * Build a map for an s sector block the same way vdev_raidz_map_alloc()
+ * would, filling the data columns with pseudo-random bytes.  Used by the
+ * self-test and by benchmarks.
+ */
+raidz_map_t *
+vdev_raidz_math_map_alloc(uint64_t dcols, uint64_t nparity, uint64_t s,
+    uint64_t *seed)
+{
+	raidz_map_t *rm;
+	uint64_t q, r, bc, acols, c, i;
+	uint64_t *data;
+
+	q = s / (dcols - nparity);
+	r = s - q * (dcols - nparity);
+	bc = (r == 0 ? 0 : r + nparity);
+	acols = (q == 0 ? bc : dcols);
+
+	rm = kmem_zalloc(offsetof(raidz_map_t, rm_col[acols]), KM_SLEEP);
+	rm->rm_cols = acols;
+	rm->rm_scols = acols;
+	rm->rm_bigcols = bc;
+	rm->rm_firstdatacol = nparity;
+
+	for (c = 0; c < acols; c++) {
+		raidz_col_t *rc = &rm->rm_col[c];
+
+		rc->rc_size = (c < bc ? q + 1 : q) << SPA_MINBLOCKSHIFT;
+		rc->rc_data = kmem_alloc(rc->rc_size, KM_SLEEP);
+		if (c < nparity)
+			continue;
+		data = rc->rc_data;
+		for (i = 0; i < rc->rc_size / sizeof (uint64_t); i++)
+			data[i] = vdev_raidz_test_rand(seed) << 32 |
+			    vdev_raidz_test_rand(seed);
+	}
+
+	return (rm);
+}
+
+void
+vdev_raidz_math_map_free(raidz_map_t *rm)
+{
+	uint64_t c;
+
+	for (c = 0; c < rm->rm_cols; c++)
+		kmem_free(rm->rm_col[c].rc_data, rm->rm_col[c].rc_size);
+	kmem_free(rm, offsetof(raidz_map_t, rm_col[rm->rm_cols]));
+}
+
+/*
+ * Generate the first nparity parity columns with both the reference and
+ * the tested implementation and compare the results.
+ */
+static boolean_t
+vdev_raidz_test_gen(const raidz_math_ops_t *ops, raidz_map_t *rm, int nparity)
+{
+	void *ref[VDEV_RAIDZ_MAXPARITY];
+	boolean_t ok = B_TRUE;
+	int c;
+
+	vdev_raidz_scalar_ops.rmo_gen[nparity - 1](rm);
+	for (c = 0; c < nparity; c++) {
+		ref[c] = kmem_alloc(rm->rm_col[c].rc_size, KM_SLEEP);
+		bcopy(rm->rm_col[c].rc_data, ref[c], rm->rm_col[c].rc_size);
+		bzero(rm->rm_col[c].rc_data, rm->rm_col[c].rc_size);
+	}
+
+	ops->rmo_gen[nparity - 1](rm);
+	for (c = 0; c < nparity; c++) {
+		if (bcmp(rm->rm_col[c].rc_data, ref[c],
+		    rm->rm_col[c].rc_size) != 0)
+			ok = B_FALSE;
+		kmem_free(ref[c], rm->rm_col[c].rc_size);
+	}
+
+	return (ok);
+}
+
+/*
+ * Check the multiply-add primitive for every coefficient, both storing and
+ * accumulating, against the reference.
+ */
+static boolean_t
+vdev_raidz_test_mul_add(const raidz_math_ops_t *ops, uint64_t *seed)
+{
+	uint64_t size = SPA_MINBLOCKSIZE * 4;
+	uint8_t *src, *ref, *dst;
+	boolean_t ok = B_TRUE;
+	uint64_t i;
+	int c, add;
+
+	src = kmem_alloc(size, KM_SLEEP);
+	ref = kmem_alloc(size, KM_SLEEP);
+	dst = kmem_alloc(size, KM_SLEEP);
+
+	for (i = 0; i < size; i++)
+		src[i] = vdev_raidz_test_rand(seed);
+	/* make sure the extreme byte values are all covered */
+	src[0] = 0x00;
+	src[1] = 0x01;
+	src[2] = 0x80;
+	src[3] = 0xff;
+
+	for (c = 0; c < 256 && ok; c++) {
+		for (add = 0; add <= 1 && ok; add++) {
+			for (i = 0; i < size; i++)
+				ref[i] = dst[i] = vdev_raidz_test_rand(seed);
+			vdev_raidz_mul_add(ref, src, size, c, add);
+			ops->rmo_mul_add(dst, src, size, c, add);
+			ok = (bcmp(ref, dst, size) == 0);
+		}
+	}
+
+	kmem_free(src, size);
+	kmem_free(ref, size);
+	kmem_free(dst, size);
+
+	return (ok);
+}
+
+static boolean_t
+vdev_raidz_math_selftest(const raidz_math_ops_t *ops)
+{
+	uint64_t seed = 0x5a5a5a5a5a5a5a5aULL;
+	uint64_t dcols, nparity, s;
+	raidz_map_t *rm;
+	boolean_t ok;
+	int i, n;
+
+	ok = vdev_raidz_test_mul_add(ops, &seed);
+
+	for (i = 0; i < RAIDZ_TEST_MAPS && ok; i++) {
+		nparity = 1 + vdev_raidz_test_rand(&seed) % VDEV_RAIDZ_MAXPARITY;
+		dcols = nparity + 1 + vdev_raidz_test_rand(&seed) %
+		    (RAIDZ_TEST_MAXCOLS - nparity);
+		s = 1 + vdev_raidz_test_rand(&seed) % RAIDZ_TEST_MAXSECTORS;
+
+		rm = vdev_raidz_math_map_alloc(dcols, nparity, s, &seed);
+
+		for (n = 1; n <= nparity && ok; n++)
+			ok = vdev_raidz_test_gen(ops, rm, n);
+
+		vdev_raidz_math_map_free(rm);
+	}
+
+	return (ok);
+}
+
+void
+vdev_raidz_math_init(void)
+{
+	int i;
+
+	vdev_raidz_math_ops = &vdev_raidz_scalar_ops;
+	for (i = 0; i < RAIDZ_IMPLS; i++) {
+		const raidz_math_ops_t *ops = vdev_raidz_impls[i];
+
+		vdev_raidz_impl_ok[i] = B_FALSE;
+		if (ops == &vdev_raidz_scalar_ops) {
+			vdev_raidz_impl_ok[i] = B_TRUE;
+			continue;
+		}
+		if (!ops->rmo_valid())
+			continue;
+		if (!vdev_raidz_math_selftest(ops)) {
+			cmn_err(CE_WARN, "raidz: %s implementation failed "
+			    "self-test, disabled", ops->rmo_name);
+			continue;
+		}
+		vdev_raidz_impl_ok[i] = B_TRUE;
+		if (vdev_raidz_math_ops == &vdev_raidz_scalar_ops)
+			vdev_raidz_math_ops = ops;
+	}
+}
+
+void
+vdev_raidz_math_fini(void)
+{
+	vdev_raidz_math_ops = &vdev_raidz_scalar_ops;
+}
+
+/*
+ * Select an implementation by name.  Only implementations which passed
+ * the self-test in vdev_raidz_math_init() can be selected.
+ */
+int
+vdev_raidz_impl_set(const char *name)
+{
+	int i;
+
+	for (i = 0; i < RAIDZ_IMPLS; i++) {
+		if (strcmp(vdev_raidz_impls[i]->rmo_name, name) != 0)
+			continue;
+		if (!vdev_raidz_impl_ok[i])
+			return (ENOTSUP);
+		vdev_raidz_math_ops = vdev_raidz_impls[i];
+		return (0);
+	}
+
+	return (EINVAL);
+}
+
+const char *
+vdev_raidz_impl_get(void)
+{
+	return (vdev_raidz_math_ops->rmo_name);
+}
@@ -0,0 +1,352 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+#ifndef _VDEV_RAIDZ_MATH_IMPL_H
+#define	_VDEV_RAIDZ_MATH_IMPL_H
+
+/*
+ * Template for the vectorized RAID-Z routines.  The including file
+ * defines:
+ *
+ *	RAIDZ_VEC_SIZE	vector width in bytes
+ *	RAIDZ_TARGET	target attribute string for the vector code
+ *	RAIDZ_FN(x)	name mangling for the generated functions
+ *	RAIDZ_SHUFFLE	(optional) the target has a byte shuffle (pshufb)
+ *
+ * and gets raidz_gen_func_t entry points RAIDZ_FN(gen_p), RAIDZ_FN(gen_pq)
+ * and RAIDZ_FN(gen_pqr) and the raidz_mul_func_t RAIDZ_FN(mul_add), all of
+ * which bracket the vector code with kfpu_begin() and kfpu_end().  Parity
+ * is generated a range of offsets at a time, all columns being done for
+ * one range before moving on to the next, so that no kfpu section covers
+ * more than about RAIDZ_KFPU_SIZE bytes of data.  mul_add() likewise
+ * splits the columns it is given into RAIDZ_KFPU_SIZE pieces.
+ *
+ * The code is written with the compiler's generic vector extensions.
+ * Multiplication by 2 in GF(2^8) is done on all bytes of a vector at once:
+ * shift left by one (x + x) and XOR in 0x1d wherever the top bit was set,
+ * which a signed compare against zero turns into a byte mask.
+ *
+ * Multiplication by an arbitrary constant c, used for reconstruction, is
+ * done with a pair of 16 entry tables when the target can shuffle bytes:
+ * c * x = c * (x & 0x0f) + c * (x & 0xf0), each half being a table lookup
+ * done for a whole vector by a single pshufb.  Without a shuffle, the
+ * product is accumulated from the set bits of c with repeated doubling.
+ */
+
+typedef uint8_t v_t __attribute__((vector_size(RAIDZ_VEC_SIZE)));
+typedef int8_t vs_t __attribute__((vector_size(RAIDZ_VEC_SIZE)));
+typedef uint8_t vu_t __attribute__((vector_size(RAIDZ_VEC_SIZE), aligned(1),
+    may_alias));
+
+#define	RAIDZ_ATTR	__attribute__((noinline, target(RAIDZ_TARGET)))
+#define	RAIDZ_INLINE	\
+	static inline __attribute__((always_inline, target(RAIDZ_TARGET)))
+
+#define	VLOAD(p)	(*(const vu_t *)(p))
+#define	VSTORE(p, v)	(*(vu_t *)(p) = (v))
+
+#define	RAIDZ_KFPU_SIZE	SPA_OLD_MAXBLOCKSIZE
+
+RAIDZ_INLINE v_t
+RAIDZ_FN(mul2)(v_t x)
+{
+	const vs_t zero = { 0 };
+	const v_t poly = (v_t){ 0 } + 0x1d;
+
+	return ((x + x) ^ ((v_t)((vs_t)x < zero) & poly));
+}
+
+RAIDZ_INLINE v_t
+RAIDZ_FN(mul4)(v_t x)
+{
+	return (RAIDZ_FN(mul2)(RAIDZ_FN(mul2)(x)));
+}
+
+/*
+ * The gen_*_impl() routines generate the parity bytes [off, end) of the
+ * map.
+ */
+static void RAIDZ_ATTR
+RAIDZ_FN(gen_p_impl)(raidz_map_t *rm, uint64_t off, uint64_t end)
+{
+	uint8_t *p = rm->rm_col[VDEV_RAIDZ_P].rc_data;
+	uint64_t psize = rm->rm_col[VDEV_RAIDZ_P].rc_size;
+	uint64_t csize, i;
+	const uint8_t *src;
+	int c;
+
+	for (c = rm->rm_firstdatacol; c < rm->rm_cols; c++) {
+		src = rm->rm_col[c].rc_data;
+		csize = rm->rm_col[c].rc_size;
+
+		if (c == rm->rm_firstdatacol) {
+			ASSERT(csize == psize);
+			for (i = off; i < end; i += RAIDZ_VEC_SIZE)
+				VSTORE(p + i, VLOAD(src + i));
+		} else {
+			ASSERT(csize <= psize);
+			csize = MIN(csize, end);
+			for (i = off; i < csize; i += RAIDZ_VEC_SIZE)
+				VSTORE(p + i, VLOAD(p + i) ^ VLOAD(src + i));
+		}
+	}
+}
+
+static void RAIDZ_ATTR
+RAIDZ_FN(gen_pq_impl)(raidz_map_t *rm, uint64_t off, uint64_t end)
+{
+	uint8_t *p = rm->rm_col[VDEV_RAIDZ_P].rc_data;
+	uint8_t *q = rm->rm_col[VDEV_RAIDZ_Q].rc_data;
+	uint64_t psize = rm->rm_col[VDEV_RAIDZ_P].rc_size;
+	uint64_t csize, i;
+	const uint8_t *src;
+	const v_t zero = { 0 };
+	v_t d;
+	int c;
+
+	ASSERT(rm->rm_col[VDEV_RAIDZ_Q].rc_size == psize);
+
+	for (c = rm->rm_firstdatacol; c < rm->rm_cols; c++) {
+		src = rm->rm_col[c].rc_data;
+		csize = rm->rm_col[c].rc_size;
+
+		if (c == rm->rm_firstdatacol) {
+			ASSERT(csize == psize || csize == 0);
+			csize = MIN(csize, end);
+			for (i = off; i < csize; i += RAIDZ_VEC_SIZE) {
+				d = VLOAD(src + i);
+				VSTORE(p + i, d);
+				VSTORE(q + i, d);
+			}
+			for (; i < end; i += RAIDZ_VEC_SIZE) {
+				VSTORE(p + i, zero);
+				VSTORE(q + i, zero);
+			}
+		} else {
+			ASSERT(csize <= psize);
+			csize = MIN(csize, end);
+			for (i = off; i < csize; i += RAIDZ_VEC_SIZE) {
+				d = VLOAD(src + i);
+				VSTORE(p + i, VLOAD(p + i) ^ d);
+				VSTORE(q + i, RAIDZ_FN(mul2)(VLOAD(q + i)) ^ d);
+			}
+			/* short columns are treated as zero padded */
+			for (; i < end; i += RAIDZ_VEC_SIZE)
+				VSTORE(q + i, RAIDZ_FN(mul2)(VLOAD(q + i)));
+		}
+	}
+}
+
+static void RAIDZ_ATTR
+RAIDZ_FN(gen_pqr_impl)(raidz_map_t *rm, uint64_t off, uint64_t end)
+{
+	uint8_t *p = rm->rm_col[VDEV_RAIDZ_P].rc_data;
+	uint8_t *q = rm->rm_col[VDEV_RAIDZ_Q].rc_data;
+	uint8_t *r = rm->rm_col[VDEV_RAIDZ_R].rc_data;
+	uint64_t psize = rm->rm_col[VDEV_RAIDZ_P].rc_size;
+	uint64_t csize, i;
+	const uint8_t *src;
+	const v_t zero = { 0 };
+	v_t d;
+	int c;
+
+	ASSERT(rm->rm_col[VDEV_RAIDZ_Q].rc_size == psize);
+	ASSERT(rm->rm_col[VDEV_RAIDZ_R].rc_size == psize);
+
+	for (c = rm->rm_firstdatacol; c < rm->rm_cols; c++) {
+		src = rm->rm_col[c].rc_data;
+		csize = rm->rm_col[c].rc_size;
+
+		if (c == rm->rm_firstdatacol) {
+			ASSERT(csize == psize || csize == 0);
+			csize = MIN(csize, end);
+			for (i = off; i < csize; i += RAIDZ_VEC_SIZE) {
+				d = VLOAD(src + i);
+				VSTORE(p + i, d);
+				VSTORE(q + i, d);
+				VSTORE(r + i, d);
+			}
+			for (; i < end; i += RAIDZ_VEC_SIZE) {
+				VSTORE(p + i, zero);
+				VSTORE(q + i, zero);
+				VSTORE(r + i, zero);
+			}
+		} else {
+			ASSERT(csize <= psize);
+			csize = MIN(csize, end);
+			for (i = off; i < csize; i += RAIDZ_VEC_SIZE) {
+				d = VLOAD(src + i);
+				VSTORE(p + i, VLOAD(p + i) ^ d);
+				VSTORE(q + i, RAIDZ_FN(mul2)(VLOAD(q + i)) ^ d);
+				VSTORE(r + i, RAIDZ_FN(mul4)(VLOAD(r + i)) ^ d);
+			}
+			for (; i < end; i += RAIDZ_VEC_SIZE) {
+				VSTORE(q + i, RAIDZ_FN(mul2)(VLOAD(q + i)));
+				VSTORE(r + i, RAIDZ_FN(mul4)(VLOAD(r + i)));
+			}
+		}
+	}
+}
+
+#if defined(RAIDZ_SHUFFLE)
+
+typedef char vc_t __attribute__((vector_size(RAIDZ_VEC_SIZE)));
+
+#if RAIDZ_VEC_SIZE == 16
+#define	RAIDZ_PSHUFB(t, x)						\
+	((v_t)__builtin_ia32_pshufb128((vc_t)(t), (vc_t)(x)))
+#elif RAIDZ_VEC_SIZE == 32
+#define	RAIDZ_PSHUFB(t, x)						\
+	((v_t)__builtin_ia32_pshufb256((vc_t)(t), (vc_t)(x)))
+#endif
+
+/*
+ * tbl holds the products of c with the low nibbles followed by the
+ * products with the high nibbles, each repeated for every 16 byte lane
+ * of the vector since pshufb does not cross lanes.
+ */
+static void RAIDZ_ATTR
+RAIDZ_FN(mul_add_impl)(uint8_t *dst, const uint8_t *src, uint64_t size,
+    const uint8_t *tbl, boolean_t add)
+{
+	const v_t lo = VLOAD(tbl);
+	const v_t hi = VLOAD(tbl + RAIDZ_VEC_SIZE);
+	const v_t nibble = (v_t){ 0 } + 0x0f;
+	v_t x, m;
+	uint64_t i;
+
+	for (i = 0; i < size; i += RAIDZ_VEC_SIZE) {
+		x = VLOAD(src + i);
+		m = RAIDZ_PSHUFB(lo, x & nibble) ^
+		    RAIDZ_PSHUFB(hi, (x >> 4) & nibble);
+		if (add)
+			m ^= VLOAD(dst + i);
+		VSTORE(dst + i, m);
+	}
+}
+
+static void
+RAIDZ_FN(mul_add)(void *dst, const void *src, uint64_t size, uint8_t c,
+    boolean_t add)
+{
+	uint8_t tbl[2 * RAIDZ_VEC_SIZE];
+	uint64_t off, n;
+	kfpu_state_t kfpu;
+	int i;
+
+	ASSERT0(size % RAIDZ_VEC_SIZE);
+
+	/* clearing, copying and plain XOR gain nothing from the vector unit */
+	if (c <= 1) {
+		vdev_raidz_mul_add(dst, src, size, c, add);
+		return;
+	}
+
+	for (i = 0; i < RAIDZ_VEC_SIZE; i++) {
+		tbl[i] = vdev_raidz_gf_mul(c, i & 0x0f);
+		tbl[RAIDZ_VEC_SIZE + i] = vdev_raidz_gf_mul(c, (i & 0x0f) << 4);
+	}
+
+	for (off = 0; off < size; off += n) {
+		n = MIN(size - off, RAIDZ_KFPU_SIZE);
+		kfpu_begin(&kfpu);
+		RAIDZ_FN(mul_add_impl)((uint8_t *)dst + off,
+		    (const uint8_t *)src + off, n, tbl, add);
+		kfpu_end(&kfpu);
+	}
+}
+
+#else	/* !RAIDZ_SHUFFLE */
+
+static void RAIDZ_ATTR
+RAIDZ_FN(mul_add_impl)(uint8_t *dst, const uint8_t *src, uint64_t size,
+    uint8_t c, boolean_t add)
+{
+	const v_t zero = { 0 };
+	v_t x, m;
+	uint64_t i;
+	int b;
+
+	for (i = 0; i < size; i += RAIDZ_VEC_SIZE) {
+		x = VLOAD(src + i);
+		m = add ? (v_t)VLOAD(dst + i) : zero;
+		for (b = 0; (c >> b) != 0; b++) {
+			if (c & (1 << b))
+				m ^= x;
+			x = RAIDZ_FN(mul2)(x);
+		}
+		VSTORE(dst + i, m);
+	}
+}
+
+static void
+RAIDZ_FN(mul_add)(void *dst, const void *src, uint64_t size, uint8_t c,
+    boolean_t add)
+{
+	uint64_t off, n;
+	kfpu_state_t kfpu;
+
+	ASSERT0(size % RAIDZ_VEC_SIZE);
+
+	/* clearing, copying and plain XOR gain nothing from the vector unit */
+	if (c <= 1) {
+		vdev_raidz_mul_add(dst, src, size, c, add);
+		return;
+	}
+
+	for (off = 0; off < size; off += n) {
+		n = MIN(size - off, RAIDZ_KFPU_SIZE);
+		kfpu_begin(&kfpu);
+		RAIDZ_FN(mul_add_impl)((uint8_t *)dst + off,
+		    (const uint8_t *)src + off, n, c, add);
+		kfpu_end(&kfpu);
+	}
+}
+
+#endif	/* RAIDZ_SHUFFLE */
+
+/*
+ * Each section covers the same range of every column, sized so that it
+ * touches about RAIDZ_KFPU_SIZE bytes in all.
+ */
+#define	RAIDZ_KFPU_WRAP(name)						\
+static void								\
+RAIDZ_FN(name)(raidz_map_t *rm)						\
+{									\
+	uint64_t psize = rm->rm_col[VDEV_RAIDZ_P].rc_size;		\
+	uint64_t chunk = MAX(P2ALIGN(RAIDZ_KFPU_SIZE / rm->rm_cols,	\
+	    RAIDZ_VEC_SIZE), RAIDZ_VEC_SIZE);				\
+	uint64_t off, end;						\
+	kfpu_state_t kfpu;						\
+									\
+	for (off = 0; off < psize; off = end) {				\
+		end = MIN(off + chunk, psize);				\
+		kfpu_begin(&kfpu);					\
+		RAIDZ_FN(name##_impl)(rm, off, end);			\
+		kfpu_end(&kfpu);					\
+	}								\
+}
+
+RAIDZ_KFPU_WRAP(gen_p)
+RAIDZ_KFPU_WRAP(gen_pq)
+RAIDZ_KFPU_WRAP(gen_pqr)
+
+#endif	/* _VDEV_RAIDZ_MATH_IMPL_H */
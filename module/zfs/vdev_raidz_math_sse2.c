@@ -0,0 +1,55 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * SSE2 RAID-Z parity and reconstruction, see vdev_raidz_math_impl.h.
+ */
+
+#include <sys/zfs_context.h>
+#include <sys/vdev_raidz.h>
+#include <sys/simd.h>
+
+#if defined(HAVE_SIMD_X86)
+
+#define	RAIDZ_VEC_SIZE		16
+#define	RAIDZ_TARGET		"sse2"
+#define	RAIDZ_FN(x)		vdev_raidz_##x##_sse2
+
+#include "vdev_raidz_math_impl.h"
+
+static boolean_t
+vdev_raidz_sse2_valid(void)
+{
+	return (zfs_sse2_available());
+}
+
+const raidz_math_ops_t vdev_raidz_sse2_ops = {
+	.rmo_gen = {
+		vdev_raidz_gen_p_sse2,
+		vdev_raidz_gen_pq_sse2,
+		vdev_raidz_gen_pqr_sse2
+	},
+	.rmo_mul_add = vdev_raidz_mul_add_sse2,
+	.rmo_valid = vdev_raidz_sse2_valid,
+	.rmo_name = "sse2"
+};
+
+#endif /* HAVE_SIMD_X86 */
@@ -138,8 +138,16 @@
  * spa_feature_decr() functions to change an enabled feature's reference count.
  * Reference counts may only be updated in the syncing context.
  *
+ * The reference counts of registered features are cached in the spa when
+ * the pool is loaded and kept up to date as they change, so checking a
+ * feature's state does not require a ZAP lookup and may be done from the
+ * I/O pipeline.
+ *
  * Features may not perform enable-time initialization. Instead, any such
- * initialization should occur when the feature is first used. This design
+ * initialization should occur when the feature is first used.  A feature
+ * whose format changes can appear at any time once it is enabled, such as
+ * embedded_data, is instead registered to become active as soon as it is
+ * enabled; its reference count is then never decremented. This design
  * enforces that on-disk changes be made only when features are used. Code
  * should only check if a feature is enabled using spa_feature_is_enabled(),
  * not by relying on any feature specific metadata existing. If a feature is
@@ -248,6 +256,20 @@ feature_get_refcount(objset_t *os, uint64_t read_obj, uint64_t write_obj,
 	return (0);
 }
 
+/*
+ * Returns the cached refcount of a feature registered in spa_feature_table,
+ * or NULL for a feature which is not (such as those made up by zhack).
+ */
+static uint64_t *
+feature_refcount_cache(spa_t *spa, zfeature_info_t *feature)
+{
+	if (feature < spa_feature_table ||
+	    feature >= &spa_feature_table[SPA_FEATURES])
+		return (NULL);
+
+	return (&spa->spa_feat_refcount_cache[feature - spa_feature_table]);
+}
+
 static int
 feature_do_action(objset_t *os, uint64_t read_obj, uint64_t write_obj,
     uint64_t desc_obj, zfeature_info_t *feature, feature_action_t action,
@@ -255,6 +277,7 @@ feature_do_action(objset_t *os, uint64_t read_obj, uint64_t write_obj,
 {
 	int error;
 	uint64_t refcount;
+	uint64_t *cachep;
 	uint64_t zapobj = feature->fi_can_readonly ? write_obj : read_obj;
 
 	ASSERT(0 != zapobj);
@@ -277,7 +300,7 @@ feature_do_action(objset_t *os, uint64_t read_obj, uint64_t write_obj,
 		 */
 		if (error == 0)
 			return (0);
-		refcount = 0;
+		refcount = feature->fi_activate_on_enable ? 1 : 0;
 		break;
 	case FEATURE_ACTION_INCR:
 		if (error == ENOENT)
@@ -316,6 +339,10 @@ feature_do_action(objset_t *os, uint64_t read_obj, uint64_t write_obj,
 	if (error != 0)
 		return (error);
 
+	cachep = feature_refcount_cache(dmu_objset_spa(os), feature);
+	if (cachep != NULL)
+		*cachep = refcount;
+
 	if (action == FEATURE_ACTION_ENABLE) {
 		error = zap_update(os, desc_obj,
 		    feature->fi_guid, 1, strlen(feature->fi_desc) + 1,
@@ -324,7 +351,7 @@ feature_do_action(objset_t *os, uint64_t read_obj, uint64_t write_obj,
 			return (error);
 	}
 
-	if (action == FEATURE_ACTION_INCR && refcount == 1 && feature->fi_mos) {
+	if (action != FEATURE_ACTION_DECR && refcount == 1 && feature->fi_mos) {
 		spa_activate_mos_feature(dmu_objset_spa(os), feature->fi_guid);
 	}
 
@@ -336,9 +363,37 @@ feature_do_action(objset_t *os, uint64_t read_obj, uint64_t write_obj,
 	return (0);
 }
 
+/*
+ * Fill the spa's refcount cache from the feature objects of a pool being
+ * loaded.
+ */
+int
+spa_feature_load_refcounts(spa_t *spa)
+{
+	int i, err;
+
+	for (i = 0; i < SPA_FEATURES; i++) {
+		uint64_t refcount;
+
+		err = feature_get_refcount(spa->spa_meta_objset,
+		    spa->spa_feat_for_read_obj, spa->spa_feat_for_write_obj,
+		    &spa_feature_table[i], &refcount);
+		if (err == 0)
+			spa->spa_feat_refcount_cache[i] = refcount;
+		else if (err == ENOTSUP)
+			spa->spa_feat_refcount_cache[i] = SPA_FEATURE_DISABLED;
+		else
+			return (err);
+	}
+
+	return (0);
+}
+
 void
 spa_feature_create_zap_objects(spa_t *spa, dmu_tx_t *tx)
 {
+	int i;
+
 	/*
 	 * We create feature flags ZAP objects in two instances: during pool
 	 * creation and during pool upgrade.
@@ -355,6 +410,9 @@ spa_feature_create_zap_objects(spa_t *spa, dmu_tx_t *tx)
 	spa->spa_feat_desc_obj = zap_create_link(spa->spa_meta_objset,
 	    DMU_OTN_ZAP_METADATA, DMU_POOL_DIRECTORY_OBJECT,
 	    DMU_POOL_FEATURE_DESCRIPTIONS, tx);
+
+	for (i = 0; i < SPA_FEATURES; i++)
+		spa->spa_feat_refcount_cache[i] = SPA_FEATURE_DISABLED;
 }
 
 /*
@@ -404,10 +462,15 @@ spa_feature_is_enabled(spa_t *spa, zfeature_info_t *feature)
 {
 	int err;
 	uint64_t refcount = 0;
+	uint64_t *cachep;
 
 	if (spa_version(spa) < SPA_VERSION_FEATURES)
 		return (B_FALSE);
 
+	cachep = feature_refcount_cache(spa, feature);
+	if (cachep != NULL)
+		return (*cachep != SPA_FEATURE_DISABLED);
+
 	err = feature_get_refcount(spa->spa_meta_objset,
 	    spa->spa_feat_for_read_obj, spa->spa_feat_for_write_obj,
 	    feature, &refcount);
@@ -420,10 +483,15 @@ spa_feature_is_active(spa_t *spa, zfeature_info_t *feature)
 {
 	int err;
 	uint64_t refcount = 0;
+	uint64_t *cachep;
 
 	if (spa_version(spa) < SPA_VERSION_FEATURES)
 		return (B_FALSE);
 
+	cachep = feature_refcount_cache(spa, feature);
+	if (cachep != NULL)
+		return (*cachep != SPA_FEATURE_DISABLED && *cachep > 0);
+
 	err = feature_get_refcount(spa->spa_meta_objset,
 	    spa->spa_feat_for_read_obj, spa->spa_feat_for_write_obj,
 	    feature, &refcount);
@@ -83,6 +83,7 @@
 #include <sys/dsl_destroy.h>
 #include <sys/dsl_userhold.h>
 #include <sys/zfeature.h>
+#include <sys/zio_checksum.h>
 
 #include "zfs_namecheck.h"
 #include "zfs_prop.h"
@@ -2344,6 +2345,63 @@ zfs_prop_set_special(const char *dsname, zprop_source_t source,
 		err = -1;
 		break;
 	}
+	case ZFS_PROP_RECORDSIZE:
+	{
+		if (intval > SPA_OLD_MAXBLOCKSIZE) {
+			zfeature_info_t *feature =
+			    &spa_feature_table[SPA_FEATURE_LARGE_BLOCKS];
+			spa_t *spa;
+
+			if ((err = spa_open(dsname, &spa, FTAG)) != 0)
+				return (err);
+
+			/*
+			 * Setting a record size above 128k activates the
+			 * feature; it stays active for the life of the pool.
+			 */
+			if (!spa_feature_is_active(spa, feature)) {
+				if ((err = zfs_prop_activate_feature(spa,
+				    feature)) != 0) {
+					spa_close(spa, FTAG);
+					return (err);
+				}
+			}
+
+			spa_close(spa, FTAG);
+		}
+		err = -1;
+		break;
+	}
+	case ZFS_PROP_CHECKSUM:
+	case ZFS_PROP_DEDUP:
+	{
+		spa_feature_t fid =
+		    zio_checksum_to_feature(intval & ZIO_CHECKSUM_MASK);
+
+		if (fid != SPA_FEATURE_NONE) {
+			zfeature_info_t *feature = &spa_feature_table[fid];
+			spa_t *spa;
+
+			if ((err = spa_open(dsname, &spa, FTAG)) != 0)
+				return (err);
+
+			/*
+			 * Setting a checksum or dedup property to one of the
+			 * newer checksums activates its feature.
+			 */
+			if (!spa_feature_is_active(spa, feature)) {
+				if ((err = zfs_prop_activate_feature(spa,
+				    feature)) != 0) {
+					spa_close(spa, FTAG);
+					return (err);
+				}
+			}
+
+			spa_close(spa, FTAG);
+		}
+		err = -1;
+		break;
+	}
 
 	default:
 		err = -1;
@@ -3118,6 +3176,30 @@ zfs_ioc_create(const char *fsname, nvlist_t *innvl, nvlist_t *outnvl)
 		    (error = zvol_check_volsize(volsize,
 		    volblocksize)) != 0)
 			return (error);
+
+		if (volblocksize > SPA_OLD_MAXBLOCKSIZE) {
+			zfeature_info_t *feature =
+			    &spa_feature_table[SPA_FEATURE_LARGE_BLOCKS];
+			spa_t *spa;
+
+			if (volblocksize > zfs_max_recordsize)
+				return (SET_ERROR(ERANGE));
+
+			if ((error = spa_open(fsname, &spa, FTAG)) != 0)
+				return (error);
+
+			if (!spa_feature_is_enabled(spa, feature)) {
+				spa_close(spa, FTAG);
+				return (SET_ERROR(ENOTSUP));
+			}
+			if (!spa_feature_is_active(spa, feature) &&
+			    (error = zfs_prop_activate_feature(spa,
+			    feature)) != 0) {
+				spa_close(spa, FTAG);
+				return (error);
+			}
+			spa_close(spa, FTAG);
+		}
 	} else if (type == DMU_OST_ZFS) {
 		int error;
 
@@ -3715,9 +3797,75 @@ zfs_check_settable(const char *dsname, nvpair_t *pair, cred_t *cr)
 			return (SET_ERROR(ENOTSUP));
 		break;
 
+	case ZFS_PROP_CHECKSUM:
 	case ZFS_PROP_DEDUP:
-		if (zfs_earlier_version(dsname, SPA_VERSION_DEDUP))
+		if (prop == ZFS_PROP_DEDUP &&
+		    zfs_earlier_version(dsname, SPA_VERSION_DEDUP))
 			return (SET_ERROR(ENOTSUP));
+
+		if (nvpair_type(pair) == DATA_TYPE_UINT64 &&
+		    nvpair_value_uint64(pair, &intval) == 0) {
+			spa_feature_t fid =
+			    zio_checksum_to_feature(intval & ZIO_CHECKSUM_MASK);
+			spa_t *spa;
+
+			if (fid == SPA_FEATURE_NONE)
+				break;
+
+			if ((err = spa_open(dsname, &spa, FTAG)) != 0)
+				return (err);
+
+			if (!spa_feature_is_enabled(spa,
+			    &spa_feature_table[fid])) {
+				spa_close(spa, FTAG);
+				return (SET_ERROR(ENOTSUP));
+			}
+			spa_close(spa, FTAG);
+
+			/*
+			 * The boot loader has no way of getting at the
+			 * pool's checksum salt.
+			 */
+			if (zfs_is_bootfs(dsname) &&
+			    zio_checksum_table[intval &
+			    ZIO_CHECKSUM_MASK].ci_salted_func[0] != NULL)
+				return (SET_ERROR(ERANGE));
+		}
+		break;
+
+	case ZFS_PROP_RECORDSIZE:
+		/* Record sizes above 128k need the feature to be enabled */
+		if (nvpair_type(pair) == DATA_TYPE_UINT64 &&
+		    nvpair_value_uint64(pair, &intval) == 0 &&
+		    intval > SPA_OLD_MAXBLOCKSIZE) {
+			spa_t *spa;
+
+			/*
+			 * The boot loader can not read blocks larger
+			 * than 128k, so keep them off a bootable
+			 * dataset.
+			 */
+			if (zfs_is_bootfs(dsname))
+				return (SET_ERROR(ERANGE));
+
+			/*
+			 * We don't allow setting the property above 1MB,
+			 * unless the tunable has been changed.
+			 */
+			if (intval > zfs_max_recordsize ||
+			    intval > SPA_MAXBLOCKSIZE)
+				return (SET_ERROR(ERANGE));
+
+			if ((err = spa_open(dsname, &spa, FTAG)) != 0)
+				return (err);
+
+			if (!spa_feature_is_enabled(spa,
+			    &spa_feature_table[SPA_FEATURE_LARGE_BLOCKS])) {
+				spa_close(spa, FTAG);
+				return (SET_ERROR(ENOTSUP));
+			}
+			spa_close(spa, FTAG);
+		}
 		break;
 
 	case ZFS_PROP_SHARESMB:
@@ -3768,6 +3916,18 @@ zfs_prop_activate_feature_sync(void *arg, dmu_tx_t *tx)
 	zfeature_info_t *feature = arg;
 
 	spa_feature_incr(spa, feature, tx);
+
+	/*
+	 * Blocks written with a salted checksum can only be verified with
+	 * the salt they were written with, so make sure it is on disk
+	 * before the first of them is.
+	 */
+	if (feature == &spa_feature_table[SPA_FEATURE_SKEIN]) {
+		VERIFY0(zap_update(spa->spa_meta_objset,
+		    DMU_POOL_DIRECTORY_OBJECT, DMU_POOL_CHECKSUM_SALT, 1,
+		    sizeof (spa->spa_cksum_salt.zcs_bytes),
+		    spa->spa_cksum_salt.zcs_bytes, tx));
+	}
 }
 
 /*
@@ -4365,6 +4525,8 @@ zfs_ioc_recv(zfs_cmd_t *zc)
  * zc_fromobj	objsetid of incremental fromsnap (may be zero)
  * zc_guid	if set, estimate size of stream only.  zc_cookie is ignored.
  *		output size in zc_objset_type.
+ * zc_flags	if =1, WRITE records with a payload greater than 128KB
+ *		may be generated.
  *
  * outputs: none
  */
@@ -4374,6 +4536,7 @@ zfs_ioc_send(zfs_cmd_t *zc)
         int error;
         offset_t off;
         boolean_t estimate = (zc->zc_guid != 0);
+        boolean_t large_block_ok = (zc->zc_flags & 0x1);
 
         if (zc->zc_obj != 0) {
                 dsl_pool_t *dp;
@@ -4433,7 +4596,8 @@ zfs_ioc_send(zfs_cmd_t *zc)
 
             off = fp->f_offset;
             error = dmu_send_obj(zc->zc_name, zc->zc_sendobj,
-                                 zc->zc_fromobj, zc->zc_cookie, fp->f_vnode, &off);
+                                 zc->zc_fromobj, large_block_ok,
+                                 zc->zc_cookie, fp->f_vnode, &off);
 
             //if (VOP_SEEK(fp->f_vnode, fp->f_offset, &off, NULL) == 0)
             fp->f_offset = off;
@@ -5307,6 +5471,8 @@ zfs_ioc_space_snaps(const char *lastsnap, nvlist_t *innvl, nvlist_t *outnvl)
  * innvl: {
  *     "fd" -> file descriptor to write stream to (int32)
  *     (optional) "fromsnap" -> full snap name to send an incremental from
+ *     (optional) "largeblockok" -> (value ignored)
+ *         indicates that blocks > 128KB are permitted
  * }
  *
  * outnvl is unused
@@ -5319,6 +5485,7 @@ zfs_ioc_send_new(const char *snapname, nvlist_t *innvl, nvlist_t *outnvl)
 	offset_t off;
 	char *fromname = NULL;
 	int fd;
+	boolean_t largeblockok;
     struct vnode *vp;
     uint32_t vipd;
 
@@ -5328,11 +5495,13 @@ zfs_ioc_send_new(const char *snapname, nvlist_t *innvl, nvlist_t *outnvl)
 
 	(void) nvlist_lookup_string(innvl, "fromsnap", &fromname);
 
+	largeblockok = nvlist_exists(innvl, "largeblockok");
+
     if (file_vnode_withvid(fd, &vp, &vipd))
 		return (SET_ERROR(EBADF));
 
 	//off = fp->f_offset;
-	error = dmu_send(snapname, fromname, fd, vp, &off);
+	error = dmu_send(snapname, fromname, largeblockok, fd, vp, &off);
 
 	//if (VOP_SEEK(fp->f_vnode, fp->f_offset, &off, NULL) == 0)
 	//	fp->f_offset = off;
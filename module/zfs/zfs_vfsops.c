@@ -492,8 +492,9 @@ blksz_changed_cb(void *arg, uint64_t newval)
 	zfsvfs_t *zfsvfs = arg;
 
 	if (newval < SPA_MINBLOCKSIZE ||
-	    newval > SPA_MAXBLOCKSIZE || !ISP2(newval))
-		newval = SPA_MAXBLOCKSIZE;
+	    newval > spa_maxblocksize(dmu_objset_spa(zfsvfs->z_os)) ||
+	    !ISP2(newval))
+		newval = SPA_OLD_MAXBLOCKSIZE;
 
 	zfsvfs->z_max_blksz = newval;
 	//zfsvfs->z_vfs->mnt_stat.f_iosize = newval;
@@ -1184,7 +1185,7 @@ zfsvfs_create(const char *osname, zfsvfs_t **zfvp)
 	 */
 	zfsvfs->z_vfs = NULL;
 	zfsvfs->z_parent = zfsvfs;
-	zfsvfs->z_max_blksz = SPA_MAXBLOCKSIZE;
+	zfsvfs->z_max_blksz = SPA_OLD_MAXBLOCKSIZE;
 	zfsvfs->z_show_ctldir = ZFS_SNAPDIR_VISIBLE;
 	zfsvfs->z_os = os;
 
@@ -566,7 +566,7 @@ zfs_obtain_xattr(znode_t *dzp, const char *name, mode_t mode, cred_t *cr,
 
 #if 1 // FIXME
 	if (dzp->z_pflags & ZFS_INHERIT_ACE) {
-		dmu_tx_hold_write(tx, DMU_NEW_OBJECT, 0, SPA_MAXBLOCKSIZE);
+		dmu_tx_hold_write(tx, DMU_NEW_OBJECT, 0, SPA_OLD_MAXBLOCKSIZE);
 	}
 #endif
     zfs_sa_upgrade_txholds(tx, dzp);
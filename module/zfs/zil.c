@@ -163,6 +163,10 @@ zil_bp_tree_add(zilog_t *zilog, const blkptr_t *bp)
 	zil_bp_node_t *zn;
 	avl_index_t where;
 
+	/* an embedded bp has no DVA, and nothing to claim or free twice */
+	if (BP_IS_EMBEDDED(bp))
+		return (0);
+
 	if (avl_find(t, dva, &where) != NULL)
 		return (SET_ERROR(EEXIST));
 
@@ -336,7 +340,7 @@ zil_parse(zilog_t *zilog, zil_parse_blk_func_t *parse_blk_func,
 	 * If the log has been claimed, stop if we encounter a sequence
 	 * number greater than the highest claimed sequence number.
 	 */
-	lrbuf = zio_buf_alloc(SPA_MAXBLOCKSIZE);
+	lrbuf = zio_buf_alloc(SPA_OLD_MAXBLOCKSIZE);
 	zil_bp_tree_init(zilog);
 
 	for (blk = zh->zh_log; !BP_IS_HOLE(&blk); blk = next_blk) {
@@ -383,7 +387,7 @@ done:
 	    (max_blk_seq == claim_blk_seq && max_lr_seq == claim_lr_seq));
 
 	zil_bp_tree_fini(zilog);
-	zio_buf_free(lrbuf, SPA_MAXBLOCKSIZE);
+	zio_buf_free(lrbuf, SPA_OLD_MAXBLOCKSIZE);
 
 	return (error);
 }
@@ -462,8 +466,13 @@ zil_alloc_lwb(zilog_t *zilog, blkptr_t *bp, uint64_t txg, boolean_t fastwrite)
 	lwb->lwb_fastwrite = fastwrite;
 	lwb->lwb_buf = zio_buf_alloc(BP_GET_LSIZE(bp));
 	lwb->lwb_max_txg = txg;
+	lwb->lwb_state = LWB_STATE_OPENED;
 	lwb->lwb_zio = NULL;
+	lwb->lwb_root_zio = NULL;
 	lwb->lwb_tx = NULL;
+	ASSERT(list_is_empty(&lwb->lwb_itxs));
+	ASSERT(list_is_empty(&lwb->lwb_waiters));
+	ASSERT0(avl_numnodes(&lwb->lwb_vdev_tree));
 	if (BP_GET_CHECKSUM(bp) == ZIO_CHECKSUM_ZILOG2) {
 		lwb->lwb_nused = sizeof (zil_chain_t);
 		lwb->lwb_sz = BP_GET_LSIZE(bp);
@@ -623,6 +632,7 @@ zil_destroy(zilog_t *zilog, boolean_t keep_first)
 		VERIFY(!keep_first);
 		while ((lwb = list_head(&zilog->zl_lwb_list)) != NULL) {
 			ASSERT(lwb->lwb_zio == NULL);
+			ASSERT(lwb->lwb_state != LWB_STATE_ISSUED);
 			if (lwb->lwb_fastwrite)
 				metaslab_fastwrite_unmark(zilog->zl_spa,
 				    &lwb->lwb_blk);
@@ -632,6 +642,7 @@ zil_destroy(zilog_t *zilog, boolean_t keep_first)
 			zio_free_zil(zilog->zl_spa, txg, &lwb->lwb_blk);
 			kmem_cache_free(zil_lwb_cache, lwb);
 		}
+		zilog->zl_last_lwb_issued = NULL;
 	} else if (!keep_first) {
 		zil_destroy_sync(zilog, tx);
 	}
@@ -777,9 +788,9 @@ zil_vdev_compare(const void *x1, const void *x2)
 }
 
 void
-zil_add_block(zilog_t *zilog, const blkptr_t *bp)
+zil_lwb_add_block(lwb_t *lwb, const blkptr_t *bp)
 {
-	avl_tree_t *t = &zilog->zl_vdev_tree;
+	avl_tree_t *t = &lwb->lwb_vdev_tree;
 	avl_index_t where;
 	zil_vdev_node_t *zv, zvsearch;
 	int ndvas = BP_GET_NDVAS(bp);
@@ -788,14 +799,11 @@ zil_add_block(zilog_t *zilog, const blkptr_t *bp)
 	if (zfs_nocacheflush)
 		return;
 
-	ASSERT(zilog->zl_writer);
-
 	/*
-	 * Even though we're zl_writer, we still need a lock because the
-	 * zl_get_data() callbacks may have dmu_sync() done callbacks
-	 * that will run concurrently.
+	 * We need a lock because the zl_get_data() callbacks may have
+	 * dmu_sync() done callbacks that will run concurrently.
 	 */
-	mutex_enter(&zilog->zl_vdev_lock);
+	mutex_enter(&lwb->lwb_vdev_lock);
 	for (i = 0; i < ndvas; i++) {
 		zvsearch.zv_vdev = DVA_GET_VDEV(&bp->blk_dva[i]);
 		if (avl_find(t, &zvsearch, &where) == NULL) {
@@ -804,45 +812,73 @@ zil_add_block(zilog_t *zilog, const blkptr_t *bp)
 			avl_insert(t, zv, where);
 		}
 	}
-	mutex_exit(&zilog->zl_vdev_lock);
+	mutex_exit(&lwb->lwb_vdev_lock);
 }
 
+/*
+ * Called when a log block has been written and the vdevs it touched have
+ * been flushed, which, as each lwb's root zio waits for the previous
+ * one's, also means every lwb issued before it is DONE.  Frees the lwb's
+ * itxs and wakes up the zil_commit() callers waiting for it.
+ */
 static void
-zil_flush_vdevs(zilog_t *zilog)
+zil_lwb_flush_vdevs_done(zio_t *zio)
 {
-	spa_t *spa = zilog->zl_spa;
-	avl_tree_t *t = &zilog->zl_vdev_tree;
-	void *cookie = NULL;
-	zil_vdev_node_t *zv;
-	zio_t *zio;
+	lwb_t *lwb = zio->io_private;
+	zilog_t *zilog = lwb->lwb_zilog;
+	dmu_tx_t *tx = lwb->lwb_tx;
+	zil_commit_waiter_t *zcw;
+	list_t itxs;
+	itx_t *itx;
 
-	ASSERT(zilog->zl_writer);
+	spa_config_exit(zilog->zl_spa, SCL_STATE, lwb);
+
+	list_create(&itxs, sizeof (itx_t), offsetof(itx_t, itx_node));
 
 	/*
-	 * We don't need zl_vdev_lock here because we're the zl_writer,
-	 * and all zl_get_data() callbacks are done.
+	 * Ensure the lwb buffer pointer is cleared before releasing
+	 * the txg. If we have had an allocation failure and
+	 * the txg is waiting to sync then we want want zil_sync()
+	 * to remove the lwb so that it's not picked up as the next new
+	 * one in zil_commit_writer(). zil_sync() will only remove
+	 * the lwb once it is DONE.
 	 */
-	if (avl_numnodes(t) == 0)
-		return;
+	zio_buf_free(lwb->lwb_buf, lwb->lwb_sz);
+	mutex_enter(&zilog->zl_lock);
+	lwb->lwb_buf = NULL;
+	lwb->lwb_tx = NULL;
+	lwb->lwb_root_zio = NULL;
+	lwb->lwb_state = LWB_STATE_DONE;
 
-	spa_config_enter(spa, SCL_STATE, FTAG, RW_READER);
+	if (zio->io_error != 0) {
+		zilog->zl_lwb_error_txg = MAX(zilog->zl_lwb_error_txg,
+		    dmu_tx_get_txg(tx));
+	}
 
-	zio = zio_root(spa, NULL, NULL, ZIO_FLAG_CANFAIL);
+	list_move_tail(&itxs, &lwb->lwb_itxs);
 
-	while ((zv = avl_destroy_nodes(t, &cookie)) != NULL) {
-		vdev_t *vd = vdev_lookup_top(spa, zv->zv_vdev);
-		if (vd != NULL)
-			zio_flush(zio, vd);
-		kmem_free(zv, sizeof (*zv));
+	while ((zcw = list_head(&lwb->lwb_waiters)) != NULL) {
+		list_remove(&lwb->lwb_waiters, zcw);
+		zcw->zcw_error = zio->io_error;
+		zcw->zcw_done = B_TRUE;
+		cv_broadcast(&zcw->zcw_cv);
 	}
+	mutex_exit(&zilog->zl_lock);
+
+	while ((itx = list_head(&itxs)) != NULL) {
+		list_remove(&itxs, itx);
+		if (itx->itx_callback != NULL)
+			itx->itx_callback(itx->itx_callback_data);
+		zil_itx_destroy(itx);
+	}
+	list_destroy(&itxs);
 
 	/*
-	 * Wait for all the flushes to complete.  Not all devices actually
-	 * support the DKIOCFLUSHWRITECACHE ioctl, so it's OK if it fails.
+	 * Now that we've written this log block, we have a stable pointer
+	 * to the next block in the chain, so it's OK to let the txg in
+	 * which we allocated the next block sync.
 	 */
-	(void) zio_wait(zio);
-
-	spa_config_exit(spa, SCL_STATE, FTAG);
+	dmu_tx_commit(tx);
 }
 
 /*
@@ -853,7 +889,10 @@ zil_lwb_write_done(zio_t *zio)
 {
 	lwb_t *lwb = zio->io_private;
 	zilog_t *zilog = lwb->lwb_zilog;
-	dmu_tx_t *tx = lwb->lwb_tx;
+	spa_t *spa = zilog->zl_spa;
+	avl_tree_t *t = &lwb->lwb_vdev_tree;
+	void *cookie = NULL;
+	zil_vdev_node_t *zv;
 
 	ASSERT(BP_GET_COMPRESS(zio->io_bp) == ZIO_COMPRESS_OFF);
 	ASSERT(BP_GET_TYPE(zio->io_bp) == DMU_OT_INTENT_LOG);
@@ -863,28 +902,26 @@ zil_lwb_write_done(zio_t *zio)
 	ASSERT(!BP_IS_HOLE(zio->io_bp));
 	ASSERT(zio->io_bp->blk_fill == 0);
 
-	/*
-	 * Ensure the lwb buffer pointer is cleared before releasing
-	 * the txg. If we have had an allocation failure and
-	 * the txg is waiting to sync then we want want zil_sync()
-	 * to remove the lwb so that it's not picked up as the next new
-	 * one in zil_commit_writer(). zil_sync() will only remove
-	 * the lwb if lwb_buf is null.
-	 */
-	zio_buf_free(lwb->lwb_buf, lwb->lwb_sz);
 	mutex_enter(&zilog->zl_lock);
 	lwb->lwb_zio = NULL;
 	lwb->lwb_fastwrite = FALSE;
-	lwb->lwb_buf = NULL;
-	lwb->lwb_tx = NULL;
 	mutex_exit(&zilog->zl_lock);
 
 	/*
-	 * Now that we've written this log block, we have a stable pointer
-	 * to the next block in the chain, so it's OK to let the txg in
-	 * which we allocated the next block sync.
+	 * Flush the vdevs this lwb and the blocks it points to were written
+	 * to.  The flushes are children of the lwb's root zio, so the lwb
+	 * isn't DONE until they are.  We don't need lwb_vdev_lock here as
+	 * the dmu_sync() zios, being children of this one, are all done.
+	 * Not all devices actually support the DKIOCFLUSHWRITECACHE ioctl,
+	 * so it's OK if it fails.  There's no point flushing if the write
+	 * failed, the waiters fall back to txg_wait_synced() anyway.
 	 */
-	dmu_tx_commit(tx);
+	while ((zv = avl_destroy_nodes(t, &cookie)) != NULL) {
+		vdev_t *vd = vdev_lookup_top(spa, zv->zv_vdev);
+		if (vd != NULL && zio->io_error == 0)
+			zio_flush(lwb->lwb_root_zio, vd);
+		kmem_free(zv, sizeof (*zv));
+	}
 }
 
 /*
@@ -899,23 +936,25 @@ zil_lwb_write_init(zilog_t *zilog, lwb_t *lwb)
 	    ZB_ZIL_OBJECT, ZB_ZIL_LEVEL,
 	    lwb->lwb_blk.blk_cksum.zc_word[ZIL_ZC_SEQ]);
 
-	if (zilog->zl_root_zio == NULL) {
-		zilog->zl_root_zio = zio_root(zilog->zl_spa, NULL, NULL,
-		    ZIO_FLAG_CANFAIL);
-	}
-
 	/* Lock so zil_sync() doesn't fastwrite_unmark after zio is created */
 	mutex_enter(&zilog->zl_lock);
 	if (lwb->lwb_zio == NULL) {
+		ASSERT3S(lwb->lwb_state, ==, LWB_STATE_OPENED);
 		if (!lwb->lwb_fastwrite) {
 			metaslab_fastwrite_mark(zilog->zl_spa, &lwb->lwb_blk);
 			lwb->lwb_fastwrite = 1;
 		}
-		lwb->lwb_zio = zio_rewrite(zilog->zl_root_zio, zilog->zl_spa,
+		/*
+		 * The write's errors, and those of the blocks dmu_sync()ed
+		 * under it, propagate to the root zio and on from there
+		 * to the root zios of the lwbs issued after this one.
+		 */
+		lwb->lwb_root_zio = zio_root(zilog->zl_spa,
+		    zil_lwb_flush_vdevs_done, lwb, ZIO_FLAG_CANFAIL);
+		lwb->lwb_zio = zio_rewrite(lwb->lwb_root_zio, zilog->zl_spa,
 		    0, &lwb->lwb_blk, lwb->lwb_buf, BP_GET_LSIZE(&lwb->lwb_blk),
 		    zil_lwb_write_done, lwb, ZIO_PRIORITY_SYNC_WRITE,
-		    ZIO_FLAG_CANFAIL | ZIO_FLAG_DONT_PROPAGATE |
-		    ZIO_FLAG_FASTWRITE, &zb);
+		    ZIO_FLAG_CANFAIL | ZIO_FLAG_FASTWRITE, &zb);
 	}
 	mutex_exit(&zilog->zl_lock);
 }
@@ -925,7 +964,7 @@ zil_lwb_write_init(zilog_t *zilog, lwb_t *lwb)
  *
  * These must be a multiple of 4KB. Note only the amount used (again
  * aligned to 4KB) actually gets written. However, we can't always just
- * allocate SPA_MAXBLOCKSIZE as the slog space could be exhausted.
+ * allocate SPA_OLD_MAXBLOCKSIZE as the slog space could be exhausted.
  */
 uint64_t zil_block_buckets[] = {
     4096,		/* non TX_WRITE */
@@ -945,12 +984,12 @@ unsigned long zil_slog_limit = 1024 * 1024;
 
 /*
  * Start a log block write and advance to the next log block.
- * Calls are serialized.
+ * Calls are serialized by zl_issuer_lock.
  */
 static lwb_t *
 zil_lwb_write_start(zilog_t *zilog, lwb_t *lwb)
 {
-	lwb_t *nlwb = NULL;
+	lwb_t *nlwb = NULL, *plwb;
 	zil_chain_t *zilc;
 	spa_t *spa = zilog->zl_spa;
 	blkptr_t *bp;
@@ -978,6 +1017,10 @@ zil_lwb_write_start(zilog_t *zilog, lwb_t *lwb)
 	 * Therefore, we don't do dmu_tx_commit() until zil_lwb_write_done().
 	 * We dirty the dataset to ensure that zil_sync() will be called
 	 * to clean up in the event of allocation failure or I/O failure.
+	 * The tx is committed once the lwb is DONE rather than as soon
+	 * as it's written, so that zil_sync() never sees an lwb that is
+	 * still being flushed, and so that txg_wait_synced() also waits
+	 * for every lwb issued before it.
 	 */
 	tx = dmu_tx_create(zilog->zl_os);
 	VERIFY(dmu_tx_assign(tx, TXG_WAIT) == 0);
@@ -1007,7 +1050,7 @@ zil_lwb_write_start(zilog_t *zilog, lwb_t *lwb)
 		continue;
 	zil_blksz = zil_block_buckets[i];
 	if (zil_blksz == UINT64_MAX)
-		zil_blksz = SPA_MAXBLOCKSIZE;
+		zil_blksz = SPA_OLD_MAXBLOCKSIZE;
 	zilog->zl_prev_blks[zilog->zl_prev_rotor] = zil_blksz;
 	for (i = 0; i < ZIL_PREV_BLKS; i++)
 		zil_blksz = MAX(zil_blksz, zilog->zl_prev_blks[i]);
@@ -1035,7 +1078,7 @@ zil_lwb_write_start(zilog_t *zilog, lwb_t *lwb)
 		nlwb = zil_alloc_lwb(zilog, bp, txg, TRUE);
 
 		/* Record the block for later vdev flushing */
-		zil_add_block(zilog, &lwb->lwb_blk);
+		zil_lwb_add_block(lwb, &lwb->lwb_blk);
 	}
 
 	if (BP_GET_CHECKSUM(&lwb->lwb_blk) == ZIO_CHECKSUM_ZILOG2) {
@@ -1057,7 +1100,31 @@ zil_lwb_write_start(zilog_t *zilog, lwb_t *lwb)
 	 */
 	bzero(lwb->lwb_buf + lwb->lwb_nused, wsz - lwb->lwb_nused);
 
+	/*
+	 * Hold the config until the lwb is DONE so the vdevs it's written
+	 * to stay put until zil_lwb_write_done() flushes them.
+	 */
+	spa_config_enter(spa, SCL_STATE, lwb, RW_READER);
+
+	/*
+	 * Have this lwb's root zio wait for the previous lwb's, unless
+	 * that one is DONE already, so that lwbs become DONE in the order
+	 * they're issued and an lwb that failed fails those after it.
+	 * zil_lwb_flush_vdevs_done() sets LWB_STATE_DONE under zl_lock, so
+	 * a root zio that isn't DONE yet can still take on a parent.
+	 */
+	mutex_enter(&zilog->zl_lock);
+	plwb = zilog->zl_last_lwb_issued;
+	if (plwb != NULL && plwb->lwb_state != LWB_STATE_DONE) {
+		ASSERT3S(plwb->lwb_state, ==, LWB_STATE_ISSUED);
+		zio_add_child(lwb->lwb_root_zio, plwb->lwb_root_zio);
+	}
+	lwb->lwb_state = LWB_STATE_ISSUED;
+	zilog->zl_last_lwb_issued = lwb;
+	mutex_exit(&zilog->zl_lock);
+
 	zio_nowait(lwb->lwb_zio); /* Kick off the write for the old log block */
+	zio_nowait(lwb->lwb_root_zio);
 
 	/*
 	 * If there was an allocation failure then nlwb will be null which
@@ -1141,7 +1208,7 @@ zil_lwb_commit(zilog_t *zilog, itx_t *itx, lwb_t *lwb)
 				    lrw->lr_length);
 			}
 			error = zilog->zl_get_data(
-			    itx->itx_private, lrw, dbuf, lwb->lwb_zio);
+			    itx->itx_private, lrw, dbuf, lwb, lwb->lwb_zio);
 			if (error == EIO) {
 				txg_wait_synced(zilog->zl_dmu_pool, txg);
 				return (lwb);
@@ -1506,46 +1573,86 @@ zil_async_to_sync(zilog_t *zilog, uint64_t foid)
 	}
 }
 
+/*
+ * Hook zcw onto the last lwb issued.  Every record committed before the
+ * caller took zl_issuer_lock, its own included, is in that lwb or one
+ * issued before it, and lwbs become DONE in order, so that's the only
+ * one it needs to wait for.
+ */
+static void
+zil_commit_waiter_link(zilog_t *zilog, zil_commit_waiter_t *zcw)
+{
+	lwb_t *lwb;
+
+	ASSERT(MUTEX_HELD(&zilog->zl_issuer_lock));
+
+	mutex_enter(&zilog->zl_lock);
+	lwb = zilog->zl_last_lwb_issued;
+	if (lwb != NULL && lwb->lwb_state == LWB_STATE_ISSUED)
+		list_insert_tail(&lwb->lwb_waiters, zcw);
+	else
+		zcw->zcw_done = B_TRUE;
+	mutex_exit(&zilog->zl_lock);
+}
+
+/*
+ * Write the itxs to be committed into lwbs, issuing each lwb as it fills
+ * up and the last one once all the itxs are in, then hook zcw onto it.
+ * None of the writes are waited for here, so the next caller to get
+ * zl_issuer_lock can open and issue more lwbs while these are in flight.
+ * Each itx is freed once the lwb it went into is DONE.
+ */
 static void
-zil_commit_writer(zilog_t *zilog)
+zil_commit_writer(zilog_t *zilog, zil_commit_waiter_t *zcw)
 {
+	list_t *commit_list = &zilog->zl_itx_commit_list;
+	list_t nolwb_itxs;
 	uint64_t txg;
 	itx_t *itx;
 	lwb_t *lwb;
 	spa_t *spa = zilog->zl_spa;
-	int error = 0;
-
-	ASSERT(zilog->zl_root_zio == NULL);
 
-	mutex_exit(&zilog->zl_lock);
+	ASSERT(MUTEX_HELD(&zilog->zl_issuer_lock));
 
 	zil_get_commit_list(zilog);
 
 	/*
-	 * Return if there's nothing to commit before we dirty the fs by
-	 * calling zil_create().
+	 * Don't dirty the fs by calling zil_create() if there's nothing to
+	 * commit.  Our itxs may still be in lwbs someone else issued.
 	 */
-	if (list_head(&zilog->zl_itx_commit_list) == NULL) {
-		mutex_enter(&zilog->zl_lock);
+	if (list_head(commit_list) == NULL) {
+		zcw->zcw_lr_seq = zilog->zl_lr_seq;
+		zil_commit_waiter_link(zilog, zcw);
 		return;
 	}
 
+	ZIL_STAT_BUMP(zil_commit_writer_count);
+	list_create(&nolwb_itxs, sizeof (itx_t), offsetof(itx_t, itx_node));
+
 	if (zilog->zl_suspend) {
 		lwb = NULL;
 	} else {
 		lwb = list_tail(&zilog->zl_lwb_list);
 		if (lwb == NULL)
 			lwb = zil_create(zilog);
+		ASSERT(lwb == NULL || lwb->lwb_state == LWB_STATE_OPENED);
 	}
 
 	DTRACE_PROBE1(zil__cw1, zilog_t *, zilog);
-	for (itx = list_head(&zilog->zl_itx_commit_list); itx != NULL;
-	    itx = list_next(&zilog->zl_itx_commit_list, itx)) {
+	while ((itx = list_head(commit_list)) != NULL) {
+		list_remove(commit_list, itx);
 		txg = itx->itx_lr.lrc_txg;
 		ASSERT(txg);
 
-		if (txg > spa_last_synced_txg(spa) || txg > spa_freeze_txg(spa))
+		if (lwb != NULL && (txg > spa_last_synced_txg(spa) ||
+		    txg > spa_freeze_txg(spa))) {
 			lwb = zil_lwb_commit(zilog, itx, lwb);
+			if (lwb != NULL) {
+				list_insert_tail(&lwb->lwb_itxs, itx);
+				continue;
+			}
+		}
+		list_insert_tail(&nolwb_itxs, itx);
 	}
 	DTRACE_PROBE1(zil__cw2, zilog_t *, zilog);
 
@@ -1556,37 +1663,28 @@ zil_commit_writer(zilog_t *zilog)
 	zilog->zl_cur_used = 0;
 
 	/*
-	 * Wait if necessary for the log blocks to be on stable storage.
+	 * If we couldn't allocate an lwb, or the log is suspended, fall
+	 * back to waiting for the txg to sync.  That waits for all the
+	 * lwbs issued so far too, as each keeps the txg it allocated the
+	 * next block in from syncing until it is DONE.
 	 */
-	if (zilog->zl_root_zio) {
-		error = zio_wait(zilog->zl_root_zio);
-		zilog->zl_root_zio = NULL;
-		zil_flush_vdevs(zilog);
-	}
-
-	if (error || lwb == NULL)
+	if (lwb == NULL)
 		txg_wait_synced(zilog->zl_dmu_pool, 0);
 
-	while ((itx = list_head(&zilog->zl_itx_commit_list))) {
-		txg = itx->itx_lr.lrc_txg;
-		ASSERT(txg);
-
+	while ((itx = list_head(&nolwb_itxs)) != NULL) {
+		list_remove(&nolwb_itxs, itx);
 		if (itx->itx_callback != NULL)
 			itx->itx_callback(itx->itx_callback_data);
-		list_remove(&zilog->zl_itx_commit_list, itx);
-		kmem_free(itx, offsetof(itx_t, itx_lr)
-		    + itx->itx_lr.lrc_reclen);
+		zil_itx_destroy(itx);
 	}
-
-	mutex_enter(&zilog->zl_lock);
+	list_destroy(&nolwb_itxs);
 
 	/*
-	 * Remember the highest committed log sequence number for ztest.
-	 * We only update this value when all the log writes succeeded,
-	 * because ztest wants to ASSERT that it got the whole log chain.
+	 * Only report the records to ztest as committed when they made it
+	 * out through the log.
 	 */
-	if (error == 0 && lwb != NULL)
-		zilog->zl_commit_lr_seq = zilog->zl_lr_seq;
+	zcw->zcw_lr_seq = (lwb != NULL) ? zilog->zl_lr_seq : 0;
+	zil_commit_waiter_link(zilog, zcw);
 }
 
 /*
@@ -1594,28 +1692,20 @@ zil_commit_writer(zilog_t *zilog)
  * If foid is 0 push out all transactions, otherwise push only those
  * for that object or might reference that object.
  *
- * itxs are committed in batches. In a heavily stressed zil there will be
- * a commit writer thread who is writing out a bunch of itxs to the log
- * for a set of committing threads (cthreads) in the same batch as the writer.
- * Those cthreads are all waiting on the same cv for that batch.
- *
- * There will also be a different and growing batch of threads that are
- * waiting to commit (qthreads). When the committing batch completes
- * a transition occurs such that the cthreads exit and the qthreads become
- * cthreads. One of the new cthreads becomes the writer thread for the
- * batch. Any new threads arriving become new qthreads.
- *
- * Only 2 condition variables are needed and there's no transition
- * between the two cvs needed. They just flip-flop between qthreads
- * and cthreads.
- *
- * Using this scheme we can efficiently wakeup up only those threads
- * that have been committed.
+ * Committing threads take turns, under zl_issuer_lock, at writing the
+ * pending itxs into lwbs and issuing them, but don't hold the lock while
+ * the lwbs are written.  Instead each thread waits on a commit waiter
+ * hooked onto the last lwb issued when it dropped the lock, which holds
+ * the last of the records it depends on.  A second thread can therefore
+ * open and issue new lwbs while the first thread's are in flight, and
+ * a thread only waits for the lwbs up to the one holding its records,
+ * not for those of threads that came after it.
  */
 void
 zil_commit(zilog_t *zilog, uint64_t foid)
 {
-	uint64_t mybatch;
+	zil_commit_waiter_t zcw;
+	uint64_t error_txg;
 
     // OSX often has NULL zil for some reason
     if (!zilog) return;
@@ -1628,30 +1718,41 @@ zil_commit(zilog_t *zilog, uint64_t foid)
 	/* move the async itxs for the foid to the sync queues */
 	zil_async_to_sync(zilog, foid);
 
-	mutex_enter(&zilog->zl_lock);
-	mybatch = zilog->zl_next_batch;
-	while (zilog->zl_writer) {
-		cv_wait(&zilog->zl_cv_batch[mybatch & 1], &zilog->zl_lock);
-		if (mybatch <= zilog->zl_com_batch) {
-			mutex_exit(&zilog->zl_lock);
-			return;
-		}
-	}
+	cv_init(&zcw.zcw_cv, NULL, CV_DEFAULT, NULL);
+	list_link_init(&zcw.zcw_node);
+	zcw.zcw_done = B_FALSE;
+	zcw.zcw_error = 0;
+	zcw.zcw_lr_seq = 0;
 
-	zilog->zl_next_batch++;
-	zilog->zl_writer = B_TRUE;
-	ZIL_STAT_BUMP(zil_commit_writer_count);
-	zil_commit_writer(zilog);
-	zilog->zl_com_batch = mybatch;
-	zilog->zl_writer = B_FALSE;
+	mutex_enter(&zilog->zl_issuer_lock);
+	zil_commit_writer(zilog, &zcw);
+	mutex_exit(&zilog->zl_issuer_lock);
 
-	/* wake up one thread to become the next writer */
-	cv_signal(&zilog->zl_cv_batch[(mybatch+1) & 1]);
-
-	/* wake up all threads waiting for this batch to be committed */
-	cv_broadcast(&zilog->zl_cv_batch[mybatch & 1]);
+	mutex_enter(&zilog->zl_lock);
+	while (!zcw.zcw_done)
+		cv_wait(&zcw.zcw_cv, &zilog->zl_lock);
 
+	/*
+	 * Remember the highest committed log sequence number for ztest.
+	 * We only update this value when all the log writes succeeded,
+	 * because ztest wants to ASSERT that it got the whole log chain.
+	 */
+	if (zcw.zcw_error == 0)
+		zilog->zl_commit_lr_seq = MAX(zilog->zl_commit_lr_seq,
+		    zcw.zcw_lr_seq);
+	error_txg = zilog->zl_lwb_error_txg;
 	mutex_exit(&zilog->zl_lock);
+
+	/*
+	 * After an lwb write fails the log chain is broken at that lwb
+	 * until zil_sync() frees it, in the txg the lwb allocated the next
+	 * block in.  Until then the records in it and in every lwb after
+	 * it, ours possibly included, are only safe once that txg syncs.
+	 */
+	if (error_txg != 0)
+		txg_wait_synced(zilog->zl_dmu_pool, error_txg);
+
+	cv_destroy(&zcw.zcw_cv);
 }
 
 /*
@@ -1707,12 +1808,15 @@ zil_sync(zilog_t *zilog, dmu_tx_t *tx)
 
 	while ((lwb = list_head(&zilog->zl_lwb_list)) != NULL) {
 		zh->zh_log = lwb->lwb_blk;
-		if (lwb->lwb_buf != NULL || lwb->lwb_max_txg > txg)
+		if (lwb->lwb_state != LWB_STATE_DONE ||
+		    lwb->lwb_max_txg > txg)
 			break;
 
 		ASSERT(lwb->lwb_zio == NULL);
 
 		list_remove(&zilog->zl_lwb_list, lwb);
+		if (zilog->zl_last_lwb_issued == lwb)
+			zilog->zl_last_lwb_issued = NULL;
 		zio_free_zil(spa, txg, &lwb->lwb_blk);
 		kmem_cache_free(zil_lwb_cache, lwb);
 
@@ -1741,11 +1845,40 @@ zil_sync(zilog_t *zilog, dmu_tx_t *tx)
 	mutex_exit(&zilog->zl_lock);
 }
 
+/* ARGSUSED */
+static int
+zil_lwb_cons(void *vbuf, void *unused, int kmflag)
+{
+	lwb_t *lwb = vbuf;
+
+	list_create(&lwb->lwb_itxs, sizeof (itx_t), offsetof(itx_t, itx_node));
+	list_create(&lwb->lwb_waiters, sizeof (zil_commit_waiter_t),
+	    offsetof(zil_commit_waiter_t, zcw_node));
+	mutex_init(&lwb->lwb_vdev_lock, NULL, MUTEX_DEFAULT, NULL);
+	avl_create(&lwb->lwb_vdev_tree, zil_vdev_compare,
+	    sizeof (zil_vdev_node_t), offsetof(zil_vdev_node_t, zv_node));
+
+	return (0);
+}
+
+/* ARGSUSED */
+static void
+zil_lwb_dest(void *vbuf, void *unused)
+{
+	lwb_t *lwb = vbuf;
+
+	avl_destroy(&lwb->lwb_vdev_tree);
+	mutex_destroy(&lwb->lwb_vdev_lock);
+	list_destroy(&lwb->lwb_waiters);
+	list_destroy(&lwb->lwb_itxs);
+}
+
 void
 zil_init(void)
 {
 	zil_lwb_cache = kmem_cache_create("zil_lwb_cache",
-	    sizeof (struct lwb), 0, NULL, NULL, NULL, NULL, NULL, 0);
+	    sizeof (struct lwb), 0, zil_lwb_cons, zil_lwb_dest, NULL, NULL,
+	    NULL, 0);
 
 	zil_ksp = kstat_create("zfs", 0, "zil", "misc",
 	    KSTAT_TYPE_NAMED, sizeof (zil_stats) / sizeof (kstat_named_t),
@@ -1795,9 +1928,9 @@ zil_alloc(objset_t *os, zil_header_t *zh_phys)
 	zilog->zl_destroy_txg = TXG_INITIAL - 1;
 	zilog->zl_logbias = dmu_objset_logbias(os);
 	zilog->zl_sync = dmu_objset_syncprop(os);
-	zilog->zl_next_batch = 1;
 
 	mutex_init(&zilog->zl_lock, NULL, MUTEX_DEFAULT, NULL);
+	mutex_init(&zilog->zl_issuer_lock, NULL, MUTEX_DEFAULT, NULL);
 
 	for (i = 0; i < TXG_SIZE; i++) {
 		mutex_init(&zilog->zl_itxg[i].itxg_lock, NULL,
@@ -1810,15 +1943,7 @@ zil_alloc(objset_t *os, zil_header_t *zh_phys)
 	list_create(&zilog->zl_itx_commit_list, sizeof (itx_t),
 	    offsetof(itx_t, itx_node));
 
-	mutex_init(&zilog->zl_vdev_lock, NULL, MUTEX_DEFAULT, NULL);
-
-	avl_create(&zilog->zl_vdev_tree, zil_vdev_compare,
-	    sizeof (zil_vdev_node_t), offsetof(zil_vdev_node_t, zv_node));
-
-	cv_init(&zilog->zl_cv_writer, NULL, CV_DEFAULT, NULL);
 	cv_init(&zilog->zl_cv_suspend, NULL, CV_DEFAULT, NULL);
-	cv_init(&zilog->zl_cv_batch[0], NULL, CV_DEFAULT, NULL);
-	cv_init(&zilog->zl_cv_batch[1], NULL, CV_DEFAULT, NULL);
 
 	return (zilog);
 }
@@ -1836,9 +1961,6 @@ zil_free(zilog_t *zilog)
 	ASSERT(list_is_empty(&zilog->zl_lwb_list));
 	list_destroy(&zilog->zl_lwb_list);
 
-	avl_destroy(&zilog->zl_vdev_tree);
-	mutex_destroy(&zilog->zl_vdev_lock);
-
 	ASSERT(list_is_empty(&zilog->zl_itx_commit_list));
 	list_destroy(&zilog->zl_itx_commit_list);
 
@@ -1855,12 +1977,10 @@ zil_free(zilog_t *zilog)
 		mutex_destroy(&zilog->zl_itxg[i].itxg_lock);
 	}
 
+	mutex_destroy(&zilog->zl_issuer_lock);
 	mutex_destroy(&zilog->zl_lock);
 
-	cv_destroy(&zilog->zl_cv_writer);
 	cv_destroy(&zilog->zl_cv_suspend);
-	cv_destroy(&zilog->zl_cv_batch[0]);
-	cv_destroy(&zilog->zl_cv_batch[1]);
 
 	kmem_free(zilog, sizeof (zilog_t));
 }
@@ -1921,6 +2041,7 @@ zil_close(zilog_t *zilog)
 	lwb = list_head(&zilog->zl_lwb_list);
 	if (lwb != NULL) {
 		ASSERT(lwb == list_tail(&zilog->zl_lwb_list));
+		ASSERT3S(lwb->lwb_state, ==, LWB_STATE_OPENED);
 		ASSERT(lwb->lwb_zio == NULL);
 		if (lwb->lwb_fastwrite)
 			metaslab_fastwrite_unmark(zilog->zl_spa, &lwb->lwb_blk);
@@ -38,9 +38,12 @@
 #include <sys/zio_impl.h>
 #include <sys/zio_compress.h>
 #include <sys/zio_checksum.h>
+#include <sys/sha256.h>
 #include <sys/dmu_objset.h>
 #include <sys/arc.h>
 #include <sys/ddt.h>
+#include <sys/blkptr.h>
+#include <sys/zfeature.h>
 
 /*
  * ==========================================================================
@@ -96,6 +99,20 @@ int zio_buf_debug_limit = 16384;
 int zio_buf_debug_limit = 0;
 #endif
 
+/*
+ * SHA-256 write checksums are computed in batches when a multi-buffer
+ * implementation is selected, see zio_checksum_generate_batch().
+ * zio_checksum_batch_max bounds the number of issue threads hashing
+ * batches at once; 0 at module load means one per four CPUs, and it is
+ * taken to be at least 1 after that.
+ */
+int zio_checksum_batch = B_TRUE;
+int zio_checksum_batch_max = 0;
+
+static kmutex_t zio_cksum_batch_lock;
+static list_t zio_cksum_batch_list;
+static int zio_cksum_batch_active;
+
 static inline void __zio_execute(zio_t *zio);
 
 static int
@@ -144,7 +161,9 @@ zio_init(void)
 	 * For small buffers, we want a cache for each multiple of
 	 * SPA_MINBLOCKSIZE.  For medium-size buffers, we want a cache
 	 * for each quarter-power of 2.  For large buffers, we want
-	 * a cache for each multiple of PAGESIZE.
+	 * a cache for each multiple of PAGESIZE, up to 128K.  Beyond
+	 * that, for large blocks, a cache per page would be thousands
+	 * of caches, so again we want one for each quarter-power of 2.
 	 */
 	for (c = 0; c < SPA_MAXBLOCKSIZE >> SPA_MINBLOCKSHIFT; c++) {
 		size_t size = (c + 1) << SPA_MINBLOCKSHIFT;
@@ -166,10 +185,11 @@ zio_init(void)
 #endif
 		if (size <= 4 * SPA_MINBLOCKSIZE) {
 			align = SPA_MINBLOCKSIZE;
-		} else if (IS_P2ALIGNED(size, PAGESIZE)) {
+		} else if (size <= SPA_OLD_MAXBLOCKSIZE &&
+		    IS_P2ALIGNED(size, PAGESIZE)) {
 			align = PAGESIZE;
 		} else if (IS_P2ALIGNED(size, p2 >> 2)) {
-			align = p2 >> 2;
+			align = MIN(p2 >> 2, PAGESIZE);
 		}
 
 		if (align != 0) {
@@ -217,9 +237,18 @@ zio_init(void)
 	if (zfs_mg_alloc_failures == 0)
 		zfs_mg_alloc_failures = MAX((3 * max_ncpus / 2), 8);
 
+	if (zio_checksum_batch_max == 0)
+		zio_checksum_batch_max = MAX(max_ncpus / 4, 1);
+
+	mutex_init(&zio_cksum_batch_lock, NULL, MUTEX_DEFAULT, NULL);
+	list_create(&zio_cksum_batch_list, sizeof (zio_t),
+	    offsetof(zio_t, io_cksum_node));
+
 	zio_inject_init();
 
 	lz4_init();
+	gzip_init();
+	zio_compress_init();
 
 }
 
@@ -248,8 +277,14 @@ zio_fini(void)
 	kmem_cache_destroy(zio_link_cache);
 	kmem_cache_destroy(zio_cache);
 
+	ASSERT(list_is_empty(&zio_cksum_batch_list));
+	list_destroy(&zio_cksum_batch_list);
+	mutex_destroy(&zio_cksum_batch_lock);
+
 	zio_inject_fini();
 
+	zio_compress_fini();
+	gzip_fini();
 	lz4_fini();
 }
 
@@ -775,6 +810,14 @@ zio_write_override(zio_t *zio, blkptr_t *bp, int copies, boolean_t nopwrite)
 void
 zio_free(spa_t *spa, uint64_t txg, const blkptr_t *bp)
 {
+	/*
+	 * An embedded block pointer has nothing allocated to free.  Drop
+	 * it here rather than putting it on the list only for
+	 * zio_free_sync() to ignore it later.
+	 */
+	if (BP_IS_EMBEDDED(bp))
+		return;
+
 	metaslab_check_free(spa, bp);
 
 	/*
@@ -806,6 +849,9 @@ zio_free_sync(zio_t *pio, spa_t *spa, uint64_t txg, const blkptr_t *bp,
 	ASSERT(spa_syncing_txg(spa) == txg);
 	ASSERT(spa_sync_pass(spa) < zfs_sync_pass_deferred_free);
 
+	if (BP_IS_EMBEDDED(bp))
+		return (zio_null(pio, spa, NULL, NULL, NULL, 0));
+
 	metaslab_check_free(spa, bp);
 	arc_freed(spa, bp);
 
@@ -841,7 +887,13 @@ zio_claim(zio_t *pio, spa_t *spa, uint64_t txg, const blkptr_t *bp,
 	 * All claims *must* be resolved in the first txg -- before the SPA
 	 * starts allocating blocks -- so that nothing is allocated twice.
 	 * If txg == 0 we just verify that the block is claimable.
+	 *
+	 * An embedded bp has nothing allocated to claim.  The null zio
+	 * does not get the caller's done callback, which expects io_bp.
 	 */
+	if (BP_IS_EMBEDDED(bp))
+		return (zio_null(pio, spa, NULL, NULL, NULL, 0));
+
 	ASSERT3U(spa->spa_uberblock.ub_rootbp.blk_birth, <, spa_first_txg(spa));
 	ASSERT(txg == spa_first_txg(spa) || txg == 0);
 	ASSERT(!BP_GET_DEDUP(bp) || !spa_writeable(spa));	/* zdb(1M) */
@@ -1036,12 +1088,20 @@ zio_read_bp_init(zio_t *zio)
 	if (BP_GET_COMPRESS(bp) != ZIO_COMPRESS_OFF &&
 	    zio->io_child_type == ZIO_CHILD_LOGICAL &&
 	    !(zio->io_flags & ZIO_FLAG_RAW)) {
-		uint64_t psize = BP_GET_PSIZE(bp);
+		uint64_t psize =
+		    BP_IS_EMBEDDED(bp) ? BPE_GET_PSIZE(bp) : BP_GET_PSIZE(bp);
 		void *cbuf = zio_buf_alloc(psize);
 
 		zio_push_transform(zio, cbuf, psize, psize, zio_decompress);
 	}
 
+	if (BP_IS_EMBEDDED(bp) && BPE_GET_ETYPE(bp) == BP_EMBEDDED_TYPE_DATA) {
+		zio->io_pipeline = ZIO_INTERLOCK_PIPELINE;
+		decode_embedded_bp_compressed(bp, zio->io_data);
+	} else {
+		ASSERT(!BP_IS_EMBEDDED(bp));
+	}
+
 	if (!DMU_OT_IS_METADATA(BP_GET_TYPE(bp)) && BP_GET_LEVEL(bp) == 0)
 		zio->io_flags |= ZIO_FLAG_DONT_CACHE;
 
@@ -1133,7 +1193,7 @@ zio_write_bp_init(zio_t *zio)
 			compress = ZIO_COMPRESS_OFF;
 
 		/* Make sure someone doesn't change their mind on overwrites */
-		ASSERT(MIN(zp->zp_copies + BP_IS_GANG(bp),
+		ASSERT(BP_IS_EMBEDDED(bp) || MIN(zp->zp_copies + BP_IS_GANG(bp),
 		    spa_max_replication(spa)) == BP_GET_NDVAS(bp));
 	}
 
@@ -1143,9 +1203,43 @@ zio_write_bp_init(zio_t *zio)
 		if (psize == 0 || psize == lsize) {
 			compress = ZIO_COMPRESS_OFF;
 			zio_buf_free(cbuf, lsize);
+		} else if (!zp->zp_dedup && psize <= BPE_PAYLOAD_SIZE &&
+		    zp->zp_level == 0 && !DMU_OT_HAS_FILL(zp->zp_type) &&
+		    spa_feature_is_enabled(spa,
+		    &spa_feature_table[SPA_FEATURE_EMBEDDED_DATA])) {
+			/*
+			 * Small enough to be stored in the block pointer
+			 * itself; there is nothing to allocate or write.
+			 */
+			encode_embedded_bp_compressed(bp,
+			    cbuf, compress, lsize, psize);
+			BPE_SET_ETYPE(bp, BP_EMBEDDED_TYPE_DATA);
+			BP_SET_TYPE(bp, zp->zp_type);
+			BP_SET_LEVEL(bp, zp->zp_level);
+			zio_buf_free(cbuf, lsize);
+			bp->blk_birth = zio->io_txg;
+			zio->io_pipeline = ZIO_INTERLOCK_PIPELINE;
+			ASSERT(spa_feature_is_active(spa,
+			    &spa_feature_table[SPA_FEATURE_EMBEDDED_DATA]));
+			return (ZIO_PIPELINE_CONTINUE);
 		} else {
-			ASSERT(psize < lsize);
-			zio_push_transform(zio, cbuf, psize, lsize, NULL);
+			/*
+			 * For both security and repeatability, pad out
+			 * the last sector.  If that saves nothing, write
+			 * the block uncompressed.
+			 */
+			size_t rounded =
+			    P2ROUNDUP(psize, (size_t)SPA_MINBLOCKSIZE);
+			if (rounded >= lsize) {
+				compress = ZIO_COMPRESS_OFF;
+				zio_buf_free(cbuf, lsize);
+				psize = lsize;
+			} else {
+				bzero((char *)cbuf + psize, rounded - psize);
+				psize = rounded;
+				zio_push_transform(zio, cbuf, psize, lsize,
+				    NULL);
+			}
 		}
 	}
 
@@ -1157,8 +1251,8 @@ zio_write_bp_init(zio_t *zio)
 	 * spa_sync() to allocate new blocks, but force rewrites after that.
 	 * There should only be a handful of blocks after pass 1 in any case.
 	 */
-	if (bp->blk_birth == zio->io_txg && BP_GET_PSIZE(bp) == psize &&
-	    pass >= zfs_sync_pass_rewrite) {
+	if (bp->blk_birth == zio->io_txg && !BP_IS_EMBEDDED(bp) &&
+	    BP_GET_PSIZE(bp) == psize && pass >= zfs_sync_pass_rewrite) {
 		enum zio_stage gang_stages = zio->io_pipeline & ZIO_GANG_STAGES;
 		ASSERT(psize != 0);
 		zio->io_pipeline = ZIO_REWRITE_PIPELINE | gang_stages;
@@ -2881,6 +2975,105 @@ zio_vdev_io_bypass(zio_t *zio)
  * Generate and verify checksums
  * ==========================================================================
  */
+
+/*
+ * A multi-buffer SHA-256 implementation only pays off when it is handed
+ * several blocks at once, but every write reaches this stage on its own
+ * issue thread.  Writes are therefore queued, and up to
+ * zio_checksum_batch_max of the issue threads act as hashers: a thread
+ * which finds fewer hashers than that becomes one and hashes a single
+ * batch, made of its own write and the oldest queued ones.  The other
+ * threads leave their write on the queue and move on.  The hasher resumes
+ * the other writes it completed in the issue taskq and carries on with
+ * its own.
+ *
+ * A hasher which still sees writes queued once it is done takes the
+ * oldest one off the queue and sends it back through this stage in the
+ * issue taskq, where it will find a free hasher slot and start the next
+ * batch.  So a queued write is never left behind, and no thread is kept
+ * hashing other writes however fast they arrive.  Batches fill up by
+ * themselves when writes arrive faster than the hashers drain them,
+ * which is exactly when the throughput matters; a lone write is hashed
+ * immediately.
+ */
+static int
+zio_checksum_generate_batch(zio_t *zio)
+{
+	zio_t *batch[SHA256_MB_LANES];
+	const void *data[SHA256_MB_LANES];
+	uint64_t size[SHA256_MB_LANES];
+	zio_cksum_t cksum[SHA256_MB_LANES];
+	zio_t *zp;
+	int i, n;
+
+	mutex_enter(&zio_cksum_batch_lock);
+	if (zio_cksum_batch_active >= MAX(zio_checksum_batch_max, 1)) {
+		list_insert_tail(&zio_cksum_batch_list, zio);
+		mutex_exit(&zio_cksum_batch_lock);
+		return (ZIO_PIPELINE_STOP);
+	}
+	zio_cksum_batch_active++;
+
+	batch[0] = zio;
+	for (n = 1; n < SHA256_MB_LANES; n++) {
+		zp = list_remove_head(&zio_cksum_batch_list);
+		if (zp == NULL)
+			break;
+		batch[n] = zp;
+	}
+	mutex_exit(&zio_cksum_batch_lock);
+
+	for (i = 0; i < n; i++) {
+		data[i] = batch[i]->io_data;
+		size[i] = batch[i]->io_size;
+	}
+
+	zio_checksum_SHA256_multi(data, size, cksum, n);
+
+	for (i = 0; i < n; i++) {
+		batch[i]->io_bp->blk_cksum = cksum[i];
+		if (batch[i] != zio)
+			zio_taskq_dispatch(batch[i], ZIO_TASKQ_ISSUE, B_FALSE);
+	}
+
+	mutex_enter(&zio_cksum_batch_lock);
+	zio_cksum_batch_active--;
+	zp = list_remove_head(&zio_cksum_batch_list);
+	mutex_exit(&zio_cksum_batch_lock);
+
+	if (zp != NULL) {
+		/* rerun this stage for it */
+		zp->io_stage >>= 1;
+		zio_taskq_dispatch(zp, ZIO_TASKQ_ISSUE, B_FALSE);
+	}
+
+	return (ZIO_PIPELINE_CONTINUE);
+}
+
+/*
+ * Once batching is turned off, or the multi-buffer implementation is no
+ * longer selected, the writes still queued are all sent back through this
+ * stage at once, since no hasher is left to pick them up one at a time.
+ */
+static void
+zio_checksum_batch_drain(void)
+{
+	list_t drain;
+	zio_t *zp;
+
+	list_create(&drain, sizeof (zio_t), offsetof(zio_t, io_cksum_node));
+	mutex_enter(&zio_cksum_batch_lock);
+	list_move_tail(&drain, &zio_cksum_batch_list);
+	mutex_exit(&zio_cksum_batch_lock);
+
+	while ((zp = list_remove_head(&drain)) != NULL) {
+		/* rerun this stage for it */
+		zp->io_stage >>= 1;
+		zio_taskq_dispatch(zp, ZIO_TASKQ_ISSUE, B_FALSE);
+	}
+	list_destroy(&drain);
+}
+
 static int
 zio_checksum_generate(zio_t *zio)
 {
@@ -2905,6 +3098,13 @@ zio_checksum_generate(zio_t *zio)
 		} else {
 			checksum = BP_GET_CHECKSUM(bp);
 		}
+
+		if (zio_checksum_batch && sha256_impl_multi()) {
+			if (checksum == ZIO_CHECKSUM_SHA256)
+				return (zio_checksum_generate_batch(zio));
+		} else if (!list_is_empty(&zio_cksum_batch_list)) {
+			zio_checksum_batch_drain();
+		}
 	}
 
 	zio_checksum_compute(zio, checksum, zio->io_data, zio->io_size);
@@ -3062,7 +3262,7 @@ zio_done(zio_t *zio)
 		for (w = 0; w < ZIO_WAIT_TYPES; w++)
 			ASSERT(zio->io_children[c][w] == 0);
 
-	if (zio->io_bp != NULL) {
+	if (zio->io_bp != NULL && !BP_IS_EMBEDDED(zio->io_bp)) {
 		ASSERT(zio->io_bp->blk_pad[0] == 0);
 		ASSERT(zio->io_bp->blk_pad[1] == 0);
 		ASSERT(bcmp(zio->io_bp, &zio->io_bp_copy,
@@ -3439,4 +3639,12 @@ MODULE_PARM_DESC(zfs_sync_pass_dont_compress,
 module_param(zfs_sync_pass_rewrite, int, 0644);
 MODULE_PARM_DESC(zfs_sync_pass_rewrite,
 	"Rewrite new bps starting in this pass");
+
+module_param(zio_checksum_batch, int, 0644);
+MODULE_PARM_DESC(zio_checksum_batch,
+	"Batch SHA-256 write checksums for multi-buffer hashing");
+
+module_param(zio_checksum_batch_max, int, 0644);
+MODULE_PARM_DESC(zio_checksum_batch_max,
+	"Max issue threads hashing checksum batches at once");
 #endif
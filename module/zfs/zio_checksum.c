@@ -25,6 +25,7 @@
 
 #include <sys/zfs_context.h>
 #include <sys/spa.h>
+#include <sys/spa_impl.h>
 #include <sys/zio.h>
 #include <sys/zio_checksum.h>
 #include <sys/zil.h>
@@ -58,6 +59,11 @@
  * checksum function of the appropriate strength.  When reading a block,
  * we compare the expected checksum against the actual checksum, which we
  * compute via the checksum function specified by BP_GET_CHECKSUM(bp).
+ *
+ * Checksums added after sha256 are recorded as pool features, which are
+ * activated when the checksum is first selected for a dataset.  skein
+ * is additionally keyed with the pool's checksum salt (spa_cksum_salt),
+ * so it has ci_salted_func entries instead of ci_func.
  */
 
 /*ARGSUSED*/
@@ -78,8 +84,44 @@ zio_checksum_info_t zio_checksum_table[ZIO_CHECKSUM_FUNCTIONS] = {
 	{{fletcher_4_native,	fletcher_4_byteswap},	1, 0, 0, "fletcher4"},
 	{{zio_checksum_SHA256,	zio_checksum_SHA256},	1, 0, 1, "sha256"},
 	{{fletcher_4_native,	fletcher_4_byteswap},	0, 1, 0, "zilog2"},
+	{{zio_checksum_off,	zio_checksum_off},	0, 0, 0, "noparity"},
+	{{zio_checksum_SHA512_native,	zio_checksum_SHA512_byteswap},
+	    1, 0, 1, "sha512"},
+	{{NULL,			NULL},			1, 0, 1, "skein",
+	    {zio_checksum_skein_native,	zio_checksum_skein_byteswap}},
 };
 
+#define	ZIO_CHECKSUM_VALID(ci)	\
+	((ci)->ci_func[0] != NULL || (ci)->ci_salted_func[0] != NULL)
+
+/*
+ * The pool feature which must be enabled before a checksum can be used,
+ * or SPA_FEATURE_NONE.
+ */
+spa_feature_t
+zio_checksum_to_feature(enum zio_checksum cksum)
+{
+	switch (cksum) {
+	case ZIO_CHECKSUM_SHA512:
+		return (SPA_FEATURE_SHA512);
+	case ZIO_CHECKSUM_SKEIN:
+		return (SPA_FEATURE_SKEIN);
+	default:
+		return (SPA_FEATURE_NONE);
+	}
+}
+
+static void
+zio_checksum_func(spa_t *spa, zio_checksum_info_t *ci, int byteswap,
+    const void *data, uint64_t size, zio_cksum_t *zcp)
+{
+	if (ci->ci_salted_func[byteswap] != NULL)
+		ci->ci_salted_func[byteswap](data, size, &spa->spa_cksum_salt,
+		    zcp);
+	else
+		ci->ci_func[byteswap](data, size, zcp);
+}
+
 enum zio_checksum
 zio_checksum_select(enum zio_checksum child, enum zio_checksum parent)
 {
@@ -158,7 +200,7 @@ zio_checksum_compute(zio_t *zio, enum zio_checksum checksum,
 	zio_cksum_t cksum;
 
 	ASSERT((uint_t)checksum < ZIO_CHECKSUM_FUNCTIONS);
-	ASSERT(ci->ci_func[0] != NULL);
+	ASSERT(ZIO_CHECKSUM_VALID(ci));
 
 	if (ci->ci_eck) {
 		zio_eck_t *eck;
@@ -179,10 +221,11 @@ zio_checksum_compute(zio_t *zio, enum zio_checksum checksum,
 		else
 			bp->blk_cksum = eck->zec_cksum;
 		eck->zec_magic = ZEC_MAGIC;
-		ci->ci_func[0](data, size, &cksum);
+		zio_checksum_func(zio->io_spa, ci, 0, data, size, &cksum);
 		eck->zec_cksum = cksum;
 	} else {
-		ci->ci_func[0](data, size, &bp->blk_cksum);
+		zio_checksum_func(zio->io_spa, ci, 0, data, size,
+		    &bp->blk_cksum);
 	}
 }
 
@@ -201,7 +244,7 @@ zio_checksum_error(zio_t *zio, zio_bad_cksum_t *info)
 	zio_checksum_info_t *ci = &zio_checksum_table[checksum];
 	zio_cksum_t actual_cksum, expected_cksum, verifier;
 
-	if (checksum >= ZIO_CHECKSUM_FUNCTIONS || ci->ci_func[0] == NULL)
+	if (checksum >= ZIO_CHECKSUM_FUNCTIONS || !ZIO_CHECKSUM_VALID(ci))
 		return (SET_ERROR(EINVAL));
 
 	if (ci->ci_eck) {
@@ -241,7 +284,8 @@ zio_checksum_error(zio_t *zio, zio_bad_cksum_t *info)
 
 		expected_cksum = eck->zec_cksum;
 		eck->zec_cksum = verifier;
-		ci->ci_func[byteswap](data, size, &actual_cksum);
+		zio_checksum_func(zio->io_spa, ci, byteswap, data, size,
+		    &actual_cksum);
 		eck->zec_cksum = expected_cksum;
 
 		if (byteswap)
@@ -251,7 +295,8 @@ zio_checksum_error(zio_t *zio, zio_bad_cksum_t *info)
 		ASSERT(!BP_IS_GANG(bp));
 		byteswap = BP_SHOULD_BYTESWAP(bp);
 		expected_cksum = bp->blk_cksum;
-		ci->ci_func[byteswap](data, size, &actual_cksum);
+		zio_checksum_func(zio->io_spa, ci, byteswap, data, size,
+		    &actual_cksum);
 	}
 
 	info->zbc_expected = expected_cksum;
@@ -60,6 +60,43 @@ zio_compress_info_t zio_compress_table[ZIO_COMPRESS_FUNCTIONS] = {
 	{lz4_compress_zfs,	lz4_decompress_zfs,	0,	"lz4"},
 };
 
+/*
+ * Early abort.
+ *
+ * gzip takes just as long on a block it cannot shrink, such as media
+ * which was compressed before it was written, as on one it can.  Before
+ * running an expensive compressor, zio_compress_data() takes two cheap
+ * looks at the block:
+ *
+ *  - A byte histogram over a sample of the block.  When two sampled
+ *    bytes are equal with a probability below 1/128, the collision
+ *    entropy, and so the Shannon entropy, is above 7 bits per byte and
+ *    no entropy coder can save the 12.5% we require.
+ *
+ *  - If so, an LZ4 trial into dst, which finds any repeated strings the
+ *    histogram is blind to.
+ *
+ * Only when neither sees redundancy is the block written uncompressed.
+ * A block which gzip could have shrunk slightly more than LZ4 can be
+ * lost this way; set zio_compress_early_abort to 0 to always try.
+ */
+int zio_compress_early_abort = 1;
+
+#define	ZIO_COMPRESS_SAMPLE_CHUNK	256
+#define	ZIO_COMPRESS_SAMPLE_CHUNKS	16
+
+/*
+ * Per algorithm counters of zio_compress_data() calls which ran the
+ * compressor (attempted) or skipped it (aborted).  They are plain arrays
+ * so that they work before zio_compress_init(); the kstat copies them.
+ */
+static uint64_t zio_compress_attempted[ZIO_COMPRESS_FUNCTIONS];
+static uint64_t zio_compress_aborted[ZIO_COMPRESS_FUNCTIONS];
+
+static kstat_t *zio_compress_ksp;
+static kstat_named_t *zio_compress_ks_data;
+static int zio_compress_ks_ndata;
+
 enum zio_compress
 zio_compress_select(enum zio_compress child, enum zio_compress parent)
 {
@@ -76,11 +113,69 @@ zio_compress_select(enum zio_compress child, enum zio_compress parent)
 	return (child);
 }
 
+static boolean_t
+zio_compress_expensive(enum zio_compress c)
+{
+	return (c >= ZIO_COMPRESS_GZIP_1 && c <= ZIO_COMPRESS_GZIP_9);
+}
+
+/*
+ * Return B_TRUE if the byte histogram of a sample of the block says it
+ * has more than 7 bits of entropy per byte, i.e. if the sum of the
+ * squared byte counts is below n^2 / 128.
+ */
+static boolean_t
+zio_compress_entropic(const uint8_t *src, size_t s_len)
+{
+	uint32_t count[256];
+	uint64_t sum = 0, n = 0;
+	size_t off, stride, i;
+	int chunk;
+
+	bzero(count, sizeof (count));
+
+	if (s_len <= ZIO_COMPRESS_SAMPLE_CHUNK * ZIO_COMPRESS_SAMPLE_CHUNKS) {
+		for (i = 0; i < s_len; i++)
+			count[src[i]]++;
+		n = s_len;
+	} else {
+		stride = s_len / ZIO_COMPRESS_SAMPLE_CHUNKS;
+		for (chunk = 0; chunk < ZIO_COMPRESS_SAMPLE_CHUNKS; chunk++) {
+			off = chunk * stride;
+			for (i = 0; i < ZIO_COMPRESS_SAMPLE_CHUNK; i++)
+				count[src[off + i]]++;
+		}
+		n = ZIO_COMPRESS_SAMPLE_CHUNK * ZIO_COMPRESS_SAMPLE_CHUNKS;
+	}
+
+	for (i = 0; i < 256; i++)
+		sum += (uint64_t)count[i] * count[i];
+
+	return (sum * 128 < n * n);
+}
+
+/*
+ * Return B_TRUE if compressing the block with c is not worth trying.
+ * dst is used as scratch space for the LZ4 trial.
+ */
+static boolean_t
+zio_compress_abort(enum zio_compress c, void *src, void *dst, size_t s_len,
+    size_t d_len)
+{
+	if (!zio_compress_early_abort || !zio_compress_expensive(c))
+		return (B_FALSE);
+
+	if (!zio_compress_entropic(src, s_len))
+		return (B_FALSE);
+
+	return (lz4_compress_zfs(src, dst, s_len, d_len, 0) > d_len);
+}
+
 size_t
 zio_compress_data(enum zio_compress c, void *src, void *dst, size_t s_len)
 {
 	uint64_t *word, *word_end;
-	size_t c_len, d_len, r_len;
+	size_t c_len, d_len;
 	zio_compress_info_t *ci = &zio_compress_table[c];
 
 	ASSERT((uint_t)c < ZIO_COMPRESS_FUNCTIONS);
@@ -101,29 +196,30 @@ zio_compress_data(enum zio_compress c, void *src, void *dst, size_t s_len)
 	if (c == ZIO_COMPRESS_EMPTY)
 		return (s_len);
 
-	/* Compress at least 12.5% */
-	d_len = P2ALIGN(s_len - (s_len >> 3), (size_t)SPA_MINBLOCKSIZE);
-	if (d_len == 0)
+	/*
+	 * Compress at least 12.5%.  d_len is not aligned to a sector, so
+	 * that blocks of a single sector can still shrink enough to be
+	 * embedded in their block pointer.
+	 */
+	d_len = s_len - (s_len >> 3);
+
+	if (zio_compress_abort(c, src, dst, s_len, d_len)) {
+		atomic_inc_64(&zio_compress_aborted[c]);
 		return (s_len);
+	}
 
+	atomic_inc_64(&zio_compress_attempted[c]);
 	c_len = ci->ci_compress(src, dst, s_len, d_len, ci->ci_level);
 
 	if (c_len > d_len)
 		return (s_len);
 
 	/*
-	 * Cool.  We compressed at least as much as we were hoping to.
-	 * For both security and repeatability, pad out the last sector.
+	 * The result is not padded out to a whole sector; callers which
+	 * write it to disk must do that, since a caller embedding it in a
+	 * block pointer needs its exact size.
 	 */
-	r_len = P2ROUNDUP(c_len, (size_t)SPA_MINBLOCKSIZE);
-	if (r_len > c_len) {
-		bzero((char *)dst + c_len, r_len - c_len);
-		c_len = r_len;
-	}
-
 	ASSERT3U(c_len, <=, d_len);
-	ASSERT(P2PHASE(c_len, (size_t)SPA_MINBLOCKSIZE) == 0);
-
 	return (c_len);
 }
 
@@ -138,3 +234,81 @@ zio_decompress_data(enum zio_compress c, void *src, void *dst,
 
 	return (ci->ci_decompress(src, dst, s_len, d_len, ci->ci_level));
 }
+
+static int
+zio_compress_kstat_update(kstat_t *ksp, int rw)
+{
+	kstat_named_t *kn = ksp->ks_data;
+	int c;
+
+	for (c = 0; c < ZIO_COMPRESS_FUNCTIONS; c++) {
+		if (zio_compress_table[c].ci_compress == NULL)
+			continue;
+
+		if (rw == KSTAT_WRITE) {
+			zio_compress_attempted[c] = 0;
+			zio_compress_aborted[c] = 0;
+		}
+		(kn++)->value.ui64 = zio_compress_attempted[c];
+		(kn++)->value.ui64 = zio_compress_aborted[c];
+	}
+
+	return (0);
+}
+
+void
+zio_compress_init(void)
+{
+	kstat_named_t *kn;
+	int c;
+
+	zio_compress_ks_ndata = 0;
+	for (c = 0; c < ZIO_COMPRESS_FUNCTIONS; c++) {
+		if (zio_compress_table[c].ci_compress != NULL)
+			zio_compress_ks_ndata += 2;
+	}
+
+	zio_compress_ks_data = kmem_zalloc(zio_compress_ks_ndata *
+	    sizeof (kstat_named_t), KM_SLEEP);
+
+	kn = zio_compress_ks_data;
+	for (c = 0; c < ZIO_COMPRESS_FUNCTIONS; c++) {
+		if (zio_compress_table[c].ci_compress == NULL)
+			continue;
+
+		(void) snprintf(kn->name, KSTAT_STRLEN, "%s_attempted",
+		    zio_compress_table[c].ci_name);
+		(kn++)->data_type = KSTAT_DATA_UINT64;
+		(void) snprintf(kn->name, KSTAT_STRLEN, "%s_aborted",
+		    zio_compress_table[c].ci_name);
+		(kn++)->data_type = KSTAT_DATA_UINT64;
+	}
+
+	zio_compress_ksp = kstat_create("zfs", 0, "compress_stats", "misc",
+	    KSTAT_TYPE_NAMED, zio_compress_ks_ndata, KSTAT_FLAG_VIRTUAL);
+
+	if (zio_compress_ksp != NULL) {
+		zio_compress_ksp->ks_data = zio_compress_ks_data;
+		zio_compress_ksp->ks_update = zio_compress_kstat_update;
+		kstat_install(zio_compress_ksp);
+	}
+}
+
+void
+zio_compress_fini(void)
+{
+	if (zio_compress_ksp != NULL) {
+		kstat_delete(zio_compress_ksp);
+		zio_compress_ksp = NULL;
+	}
+
+	kmem_free(zio_compress_ks_data, zio_compress_ks_ndata *
+	    sizeof (kstat_named_t));
+	zio_compress_ks_data = NULL;
+}
+
+#if defined(_KERNEL) && defined(HAVE_SPL)
+module_param(zio_compress_early_abort, int, 0644);
+MODULE_PARM_DESC(zio_compress_early_abort,
+	"Skip gzip on blocks an entropy sample and LZ4 trial can't compress");
+#endif
@@ -296,6 +296,7 @@ zpios_setup_run(run_args_t **run_args, zpios_cmd_t *kcmd, struct file *file)
 	ra->region_noise	= kcmd->cmd_region_noise;
 	ra->chunk_noise		= kcmd->cmd_chunk_noise;
 	ra->thread_delay	= kcmd->cmd_thread_delay;
+	ra->queue_depth		= kcmd->cmd_queue_depth;
 	ra->flags		= kcmd->cmd_flags;
 	ra->stats.wr_data	= 0;
 	ra->stats.wr_chunks	= 0;
@@ -447,6 +448,7 @@ zpios_cleanup_run(run_args_t *run_args)
 	if (run_args->threads != NULL) {
 		for (i = 0; i < run_args->thread_count; i++) {
 			if (run_args->threads[i]) {
+				cv_destroy(&run_args->threads[i]->rd_cv);
 				mutex_destroy(&run_args->threads[i]->lock);
 				kmem_free(run_args->threads[i],
 				    sizeof (thread_data_t));
@@ -521,6 +523,156 @@ zpios_dmu_read(run_args_t *run_args, objset_t *os, uint64_t object,
 	return (dmu_read(os, object, offset, size, buf, flags));
 }
 
+/* one read kept in flight by zpios_thread_read_async() */
+typedef struct zpios_async_read {
+	thread_data_t *thr;
+	zpios_region_t *region;
+	dmu_read_range_t range;
+	zpios_time_t t;
+	char *buf;
+	int busy;
+} zpios_async_read_t;
+
+static void
+zpios_dmu_read_done(void *arg, int rc)
+{
+	zpios_async_read_t *ar = (zpios_async_read_t *)arg;
+	thread_data_t *thr = ar->thr;
+	run_args_t *run_args = thr->run_args;
+	zpios_region_t *region = ar->region;
+	__u64 offset = ar->range.dmr_offset;
+	__u32 chunk_size = ar->range.dmr_size;
+	int i;
+
+	ar->t.stop  = zpios_timespec_now();
+	ar->t.delta = zpios_timespec_sub(ar->t.stop, ar->t.start);
+
+	if (rc) {
+		zpios_print(run_args->file, "IO error while doing "
+			    "dmu_read_async(): %d\n", rc);
+	} else {
+		/* Trivial data verification, expensive! */
+		if (run_args->flags & DMU_VERIFY) {
+			for (i = 0; i < chunk_size; i++) {
+				if (ar->buf[i] != 'z') {
+					zpios_print(run_args->file,
+					    "IO verify error: %d/%d/%d\n",
+					    (int)ar->range.dmr_object,
+					    (int)offset, (int)chunk_size);
+					break;
+				}
+			}
+		}
+
+		mutex_enter(&region->lock);
+		region->stats.rd_data += chunk_size;
+		region->stats.rd_chunks++;
+		region->stats.rd_time.delta = zpios_timespec_add(
+		    region->stats.rd_time.delta, ar->t.delta);
+
+		/* First time region was accessed */
+		if (region->init_offset == offset)
+			region->stats.rd_time.start = ar->t.start;
+
+		mutex_exit(&region->lock);
+	}
+
+	mutex_enter(&thr->lock);
+	if (rc == 0) {
+		thr->stats.rd_data += chunk_size;
+		thr->stats.rd_chunks++;
+		thr->stats.rd_time.delta = zpios_timespec_add(
+		    thr->stats.rd_time.delta, ar->t.delta);
+	} else if (thr->rc == 0) {
+		thr->rc = rc;
+	}
+	ar->busy = 0;
+	thr->rd_inflight--;
+	cv_signal(&thr->rd_cv);
+	mutex_exit(&thr->lock);
+}
+
+/*
+ * Read phase for a queue depth larger than one.  Rather than waiting on
+ * each dmu_read() in turn keep up to queue_depth dmu_read_async() calls
+ * outstanding, each with its own buffer, and account for every read in
+ * its completion callback.  Returns the first read error, if any.
+ */
+static int
+zpios_thread_read_async(thread_data_t *thr, __u32 chunk_size)
+{
+	run_args_t *run_args = thr->run_args;
+	zpios_async_read_t *ars, *ar;
+	zpios_region_t *region;
+	dmu_obj_t obj;
+	__u64 offset;
+	unsigned int random_int;
+	int depth = run_args->queue_depth;
+	int thread_delay = run_args->thread_delay;
+	int thread_delay_tmp = 0;
+	int flags = 0;
+	int i, rc = 0;
+
+	if (run_args->flags & DMU_READ_NOPF)
+		flags |= DMU_READ_NO_PREFETCH;
+
+	ars = kmem_zalloc(depth * sizeof (zpios_async_read_t), KM_SLEEP);
+	for (i = 0; i < depth; i++) {
+		ars[i].thr = thr;
+		ars[i].buf = (char *)vmem_alloc(chunk_size, KM_SLEEP);
+	}
+
+	while (zpios_get_work_item(run_args, &obj, &offset,
+	    &chunk_size, &region, DMU_READ)) {
+		if (thread_delay) {
+			get_random_bytes(&random_int, sizeof (unsigned int));
+			thread_delay_tmp = random_int % thread_delay;
+			set_current_state(TASK_UNINTERRUPTIBLE);
+			schedule_timeout(thread_delay_tmp); /* In jiffies */
+		}
+
+		/* Wait for a free slot, stop issuing after an error */
+		mutex_enter(&thr->lock);
+		while (thr->rd_inflight == depth)
+			cv_wait(&thr->rd_cv, &thr->lock);
+		rc = thr->rc;
+		for (ar = ars; ar->busy; ar++)
+			;
+		if (rc == 0) {
+			ar->busy = 1;
+			thr->rd_inflight++;
+		}
+		mutex_exit(&thr->lock);
+
+		if (rc)
+			break;
+
+		if (run_args->flags & DMU_VERIFY)
+			memset(ar->buf, 0, chunk_size);
+
+		ar->region = region;
+		ar->range.dmr_object = obj.obj;
+		ar->range.dmr_offset = offset;
+		ar->range.dmr_size = chunk_size;
+		ar->range.dmr_buf = ar->buf;
+		ar->t.start = zpios_timespec_now();
+		dmu_read_async(obj.os, &ar->range, 1, flags,
+		    zpios_dmu_read_done, ar);
+	}
+
+	mutex_enter(&thr->lock);
+	while (thr->rd_inflight > 0)
+		cv_wait(&thr->rd_cv, &thr->lock);
+	rc = thr->rc;
+	mutex_exit(&thr->lock);
+
+	for (i = 0; i < depth; i++)
+		vmem_free(ars[i].buf, chunk_size);
+	kmem_free(ars, depth * sizeof (zpios_async_read_t));
+
+	return (rc);
+}
+
 static int
 zpios_thread_main(void *data)
 {
@@ -630,6 +782,11 @@ zpios_thread_main(void *data)
 	thr->stats.rd_time.start = zpios_timespec_now();
 	mutex_exit(&thr->lock);
 
+	if (run_args->queue_depth > 1) {
+		rc = zpios_thread_read_async(thr, chunk_size);
+		goto read_done;
+	}
+
 	while (zpios_get_work_item(run_args, &obj, &offset,
 	    &chunk_size, &region, DMU_READ)) {
 		if (thread_delay) {
@@ -687,6 +844,7 @@ zpios_thread_main(void *data)
 		mutex_exit(&region->lock);
 	}
 
+read_done:
 	mutex_enter(&run_args->lock_ctl);
 	run_args->threads_done++;
 	mutex_exit(&run_args->lock_ctl);
@@ -748,6 +906,7 @@ zpios_threads_run(run_args_t *run_args)
 		thr->run_args = run_args;
 		thr->rc = 0;
 		mutex_init(&thr->lock, NULL, MUTEX_DEFAULT, NULL);
+		cv_init(&thr->rd_cv, NULL, CV_DEFAULT, NULL);
 		run_args->threads[i] = thr;
 
 		tsk = kthread_create(zpios_thread_main, (void *)thr,